@@ -24,6 +24,7 @@ let package = Package(
         .executable(name: "dtntrigger", targets: ["dtntrigger"]),
         .executable(name: "dtnecho", targets: ["dtnecho"]),
         .executable(name: "dtnping", targets: ["dtnping"]),
+        .executable(name: "dtnbench", targets: ["dtnbench"]),
     ],
     dependencies: [
         .package(url: "https://github.com/edgeengineer/bp7.git", from: "0.0.5"),
@@ -33,6 +34,7 @@ let package = Package(
         .package(url: "https://github.com/hummingbird-project/hummingbird.git", exact: "2.14.1"),
         .package(url: "https://github.com/hummingbird-project/hummingbird-websocket.git", from: "2.5.0"),
         .package(url: "https://github.com/apple/swift-async-algorithms.git", from: "1.0.0"),
+        .package(url: "https://github.com/apple/swift-atomics.git", from: "1.2.0"),
     ],
     targets: [
         // Targets are the basic building blocks of a package, defining a module or a test suite.
@@ -41,7 +43,8 @@ let package = Package(
             name: "CSQLite",
             dependencies: [],
             linkerSettings: [
-                .linkedLibrary("sqlite3")
+                .linkedLibrary("sqlite3"),
+                .linkedLibrary("z")
             ]),
         .target(
             name: "DTN7",
@@ -49,10 +52,12 @@ let package = Package(
                 "CSQLite",
                 .product(name: "BP7", package: "bp7"),
                 .product(name: "NIO", package: "swift-nio"),
+                .product(name: "NIOConcurrencyHelpers", package: "swift-nio"),
                 .product(name: "Logging", package: "swift-log"),
                 .product(name: "Hummingbird", package: "hummingbird"),
                 .product(name: "HummingbirdWebSocket", package: "hummingbird-websocket"),
                 .product(name: "AsyncAlgorithms", package: "swift-async-algorithms"),
+                .product(name: "Atomics", package: "swift-atomics"),
             ]),
         .executableTarget(
             name: "dtnd",
@@ -75,9 +80,20 @@ let package = Package(
         .executableTarget(
             name: "dtnping",
             dependencies: ["DTN7", .product(name: "ArgumentParser", package: "swift-argument-parser")]),
+        .executableTarget(
+            name: "dtnbench",
+            dependencies: [
+                "DTN7",
+                .product(name: "BP7", package: "bp7"),
+                .product(name: "NIOCore", package: "swift-nio"),
+                .product(name: "ArgumentParser", package: "swift-argument-parser"),
+            ]),
         .testTarget(
             name: "UnitTests",
-            dependencies: ["DTN7"],
+            dependencies: [
+                "DTN7",
+                .product(name: "AsyncAlgorithms", package: "swift-async-algorithms"),
+            ],
             path: "Tests/UnitTests"
         ),
         .testTarget(
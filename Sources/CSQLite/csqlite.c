@@ -1,11 +1,106 @@
 #include "include/csqlite.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+
+// Statements prepared once per connection and reused for every call
+typedef enum {
+    STMT_BEGIN = 0,
+    STMT_COMMIT,
+    STMT_ROLLBACK,
+    STMT_INSERT_BUNDLE,
+    STMT_INSERT_METADATA,
+    STMT_GET_BUNDLE,
+    STMT_GET_METADATA,
+    STMT_UPDATE_METADATA,
+    STMT_REMOVE_BUNDLE,
+    STMT_HAS_BUNDLE,
+    STMT_COUNT_BUNDLES,
+    STMT_ALL_IDS,
+    STMT_ALL_METADATA,
+    STMT_PAGE_IDS,
+    STMT_PAGE_METADATA,
+    STMT_PAGE_FORWARD_PENDING,
+    STMT_EXPIRED_IDS,
+    STMT_REMOVE_EXPIRED,
+    STMT_BUNDLE_ROWID,
+    STMT_EID_ID,
+    STMT_INSERT_EID,
+    STMT_METADATA_SIZES,
+    STMT_ALL_EIDS,
+    STMT_FIND_PAYLOAD,
+    STMT_RETAIN_PAYLOAD,
+    STMT_INSERT_PAYLOAD,
+    STMT_PAYLOAD_DATA,
+    STMT_PAYLOAD_STATS,
+    STMT_COUNT
+} CSQLiteStatement;
+
+// Bundles are keyed by an integer `key`; the textual id is a unique column of
+// the narrow metadata table, and EIDs are ids into the `eids` dictionary
+#define METADATA_COLUMNS "m.id, s.eid, d.eid, m.creation_time, m.size, m.constraints, m.expires_at, m.key"
+#define METADATA_EIDS_JOIN "JOIN eids s ON s.id = m.source JOIN eids d ON d.id = m.destination"
+
+static const char* STATEMENT_SQL[STMT_COUNT] = {
+    [STMT_BEGIN] = "BEGIN TRANSACTION;",
+    [STMT_COMMIT] = "COMMIT;",
+    [STMT_ROLLBACK] = "ROLLBACK;",
+    [STMT_INSERT_BUNDLE] = "INSERT INTO bundles (key, data, payload, payload_offset) VALUES (?, ?, ?, ?);",
+    [STMT_INSERT_METADATA] = "INSERT INTO bundle_metadata (id, source, destination, creation_time, size, constraints, expires_at) VALUES (?, ?, ?, ?, ?, ?, ?);",
+    [STMT_GET_BUNDLE] = "SELECT b.data, b.payload_offset, p.codec, p.size, p.data, b.payload FROM bundles b LEFT JOIN payloads p ON p.id = b.payload "
+                        "WHERE b.key = (SELECT key FROM bundle_metadata WHERE id = ?);",
+    [STMT_GET_METADATA] = "SELECT " METADATA_COLUMNS " FROM bundle_metadata m " METADATA_EIDS_JOIN " WHERE m.id = ?;",
+    [STMT_UPDATE_METADATA] = "UPDATE bundle_metadata SET source = ?, destination = ?, creation_time = ?, size = ?, constraints = ?, expires_at = ? WHERE id = ?;",
+    [STMT_REMOVE_BUNDLE] = "DELETE FROM bundle_metadata WHERE id = ?;",
+    [STMT_HAS_BUNDLE] = "SELECT 1 FROM bundle_metadata WHERE id = ? LIMIT 1;",
+    [STMT_COUNT_BUNDLES] = "SELECT COUNT(*) FROM bundle_metadata;",
+    [STMT_ALL_IDS] = "SELECT id FROM bundle_metadata;",
+    [STMT_ALL_METADATA] = "SELECT id, source, destination, creation_time, size, constraints, expires_at FROM bundle_metadata ORDER BY key;",
+    [STMT_PAGE_IDS] = "SELECT id, key FROM bundle_metadata WHERE key > ? ORDER BY key LIMIT ?;",
+    [STMT_PAGE_METADATA] = "SELECT " METADATA_COLUMNS " FROM bundle_metadata m " METADATA_EIDS_JOIN " WHERE m.key > ? ORDER BY m.key LIMIT ?;",
+    [STMT_PAGE_FORWARD_PENDING] = "SELECT " METADATA_COLUMNS " FROM bundle_metadata m " METADATA_EIDS_JOIN " WHERE (m.constraints & 2) != 0 AND m.key > ? ORDER BY m.key LIMIT ?;",
+    [STMT_EXPIRED_IDS] = "SELECT id FROM bundle_metadata WHERE expires_at > 0 AND expires_at <= ?;",
+    [STMT_REMOVE_EXPIRED] = "DELETE FROM bundle_metadata WHERE expires_at > 0 AND expires_at <= ?;",
+    [STMT_BUNDLE_ROWID] = "SELECT b.key, b.payload, b.payload_offset, p.codec, p.size FROM bundles b LEFT JOIN payloads p ON p.id = b.payload "
+                          "WHERE b.key = (SELECT key FROM bundle_metadata WHERE id = ?);",
+    [STMT_EID_ID] = "SELECT id FROM eids WHERE eid = ?;",
+    [STMT_INSERT_EID] = "INSERT INTO eids (eid) VALUES (?);",
+    [STMT_METADATA_SIZES] = "SELECT (SELECT COUNT(*) FROM bundle_metadata), (SELECT COALESCE(SUM(length(CAST(id AS BLOB))), 0) FROM bundle_metadata), "
+                            "(SELECT COUNT(*) FROM eids), (SELECT COALESCE(SUM(length(CAST(eid AS BLOB))), 0) FROM eids);",
+    [STMT_ALL_EIDS] = "SELECT id, eid FROM eids ORDER BY id;",
+    [STMT_FIND_PAYLOAD] = "SELECT id, codec, size, data FROM payloads WHERE hash = ?;",
+    [STMT_RETAIN_PAYLOAD] = "UPDATE payloads SET refs = refs + 1 WHERE id = ?;",
+    [STMT_INSERT_PAYLOAD] = "INSERT INTO payloads (hash, refs, codec, size, data) VALUES (?, 1, ?, ?, ?);",
+    [STMT_PAYLOAD_DATA] = "SELECT data FROM payloads WHERE id = ?;",
+    [STMT_PAYLOAD_STATS] = "SELECT COUNT(*), COALESCE(SUM(refs), 0), COALESCE(SUM(length(data)), 0), COALESCE(SUM(size * refs), 0) FROM payloads;",
+};
+
+// How a payloads row stores its bytes
+#define PAYLOAD_CODEC_PLAIN 0
+#define PAYLOAD_CODEC_DEFLATE 1
+
+// Direct-mapped cache of interned EIDs; a node sees few distinct endpoints
+#define EID_CACHE_SLOTS 64
+
+typedef struct {
+    char* eid;
+    sqlite3_int64 id;
+} CSQLiteEidSlot;
 
 struct CSQLiteDB {
     sqlite3* db;
+    sqlite3_stmt* statements[STMT_COUNT];
+    int upgraded_from;
+    CSQLiteEidSlot eid_cache[EID_CACHE_SLOTS];
+    
+    // Payload storage, from CSQLiteOptions
+    size_t dedup_min_size;
+    size_t compress_min_size;
+    int compress_level;
 };
 
+// The schema at user_version 0; MIGRATIONS bring it up to date
 static const char* CREATE_TABLES_SQL = 
     "CREATE TABLE IF NOT EXISTS bundles ("
     "  id TEXT PRIMARY KEY,"
@@ -21,8 +116,283 @@ static const char* CREATE_TABLES_SQL =
     "  FOREIGN KEY(id) REFERENCES bundles(id) ON DELETE CASCADE"
     ");";
 
+// Schema changes applied on top of CREATE_TABLES_SQL. MIGRATIONS[i] upgrades a
+// database from user_version i to i + 1; append new steps, never edit old ones.
+static const char* MIGRATIONS[] = {
+    // 1: absolute expiry time in DTN milliseconds (0 = never), indexed for range deletes
+    "ALTER TABLE bundle_metadata ADD COLUMN expires_at INTEGER NOT NULL DEFAULT 0;"
+    "CREATE INDEX IF NOT EXISTS idx_bundle_metadata_expires_at ON bundle_metadata(expires_at) WHERE expires_at > 0;",
+    // 2: forwarding queue, the rows with CSQLITE_CONSTRAINT_FORWARD_PENDING set
+    "CREATE INDEX IF NOT EXISTS idx_bundle_metadata_forward_pending ON bundle_metadata(id) WHERE (constraints & 2) != 0;",
+    // 3: integer keys with the textual id as a unique column of the metadata,
+    // EIDs interned in a dictionary table; existing rows keep their rowid as key
+    "CREATE TABLE eids ("
+    "  id INTEGER PRIMARY KEY,"
+    "  eid TEXT NOT NULL UNIQUE"
+    ");"
+    "INSERT INTO eids (eid) SELECT source FROM bundle_metadata UNION SELECT destination FROM bundle_metadata;"
+    "DROP INDEX IF EXISTS idx_bundle_metadata_expires_at;"
+    "DROP INDEX IF EXISTS idx_bundle_metadata_forward_pending;"
+    "ALTER TABLE bundle_metadata RENAME TO bundle_metadata_v2;"
+    "ALTER TABLE bundles RENAME TO bundles_v2;"
+    "CREATE TABLE bundle_metadata ("
+    "  key INTEGER PRIMARY KEY,"
+    "  id TEXT NOT NULL UNIQUE,"
+    "  source INTEGER NOT NULL,"
+    "  destination INTEGER NOT NULL,"
+    "  creation_time INTEGER NOT NULL,"
+    "  size INTEGER NOT NULL,"
+    "  constraints INTEGER NOT NULL,"
+    "  expires_at INTEGER NOT NULL DEFAULT 0"
+    ");"
+    "CREATE TABLE bundles ("
+    "  key INTEGER PRIMARY KEY REFERENCES bundle_metadata(key) ON DELETE CASCADE,"
+    "  data BLOB NOT NULL"
+    ");"
+    "INSERT INTO bundle_metadata (key, id, source, destination, creation_time, size, constraints, expires_at) "
+    "  SELECT b.rowid, m.id, s.id, d.id, m.creation_time, m.size, m.constraints, m.expires_at "
+    "  FROM bundle_metadata_v2 m JOIN bundles_v2 b ON b.id = m.id JOIN eids s ON s.eid = m.source JOIN eids d ON d.eid = m.destination;"
+    "INSERT INTO bundles (key, data) SELECT b.rowid, b.data FROM bundles_v2 b WHERE b.rowid IN (SELECT key FROM bundle_metadata);"
+    "DROP TABLE bundle_metadata_v2;"
+    "DROP TABLE bundles_v2;"
+    "CREATE INDEX idx_bundle_metadata_expires_at ON bundle_metadata(expires_at) WHERE expires_at > 0;"
+    "CREATE INDEX idx_bundle_metadata_forward_pending ON bundle_metadata(key) WHERE (constraints & 2) != 0;",
+    // 4: payloads stored once per content and reference counted. A bundle row
+    // pointing at one keeps its encoding without the payload bytes, which go
+    // back in at `payload_offset`; rows stored before keep their full encoding.
+    "CREATE TABLE payloads ("
+    "  id INTEGER PRIMARY KEY,"
+    "  hash INTEGER NOT NULL,"
+    "  refs INTEGER NOT NULL,"
+    "  codec INTEGER NOT NULL,"
+    "  size INTEGER NOT NULL,"
+    "  data BLOB NOT NULL"
+    ");"
+    "CREATE INDEX idx_payloads_hash ON payloads(hash);"
+    "ALTER TABLE bundles ADD COLUMN payload INTEGER;"
+    "ALTER TABLE bundles ADD COLUMN payload_offset INTEGER NOT NULL DEFAULT 0;"
+    "CREATE TRIGGER bundles_release_payload AFTER DELETE ON bundles WHEN old.payload IS NOT NULL BEGIN"
+    "  UPDATE payloads SET refs = refs - 1 WHERE id = old.payload;"
+    "  DELETE FROM payloads WHERE id = old.payload AND refs <= 0;"
+    "END;",
+};
+
+#define SCHEMA_VERSION ((int)(sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0])))
+
+// Returns the cached statement, preparing it on first use. The statement is
+// ready to be bound; callers must hand it back through release_statement.
+static sqlite3_stmt* get_statement(CSQLiteDB* db, CSQLiteStatement which) {
+    if (!db->statements[which]) {
+        int rc = sqlite3_prepare_v3(db->db, STATEMENT_SQL[which], -1, SQLITE_PREPARE_PERSISTENT, &db->statements[which], NULL);
+        if (rc != SQLITE_OK) {
+            db->statements[which] = NULL;
+            return NULL;
+        }
+    }
+    return db->statements[which];
+}
+
+// Resets a cached statement so it releases its locks and drops its bindings
+static void release_statement(sqlite3_stmt* stmt) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+// Runs a cached statement that takes no parameters and returns no rows
+static int exec_statement(CSQLiteDB* db, CSQLiteStatement which) {
+    sqlite3_stmt* stmt = get_statement(db, which);
+    if (!stmt) {
+        return SQLITE_ERROR;
+    }
+    int rc = sqlite3_step(stmt);
+    release_statement(stmt);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
+
+static void clear_eid_cache(CSQLiteDB* db) {
+    for (int i = 0; i < EID_CACHE_SLOTS; i++) {
+        free(db->eid_cache[i].eid);
+        db->eid_cache[i].eid = NULL;
+    }
+}
+
+// Rolls back the open transaction. EIDs interned inside it are gone again,
+// so the cache forgets them too.
+static void rollback(CSQLiteDB* db) {
+    exec_statement(db, STMT_ROLLBACK);
+    clear_eid_cache(db);
+}
+
+static size_t eid_slot(const char* eid) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)eid; *c; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash % EID_CACHE_SLOTS;
+}
+
+// Looks up the dictionary id of `eid`, adding the EID on first use
+static int intern_eid(CSQLiteDB* db, const char* eid, sqlite3_int64* id) {
+    if (!eid) {
+        return SQLITE_MISUSE;
+    }
+    
+    CSQLiteEidSlot* slot = &db->eid_cache[eid_slot(eid)];
+    if (slot->eid && strcmp(slot->eid, eid) == 0) {
+        *id = slot->id;
+        return SQLITE_OK;
+    }
+    
+    sqlite3_stmt* stmt = get_statement(db, STMT_EID_ID);
+    if (!stmt) {
+        return SQLITE_ERROR;
+    }
+    
+    sqlite3_bind_text(stmt, 1, eid, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        *id = sqlite3_column_int64(stmt, 0);
+    }
+    release_statement(stmt);
+    
+    if (rc == SQLITE_DONE) {
+        stmt = get_statement(db, STMT_INSERT_EID);
+        if (!stmt) {
+            return SQLITE_ERROR;
+        }
+        
+        sqlite3_bind_text(stmt, 1, eid, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        release_statement(stmt);
+        if (rc != SQLITE_DONE) {
+            return rc;
+        }
+        *id = sqlite3_last_insert_rowid(db->db);
+    } else if (rc != SQLITE_ROW) {
+        return rc;
+    }
+    
+    // Caching is best effort
+    char* copy = csqlite_strdup(eid);
+    if (copy) {
+        free(slot->eid);
+        slot->eid = copy;
+        slot->id = *id;
+    }
+    return SQLITE_OK;
+}
+
+static int exec_pragma(sqlite3* db, const char* name, long long value) {
+    char sql[96];
+    snprintf(sql, sizeof(sql), "PRAGMA %s = %lld;", name, value);
+    return sqlite3_exec(db, sql, NULL, NULL, NULL);
+}
+
+// Brings the schema up to SCHEMA_VERSION, storing the version found in `from`
+static int migrate(sqlite3* db, int* from) {
+    sqlite3_stmt* stmt;
+    int rc = sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    
+    int version = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    *from = version;
+    
+    for (; version < SCHEMA_VERSION; version++) {
+        rc = sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+        if (rc != SQLITE_OK) return rc;
+        
+        rc = sqlite3_exec(db, MIGRATIONS[version], NULL, NULL, NULL);
+        if (rc == SQLITE_OK) {
+            rc = exec_pragma(db, "user_version", version + 1);
+        }
+        
+        if (rc != SQLITE_OK) {
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+            return rc;
+        }
+        
+        rc = sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+        if (rc != SQLITE_OK) return rc;
+    }
+    
+    return SQLITE_OK;
+}
+
+// The journal modes SQLite knows; the pragma cannot take a bound parameter, so
+// only these are ever spliced into it
+static int is_journal_mode(const char* mode) {
+    static const char* modes[] = { "DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF" };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        if (sqlite3_stricmp(mode, modes[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int apply_options(sqlite3* db, const CSQLiteOptions* options) {
+    int rc = SQLITE_OK;
+    
+    // Refuse a bad profile before any of it is applied
+    if (options->journal_mode && !is_journal_mode(options->journal_mode)) {
+        return SQLITE_MISUSE;
+    }
+    
+    // Page size only takes effect before the first table is created and
+    // cannot change once the database is in WAL mode, so it goes first
+    if (options->page_size > 0) {
+        rc = exec_pragma(db, "page_size", options->page_size);
+        if (rc != SQLITE_OK) return rc;
+    }
+    
+    if (options->journal_mode) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA journal_mode = %s;", options->journal_mode);
+        rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+        if (rc != SQLITE_OK) return rc;
+    }
+    
+    if (options->synchronous >= 0) {
+        rc = exec_pragma(db, "synchronous", options->synchronous);
+        if (rc != SQLITE_OK) return rc;
+    }
+    
+    if (options->mmap_size >= 0) {
+        rc = exec_pragma(db, "mmap_size", options->mmap_size);
+        if (rc != SQLITE_OK) return rc;
+    }
+    
+    if (options->cache_size != 0) {
+        rc = exec_pragma(db, "cache_size", options->cache_size);
+        if (rc != SQLITE_OK) return rc;
+    }
+    
+    return rc;
+}
+
+void csqlite_default_options(CSQLiteOptions* options) {
+    if (!options) return;
+    options->journal_mode = NULL;
+    options->synchronous = -1;
+    options->mmap_size = -1;
+    options->cache_size = 0;
+    options->page_size = 0;
+    options->dedup_min_size = 1024;
+    options->compress_min_size = 0;
+    options->compress_level = Z_DEFAULT_COMPRESSION;
+}
+
 CSQLiteDB* csqlite_open(const char* path, CSQLiteResult* result) {
-    CSQLiteDB* db = malloc(sizeof(CSQLiteDB));
+    return csqlite_open_with_options(path, NULL, result);
+}
+
+CSQLiteDB* csqlite_open_with_options(const char* path, const CSQLiteOptions* options, CSQLiteResult* result) {
+    CSQLiteDB* db = calloc(1, sizeof(CSQLiteDB));
     if (!db) {
         if (result) *result = CSQLITE_ERROR;
         return NULL;
@@ -30,17 +400,39 @@ CSQLiteDB* csqlite_open(const char* path, CSQLiteResult* result) {
     
     int rc = sqlite3_open(path, &db->db);
     if (rc != SQLITE_OK) {
+        sqlite3_close(db->db);
         free(db);
         if (result) *result = CSQLITE_ERROR;
         return NULL;
     }
     
+    // Apply the connection profile
+    if (options) {
+        rc = apply_options(db->db, options);
+        if (rc != SQLITE_OK) {
+            sqlite3_close(db->db);
+            free(db);
+            if (result) *result = CSQLITE_ERROR;
+            return NULL;
+        }
+    }
+    
+    CSQLiteOptions defaults;
+    csqlite_default_options(&defaults);
+    const CSQLiteOptions* payload_options = options ? options : &defaults;
+    db->dedup_min_size = payload_options->dedup_min_size > 0 ? (size_t)payload_options->dedup_min_size : 0;
+    db->compress_min_size = payload_options->compress_min_size > 0 ? (size_t)payload_options->compress_min_size : 0;
+    db->compress_level = payload_options->compress_level;
+    
     // Enable foreign keys
     sqlite3_exec(db->db, "PRAGMA foreign_keys = ON;", NULL, NULL, NULL);
     
     // Create tables
     char* err_msg = NULL;
     rc = sqlite3_exec(db->db, CREATE_TABLES_SQL, NULL, NULL, &err_msg);
+    if (rc == SQLITE_OK) {
+        rc = migrate(db->db, &db->upgraded_from);
+    }
     if (rc != SQLITE_OK) {
         sqlite3_free(err_msg);
         sqlite3_close(db->db);
@@ -53,105 +445,653 @@ CSQLiteDB* csqlite_open(const char* path, CSQLiteResult* result) {
     return db;
 }
 
+int csqlite_schema_upgraded_from(CSQLiteDB* db) {
+    return db ? db->upgraded_from : 0;
+}
+
 void csqlite_close(CSQLiteDB* db) {
     if (db) {
+        for (int i = 0; i < STMT_COUNT; i++) {
+            sqlite3_finalize(db->statements[i]);
+        }
+        clear_eid_cache(db);
         sqlite3_close(db->db);
         free(db);
     }
 }
 
-CSQLiteResult csqlite_store_bundle(CSQLiteDB* db, const char* bundle_id, const uint8_t* bundle_data, size_t bundle_size, const CSQLiteBundleMetadata* metadata) {
-    if (!db || !bundle_id || !bundle_data || !metadata) {
+// Minimal CBOR walking, enough to find the payload block of a bundle encoding
+
+// Reads the head of the item at `*pos`. `*arg` is the length or value, or
+// UINT64_MAX for an indefinite length.
+static bool cbor_head(const uint8_t* data, size_t size, size_t* pos, int* major, uint64_t* arg) {
+    if (*pos >= size) {
+        return false;
+    }
+    
+    uint8_t initial = data[(*pos)++];
+    *major = initial >> 5;
+    uint8_t info = initial & 0x1f;
+    
+    if (info < 24) {
+        *arg = info;
+        return true;
+    }
+    if (info == 31) {
+        *arg = UINT64_MAX;
+        return *major >= 2 && *major <= 5;
+    }
+    if (info > 27) {
+        return false;
+    }
+    
+    size_t bytes = (size_t)1 << (info - 24);
+    if (bytes > size - *pos) {
+        return false;
+    }
+    *arg = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        *arg = (*arg << 8) | data[(*pos)++];
+    }
+    return true;
+}
+
+static bool cbor_skip(const uint8_t* data, size_t size, size_t* pos, int depth) {
+    int major;
+    uint64_t arg;
+    if (depth > 32 || !cbor_head(data, size, pos, &major, &arg)) {
+        return false;
+    }
+    
+    if (arg == UINT64_MAX) {
+        // Indefinite length: items (or chunks) up to the break byte
+        while (*pos < size && data[*pos] != 0xff) {
+            if (!cbor_skip(data, size, pos, depth + 1)) {
+                return false;
+            }
+        }
+        if (*pos >= size) {
+            return false;
+        }
+        (*pos)++;
+        return true;
+    }
+    
+    switch (major) {
+    case 2:
+    case 3:
+        if (arg > size - *pos) {
+            return false;
+        }
+        *pos += (size_t)arg;
+        return true;
+    case 4:
+    case 5:
+        for (uint64_t i = 0; i < (major == 5 ? 2 * arg : arg); i++) {
+            if (!cbor_skip(data, size, pos, depth + 1)) {
+                return false;
+            }
+        }
+        return true;
+    case 6:
+        return cbor_skip(data, size, pos, depth + 1);
+    default:
+        return true;
+    }
+}
+
+// Finds the data of the payload block (block type 1) in a bundle encoding
+static bool find_payload(const uint8_t* data, size_t size, size_t* offset, size_t* length) {
+    size_t pos = 0;
+    int major;
+    uint64_t blocks;
+    if (!cbor_head(data, size, &pos, &major, &blocks) || major != 4 || !cbor_skip(data, size, &pos, 1)) {
+        return false;
+    }
+    
+    // After the primary block: canonical blocks [type, number, flags, crc type, data, crc?]
+    for (uint64_t i = 1; blocks == UINT64_MAX || i < blocks; i++) {
+        if (pos >= size || data[pos] == 0xff) {
+            return false;
+        }
+        
+        uint64_t fields, type;
+        if (!cbor_head(data, size, &pos, &major, &fields) || major != 4 || fields == UINT64_MAX || fields < 5 ||
+            !cbor_head(data, size, &pos, &major, &type) || major != 0) {
+            return false;
+        }
+        
+        if (type == 1) {
+            for (int skip = 0; skip < 3; skip++) {
+                if (!cbor_skip(data, size, &pos, 2)) {
+                    return false;
+                }
+            }
+            uint64_t payload_length;
+            if (!cbor_head(data, size, &pos, &major, &payload_length) || major != 2 ||
+                payload_length == UINT64_MAX || payload_length > size - pos) {
+                return false;
+            }
+            *offset = pos;
+            *length = (size_t)payload_length;
+            return true;
+        }
+        
+        for (uint64_t field = 1; field < fields; field++) {
+            if (!cbor_skip(data, size, &pos, 2)) {
+                return false;
+            }
+        }
+    }
+    return false;
+}
+
+// Inflates zlib data into `out`, which must receive exactly `size` bytes
+static bool inflate_exact(const uint8_t* data, size_t data_size, uint8_t* out, size_t size) {
+    if (data_size > UINT_MAX || size > UINT_MAX) {
+        return false;
+    }
+    
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = (uInt)data_size;
+    stream.next_out = out;
+    stream.avail_out = (uInt)size;
+    
+    int rc = inflate(&stream, Z_FINISH);
+    bool complete = (rc == Z_STREAM_END && stream.total_out == size);
+    inflateEnd(&stream);
+    return complete;
+}
+
+// Content hash of a payload: its CRC-32 and length. Matches are confirmed
+// byte for byte, so collisions only cost a comparison.
+static sqlite3_int64 payload_hash(const uint8_t* payload, size_t length) {
+    uint32_t crc = csqlite_crc32(0, payload, length);
+    return (sqlite3_int64)((((uint64_t)length & 0x7fffffff) << 32) | (uint64_t)crc);
+}
+
+uint32_t csqlite_crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    uLong value = crc;
+    size_t done = 0;
+    while (done < size) {
+        uInt chunk = (size - done > UINT_MAX) ? UINT_MAX : (uInt)(size - done);
+        value = crc32(value, data + done, chunk);
+        done += chunk;
+    }
+    return (uint32_t)(value & 0xffffffff);
+}
+
+// Whether a payloads row holds exactly `payload`
+static bool payload_matches(sqlite3_stmt* stmt, const uint8_t* payload, size_t length) {
+    int codec = sqlite3_column_int(stmt, 1);
+    if ((size_t)sqlite3_column_int64(stmt, 2) != length) {
+        return false;
+    }
+    
+    const uint8_t* stored = sqlite3_column_blob(stmt, 3);
+    size_t stored_size = (size_t)sqlite3_column_bytes(stmt, 3);
+    if (codec == PAYLOAD_CODEC_PLAIN) {
+        return stored_size == length && (length == 0 || memcmp(stored, payload, length) == 0);
+    }
+    
+    uint8_t* inflated = malloc(length ? length : 1);
+    bool match = inflated && inflate_exact(stored, stored_size, inflated, length) && memcmp(inflated, payload, length) == 0;
+    free(inflated);
+    return match;
+}
+
+// Takes a reference on the payloads row holding `payload`, adding the row if
+// there is none; large payloads are deflated when that makes them smaller
+static CSQLiteResult retain_payload(CSQLiteDB* db, const uint8_t* payload, size_t length, sqlite3_int64* payload_id) {
+    sqlite3_int64 hash = payload_hash(payload, length);
+    
+    sqlite3_stmt* stmt = get_statement(db, STMT_FIND_PAYLOAD);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
-    sqlite3_stmt* stmt = NULL;
+    sqlite3_bind_int64(stmt, 1, hash);
+    sqlite3_int64 found = 0;
     int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (payload_matches(stmt, payload, length)) {
+            found = sqlite3_column_int64(stmt, 0);
+            break;
+        }
+    }
+    release_statement(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        return CSQLITE_ERROR;
+    }
+    
+    if (found) {
+        stmt = get_statement(db, STMT_RETAIN_PAYLOAD);
+        if (!stmt) {
+            return CSQLITE_ERROR;
+        }
+        sqlite3_bind_int64(stmt, 1, found);
+        rc = sqlite3_step(stmt);
+        release_statement(stmt);
+        *payload_id = found;
+        return (rc == SQLITE_DONE) ? CSQLITE_OK : CSQLITE_ERROR;
+    }
+    
+    int codec = PAYLOAD_CODEC_PLAIN;
+    const uint8_t* stored = payload;
+    size_t stored_size = length;
+    uint8_t* compressed = NULL;
+    size_t compressed_size = 0;
+    if (db->compress_min_size > 0 && length >= db->compress_min_size &&
+        csqlite_deflate(payload, length, db->compress_level, &compressed, &compressed_size) == CSQLITE_OK &&
+        compressed_size < length) {
+        codec = PAYLOAD_CODEC_DEFLATE;
+        stored = compressed;
+        stored_size = compressed_size;
+    }
+    
+    stmt = get_statement(db, STMT_INSERT_PAYLOAD);
+    if (!stmt) {
+        free(compressed);
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, hash);
+    sqlite3_bind_int(stmt, 2, codec);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)length);
+    sqlite3_bind_blob(stmt, 4, stored, (int)stored_size, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    release_statement(stmt);
+    free(compressed);
+    
+    if (rc != SQLITE_DONE) {
+        return CSQLITE_ERROR;
+    }
+    *payload_id = sqlite3_last_insert_rowid(db->db);
+    return CSQLITE_OK;
+}
+
+// Inserts one bundle and its metadata inside the caller's transaction.
+// A duplicate id only fails the statement, leaving the transaction usable.
+static CSQLiteResult insert_bundle(CSQLiteDB* db, const char* bundle_id, const uint8_t* bundle_data, size_t bundle_size, const CSQLiteBundleMetadata* metadata) {
+    sqlite3_int64 source, destination;
+    if (intern_eid(db, metadata->source, &source) != SQLITE_OK ||
+        intern_eid(db, metadata->destination, &destination) != SQLITE_OK) {
+        return CSQLITE_ERROR;
+    }
+    
+    // Insert metadata, which assigns the bundle's key
+    sqlite3_stmt* stmt = get_statement(db, STMT_INSERT_METADATA);
+    if (!stmt) {
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, source);
+    sqlite3_bind_int64(stmt, 3, destination);
+    sqlite3_bind_int64(stmt, 4, metadata->creation_time);
+    sqlite3_bind_int64(stmt, 5, metadata->size);
+    sqlite3_bind_int(stmt, 6, metadata->constraints);
+    sqlite3_bind_int64(stmt, 7, metadata->expires_at);
+    
+    int rc = sqlite3_step(stmt);
+    release_statement(stmt);
+    
+    if (rc != SQLITE_DONE) {
+        return (rc == SQLITE_CONSTRAINT) ? CSQLITE_CONSTRAINT : CSQLITE_ERROR;
+    }
+    
+    sqlite3_int64 key = sqlite3_last_insert_rowid(db->db);
+    
+    // A large enough payload is stored once and cut out of the encoding
+    size_t payload_offset = 0, payload_length = 0;
+    sqlite3_int64 payload_id = 0;
+    uint8_t* rest = NULL;
+    const uint8_t* stored = bundle_data;
+    size_t stored_size = bundle_size;
+    
+    if (db->dedup_min_size > 0 && bundle_size >= db->dedup_min_size &&
+        find_payload(bundle_data, bundle_size, &payload_offset, &payload_length) &&
+        payload_length >= db->dedup_min_size) {
+        if (retain_payload(db, bundle_data + payload_offset, payload_length, &payload_id) != CSQLITE_OK) {
+            return CSQLITE_ERROR;
+        }
+        
+        rest = malloc(bundle_size - payload_length);
+        if (!rest) {
+            return CSQLITE_ERROR;
+        }
+        memcpy(rest, bundle_data, payload_offset);
+        memcpy(rest + payload_offset, bundle_data + payload_offset + payload_length, bundle_size - payload_offset - payload_length);
+        stored = rest;
+        stored_size = bundle_size - payload_length;
+    }
+    
+    // Insert bundle data
+    stmt = get_statement(db, STMT_INSERT_BUNDLE);
+    if (!stmt) {
+        free(rest);
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, key);
+    sqlite3_bind_blob(stmt, 2, stored, (int)stored_size, SQLITE_STATIC);
+    if (payload_id) {
+        sqlite3_bind_int64(stmt, 3, payload_id);
+    } else {
+        sqlite3_bind_null(stmt, 3);
+    }
+    sqlite3_bind_int64(stmt, 4, (sqlite3_int64)payload_offset);
+    
+    rc = sqlite3_step(stmt);
+    release_statement(stmt);
+    free(rest);
+    
+    return (rc == SQLITE_DONE) ? CSQLITE_OK : CSQLITE_ERROR;
+}
+
+CSQLiteResult csqlite_store_bundle(CSQLiteDB* db, const char* bundle_id, const uint8_t* bundle_data, size_t bundle_size, const CSQLiteBundleMetadata* metadata) {
+    if (!db || !bundle_id || !bundle_data || !metadata) {
+        return CSQLITE_ERROR;
+    }
     
     // Begin transaction
-    rc = sqlite3_exec(db->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    int rc = exec_statement(db, STMT_BEGIN);
+    if (rc != SQLITE_OK) {
+        return CSQLITE_ERROR;
+    }
+    
+    CSQLiteResult result = insert_bundle(db, bundle_id, bundle_data, bundle_size, metadata);
+    if (result != CSQLITE_OK) {
+        rollback(db);
+        return result;
+    }
+    
+    // Commit transaction
+    rc = exec_statement(db, STMT_COMMIT);
+    return (rc == SQLITE_OK) ? CSQLITE_OK : CSQLITE_ERROR;
+}
+
+CSQLiteResult csqlite_store_bundles_batch(CSQLiteDB* db, const CSQLiteBundleRecord* records, size_t count, CSQLiteResult* results) {
+    if (!db || (count > 0 && (!records || !results))) {
+        return CSQLITE_ERROR;
+    }
+    
+    if (count == 0) {
+        return CSQLITE_OK;
+    }
+    
+    int rc = exec_statement(db, STMT_BEGIN);
+    if (rc != SQLITE_OK) {
+        return CSQLITE_ERROR;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        const CSQLiteBundleRecord* record = &records[i];
+        
+        if (!record->bundle_id || !record->bundle_data) {
+            results[i] = CSQLITE_ERROR;
+            continue;
+        }
+        
+        results[i] = insert_bundle(db, record->bundle_id, record->bundle_data, record->bundle_size, &record->metadata);
+        
+        // Anything but a duplicate leaves the batch in an unknown state
+        if (results[i] == CSQLITE_ERROR) {
+            rollback(db);
+            for (size_t j = 0; j < count; j++) {
+                results[j] = CSQLITE_ERROR;
+            }
+            return CSQLITE_ERROR;
+        }
+    }
+    
+    rc = exec_statement(db, STMT_COMMIT);
     if (rc != SQLITE_OK) {
+        rollback(db);
+        for (size_t j = 0; j < count; j++) {
+            results[j] = CSQLITE_ERROR;
+        }
         return CSQLITE_ERROR;
     }
     
-    // Insert bundle data
-    const char* insert_bundle_sql = "INSERT INTO bundles (id, data) VALUES (?, ?);";
-    rc = sqlite3_prepare_v2(db->db, insert_bundle_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        sqlite3_exec(db->db, "ROLLBACK;", NULL, NULL, NULL);
-        return CSQLITE_ERROR;
+    return CSQLITE_OK;
+}
+
+CSQLiteResult csqlite_get_bundle(CSQLiteDB* db, const char* bundle_id, uint8_t** bundle_data, size_t* bundle_size) {
+    if (!db || !bundle_id || !bundle_data || !bundle_size) {
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_stmt* stmt = get_statement(db, STMT_GET_BUNDLE);
+    if (!stmt) {
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    
+    if (rc != SQLITE_ROW) {
+        release_statement(stmt);
+        return (rc == SQLITE_DONE) ? CSQLITE_NOT_FOUND : CSQLITE_ERROR;
+    }
+        
+    const uint8_t* rest = sqlite3_column_blob(stmt, 0);
+    size_t rest_size = (size_t)sqlite3_column_bytes(stmt, 0);
+    bool has_payload = sqlite3_column_type(stmt, 2) != SQLITE_NULL;
+    size_t offset = has_payload ? (size_t)sqlite3_column_int64(stmt, 1) : rest_size;
+    size_t payload_size = has_payload ? (size_t)sqlite3_column_int64(stmt, 3) : 0;
+    
+    // A payload reference without its row cannot be put back together
+    bool dangling = !has_payload && sqlite3_column_type(stmt, 5) != SQLITE_NULL;
+    
+    uint8_t* data = (offset <= rest_size && !dangling) ? malloc(rest_size + payload_size + 1) : NULL;
+    bool complete = data != NULL;
+    if (data) {
+        // The encoding around the payload, with the payload put back in between
+        memcpy(data, rest, offset);
+        memcpy(data + offset + payload_size, rest + offset, rest_size - offset);
+        
+        if (has_payload) {
+            const uint8_t* payload = sqlite3_column_blob(stmt, 4);
+            size_t stored_size = (size_t)sqlite3_column_bytes(stmt, 4);
+            if (sqlite3_column_int(stmt, 2) == PAYLOAD_CODEC_DEFLATE) {
+                complete = inflate_exact(payload, stored_size, data + offset, payload_size);
+            } else if (stored_size == payload_size) {
+                memcpy(data + offset, payload, payload_size);
+            } else {
+                complete = false;
+            }
+        }
+    }
+    release_statement(stmt);
+    
+    if (!complete) {
+        free(data);
+        return CSQLITE_ERROR;
+    }
+    
+    *bundle_data = data;
+    *bundle_size = rest_size + payload_size;
+    return CSQLITE_OK;
+}
+
+// Incremental-I/O handle on one bundle's stored encoding. With a deduplicated
+// payload the bytes come from the bundle row up to `payload_offset`, then from
+// the payload (inflated once at open if it is compressed), then the bundle row again.
+struct CSQLiteBlob {
+    sqlite3_blob* blob;
+    sqlite3_blob* payload;
+    uint8_t* inflated;
+    size_t payload_offset;
+    size_t payload_size;
+    size_t size;
+};
+
+// Inflates a compressed payloads row in full
+static uint8_t* load_inflated_payload(CSQLiteDB* db, sqlite3_int64 payload_id, size_t size) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_PAYLOAD_DATA);
+    if (!stmt) {
+        return NULL;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, payload_id);
+    uint8_t* inflated = NULL;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        inflated = malloc(size ? size : 1);
+        if (inflated && !inflate_exact(sqlite3_column_blob(stmt, 0), (size_t)sqlite3_column_bytes(stmt, 0), inflated, size)) {
+            free(inflated);
+            inflated = NULL;
+        }
+    }
+    release_statement(stmt);
+    return inflated;
+}
+
+CSQLiteBlob* csqlite_blob_open(CSQLiteDB* db, const char* bundle_id, size_t* size, CSQLiteResult* result) {
+    if (result) *result = CSQLITE_ERROR;
+    
+    if (!db || !bundle_id || !size) {
+        return NULL;
+    }
+    
+    sqlite3_stmt* stmt = get_statement(db, STMT_BUNDLE_ROWID);
+    if (!stmt) {
+        return NULL;
     }
     
     sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
-    sqlite3_bind_blob(stmt, 2, bundle_data, (int)bundle_size, SQLITE_STATIC);
-    
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    int rc = sqlite3_step(stmt);
+    sqlite3_int64 rowid = 0, payload_id = 0;
+    size_t payload_offset = 0, payload_size = 0;
+    int codec = PAYLOAD_CODEC_PLAIN;
+    bool has_payload = false, dangling = false;
+    if (rc == SQLITE_ROW) {
+        rowid = sqlite3_column_int64(stmt, 0);
+        has_payload = sqlite3_column_type(stmt, 3) != SQLITE_NULL;
+        dangling = !has_payload && sqlite3_column_type(stmt, 1) != SQLITE_NULL;
+        payload_id = sqlite3_column_int64(stmt, 1);
+        payload_offset = (size_t)sqlite3_column_int64(stmt, 2);
+        codec = sqlite3_column_int(stmt, 3);
+        payload_size = (size_t)sqlite3_column_int64(stmt, 4);
+    }
+    release_statement(stmt);
     
-    if (rc != SQLITE_DONE) {
-        sqlite3_exec(db->db, "ROLLBACK;", NULL, NULL, NULL);
-        return (rc == SQLITE_CONSTRAINT) ? CSQLITE_CONSTRAINT : CSQLITE_ERROR;
+    if (rc != SQLITE_ROW) {
+        if (result && rc == SQLITE_DONE) *result = CSQLITE_NOT_FOUND;
+        return NULL;
+    }
+    if (dangling) {
+        return NULL;
     }
     
-    // Insert metadata
-    const char* insert_metadata_sql = "INSERT INTO bundle_metadata (id, source, destination, creation_time, size, constraints) VALUES (?, ?, ?, ?, ?, ?);";
-    rc = sqlite3_prepare_v2(db->db, insert_metadata_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        sqlite3_exec(db->db, "ROLLBACK;", NULL, NULL, NULL);
-        return CSQLITE_ERROR;
+    CSQLiteBlob* handle = calloc(1, sizeof(CSQLiteBlob));
+    if (!handle) {
+        return NULL;
     }
     
-    sqlite3_bind_text(stmt, 1, metadata->id, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, metadata->source, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, metadata->destination, -1, SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 4, metadata->creation_time);
-    sqlite3_bind_int64(stmt, 5, metadata->size);
-    sqlite3_bind_int(stmt, 6, metadata->constraints);
+    if (sqlite3_blob_open(db->db, "main", "bundles", "data", rowid, 0, &handle->blob) != SQLITE_OK) {
+        // sqlite3_blob_open may hand back a handle even on failure
+        csqlite_blob_close(handle);
+        return NULL;
+    }
     
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    size_t rest_size = (size_t)sqlite3_blob_bytes(handle->blob);
+    if (!has_payload) {
+        payload_offset = rest_size;
+        payload_size = 0;
+    } else if (payload_offset > rest_size) {
+        csqlite_blob_close(handle);
+        return NULL;
+    } else if (codec == PAYLOAD_CODEC_DEFLATE) {
+        handle->inflated = load_inflated_payload(db, payload_id, payload_size);
+        if (!handle->inflated) {
+            csqlite_blob_close(handle);
+            return NULL;
+        }
+    } else if (sqlite3_blob_open(db->db, "main", "payloads", "data", payload_id, 0, &handle->payload) != SQLITE_OK ||
+               (size_t)sqlite3_blob_bytes(handle->payload) != payload_size) {
+        csqlite_blob_close(handle);
+        return NULL;
+    }
     
-    if (rc != SQLITE_DONE) {
-        sqlite3_exec(db->db, "ROLLBACK;", NULL, NULL, NULL);
+    handle->payload_offset = payload_offset;
+    handle->payload_size = payload_size;
+    handle->size = rest_size + payload_size;
+    *size = handle->size;
+    if (result) *result = CSQLITE_OK;
+    return handle;
+}
+
+CSQLiteResult csqlite_blob_read(CSQLiteBlob* blob, uint8_t* buffer, size_t offset, size_t count) {
+    if (!blob || (!buffer && count > 0) || offset > blob->size || count > blob->size - offset) {
         return CSQLITE_ERROR;
     }
     
-    // Commit transaction
-    rc = sqlite3_exec(db->db, "COMMIT;", NULL, NULL, NULL);
-    return (rc == SQLITE_OK) ? CSQLITE_OK : CSQLITE_ERROR;
+    size_t payload_end = blob->payload_offset + blob->payload_size;
+    while (count > 0) {
+        size_t n;
+        int rc = SQLITE_OK;
+        
+        // A stored bundle never exceeds SQLite's blob limit, which fits in an int
+        if (offset < blob->payload_offset) {
+            n = (count < blob->payload_offset - offset) ? count : blob->payload_offset - offset;
+            rc = sqlite3_blob_read(blob->blob, buffer, (int)n, (int)offset);
+        } else if (offset < payload_end) {
+            n = (count < payload_end - offset) ? count : payload_end - offset;
+            if (blob->inflated) {
+                memcpy(buffer, blob->inflated + (offset - blob->payload_offset), n);
+            } else {
+                rc = sqlite3_blob_read(blob->payload, buffer, (int)n, (int)(offset - blob->payload_offset));
+            }
+        } else {
+            n = count;
+            rc = sqlite3_blob_read(blob->blob, buffer, (int)n, (int)(offset - blob->payload_size));
+        }
+        
+        if (rc != SQLITE_OK) {
+            return CSQLITE_ERROR;
+        }
+        buffer += n;
+        offset += n;
+        count -= n;
+    }
+    return CSQLITE_OK;
 }
 
-CSQLiteResult csqlite_get_bundle(CSQLiteDB* db, const char* bundle_id, uint8_t** bundle_data, size_t* bundle_size) {
-    if (!db || !bundle_id || !bundle_data || !bundle_size) {
+void csqlite_blob_close(CSQLiteBlob* blob) {
+    if (blob) {
+        sqlite3_blob_close(blob->blob);
+        sqlite3_blob_close(blob->payload);
+        free(blob->inflated);
+        free(blob);
+    }
+}
+
+CSQLiteResult csqlite_payload_stats(CSQLiteDB* db, CSQLitePayloadStats* stats) {
+    if (!db || !stats) {
         return CSQLITE_ERROR;
     }
     
-    const char* query = "SELECT data FROM bundles WHERE id = ?;";
-    sqlite3_stmt* stmt = NULL;
-    
-    int rc = sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_PAYLOAD_STATS);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
-    sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
-    rc = sqlite3_step(stmt);
-    
+    int rc = sqlite3_step(stmt);
     if (rc == SQLITE_ROW) {
-        const void* blob = sqlite3_column_blob(stmt, 0);
-        int blob_size = sqlite3_column_bytes(stmt, 0);
-        
-        *bundle_data = malloc(blob_size);
-        if (*bundle_data) {
-            memcpy(*bundle_data, blob, blob_size);
-            *bundle_size = blob_size;
-            sqlite3_finalize(stmt);
-            return CSQLITE_OK;
-        }
+        stats->payloads = (uint64_t)sqlite3_column_int64(stmt, 0);
+        stats->references = (uint64_t)sqlite3_column_int64(stmt, 1);
+        stats->stored_bytes = (uint64_t)sqlite3_column_int64(stmt, 2);
+        stats->referenced_bytes = (uint64_t)sqlite3_column_int64(stmt, 3);
     }
-    
-    sqlite3_finalize(stmt);
-    return (rc == SQLITE_DONE) ? CSQLITE_NOT_FOUND : CSQLITE_ERROR;
+    release_statement(stmt);
+    return (rc == SQLITE_ROW) ? CSQLITE_OK : CSQLITE_ERROR;
 }
 
 CSQLiteResult csqlite_get_metadata(CSQLiteDB* db, const char* bundle_id, CSQLiteBundleMetadata* metadata) {
@@ -159,16 +1099,13 @@ CSQLiteResult csqlite_get_metadata(CSQLiteDB* db, const char* bundle_id, CSQLite
         return CSQLITE_ERROR;
     }
     
-    const char* query = "SELECT id, source, destination, creation_time, size, constraints FROM bundle_metadata WHERE id = ?;";
-    sqlite3_stmt* stmt = NULL;
-    
-    int rc = sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_GET_METADATA);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
     sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
     
     if (rc == SQLITE_ROW) {
         metadata->id = csqlite_strdup((const char*)sqlite3_column_text(stmt, 0));
@@ -177,12 +1114,13 @@ CSQLiteResult csqlite_get_metadata(CSQLiteDB* db, const char* bundle_id, CSQLite
         metadata->creation_time = sqlite3_column_int64(stmt, 3);
         metadata->size = sqlite3_column_int64(stmt, 4);
         metadata->constraints = sqlite3_column_int(stmt, 5);
+        metadata->expires_at = sqlite3_column_int64(stmt, 6);
         
-        sqlite3_finalize(stmt);
+        release_statement(stmt);
         return CSQLITE_OK;
     }
     
-    sqlite3_finalize(stmt);
+    release_statement(stmt);
     return (rc == SQLITE_DONE) ? CSQLITE_NOT_FOUND : CSQLITE_ERROR;
 }
 
@@ -191,23 +1129,27 @@ CSQLiteResult csqlite_update_metadata(CSQLiteDB* db, const CSQLiteBundleMetadata
         return CSQLITE_ERROR;
     }
     
-    const char* update_sql = "UPDATE bundle_metadata SET source = ?, destination = ?, creation_time = ?, size = ?, constraints = ? WHERE id = ?;";
-    sqlite3_stmt* stmt = NULL;
+    sqlite3_int64 source, destination;
+    if (intern_eid(db, metadata->source, &source) != SQLITE_OK ||
+        intern_eid(db, metadata->destination, &destination) != SQLITE_OK) {
+        return CSQLITE_ERROR;
+    }
     
-    int rc = sqlite3_prepare_v2(db->db, update_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_UPDATE_METADATA);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
-    sqlite3_bind_text(stmt, 1, metadata->source, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, metadata->destination, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 1, source);
+    sqlite3_bind_int64(stmt, 2, destination);
     sqlite3_bind_int64(stmt, 3, metadata->creation_time);
     sqlite3_bind_int64(stmt, 4, metadata->size);
     sqlite3_bind_int(stmt, 5, metadata->constraints);
-    sqlite3_bind_text(stmt, 6, metadata->id, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 6, metadata->expires_at);
+    sqlite3_bind_text(stmt, 7, metadata->id, -1, SQLITE_STATIC);
     
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    int rc = sqlite3_step(stmt);
+    release_statement(stmt);
     
     if (rc != SQLITE_DONE) {
         return CSQLITE_ERROR;
@@ -221,17 +1163,14 @@ CSQLiteResult csqlite_remove_bundle(CSQLiteDB* db, const char* bundle_id) {
         return CSQLITE_ERROR;
     }
     
-    const char* delete_sql = "DELETE FROM bundles WHERE id = ?;";
-    sqlite3_stmt* stmt = NULL;
-    
-    int rc = sqlite3_prepare_v2(db->db, delete_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_REMOVE_BUNDLE);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
     sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    int rc = sqlite3_step(stmt);
+    release_statement(stmt);
     
     if (rc != SQLITE_DONE) {
         return CSQLITE_ERROR;
@@ -245,19 +1184,16 @@ CSQLiteResult csqlite_has_bundle(CSQLiteDB* db, const char* bundle_id, bool* exi
         return CSQLITE_ERROR;
     }
     
-    const char* query = "SELECT 1 FROM bundles WHERE id = ? LIMIT 1;";
-    sqlite3_stmt* stmt = NULL;
-    
-    int rc = sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_HAS_BUNDLE);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
     sqlite3_bind_text(stmt, 1, bundle_id, -1, SQLITE_STATIC);
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
     
     *exists = (rc == SQLITE_ROW);
-    sqlite3_finalize(stmt);
+    release_statement(stmt);
     
     return CSQLITE_OK;
 }
@@ -267,22 +1203,19 @@ uint64_t csqlite_count_bundles(CSQLiteDB* db) {
         return 0;
     }
     
-    const char* query = "SELECT COUNT(*) FROM bundles;";
-    sqlite3_stmt* stmt = NULL;
-    
-    int rc = sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_COUNT_BUNDLES);
+    if (!stmt) {
         return 0;
     }
     
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
     uint64_t count = 0;
     
     if (rc == SQLITE_ROW) {
         count = sqlite3_column_int64(stmt, 0);
     }
     
-    sqlite3_finalize(stmt);
+    release_statement(stmt);
     return count;
 }
 
@@ -291,11 +1224,8 @@ CSQLiteResult csqlite_get_all_ids(CSQLiteDB* db, char*** ids, size_t* count) {
         return CSQLITE_ERROR;
     }
     
-    const char* query = "SELECT id FROM bundles;";
-    sqlite3_stmt* stmt = NULL;
-    
-    int rc = sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_stmt* stmt = get_statement(db, STMT_ALL_IDS);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
@@ -308,14 +1238,14 @@ CSQLiteResult csqlite_get_all_ids(CSQLiteDB* db, char*** ids, size_t* count) {
     if (n == 0) {
         *ids = NULL;
         *count = 0;
-        sqlite3_finalize(stmt);
+        release_statement(stmt);
         return CSQLITE_OK;
     }
     
     // Allocate array
     *ids = malloc(n * sizeof(char*));
     if (!*ids) {
-        sqlite3_finalize(stmt);
+        release_statement(stmt);
         return CSQLITE_ERROR;
     }
     
@@ -329,61 +1259,430 @@ CSQLiteResult csqlite_get_all_ids(CSQLiteDB* db, char*** ids, size_t* count) {
     }
     
     *count = i;
-    sqlite3_finalize(stmt);
+    release_statement(stmt);
+    return CSQLITE_OK;
+}
+
+// Index of `id` in the ascending `ids`, or -1
+static long long find_eid(const sqlite3_int64* ids, size_t count, sqlite3_int64 id) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (ids[mid] < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return (low < count && ids[low] == id) ? (long long)low : -1;
+}
+
+// Copies a string into the arena at `*used`, failing if it does not fit
+static bool arena_put(char* arena, size_t capacity, size_t* used, const unsigned char* str, int len, uint32_t* offset) {
+    if (!str || len < 0 || (size_t)len + 1 > capacity - *used) {
+        return false;
+    }
+    *offset = (uint32_t)*used;
+    memcpy(arena + *used, str, (size_t)len);
+    arena[*used + (size_t)len] = '\0';
+    *used += (size_t)len + 1;
+    return true;
+}
+
+// Fills `columns`, whose arrays are sized from STMT_METADATA_SIZES. Every EID
+// is copied into the arena once, ahead of the bundle ids, and shared by offset.
+static int fill_metadata_columns(CSQLiteDB* db, CSQLiteMetadataColumns* columns, size_t rows, size_t eid_count, size_t arena_size) {
+    sqlite3_int64* eid_ids = malloc((eid_count ? eid_count : 1) * sizeof(sqlite3_int64));
+    uint32_t* eid_offsets = malloc((eid_count ? eid_count : 1) * sizeof(uint32_t));
+    if (!eid_ids || !eid_offsets) {
+        free(eid_ids);
+        free(eid_offsets);
+        return SQLITE_NOMEM;
+    }
+    
+    char* arena = (char*)columns->strings;
+    size_t used = 0;
+    size_t n = 0;
+    int rc = SQLITE_ERROR;
+    
+    sqlite3_stmt* stmt = get_statement(db, STMT_ALL_EIDS);
+    if (!stmt) {
+        goto done;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (n == eid_count ||
+            !arena_put(arena, arena_size, &used, sqlite3_column_text(stmt, 1), sqlite3_column_bytes(stmt, 1), &eid_offsets[n])) {
+            rc = SQLITE_CORRUPT;
+            break;
+        }
+        eid_ids[n++] = sqlite3_column_int64(stmt, 0);
+    }
+    release_statement(stmt);
+    if (rc != SQLITE_DONE) {
+        goto done;
+    }
+    eid_count = n;
+    
+    rc = SQLITE_ERROR;
+    stmt = get_statement(db, STMT_ALL_METADATA);
+    if (!stmt) {
+        goto done;
+    }
+    
+    n = 0;
+    uint32_t* id = (uint32_t*)columns->id;
+    uint32_t* source = (uint32_t*)columns->source;
+    uint32_t* destination = (uint32_t*)columns->destination;
+    uint64_t* creation_time = (uint64_t*)columns->creation_time;
+    uint64_t* size = (uint64_t*)columns->size;
+    uint64_t* expires_at = (uint64_t*)columns->expires_at;
+    int32_t* constraints = (int32_t*)columns->constraints;
+    
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        long long s = find_eid(eid_ids, eid_count, sqlite3_column_int64(stmt, 1));
+        long long d = find_eid(eid_ids, eid_count, sqlite3_column_int64(stmt, 2));
+        if (n == rows || s < 0 || d < 0 ||
+            !arena_put(arena, arena_size, &used, sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0), &id[n])) {
+            rc = SQLITE_CORRUPT;
+            break;
+        }
+        source[n] = eid_offsets[s];
+        destination[n] = eid_offsets[d];
+        creation_time[n] = sqlite3_column_int64(stmt, 3);
+        size[n] = sqlite3_column_int64(stmt, 4);
+        constraints[n] = sqlite3_column_int(stmt, 5);
+        expires_at[n] = sqlite3_column_int64(stmt, 6);
+        n++;
+    }
+    release_statement(stmt);
+    
+    columns->count = n;
+    columns->strings_size = used;
+
+done:
+    free(eid_ids);
+    free(eid_offsets);
+    return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
+
+CSQLiteResult csqlite_get_all_metadata(CSQLiteDB* db, CSQLiteMetadataColumns** columns) {
+    if (!db || !columns) {
+        return CSQLITE_ERROR;
+    }
+    
+    *columns = NULL;
+    
+    // One read transaction, so the sizes still hold for the scan
+    if (exec_statement(db, STMT_BEGIN) != SQLITE_OK) {
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_stmt* stmt = get_statement(db, STMT_METADATA_SIZES);
+    if (!stmt) {
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    int rc = sqlite3_step(stmt);
+    uint64_t rows = (rc == SQLITE_ROW) ? (uint64_t)sqlite3_column_int64(stmt, 0) : 0;
+    uint64_t id_bytes = (rc == SQLITE_ROW) ? (uint64_t)sqlite3_column_int64(stmt, 1) : 0;
+    uint64_t eid_count = (rc == SQLITE_ROW) ? (uint64_t)sqlite3_column_int64(stmt, 2) : 0;
+    uint64_t eid_bytes = (rc == SQLITE_ROW) ? (uint64_t)sqlite3_column_int64(stmt, 3) : 0;
+    release_statement(stmt);
+    
+    // Every string plus its terminator, addressed by 32-bit offsets
+    uint64_t arena_size = id_bytes + rows + eid_bytes + eid_count;
+    if (rc != SQLITE_ROW || arena_size > UINT32_MAX) {
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    // Header, columns and arena in one block; the 8-byte columns come first
+    size_t numbers = (size_t)rows * (3 * sizeof(uint64_t) + 3 * sizeof(uint32_t) + sizeof(int32_t));
+    uint8_t* block = malloc(sizeof(CSQLiteMetadataColumns) + numbers + (size_t)arena_size + 1);
+    if (!block) {
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    CSQLiteMetadataColumns* result = (CSQLiteMetadataColumns*)block;
+    uint8_t* next = block + sizeof(CSQLiteMetadataColumns);
+    result->creation_time = (const uint64_t*)next;
+    next += rows * sizeof(uint64_t);
+    result->size = (const uint64_t*)next;
+    next += rows * sizeof(uint64_t);
+    result->expires_at = (const uint64_t*)next;
+    next += rows * sizeof(uint64_t);
+    result->id = (const uint32_t*)next;
+    next += rows * sizeof(uint32_t);
+    result->source = (const uint32_t*)next;
+    next += rows * sizeof(uint32_t);
+    result->destination = (const uint32_t*)next;
+    next += rows * sizeof(uint32_t);
+    result->constraints = (const int32_t*)next;
+    next += rows * sizeof(int32_t);
+    result->strings = (const char*)next;
+    
+    rc = fill_metadata_columns(db, result, (size_t)rows, (size_t)eid_count, (size_t)arena_size);
+    if (rc != SQLITE_OK || exec_statement(db, STMT_COMMIT) != SQLITE_OK) {
+        free(block);
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    *columns = result;
     return CSQLITE_OK;
 }
 
-CSQLiteResult csqlite_get_all_metadata(CSQLiteDB* db, CSQLiteBundleMetadata** metadata, size_t* count) {
-    if (!db || !metadata || !count) {
+CSQLiteResult csqlite_remove_expired(CSQLiteDB* db, uint64_t before, char*** ids, size_t* count) {
+    if (!db || !ids || !count) {
         return CSQLITE_ERROR;
     }
     
-    const char* query = "SELECT id, source, destination, creation_time, size, constraints FROM bundle_metadata;";
-    sqlite3_stmt* stmt = NULL;
+    *ids = NULL;
+    *count = 0;
     
-    int rc = sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL);
+    int rc = exec_statement(db, STMT_BEGIN);
     if (rc != SQLITE_OK) {
         return CSQLITE_ERROR;
     }
     
-    // Count results first
+    // Collect the ids first so callers can drop any state they keep per bundle
+    sqlite3_stmt* stmt = get_statement(db, STMT_EXPIRED_IDS);
+    if (!stmt) {
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)before);
+    
     size_t n = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+    size_t capacity = 0;
+    char** result = NULL;
+    
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (n == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char** grown = realloc(result, capacity * sizeof(char*));
+            if (!grown) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            result = grown;
+        }
+        result[n] = csqlite_strdup((const char*)sqlite3_column_text(stmt, 0));
+        if (!result[n]) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
         n++;
     }
+    release_statement(stmt);
     
-    if (n == 0) {
-        *metadata = NULL;
-        *count = 0;
-        sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        csqlite_free_ids(result, n);
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    // Deleting the metadata cascades to the encodings
+    stmt = get_statement(db, STMT_REMOVE_EXPIRED);
+    if (!stmt) {
+        csqlite_free_ids(result, n);
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)before);
+    rc = sqlite3_step(stmt);
+    release_statement(stmt);
+    
+    if (rc != SQLITE_DONE || exec_statement(db, STMT_COMMIT) != SQLITE_OK) {
+        csqlite_free_ids(result, n);
+        rollback(db);
+        return CSQLITE_ERROR;
+    }
+    
+    *ids = result;
+    *count = n;
+    return CSQLITE_OK;
+}
+
+// Keyset-paginated cursor. No statement stays open between pages, so the
+// store can be modified while a cursor is in use.
+struct CSQLiteIterator {
+    CSQLiteDB* db;
+    CSQLiteIterKind kind;
+    size_t page_size;
+    bool finished;
+    
+    // Key of the last row handed out; the next page starts after it
+    sqlite3_int64 last_key;
+    
+    // Rows of the current page; their strings point into `arena`
+    CSQLiteBundleMetadata* rows;
+    char* arena;
+    size_t arena_capacity;
+    
+    // Arena offsets of each row's id, source and destination (-1 if unset),
+    // collected while the arena may still move
+    long long* offsets;
+};
+
+// Appends a string to the page arena and returns its offset, or -1 on failure
+static long long arena_append(CSQLiteIterator* it, size_t* used, const char* str) {
+    size_t len = str ? strlen(str) : 0;
+    
+    if (*used + len + 1 > it->arena_capacity) {
+        size_t capacity = it->arena_capacity ? it->arena_capacity : 4096;
+        while (*used + len + 1 > capacity) {
+            capacity *= 2;
+        }
+        char* arena = realloc(it->arena, capacity);
+        if (!arena) {
+            return -1;
+        }
+        it->arena = arena;
+        it->arena_capacity = capacity;
+    }
+    
+    long long offset = (long long)*used;
+    if (len > 0) {
+        memcpy(it->arena + *used, str, len);
+    }
+    it->arena[*used + len] = '\0';
+    *used += len + 1;
+    return offset;
+}
+
+CSQLiteIterator* csqlite_iter_open(CSQLiteDB* db, CSQLiteIterKind kind, size_t page_size, CSQLiteResult* result) {
+    if (!db || page_size == 0 || (int)kind < CSQLITE_ITER_IDS || (int)kind > CSQLITE_ITER_FORWARD_PENDING) {
+        if (result) *result = CSQLITE_ERROR;
+        return NULL;
+    }
+    
+    CSQLiteIterator* it = calloc(1, sizeof(CSQLiteIterator));
+    if (!it) {
+        if (result) *result = CSQLITE_ERROR;
+        return NULL;
+    }
+    
+    it->rows = calloc(page_size, sizeof(CSQLiteBundleMetadata));
+    it->offsets = calloc(page_size * 3, sizeof(long long));
+    if (!it->rows || !it->offsets) {
+        free(it->rows);
+        free(it->offsets);
+        free(it);
+        if (result) *result = CSQLITE_ERROR;
+        return NULL;
+    }
+    
+    it->db = db;
+    it->kind = kind;
+    it->page_size = page_size;
+    
+    if (result) *result = CSQLITE_OK;
+    return it;
+}
+
+CSQLiteResult csqlite_iter_next(CSQLiteIterator* it, const CSQLiteBundleMetadata** rows, size_t* count) {
+    if (!it || !rows || !count) {
+        return CSQLITE_ERROR;
+    }
+    
+    *rows = it->rows;
+    *count = 0;
+    
+    if (it->finished) {
         return CSQLITE_OK;
     }
     
-    // Allocate array
-    *metadata = malloc(n * sizeof(CSQLiteBundleMetadata));
-    if (!*metadata) {
-        sqlite3_finalize(stmt);
+    CSQLiteStatement which = STMT_PAGE_METADATA;
+    if (it->kind == CSQLITE_ITER_IDS) {
+        which = STMT_PAGE_IDS;
+    } else if (it->kind == CSQLITE_ITER_FORWARD_PENDING) {
+        which = STMT_PAGE_FORWARD_PENDING;
+    }
+    
+    sqlite3_stmt* stmt = get_statement(it->db, which);
+    if (!stmt) {
         return CSQLITE_ERROR;
     }
     
-    // Reset and fetch
-    sqlite3_reset(stmt);
-    size_t i = 0;
-    while (sqlite3_step(stmt) == SQLITE_ROW && i < n) {
-        (*metadata)[i].id = csqlite_strdup((const char*)sqlite3_column_text(stmt, 0));
-        (*metadata)[i].source = csqlite_strdup((const char*)sqlite3_column_text(stmt, 1));
-        (*metadata)[i].destination = csqlite_strdup((const char*)sqlite3_column_text(stmt, 2));
-        (*metadata)[i].creation_time = sqlite3_column_int64(stmt, 3);
-        (*metadata)[i].size = sqlite3_column_int64(stmt, 4);
-        (*metadata)[i].constraints = sqlite3_column_int(stmt, 5);
-        i++;
+    sqlite3_bind_int64(stmt, 1, it->last_key);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)it->page_size);
+    
+    size_t used = 0;
+    size_t n = 0;
+    int rc = SQLITE_DONE;
+    sqlite3_int64 last_key = it->last_key;
+    const int key_column = (it->kind == CSQLITE_ITER_IDS) ? 1 : 7;
+    
+    while (n < it->page_size && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        CSQLiteBundleMetadata* row = &it->rows[n];
+        long long* offsets = &it->offsets[n * 3];
+        memset(row, 0, sizeof(*row));
+        
+        offsets[0] = arena_append(it, &used, (const char*)sqlite3_column_text(stmt, 0));
+        offsets[1] = -1;
+        offsets[2] = -1;
+        
+        if (it->kind != CSQLITE_ITER_IDS) {
+            offsets[1] = arena_append(it, &used, (const char*)sqlite3_column_text(stmt, 1));
+            offsets[2] = arena_append(it, &used, (const char*)sqlite3_column_text(stmt, 2));
+            row->creation_time = sqlite3_column_int64(stmt, 3);
+            row->size = sqlite3_column_int64(stmt, 4);
+            row->constraints = sqlite3_column_int(stmt, 5);
+            row->expires_at = sqlite3_column_int64(stmt, 6);
+            
+            if (offsets[1] < 0 || offsets[2] < 0) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+        }
+        
+        if (offsets[0] < 0) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        
+        last_key = sqlite3_column_int64(stmt, key_column);
+        n++;
     }
     
-    *count = i;
-    sqlite3_finalize(stmt);
+    release_statement(stmt);
+    
+    if (n < it->page_size && rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        return CSQLITE_ERROR;
+    }
+    
+    // The arena no longer moves, so offsets can become pointers
+    for (size_t i = 0; i < n; i++) {
+        CSQLiteBundleMetadata* row = &it->rows[i];
+        const long long* offsets = &it->offsets[i * 3];
+        row->id = it->arena + offsets[0];
+        row->source = (offsets[1] >= 0) ? it->arena + offsets[1] : NULL;
+        row->destination = (offsets[2] >= 0) ? it->arena + offsets[2] : NULL;
+    }
+    
+    if (n < it->page_size) {
+        it->finished = true;
+    }
+    
+    it->last_key = last_key;
+    *count = n;
     return CSQLITE_OK;
 }
 
+void csqlite_iter_close(CSQLiteIterator* it) {
+    if (it) {
+        free(it->rows);
+        free(it->offsets);
+        free(it->arena);
+        free(it);
+    }
+}
+
 void csqlite_free_data(void* data) {
     free(data);
 }
@@ -397,15 +1696,89 @@ void csqlite_free_ids(char** ids, size_t count) {
     }
 }
 
-void csqlite_free_metadata_array(CSQLiteBundleMetadata* metadata, size_t count) {
-    if (metadata) {
-        for (size_t i = 0; i < count; i++) {
-            free((void*)metadata[i].id);
-            free((void*)metadata[i].source);
-            free((void*)metadata[i].destination);
+void csqlite_free_metadata_columns(CSQLiteMetadataColumns* columns) {
+    free(columns);
+}
+
+CSQLiteResult csqlite_deflate(const uint8_t* data, size_t size, int level, uint8_t** out, size_t* out_size) {
+    if ((!data && size > 0) || !out || !out_size || size > UINT_MAX) {
+        return CSQLITE_ERROR;
+    }
+    
+    uLongf capacity = compressBound((uLong)size);
+    uint8_t* compressed = malloc(capacity);
+    if (!compressed) {
+        return CSQLITE_ERROR;
+    }
+    
+    if (compress2(compressed, &capacity, data, (uLong)size, level) != Z_OK) {
+        free(compressed);
+        return CSQLITE_ERROR;
+    }
+    
+    *out = compressed;
+    *out_size = (size_t)capacity;
+    return CSQLITE_OK;
+}
+
+CSQLiteResult csqlite_inflate(const uint8_t* data, size_t size, size_t max_size, uint8_t** out, size_t* out_size) {
+    if ((!data && size > 0) || !out || !out_size || size > UINT_MAX) {
+        return CSQLITE_ERROR;
+    }
+    
+    if (max_size > UINT_MAX) {
+        max_size = UINT_MAX;
+    }
+    
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return CSQLITE_ERROR;
+    }
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = (uInt)size;
+    
+    // Grow the output as needed, never past `max_size`
+    size_t capacity = (size < max_size / 4) ? size * 4 : max_size;
+    if (capacity < 4096) {
+        capacity = (max_size < 4096) ? max_size : 4096;
+    }
+    uint8_t* inflated = NULL;
+    int rc = Z_OK;
+    
+    while (rc != Z_STREAM_END) {
+        uint8_t* grown = realloc(inflated, capacity ? capacity : 1);
+        if (!grown) {
+            rc = Z_MEM_ERROR;
+            break;
+        }
+        inflated = grown;
+        stream.next_out = inflated + stream.total_out;
+        stream.avail_out = (uInt)(capacity - stream.total_out);
+        
+        rc = inflate(&stream, Z_FINISH);
+        if (rc == Z_STREAM_END) {
+            break;
         }
-        free(metadata);
+        // Out of room: grow unless the limit is reached
+        if ((rc != Z_BUF_ERROR && rc != Z_OK) || stream.avail_out != 0 || capacity >= max_size) {
+            rc = Z_DATA_ERROR;
+            break;
+        }
+        capacity = (capacity > max_size / 2) ? max_size : capacity * 2;
+    }
+    
+    size_t produced = (size_t)stream.total_out;
+    inflateEnd(&stream);
+    
+    if (rc != Z_STREAM_END) {
+        free(inflated);
+        return CSQLITE_ERROR;
     }
+    
+    *out = inflated;
+    *out_size = produced;
+    return CSQLITE_OK;
 }
 
 char* csqlite_strdup(const char* str) {
@@ -416,4 +1789,4 @@ char* csqlite_strdup(const char* str) {
         memcpy(copy, str, len);
     }
     return copy;
-}
\ No newline at end of file
+}
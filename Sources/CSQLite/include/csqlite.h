@@ -4,6 +4,7 @@
 #include <sqlite3.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // Error codes
 typedef enum {
@@ -20,33 +21,133 @@ typedef struct {
     const char* destination;
     uint64_t creation_time;
     uint64_t size;
-    int constraints;
+    int constraints;            // bit set mirroring the Swift `Constraints` option set
+    uint64_t expires_at;        // DTN time in milliseconds; 0 = never expires
 } CSQLiteBundleMetadata;
 
+// Metadata of many bundles as parallel arrays, indexed by row. `id`, `source`
+// and `destination` are offsets of NUL-terminated strings in `strings`; rows
+// with the same EID share one copy. Header, arrays and strings are a single
+// allocation, freed with csqlite_free_metadata_columns.
+typedef struct {
+    size_t count;
+    const uint64_t* creation_time;
+    const uint64_t* size;
+    const uint64_t* expires_at;
+    const uint32_t* id;
+    const uint32_t* source;
+    const uint32_t* destination;
+    const int32_t* constraints;
+    const char* strings;
+    size_t strings_size;
+} CSQLiteMetadataColumns;
+
+// One bundle of a batch insert
+typedef struct {
+    const char* bundle_id;
+    const uint8_t* bundle_data;
+    size_t bundle_size;
+    CSQLiteBundleMetadata metadata;
+} CSQLiteBundleRecord;
+
+// Connection profile applied when a database is opened
+typedef struct {
+    const char* journal_mode;   // DELETE, TRUNCATE, PERSIST, MEMORY, WAL or OFF; NULL keeps the SQLite default
+    int synchronous;            // 0 = OFF, 1 = NORMAL, 2 = FULL, 3 = EXTRA; -1 keeps the default
+    int64_t mmap_size;          // bytes of the file to memory-map; -1 keeps the default
+    int64_t cache_size;         // PRAGMA cache_size (pages if > 0, KiB if < 0); 0 keeps the default
+    int page_size;              // bytes per page for new databases; 0 keeps the default
+    int64_t dedup_min_size;     // payloads of at least this many bytes are stored once per content; 0 disables
+    int64_t compress_min_size;  // deduplicated payloads of at least this many bytes are deflated; 0 disables
+    int compress_level;         // zlib level 0-9, or -1 for the zlib default
+} CSQLiteOptions;
+
+// Deduplicated payload storage
+typedef struct {
+    uint64_t payloads;          // distinct payloads stored
+    uint64_t references;        // bundles pointing at them
+    uint64_t stored_bytes;      // bytes the payloads take up, after compression
+    uint64_t referenced_bytes;  // bytes the bundles would take up storing their payloads on their own
+} CSQLitePayloadStats;
+
 // Database handle
 typedef struct CSQLiteDB CSQLiteDB;
 
+// Read handle on the stored encoding of one bundle
+typedef struct CSQLiteBlob CSQLiteBlob;
+
+// Cursor over the store, yielding rows one page at a time
+typedef struct CSQLiteIterator CSQLiteIterator;
+
+typedef enum {
+    CSQLITE_ITER_IDS = 0,               // only `id` is set in each row
+    CSQLITE_ITER_METADATA = 1,          // every metadata field is set
+    CSQLITE_ITER_FORWARD_PENDING = 2,   // metadata of bundles with CSQLITE_CONSTRAINT_FORWARD_PENDING set
+} CSQLiteIterKind;
+
+// Constraint bits the store queries on; must match `Constraints` in BundleStore.swift
+#define CSQLITE_CONSTRAINT_FORWARD_PENDING (1 << 1)
+
 // Database operations
+void csqlite_default_options(CSQLiteOptions* options);
 CSQLiteDB* csqlite_open(const char* path, CSQLiteResult* result);
+CSQLiteDB* csqlite_open_with_options(const char* path, const CSQLiteOptions* options, CSQLiteResult* result);
 void csqlite_close(CSQLiteDB* db);
 
+// Schema version the database had before this open applied its migrations
+int csqlite_schema_upgraded_from(CSQLiteDB* db);
+
 // Bundle operations
 CSQLiteResult csqlite_store_bundle(CSQLiteDB* db, const char* bundle_id, const uint8_t* bundle_data, size_t bundle_size, const CSQLiteBundleMetadata* metadata);
+// Stores `count` bundles in one transaction. `results[i]` receives the outcome for
+// `records[i]`: a duplicate id yields CSQLITE_CONSTRAINT without aborting the batch,
+// any other failure rolls back the whole batch and reports CSQLITE_ERROR for every record.
+CSQLiteResult csqlite_store_bundles_batch(CSQLiteDB* db, const CSQLiteBundleRecord* records, size_t count, CSQLiteResult* results);
 CSQLiteResult csqlite_get_bundle(CSQLiteDB* db, const char* bundle_id, uint8_t** bundle_data, size_t* bundle_size);
 CSQLiteResult csqlite_get_metadata(CSQLiteDB* db, const char* bundle_id, CSQLiteBundleMetadata* metadata);
 CSQLiteResult csqlite_update_metadata(CSQLiteDB* db, const CSQLiteBundleMetadata* metadata);
 CSQLiteResult csqlite_remove_bundle(CSQLiteDB* db, const char* bundle_id);
 CSQLiteResult csqlite_has_bundle(CSQLiteDB* db, const char* bundle_id, bool* exists);
 
+// Incremental blob I/O on a bundle's stored encoding. csqlite_blob_read copies
+// straight from the database pages (the memory map when mmap_size is set) into
+// `buffer`, so a caller can read the bytes without an intermediate allocation;
+// only a compressed payload is inflated into memory when the handle is opened.
+// The handle must be closed before the bundle's row is modified.
+CSQLiteBlob* csqlite_blob_open(CSQLiteDB* db, const char* bundle_id, size_t* size, CSQLiteResult* result);
+CSQLiteResult csqlite_blob_read(CSQLiteBlob* blob, uint8_t* buffer, size_t offset, size_t count);
+void csqlite_blob_close(CSQLiteBlob* blob);
+
+CSQLiteResult csqlite_payload_stats(CSQLiteDB* db, CSQLitePayloadStats* stats);
+
+// Removes every bundle with 0 < expires_at <= `before` in one transaction.
+// The removed ids are returned in `ids` (free with csqlite_free_ids).
+CSQLiteResult csqlite_remove_expired(CSQLiteDB* db, uint64_t before, char*** ids, size_t* count);
+
 // Query operations
 uint64_t csqlite_count_bundles(CSQLiteDB* db);
 CSQLiteResult csqlite_get_all_ids(CSQLiteDB* db, char*** ids, size_t* count);
-CSQLiteResult csqlite_get_all_metadata(CSQLiteDB* db, CSQLiteBundleMetadata** metadata, size_t* count);
+CSQLiteResult csqlite_get_all_metadata(CSQLiteDB* db, CSQLiteMetadataColumns** columns);
+
+// Cursor operations. Rows returned by csqlite_iter_next are owned by the iterator
+// and stay valid until the next call; a page with `count == 0` marks the end.
+CSQLiteIterator* csqlite_iter_open(CSQLiteDB* db, CSQLiteIterKind kind, size_t page_size, CSQLiteResult* result);
+CSQLiteResult csqlite_iter_next(CSQLiteIterator* it, const CSQLiteBundleMetadata** rows, size_t* count);
+void csqlite_iter_close(CSQLiteIterator* it);
 
 // Memory management helpers
 void csqlite_free_data(void* data);
 void csqlite_free_ids(char** ids, size_t count);
-void csqlite_free_metadata_array(CSQLiteBundleMetadata* metadata, size_t count);
+void csqlite_free_metadata_columns(CSQLiteMetadataColumns* columns);
 char* csqlite_strdup(const char* str);
 
+// zlib (RFC 1950) codec, used for stored payloads and by the CLAs on the wire.
+// Output is malloc'd; free it with csqlite_free_data. csqlite_inflate fails
+// rather than produce more than `max_size` bytes.
+CSQLiteResult csqlite_deflate(const uint8_t* data, size_t size, int level, uint8_t** out, size_t* out_size);
+CSQLiteResult csqlite_inflate(const uint8_t* data, size_t size, size_t max_size, uint8_t** out, size_t* out_size);
+
+// zlib CRC-32 of `data`, continuing from `crc` (0 to start a new one)
+uint32_t csqlite_crc32(uint32_t crc, const uint8_t* data, size_t size);
+
 #endif // CSQLITE_H
\ No newline at end of file
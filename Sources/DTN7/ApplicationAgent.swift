@@ -25,20 +25,48 @@ public protocol ApplicationAgentDelegate: Sendable {
 }
 
 /// Manages application registrations and bundle delivery
+///
+/// Bundles for an endpoint with nobody reading it wait in its mailbox. The
+/// mailbox holds bundle IDs only; the bytes stay in the store, which already has
+/// every bundle the processor delivers, and are read back when an application
+/// subscribes, polls or registers a channel.
 public actor ApplicationAgent {
     private let logger = Logger(label: "ApplicationAgent")
     
+    // Where the bytes of queued bundles live
+    private let store: any BundleStore
+    
     // Registered endpoints and their delivery channels
-    private var registeredEndpoints: [EndpointID: ApplicationEndpoint] = [:]
+    private var registeredEndpoints: [EndpointID: ApplicationEndpoint] = [:] {
+        didSet { index = EndpointIndex(registrations: registeredEndpoints.keys) }
+    }
+    private var index = EndpointIndex()
     private var deliveryChannels: [EndpointID: AsyncChannel<BP7.Bundle>] = [:]
     
     // Optional delegates for direct delivery
     private var delegates: [EndpointID: any ApplicationAgentDelegate] = [:]
     
-    // Queue for bundles awaiting delivery
-    private var pendingBundles: [EndpointID: [BP7.Bundle]] = [:]
+    // Bundles awaiting delivery, by endpoint
+    private var mailboxes: [EndpointID: Mailbox] = [:]
+    
+    /// Most bundle IDs a mailbox holds before it drops the oldest
+    public let maxQueuedBundles: Int
+    
+    // Identifies subscriptions, so a stale subscriber cannot detach its replacement
+    private var nextSubscription = 0
     
-    public init() {}
+    public init(store: any BundleStore = InMemoryBundleStore(), maxQueuedBundles: Int = 10_000) {
+        self.store = store
+        self.maxQueuedBundles = maxQueuedBundles
+    }
+    
+    /// Register an application endpoint whose bundles wait in its mailbox until
+    /// an application subscribes or polls for them
+    public func register(_ endpoint: EndpointID) {
+        guard registeredEndpoints[endpoint] == nil else { return }
+        logger.info("Registering application endpoint: \(endpoint)")
+        registeredEndpoints[endpoint] = ApplicationEndpoint(endpoint: endpoint)
+    }
     
     /// Register an application endpoint
     public func registerEndpoint(_ endpoint: EndpointID) -> AsyncChannel<BP7.Bundle> {
@@ -52,17 +80,20 @@ public actor ApplicationAgent {
         }
         
         // Deliver any pending bundles
-        if let pending = pendingBundles[endpoint] {
-            let channel = deliveryChannels[endpoint]!
+        let channel = deliveryChannels[endpoint]!
+        let pending = drainMailbox(of: endpoint)
+        if !pending.isEmpty {
+            let store = self.store
             Task {
-                for bundle in pending {
-                    await channel.send(bundle)
+                for bundleId in pending {
+                    if let bundle = await store.getBundle(bundleId: bundleId) {
+                        await channel.send(bundle)
+                    }
                 }
             }
-            pendingBundles.removeValue(forKey: endpoint)
         }
         
-        return deliveryChannels[endpoint]!
+        return channel
     }
     
     /// Register an application endpoint with a delegate
@@ -73,13 +104,16 @@ public actor ApplicationAgent {
         delegates[endpoint] = delegate
         
         // Deliver any pending bundles
-        if let pending = pendingBundles[endpoint] {
+        let pending = drainMailbox(of: endpoint)
+        if !pending.isEmpty {
+            let store = self.store
             Task {
-                for bundle in pending {
-                    await delegate.bundleReceived(bundle)
+                for bundleId in pending {
+                    if let bundle = await store.getBundle(bundleId: bundleId) {
+                        await delegate.bundleReceived(bundle)
+                    }
                 }
             }
-            pendingBundles.removeValue(forKey: endpoint)
         }
     }
     
@@ -91,32 +125,27 @@ public actor ApplicationAgent {
         deliveryChannels[endpoint]?.finish()
         deliveryChannels.removeValue(forKey: endpoint)
         delegates.removeValue(forKey: endpoint)
-        pendingBundles.removeValue(forKey: endpoint)
+        mailboxes.removeValue(forKey: endpoint)
     }
     
     /// Deliver a bundle to the appropriate application
+    ///
+    /// Returns whether an application took the bundle; otherwise it waits in
+    /// the mailbox of its endpoint.
     public func deliverBundle(_ bundle: BP7.Bundle) async -> Bool {
         let destination = bundle.primary.destination
-        let bundleId = BundlePack(from: bundle).id
+        let bundleId = BundlePack.id(of: bundle)
         
         logger.debug("Attempting to deliver bundle \(bundleId) to \(destination)")
         
-        // Try exact match first
-        if let registration = registeredEndpoints[destination] {
-            return await deliverToEndpoint(bundle, to: destination)
-        }
-        
-        // Try pattern matching for group endpoints
-        for (registeredEndpoint, _) in registeredEndpoints {
-            if matchesEndpoint(destination, pattern: registeredEndpoint) {
-                logger.debug("Bundle \(bundleId) matches registered endpoint \(registeredEndpoint)")
-                return await deliverToEndpoint(bundle, to: registeredEndpoint)
-            }
+        // The exact registration, else a wildcard or group one
+        if let registeredEndpoint = index.match(destination) {
+            return await deliverToEndpoint(bundle, to: registeredEndpoint)
         }
         
         // No registered endpoint found - queue the bundle
-        logger.info("No application registered for endpoint \(destination), queuing bundle \(bundleId)")
-        queueBundle(bundle, for: destination)
+        logger.debug("No application registered for endpoint \(destination), queuing bundle \(bundleId)")
+        await queueBundle(bundle, for: destination)
         return false
     }
     
@@ -127,45 +156,122 @@ public actor ApplicationAgent {
     
     /// Check if an endpoint is registered
     public func isEndpointRegistered(_ endpoint: EndpointID) -> Bool {
-        if registeredEndpoints[endpoint] != nil {
-            return true
+        index.contains(endpoint)
+    }
+    
+    // MARK: - Push Delivery
+    
+    /// Attach a subscriber to `endpoint`, registering it if needed. `doorbell`
+    /// is signalled whenever bundles are queued for it; the subscriber then
+    /// fetches them with `takeBundles(for:limit:)`.
+    ///
+    /// A second subscriber replaces the first, whose unacknowledged bundles
+    /// are requeued. Returns the subscription to pass to `unsubscribe`.
+    public func subscribe(_ endpoint: EndpointID, doorbell: AsyncStream<Void>.Continuation) -> Int {
+        register(endpoint)
+        nextSubscription += 1
+        
+        var mailbox = mailboxes[endpoint] ?? Mailbox()
+        mailbox.requeueInFlight()
+        mailbox.doorbell = doorbell
+        mailbox.subscription = nextSubscription
+        if mailbox.queuedCount > 0 {
+            doorbell.yield()
+        }
+        mailboxes[endpoint] = mailbox
+        return nextSubscription
+    }
+    
+    /// End a subscription to `endpoint`. Bundles it has not acknowledged go
+    /// back to the front of the mailbox; the endpoint stays registered and
+    /// keeps queueing.
+    public func unsubscribe(_ endpoint: EndpointID, subscription: Int) {
+        guard mailboxes[endpoint]?.subscription == subscription else { return }
+        mailboxes[endpoint]?.requeueInFlight()
+        mailboxes[endpoint]?.doorbell = nil
+        mailboxes[endpoint]?.subscription = nil
+    }
+    
+    /// Hand the subscriber of `endpoint` up to `limit` queued bundles, oldest
+    /// first. They count as in flight until acknowledged.
+    public func takeBundles(for endpoint: EndpointID, limit: Int) async -> [BP7.Bundle] {
+        guard limit > 0, let ids = mailboxes[endpoint]?.take(limit), !ids.isEmpty else {
+            return []
         }
         
-        // Check pattern matching
-        for (registeredEndpoint, _) in registeredEndpoints {
-            if matchesEndpoint(endpoint, pattern: registeredEndpoint) {
-                return true
+        var bundles: [BP7.Bundle] = []
+        bundles.reserveCapacity(ids.count)
+        for bundleId in ids {
+            if let bundle = await store.getBundle(bundleId: bundleId) {
+                bundles.append(bundle)
+            } else {
+                // Expired or removed while it waited
+                mailboxes[endpoint]?.acknowledge(bundleId)
             }
         }
-        
-        return false
+        return bundles
+    }
+    
+    /// Mark an in-flight bundle of `endpoint` as delivered; false if it was not in flight
+    @discardableResult
+    public func acknowledge(_ bundleId: String, for endpoint: EndpointID) -> Bool {
+        mailboxes[endpoint]?.acknowledge(bundleId) ?? false
+    }
+    
+    /// Bundles queued for `endpoint` and not yet handed out
+    public func pendingCount(for endpoint: EndpointID) -> Int {
+        mailboxes[endpoint]?.queuedCount ?? 0
+    }
+    
+    /// Remove and return the oldest queued bundle of `endpoint`, for polling clients
+    public func takePendingBundle(for endpoint: EndpointID) async -> BP7.Bundle? {
+        while let bundleId = mailboxes[endpoint]?.take(1).first {
+            mailboxes[endpoint]?.acknowledge(bundleId)
+            if let bundle = await store.getBundle(bundleId: bundleId) {
+                return bundle
+            }
+        }
+        return nil
     }
     
     /// Get pending bundles for an endpoint
-    public func getPendingBundles(for endpoint: EndpointID) -> [BP7.Bundle] {
-        pendingBundles[endpoint] ?? []
+    public func getPendingBundles(for endpoint: EndpointID) async -> [BP7.Bundle] {
+        var bundles: [BP7.Bundle] = []
+        for bundleId in mailboxes[endpoint]?.queuedIds ?? [] {
+            if let bundle = await store.getBundle(bundleId: bundleId) {
+                bundles.append(bundle)
+            }
+        }
+        return bundles
     }
     
     /// Clear pending bundles for an endpoint
     public func clearPendingBundles(for endpoint: EndpointID) {
-        pendingBundles.removeValue(forKey: endpoint)
+        _ = drainMailbox(of: endpoint)
     }
     
     // MARK: - Private Methods
     
     private func deliverToEndpoint(_ bundle: BP7.Bundle, to endpoint: EndpointID) async -> Bool {
-        let bundleId = BundlePack(from: bundle).id
+        let bundleId = BundlePack.id(of: bundle)
         
         // Try delegate delivery first
         if let delegate = delegates[endpoint] {
-            logger.info("Delivering bundle \(bundleId) to delegate for \(endpoint)")
+            logger.debug("Delivering bundle \(bundleId) to delegate for \(endpoint)")
             await delegate.bundleReceived(bundle)
             return true
         }
         
+        // A subscriber fetches the bundle from the store when it has room for it
+        if mailboxes[endpoint]?.doorbell != nil {
+            logger.debug("Queuing bundle \(bundleId) for the subscriber of \(endpoint)")
+            await queueBundle(bundle, for: endpoint)
+            return true
+        }
+        
         // Try channel delivery - use non-blocking approach to prevent HTTP handler blocking
         if let channel = deliveryChannels[endpoint] {
-            logger.info("Delivering bundle \(bundleId) to channel for \(endpoint)")
+            logger.debug("Delivering bundle \(bundleId) to channel for \(endpoint)")
             
             // Spawn a detached task for channel delivery to prevent blocking the HTTP response
             Task.detached {
@@ -176,48 +282,96 @@ public actor ApplicationAgent {
             return true
         }
         
+        // Registered, but nobody is reading it right now
+        await queueBundle(bundle, for: endpoint)
         return false
     }
     
-    private func queueBundle(_ bundle: BP7.Bundle, for endpoint: EndpointID) {
-        if pendingBundles[endpoint] == nil {
-            pendingBundles[endpoint] = []
+    private func queueBundle(_ bundle: BP7.Bundle, for endpoint: EndpointID) async {
+        let bundleId = BundlePack.id(of: bundle)
+        
+        // Bundles from the processor are stored already; others are stored here
+        if await !store.hasItem(bundleId: bundleId) {
+            do {
+                try await store.push(bundle: bundle)
+            } catch {
+                logger.error("Failed to store bundle \(bundleId) for \(endpoint): \(error)")
+                return
+            }
         }
-        pendingBundles[endpoint]!.append(bundle)
         
-        // Limit queue size
-        let maxQueueSize = 100
-        if pendingBundles[endpoint]!.count > maxQueueSize {
+        if mailboxes[endpoint, default: Mailbox()].append(bundleId, limit: maxQueuedBundles) {
             logger.warning("Bundle queue for \(endpoint) exceeded limit, dropping oldest bundle")
-            pendingBundles[endpoint]!.removeFirst()
         }
+        mailboxes[endpoint]?.doorbell?.yield()
     }
     
-    private func matchesEndpoint(_ endpoint: EndpointID, pattern: EndpointID) -> Bool {
-        // Simple pattern matching for group endpoints
-        // For example: dtn://global/~news matches dtn://global/~news/*
-        let endpointStr = endpoint.description
-        let patternStr = pattern.description
-        
-        // Check if pattern ends with /* for wildcard matching
-        if patternStr.hasSuffix("/*") {
-            let prefix = String(patternStr.dropLast(2))
-            return endpointStr.hasPrefix(prefix)
-        }
-        
-        // Check if pattern contains ~ for group endpoints
-        if patternStr.contains("/~") && endpointStr.contains("/~") {
-            let patternParts = patternStr.split(separator: "/")
-            let endpointParts = endpointStr.split(separator: "/")
-            
-            if patternParts.count >= 2 && endpointParts.count >= 2 {
-                // Match node and group parts
-                return patternParts[0] == endpointParts[0] && 
-                       patternParts[1] == endpointParts[1]
-            }
+    /// Empty the mailbox of `endpoint` for a consumer that takes everything at once
+    private func drainMailbox(of endpoint: EndpointID) -> [String] {
+        guard var mailbox = mailboxes[endpoint] else { return [] }
+        mailbox.requeueInFlight()
+        let ids = mailbox.queuedIds
+        mailboxes.removeValue(forKey: endpoint)
+        return ids
+    }
+}
+
+/// IDs of the bundles waiting for one endpoint, oldest first
+private struct Mailbox {
+    /// Queued IDs; the ones before `head` have been handed out
+    private var queued: [String] = []
+    private var head = 0
+    
+    /// Handed to the subscriber and not yet acknowledged, in the order they went out
+    private(set) var inFlight: [String] = []
+    
+    /// Signalled when bundles are queued while a subscriber is attached
+    var doorbell: AsyncStream<Void>.Continuation?
+    var subscription: Int?
+    
+    var queuedCount: Int { queued.count - head }
+    
+    var queuedIds: [String] { Array(queued[head...]) }
+    
+    /// Queue `bundleId`; returns whether the oldest ID was dropped to stay within `limit`
+    mutating func append(_ bundleId: String, limit: Int) -> Bool {
+        queued.append(bundleId)
+        guard queuedCount > limit else { return false }
+        head += 1
+        compact()
+        return true
+    }
+    
+    /// Move up to `count` queued IDs in flight
+    mutating func take(_ count: Int) -> [String] {
+        let end = min(queued.count, head + count)
+        let ids = Array(queued[head..<end])
+        head = end
+        inFlight.append(contentsOf: ids)
+        compact()
+        return ids
+    }
+    
+    mutating func acknowledge(_ bundleId: String) -> Bool {
+        guard let index = inFlight.firstIndex(of: bundleId) else { return false }
+        inFlight.remove(at: index)
+        return true
+    }
+    
+    /// Put the in-flight IDs back at the front, to be handed out again
+    mutating func requeueInFlight() {
+        guard !inFlight.isEmpty else { return }
+        queued = inFlight + queued[head...]
+        head = 0
+        inFlight.removeAll()
+    }
+    
+    /// Drop handed out IDs once they make up most of the array
+    private mutating func compact() {
+        if head >= 1024 && head * 2 >= queued.count {
+            queued.removeFirst(head)
+            head = 0
         }
-        
-        return endpoint == pattern
     }
 }
 
@@ -231,8 +385,7 @@ public struct BundleDeliveryInfo: Codable, Sendable {
     public let payloadLength: Int
     
     public init(from bundle: BP7.Bundle) {
-        let pack = BundlePack(from: bundle)
-        self.bundleId = pack.id
+        self.bundleId = BundlePack.id(of: bundle)
         self.source = bundle.primary.source.description
         self.destination = bundle.primary.destination.description
         self.creationTimestamp = bundle.primary.creationTimestamp.getDtnTime()
@@ -18,6 +18,9 @@ public protocol ApplicationInterface: Sendable {
     /// Send a bundle
     func sendBundle(from source: String, to destination: String, payload: Data, lifetime: TimeInterval, deliveryNotification: Bool) async throws
     
+    /// Send a bundle whose payload is the contents of a file, without reading the file into memory where the interface allows
+    func sendBundle(from source: String, to destination: String, payloadFile: URL, lifetime: TimeInterval, deliveryNotification: Bool) async throws
+    
     /// Receive bundles for registered endpoints
     var incomingBundles: AsyncChannel<ReceivedBundle> { get }
     
@@ -31,6 +34,14 @@ public protocol ApplicationInterface: Sendable {
     func disconnect() async
 }
 
+extension ApplicationInterface {
+    /// Default for interfaces that need the payload as `Data`: map the file rather than copy it in
+    public func sendBundle(from source: String, to destination: String, payloadFile: URL, lifetime: TimeInterval, deliveryNotification: Bool) async throws {
+        let payload = try Data(contentsOf: payloadFile, options: .mappedIfSafe)
+        try await sendBundle(from: source, to: destination, payload: payload, lifetime: lifetime, deliveryNotification: deliveryNotification)
+    }
+}
+
 /// Represents a bundle received by an application
 public struct ReceivedBundle: Sendable {
     public let bundleId: String
@@ -39,15 +50,17 @@ public struct ReceivedBundle: Sendable {
     public let creationTimestamp: Date
     public let lifetime: TimeInterval
     public let payload: Data
+    /// The whole bundle as the daemon sent it, in bundle mode
+    public let encoded: Data?
     
-    public init(from bundle: BP7.Bundle) {
-        let pack = BundlePack(from: bundle)
-        self.bundleId = pack.id
+    public init(from bundle: BP7.Bundle, encoded: Data? = nil) {
+        self.bundleId = BundlePack.id(of: bundle)
         self.source = bundle.primary.source.description
         self.destination = bundle.primary.destination.description
         self.creationTimestamp = Date(timeIntervalSince1970: Double(bundle.primary.creationTimestamp.getDtnTime()) / 1000.0)
         self.lifetime = bundle.primary.lifetime
         self.payload = bundle.payload().map { Data($0) } ?? Data()
+        self.encoded = encoded
     }
     
     public init(bundleId: String, source: String, destination: String, creationTimestamp: Date, lifetime: TimeInterval, payload: Data) {
@@ -57,6 +70,7 @@ public struct ReceivedBundle: Sendable {
         self.creationTimestamp = creationTimestamp
         self.lifetime = lifetime
         self.payload = payload
+        self.encoded = nil
     }
 }
 
@@ -77,6 +91,20 @@ public struct BundleSendRequest: Codable, Sendable {
     }
 }
 
+extension BundleSendRequest {
+    /// Content type of a `/send/batch` body
+    public static let batchContentType = "application/cbor"
+    
+    /// A `/send/batch` body: the requests as one CBOR array
+    public static func encodeBatch(_ requests: [BundleSendRequest]) throws -> [UInt8] {
+        try CBOREncoder().encode(requests)
+    }
+    
+    public static func decodeBatch(_ body: [UInt8]) throws -> [BundleSendRequest] {
+        try CBORDecoder().decode([BundleSendRequest].self, from: body)
+    }
+}
+
 /// Bundle receive data for WebSocket
 struct WsRecvData: Codable, Sendable {
     let bid: String
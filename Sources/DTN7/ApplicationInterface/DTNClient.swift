@@ -140,6 +140,27 @@ public class DTNClient: @unchecked Sendable {
         logger.debug("Sent bundle from \(sourceEndpoint) to \(destination), size: \(payload.count) bytes")
     }
     
+    /// Send the contents of a file as a bundle, streaming it where the interface allows
+    public func sendBundle(
+        to destination: String,
+        payloadFile: URL,
+        lifetime: TimeInterval = 3600,
+        deliveryNotification: Bool = false,
+        from source: String? = nil
+    ) async throws {
+        let sourceEndpoint = source ?? "\(nodeId)/\(applicationName)"
+        
+        try await interface.sendBundle(
+            from: sourceEndpoint,
+            to: destination,
+            payloadFile: payloadFile,
+            lifetime: lifetime,
+            deliveryNotification: deliveryNotification
+        )
+        
+        logger.debug("Sent bundle from \(sourceEndpoint) to \(destination), payload: \(payloadFile.path)")
+    }
+    
     /// Send a text message as a bundle
     public func sendText(
         to destination: String,
@@ -9,6 +9,9 @@ import AsyncAlgorithms
 import Logging
 
 /// HTTP-based implementation of the ApplicationInterface for simpler use cases
+///
+/// Bundles are fetched by polling `/endpoint`, so they arrive up to one polling
+/// interval late; `WebSocketApplicationInterface` has them pushed instead.
 public actor HTTPApplicationInterface: ApplicationInterface {
     private let logger = Logger(label: "HTTPApplicationInterface")
     
@@ -106,6 +109,26 @@ public actor HTTPApplicationInterface: ApplicationInterface {
     }
     
     public func sendBundle(from source: String, to destination: String, payload: Data, lifetime: TimeInterval, deliveryNotification: Bool) async throws {
+        var request = sendRequest(from: source, to: destination, lifetime: lifetime, deliveryNotification: deliveryNotification)
+        request.httpBody = payload
+        
+        try await performSend(from: source, to: destination) {
+            try await self.session.data(for: request).1
+        }
+    }
+    
+    /// Upload the payload file as the request body, streamed from disk by URLSession
+    public func sendBundle(from source: String, to destination: String, payloadFile: URL, lifetime: TimeInterval, deliveryNotification: Bool) async throws {
+        let request = sendRequest(from: source, to: destination, lifetime: lifetime, deliveryNotification: deliveryNotification)
+        
+        try await performSend(from: source, to: destination) {
+            try await self.session.upload(for: request, fromFile: payloadFile).1
+        }
+    }
+    
+    // MARK: - Private Methods
+    
+    private func sendRequest(from source: String, to destination: String, lifetime: TimeInterval, deliveryNotification: Bool) -> URLRequest {
         // Send bundle via HTTP POST
         let url = baseURL.appendingPathComponent("send")
             .appending(queryItems: [
@@ -117,11 +140,13 @@ public actor HTTPApplicationInterface: ApplicationInterface {
         
         var request = URLRequest(url: url)
         request.httpMethod = "POST"
-        request.httpBody = payload
         request.setValue("application/octet-stream", forHTTPHeaderField: "Content-Type")
+        return request
+    }
         
+    private func performSend(from source: String, to destination: String, _ perform: () async throws -> URLResponse) async throws {
         do {
-            let (_, response) = try await session.data(for: request)
+            let response = try await perform()
             
             if let httpResponse = response as? HTTPURLResponse {
                 if httpResponse.statusCode == 200 || httpResponse.statusCode == 201 {
@@ -136,16 +161,14 @@ public actor HTTPApplicationInterface: ApplicationInterface {
         }
     }
     
-    // MARK: - Private Methods
-    
     private func startPolling() {
         pollingTask?.cancel()
         
         pollingTask = Task {
             while !Task.isCancelled {
-                // Poll each registered endpoint
+                // Poll each registered endpoint until it has nothing left
                 for endpoint in registeredEndpoints {
-                    await pollEndpoint(endpoint)
+                    while !Task.isCancelled, await pollEndpoint(endpoint) {}
                 }
                 
                 // Wait before next poll
@@ -154,7 +177,8 @@ public actor HTTPApplicationInterface: ApplicationInterface {
         }
     }
     
-    private func pollEndpoint(_ endpoint: String) async {
+    /// Fetch one bundle for `endpoint`; returns whether there was one
+    private func pollEndpoint(_ endpoint: String) async -> Bool {
         let url = baseURL.appendingPathComponent("endpoint")
             .appending(queryItems: [URLQueryItem(name: "endpoint", value: endpoint)])
         
@@ -166,17 +190,21 @@ public actor HTTPApplicationInterface: ApplicationInterface {
                !data.isEmpty {
                 
                 // Check if it's a "Nothing to receive" response
-                if let text = String(data: data, encoding: .utf8),
-                   text == "Nothing to receive" {
-                    return
+                guard let text = String(data: data, encoding: .utf8),
+                      text != "Nothing to receive" else {
+                    return false
                 }
                 
-                // Try to decode as bundle
+                // The bundle comes as base64 encoded CBOR
                 do {
-                    let bundle = try BP7.Bundle.decode(from: Array(data))
+                    guard let encoded = Data(base64Encoded: text) else {
+                        throw ApplicationInterfaceError.protocolError(text)
+                    }
+                    let bundle = try BP7.Bundle.decode(from: Array(encoded))
                     let receivedBundle = ReceivedBundle(from: bundle)
                     await incomingBundles.send(receivedBundle)
                     logger.debug("Received bundle \(receivedBundle.bundleId) for endpoint \(endpoint)")
+                    return true
                 } catch {
                     logger.warning("Failed to decode bundle from endpoint poll: \(error)")
                 }
@@ -185,6 +213,7 @@ public actor HTTPApplicationInterface: ApplicationInterface {
             // Silently ignore polling errors to avoid log spam
             logger.trace("Polling error for \(endpoint): \(error)")
         }
+        return false
     }
 }
 
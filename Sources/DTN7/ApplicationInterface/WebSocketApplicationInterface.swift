@@ -13,6 +13,10 @@ import NIOPosix
 import Logging
 
 /// WebSocket-based implementation of the ApplicationInterface
+///
+/// The daemon pushes bundles for subscribed endpoints as they are delivered. With
+/// a window, each is acknowledged once `incomingBundles` has handed it on, and the
+/// daemon keeps at most `window` unacknowledged bundles out at a time.
 public actor WebSocketApplicationInterface: ApplicationInterface {
     private let logger = Logger(label: "WebSocketApplicationInterface")
     
@@ -20,6 +24,7 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
     private let host: String
     private let port: Int
     private let mode: TransmissionMode
+    private let window: Int
     
     // Connection state
     private var eventLoopGroup: EventLoopGroup?
@@ -33,15 +38,28 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
     // Incoming bundles channel
     public let incomingBundles = AsyncChannel<ReceivedBundle>()
     
+    // Fragments of a message split into continuation frames, and the opcode of its first frame
+    private var fragments: ByteBuffer?
+    private var fragmentOpcode: WebSocketOpcode = .binary
+    
+    /// Largest frame sent; longer messages go out as continuation frames
+    private let maxFrameSize = 64 * 1024
+    
+    /// Largest message reassembled from continuation frames
+    private let maxMessageSize = 1024 * 1024 * 1024
+    
     // Heartbeat
     private var heartbeatTask: Task<Void, Never>?
     private let heartbeatInterval: TimeInterval = 5.0
     private let heartbeatTimeout: TimeInterval = 30.0
     
-    public init(host: String = "localhost", port: Int = 3000, mode: TransmissionMode = .data) {
+    /// - Parameter window: Bundles the daemon may push before they are acknowledged;
+    ///   0 has it count them delivered once sent
+    public init(host: String = "localhost", port: Int = 3000, mode: TransmissionMode = .data, window: Int = 32) {
         self.host = host
         self.port = port
         self.mode = mode
+        self.window = window
     }
     
     deinit {
@@ -71,6 +89,7 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
                 
                 let websocketUpgrader = NIOWebSocketClientUpgrader(
                     requestKey: Self.generateWebSocketKey(),
+                    maxFrameSize: self.maxFrameSize,
                     upgradePipelineHandler: { @Sendable channel, _ in
                         // Create handler in closure to avoid actor isolation issues
                         let handler = WebSocketHandler(frameHandler: frameHandler)
@@ -102,6 +121,9 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
             
             // Send initial mode command
             try await sendTextMessage(mode.rawValue)
+            if window > 0 {
+                try await sendTextMessage("/window \(window)")
+            }
             
             // Start heartbeat
             startHeartbeat()
@@ -139,8 +161,9 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
             throw ApplicationInterfaceError.notConnected
         }
         
-        // Validate endpoint
-        guard let _ = try? EndpointID.from(endpoint) else {
+        // Validate endpoint; a name without a scheme is a service on the daemon's node
+        let valid = endpoint.contains(":") ? (try? EndpointID.from(endpoint)) != nil : !endpoint.isEmpty
+        guard valid else {
             throw ApplicationInterfaceError.invalidEndpoint(endpoint)
         }
         
@@ -211,16 +234,34 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
     
     private func handleWebSocketFrame(_ frame: WebSocketFrame) async {
         switch frame.opcode {
-        case .text:
-            var buffer = frame.unmaskedData
-            if let text = buffer.readString(length: buffer.readableBytes) {
-                await handleTextMessage(text)
+        case .text, .binary:
+            guard frame.fin else {
+                // First fragment of a longer message
+                fragments = frame.unmaskedData
+                fragmentOpcode = frame.opcode
+                return
+            }
+            await handleMessage(frame.unmaskedData, opcode: frame.opcode)
+        
+        case .continuation:
+            guard var buffer = fragments else {
+                logger.warning("Continuation frame without a message to continue")
+                return
+            }
+            var data = frame.unmaskedData
+            guard buffer.readableBytes + data.readableBytes <= maxMessageSize else {
+                logger.error("Fragmented message exceeds \(maxMessageSize) bytes, dropping it")
+                fragments = nil
+                return
             }
             
-        case .binary:
-            var buffer = frame.unmaskedData
-            if let data = buffer.readData(length: buffer.readableBytes) {
-                await handleBinaryMessage(data)
+            // Drop our reference first so the append does not copy the buffer
+            fragments = nil
+            buffer.writeBuffer(&data)
+            if frame.fin {
+                await handleMessage(buffer, opcode: fragmentOpcode)
+            } else {
+                fragments = buffer
             }
             
         case .pong:
@@ -230,7 +271,7 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
             // Respond with pong
             if webSocketHandler != nil {
                 let buffer = channel!.allocator.buffer(capacity: 0)
-                let pongFrame = WebSocketFrame(fin: true, opcode: .pong, data: buffer)
+                let pongFrame = WebSocketFrame(fin: true, opcode: .pong, maskKey: .random(), data: buffer)
                 channel?.writeAndFlush(pongFrame, promise: nil)
             }
             
@@ -243,6 +284,17 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
         }
     }
     
+    private func handleMessage(_ buffer: ByteBuffer, opcode: WebSocketOpcode) async {
+        var buffer = buffer
+        if opcode == .text {
+            if let text = buffer.readString(length: buffer.readableBytes) {
+                await handleTextMessage(text)
+            }
+        } else if let data = buffer.readData(length: buffer.readableBytes) {
+            await handleBinaryMessage(data)
+        }
+    }
+    
     private func handleTextMessage(_ text: String) async {
         logger.debug("Received text message: \(text)")
         
@@ -273,7 +325,7 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
                     payload: recvData.data
                 )
                 
-                await incomingBundles.send(bundle)
+                await deliver(bundle)
                 
             case .json:
                 // Decode JSON
@@ -295,18 +347,27 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
                         payload: payload
                     )
                     
-                    await incomingBundles.send(bundle)
+                    await deliver(bundle)
                 }
                 
             case .bundle:
-                // Decode raw bundle
-                throw ApplicationInterfaceError.protocolError("Bundle mode not yet implemented")
+                // Raw CBOR bundle
+                let bundle = try BP7.Bundle.decode(from: Array(data))
+                await deliver(ReceivedBundle(from: bundle, encoded: data))
             }
         } catch {
             logger.error("Failed to decode incoming bundle: \(error)")
         }
     }
     
+    /// Hand a bundle to the application, then free its slot in the window
+    private func deliver(_ bundle: ReceivedBundle) async {
+        await incomingBundles.send(bundle)
+        if window > 0 {
+            try? await sendTextMessage("/ack \(bundle.bundleId)")
+        }
+    }
+    
     private func sendTextMessage(_ text: String) async throws {
         guard webSocketHandler != nil else {
             throw ApplicationInterfaceError.notConnected
@@ -315,20 +376,33 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
         var buffer = channel!.allocator.buffer(capacity: text.count)
         buffer.writeString(text)
         
-        let frame = WebSocketFrame(fin: true, opcode: .text, data: buffer)
+        let frame = WebSocketFrame(fin: true, opcode: .text, maskKey: .random(), data: buffer)
         try await channel!.writeAndFlush(frame).get()
     }
     
+    /// Send a binary message, split into continuation frames of at most `maxFrameSize`
+    /// bytes so no frame buffer as large as the payload is allocated
     private func sendBinaryMessage(_ data: Data) async throws {
-        guard webSocketHandler != nil else {
+        guard webSocketHandler != nil, let channel = channel else {
             throw ApplicationInterfaceError.notConnected
         }
         
-        var buffer = channel!.allocator.buffer(capacity: data.count)
-        buffer.writeBytes(data)
+        var offset = data.startIndex
+        repeat {
+            let end = data.index(offset, offsetBy: maxFrameSize, limitedBy: data.endIndex) ?? data.endIndex
+            var buffer = channel.allocator.buffer(capacity: end - offset)
+            buffer.writeBytes(data[offset..<end])
         
-        let frame = WebSocketFrame(fin: true, opcode: .binary, data: buffer)
-        try await channel!.writeAndFlush(frame).get()
+            let frame = WebSocketFrame(
+                fin: end == data.endIndex,
+                opcode: offset == data.startIndex ? .binary : .continuation,
+                maskKey: .random(),
+                data: buffer
+            )
+            // Waiting for each write keeps at most one frame queued in the channel
+            try await channel.writeAndFlush(frame).get()
+            offset = end
+        } while offset < data.endIndex
     }
     
     private func startHeartbeat() {
@@ -340,7 +414,7 @@ public actor WebSocketApplicationInterface: ApplicationInterface {
                     // Send ping
                     if let channel = channel {
                         let buffer = channel.allocator.buffer(capacity: 0)
-                        let pingFrame = WebSocketFrame(fin: true, opcode: .ping, data: buffer)
+                        let pingFrame = WebSocketFrame(fin: true, opcode: .ping, maskKey: .random(), data: buffer)
                         channel.writeAndFlush(pingFrame, promise: nil)
                     }
                     
@@ -0,0 +1,40 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import BP7
+
+/// A bundle together with its ID and wire encoding, computed once when the bundle
+/// enters the node and handed along the pipeline, so later stages (store, routing,
+/// CLAs, logging) neither re-encode the bundle nor rebuild its ID string or key.
+public struct BundleContext: Sendable {
+    public let bundle: BP7.Bundle
+    public let id: String
+    /// Hashed identity used for duplicate detection and shard selection
+    public let key: BundleKey
+    public let encoded: [UInt8]
+    /// When the bundle entered the node, for latency metrics
+    public let receivedAt: ContinuousClock.Instant
+    /// When the bundle was written to the store, once it has been
+    public var storedAt: ContinuousClock.Instant?
+    /// Set when the bundle was sampled for tracing
+    public var trace: BundleTrace?
+    
+    /// Size of the encoded bundle in bytes
+    public var size: UInt64 { UInt64(encoded.count) }
+    
+    /// Store metadata for the bundle, built without encoding it again
+    public var pack: BundlePack {
+        BundlePack(from: bundle, id: id, size: size)
+    }
+    
+    /// Create a context, encoding the bundle unless its encoding is already at hand
+    public init(bundle: BP7.Bundle, encoded: [UInt8]? = nil) {
+        self.bundle = bundle
+        self.id = BundlePack.id(of: bundle)
+        self.key = BundleKey(bundle: bundle)
+        self.encoded = encoded ?? bundle.encode()
+        self.receivedAt = .now
+    }
+}
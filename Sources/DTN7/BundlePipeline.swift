@@ -0,0 +1,146 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import BP7
+import Logging
+import AsyncAlgorithms
+
+/// Spreads bundle processing over independent `BundleProcessor` shards.
+///
+/// A bundle always lands on the shard picked by its `BundleKey`, so duplicate
+/// detection and constraint tracking stay consistent per bundle while bundles
+/// with different keys are processed in parallel. Received bundles pass through a
+/// bounded queue per shard; when it is full the CLA handing them in waits, which
+/// pushes back on the sender instead of growing memory.
+public final class BundlePipeline: Sendable {
+    /// Received bundles a shard holds before senders have to wait
+    public static let defaultQueueDepth = 64
+    
+    public let shards: [BundleProcessor]
+    private let queues: [AsyncChannel<BundleContext>]
+    private let workers: [Task<Void, Never>]
+    
+    /// Create one shard per active processor when `parallelBundleProcessing` is set, a single one otherwise
+    public convenience init(config: DtnConfig, metrics: DtnMetrics = DtnMetrics(), queueDepth: Int = BundlePipeline.defaultQueueDepth) {
+        let shardCount = config.parallelBundleProcessing ? ProcessInfo.processInfo.activeProcessorCount : 1
+        self.init(config: config, metrics: metrics, shardCount: shardCount, queueDepth: queueDepth)
+    }
+    
+    public init(config: DtnConfig, metrics: DtnMetrics = DtnMetrics(), shardCount: Int, queueDepth: Int = BundlePipeline.defaultQueueDepth) {
+        let shardCount = max(1, shardCount)
+        let shards = (0..<shardCount).map { BundleProcessor(config: config, metrics: metrics, shard: $0, of: shardCount) }
+        let queues = shards.map { _ in AsyncChannel<BundleContext>() }
+        let depth = max(1, queueDepth)
+        
+        self.shards = shards
+        self.queues = queues
+        self.workers = zip(shards, queues).map { shard, queue in
+            Task {
+                for await context in queue.buffer(policy: .bounded(depth)) {
+                    await shard.process(context)
+                }
+            }
+        }
+        
+        Logger(label: "BundlePipeline").info("Processing bundles on \(shardCount) shard(s)")
+    }
+    
+    /// The shard responsible for a bundle
+    public func shard(for key: BundleKey) -> BundleProcessor {
+        shards[shardIndex(for: key)]
+    }
+    
+    /// The shard responsible for a bundle ID as built by `BundlePack.id(of:)`
+    public func shard(forBundleId bundleId: String) -> BundleProcessor {
+        shard(for: BundleKey(id: bundleId))
+    }
+    
+    /// Queue a received bundle on its shard, waiting while that shard's queue is full
+    public func receive(_ context: BundleContext) async {
+        await queues[shardIndex(for: context.key)].send(context)
+    }
+    
+    /// Transmit a locally submitted bundle on its shard, reporting errors to the caller
+    public func transmit(_ context: BundleContext) async throws {
+        try await shard(for: context.key).transmit(context)
+    }
+    
+    /// Transmit several bundles, each shard taking its share in order while the
+    /// shards run in parallel. Returns the bundles that failed and why.
+    public func transmit(_ contexts: [BundleContext]) async -> [(id: String, error: any Error)] {
+        var contextsByShard = [[BundleContext]](repeating: [], count: shards.count)
+        for context in contexts {
+            contextsByShard[shardIndex(for: context.key)].append(context)
+        }
+        
+        return await withTaskGroup(of: [(id: String, error: any Error)].self) { group in
+            for (shard, contexts) in zip(shards, contextsByShard) where !contexts.isEmpty {
+                group.addTask {
+                    var failures: [(id: String, error: any Error)] = []
+                    for context in contexts {
+                        do {
+                            try await shard.transmit(context)
+                        } catch {
+                            failures.append((context.id, error))
+                        }
+                    }
+                    return failures
+                }
+            }
+            
+            var failures: [(id: String, error: any Error)] = []
+            for await shardFailures in group {
+                failures.append(contentsOf: shardFailures)
+            }
+            return failures
+        }
+    }
+    
+    /// Set the DtnCore reference on every shard
+    public func setCore(_ core: DtnCore) async {
+        for shard in shards {
+            await shard.setCore(core)
+        }
+    }
+    
+    public func loadDuplicateState() async {
+        for shard in shards {
+            await shard.loadDuplicateState()
+        }
+    }
+    
+    /// Record stored bundles as seen on their shards
+    public func markSeen(_ keys: [BundleKey]) async {
+        var keysByShard = [[BundleKey]](repeating: [], count: shards.count)
+        for key in keys {
+            keysByShard[shardIndex(for: key)].append(key)
+        }
+        for (shard, keys) in zip(shards, keysByShard) where !keys.isEmpty {
+            await shard.markSeen(keys)
+        }
+    }
+    
+    /// Snapshot every shard's duplicate filter while processing goes on
+    public func saveDuplicateState() async {
+        for shard in shards {
+            await shard.saveDuplicateState()
+        }
+    }
+    
+    /// Stop taking bundles, let the shards drain their queues and save their duplicate filters
+    public func stop() async {
+        for queue in queues {
+            queue.finish()
+        }
+        for worker in workers {
+            await worker.value
+        }
+        await saveDuplicateState()
+    }
+    
+    private func shardIndex(for key: BundleKey) -> Int {
+        Int(key.high % UInt64(shards.count))
+    }
+}
@@ -18,55 +18,108 @@ public enum BundleProcessorError: Error, Sendable {
     case noLocalEndpoint
 }
 
-/// An actor responsible for processing bundles with complete pipeline support
+/// An actor responsible for processing bundles with complete pipeline support.
+///
+/// One processor handles one shard of a `BundlePipeline`: the bundles whose keys
+/// map to it, with its own duplicate filter and constraints.
 public actor BundleProcessor {
     private let config: DtnConfig
     private var logger: Logger
     private var core: DtnCore?
     
-    // Duplicate detection
-    private var seenBundles: Set<String> = []
-    private let maxSeenBundles = 10000
+    // Duplicate detection, persisted next to the bundle store unless that lives in memory
+    private var seenBundles: DuplicateFilter
+    private let seenBundlesPath: String?
     
     // Bundle state tracking
     private var bundleConstraints: [String: Constraints] = [:]
 
-    public init(config: DtnConfig) {
+    // Node-wide counters and latencies, shared with the other shards
+    private let metrics: DtnMetrics
+    
+    /// Create the processor for `shard` out of `shardCount`, sizing its duplicate filter for its share of bundles
+    public init(config: DtnConfig, metrics: DtnMetrics = DtnMetrics(), shard: Int = 0, of shardCount: Int = 1) {
         self.config = config
-        self.logger = Logger(label: "BundleProcessor")
+        self.metrics = metrics
+        self.logger = Logger(label: shardCount == 1 ? "BundleProcessor" : "BundleProcessor[\(shard)]")
+        self.seenBundles = DuplicateFilter(configuration: DuplicateFilter.Configuration(settings: config.dedupSettings).split(into: shardCount))
+        if config.db == "mem" {
+            self.seenBundlesPath = nil
+        } else if shardCount == 1 {
+            self.seenBundlesPath = "\(config.workdir)/dedup.state"
+        } else {
+            // The shard count is part of the name since keys map to other shards when it changes
+            self.seenBundlesPath = "\(config.workdir)/dedup.\(shard)-of-\(shardCount).state"
+        }
     }
     
     /// Set the DtnCore reference
     public func setCore(_ core: DtnCore) {
         self.core = core
     }
+    
+    /// Load the duplicate filter saved by `saveDuplicateState()`, if there is one
+    public func loadDuplicateState() {
+        guard let path = seenBundlesPath,
+              let data = try? Data(contentsOf: URL(fileURLWithPath: path)) else {
+            return
+        }
+        
+        if let restored = DuplicateFilter(serialized: data, configuration: seenBundles.configuration) {
+            seenBundles = restored
+            logger.info("Restored duplicate filter with \(restored.count) bundles")
+        } else {
+            logger.warning("Ignoring unreadable duplicate filter state at \(path)")
+        }
+    }
+    
+    /// Record stored bundles as seen without processing them, e.g. those a restart found in the store
+    public func markSeen(_ keys: [BundleKey]) {
+        for key in keys {
+            seenBundles.insert(key)
+        }
+    }
+    
+    /// Save the duplicate filter so bundles seen before a restart are still recognized
+    public func saveDuplicateState() {
+        guard let path = seenBundlesPath else { return }
+        
+        do {
+            try seenBundles.serialized().write(to: URL(fileURLWithPath: path), options: .atomic)
+        } catch {
+            logger.error("Failed to save duplicate filter state: \(error)")
+        }
+    }
 
     /// Handles a new incoming bundle.
     public func receive(bundle: BP7.Bundle) async throws {
-        let bundlePack = BundlePack(from: bundle)
-        let bundleId = bundlePack.id
-        logger.info("Received new bundle: \(bundleId)")
+        try await receive(BundleContext(bundle: bundle))
+    }
+    
+    /// Handles a new incoming bundle whose ID and encoding were computed on ingest.
+    public func receive(_ context: BundleContext) async throws {
+        var context = context
+        let bundle = context.bundle
+        let bundleId = context.id
+        logger.debug("Received new bundle: \(bundleId)")
         
         guard let core = core else {
             throw BundleProcessorError.noCoreReference
         }
         
+        context.trace?.record(.queue, from: context.receivedAt)
+        defer { context.trace?.finish() }
+        
         // 1. Check for duplicates
-        if seenBundles.contains(bundleId) {
+        let dedupSpan = context.trace?.begin(.dedup)
+        let duplicate = seenBundles.insert(context.key)
+        dedupSpan?.end(attributes: ["duplicate": "\(duplicate)"])
+        if duplicate {
             logger.debug("Duplicate bundle detected: \(bundleId)")
-            await core.updateStatistics { stats in
-                stats.recordDuplicate()
-            }
+            metrics.duplicates.add()
             throw BundleProcessorError.duplicateBundle
         }
         
-        // Add to seen bundles (with size limit)
-        seenBundles.insert(bundleId)
-        if seenBundles.count > maxSeenBundles {
-            // Remove oldest entries (simplified - in production use LRU cache)
-            seenBundles.removeFirst()
-        }
-        
         // 2. Check bundle expiration
         if isBundleExpired(bundle) {
             logger.warning("Received expired bundle: \(bundleId)")
@@ -84,10 +137,13 @@ public actor BundleProcessor {
         }
         
         // 3. Store bundle
-        try await core.store.push(bundle: bundle)
-        await core.updateStatistics { stats in
-            stats.recordIncoming()
-        }
+        let storeSpan = context.trace?.begin(.store)
+        try await core.store.push(context)
+        storeSpan?.end()
+        core.journal.append(context.id)
+        metrics.incoming.add()
+        metrics.ingestToStore.record(since: context.receivedAt)
+        context.storedAt = .now
         
         // 4. Initialize constraints
         var constraints = Constraints()
@@ -154,21 +210,41 @@ public actor BundleProcessor {
         bundleConstraints[bundleId] = constraints
         
         // 9. Dispatch the bundle
-        try await dispatch(bundle: bundle, bundleId: bundleId)
+        try await dispatch(context)
+    }
+    
+    /// Handles a bundle taken off this shard's receive queue, where no caller is left to report errors to.
+    func process(_ context: BundleContext) async {
+        do {
+            try await receive(context)
+        } catch BundleProcessorError.duplicateBundle {
+            // Already counted as a duplicate
+        } catch {
+            logger.error("Failed to process bundle \(context.id): \(error)")
+            metrics.failed.add()
+        }
     }
     
     /// Starts the transmission of an outbound bundle.
     public func transmit(bundle: BP7.Bundle) async throws {
-        let bundlePack = BundlePack(from: bundle)
-        let bundleId = bundlePack.id
-        logger.info("Transmission of bundle requested: \(bundleId)")
+        try await transmit(BundleContext(bundle: bundle))
+    }
+    
+    /// Starts the transmission of an outbound bundle whose ID and encoding are already computed.
+    public func transmit(_ context: BundleContext) async throws {
+        var context = context
+        let bundle = context.bundle
+        let bundleId = context.id
+        logger.debug("Transmission of bundle requested: \(bundleId)")
         
         guard let core = core else {
             throw BundleProcessorError.noCoreReference
         }
         
+        defer { context.trace?.finish(attributes: ["local": "true"]) }
+        
         // 1. Validate source
-        if await !core.isLocalEndpoint(bundle.primary.source) {
+        if !core.isLocalEndpoint(bundle.primary.source) {
             logger.error("Bundle source is not a local endpoint: \(bundle.primary.source)")
             throw BundleProcessorError.invalidSource
         }
@@ -180,7 +256,12 @@ public actor BundleProcessor {
         }
         
         // 3. Store bundle
-        try await core.store.push(bundle: bundle)
+        let storeSpan = context.trace?.begin(.store)
+        try await core.store.push(context)
+        storeSpan?.end()
+        core.journal.append(context.id)
+        metrics.ingestToStore.record(since: context.receivedAt)
+        context.storedAt = .now
         
         // 4. Initialize constraints with dispatch pending
         var constraints = Constraints()
@@ -188,12 +269,14 @@ public actor BundleProcessor {
         bundleConstraints[bundleId] = constraints
         
         // 5. Dispatch the bundle
-        try await dispatch(bundle: bundle, bundleId: bundleId)
+        try await dispatch(context)
     }
 
     /// Dispatches a bundle to local delivery or forwarding.
-    private func dispatch(bundle: BP7.Bundle, bundleId: String) async throws {
-        logger.info("Dispatching bundle: \(bundleId)")
+    private func dispatch(_ context: BundleContext) async throws {
+        let bundle = context.bundle
+        let bundleId = context.id
+        logger.debug("Dispatching bundle: \(bundleId)")
         
         guard let core = core else {
             throw BundleProcessorError.noCoreReference
@@ -206,10 +289,19 @@ public actor BundleProcessor {
         }
         
         // Get routing decision
+        let routeSpan = context.trace?.begin(.route)
         let decision = await core.getRoutingDecision(for: bundle)
+        routeSpan?.end(attributes: ["next_hops": "\(decision.nextHops.count)", "local": "\(decision.isLocalDelivery)"])
+        
+        if !decision.isLocalDelivery {
+            // Queue for forwarding; the Janitor retries it when new peers become reachable
+            await persistForwardPending(bundleId: bundleId)
+        }
         
         if decision.isLocalDelivery {
+            let deliverSpan = context.trace?.begin(.deliver)
             try await localDelivery(bundle: bundle, bundleId: bundleId)
+            deliverSpan?.end()
         } else if !decision.nextHops.isEmpty {
             // Set forward pending constraint
             if var constraints = bundleConstraints[bundleId] {
@@ -217,7 +309,7 @@ public actor BundleProcessor {
                 bundleConstraints[bundleId] = constraints
             }
             
-            try await forward(bundle: bundle, bundleId: bundleId, to: decision.nextHops)
+            try await forward(context, to: decision.nextHops)
         } else {
             logger.warning("No route found for bundle: \(bundleId)")
             
@@ -231,15 +323,31 @@ public actor BundleProcessor {
                 )
             }
             
-            await core.updateStatistics { stats in
-                stats.recordFailed()
-            }
+            metrics.failed.add()
+        }
+    }
+    
+    /// Mark a stored bundle as part of the persistent forwarding queue
+    private func persistForwardPending(bundleId: String) async {
+        guard let core = core,
+              var bundlePack = await core.store.getMetadata(bundleId: bundleId),
+              !bundlePack.constraints.contains(.forwardPending) else {
+            return
+        }
+        
+        bundlePack.constraints.insert(.forwardPending)
+        do {
+            try await core.store.updateMetadata(bundlePack: bundlePack)
+        } catch {
+            logger.warning("Failed to queue bundle \(bundleId) for forwarding: \(error)")
         }
     }
     
     /// Forwards a bundle to the next hop.
-    private func forward(bundle: BP7.Bundle, bundleId: String, to peers: [DtnPeer]) async throws {
-        logger.info("Forwarding bundle: \(bundleId) to \(peers.count) peers")
+    private func forward(_ context: BundleContext, to peers: [DtnPeer]) async throws {
+        let bundle = context.bundle
+        let bundleId = context.id
+        logger.debug("Forwarding bundle: \(bundleId) to \(peers.count) peers")
         
         guard let core = core else {
             throw BundleProcessorError.noCoreReference
@@ -268,7 +376,10 @@ public actor BundleProcessor {
         }
         
         // Send to peers
-        await core.sendBundle(bundle, to: peers)
+        if let storedAt = context.storedAt {
+            metrics.storeToForward.record(since: storedAt)
+        }
+        await core.sendBundle(context, to: peers)
         
         // Remove forward pending constraint
         if var constraints = bundleConstraints[bundleId] {
@@ -284,22 +395,18 @@ public actor BundleProcessor {
                 reason: .noInformation
             )
         }
-        
-        await core.updateStatistics { stats in
-            stats.recordOutgoing()
-        }
     }
     
     /// Delivers a bundle to a local application.
     private func localDelivery(bundle: BP7.Bundle, bundleId: String) async throws {
-        logger.info("Delivering bundle locally: \(bundleId)")
+        logger.debug("Delivering bundle locally: \(bundleId)")
         
         guard let core = core else {
             throw BundleProcessorError.noCoreReference
         }
         
         // Check if destination is actually local
-        if await !core.isLocalEndpoint(bundle.primary.destination) {
+        if !core.isLocalEndpoint(bundle.primary.destination) {
             logger.error("Attempted local delivery for non-local endpoint: \(bundle.primary.destination)")
             throw BundleProcessorError.noLocalEndpoint
         }
@@ -308,14 +415,12 @@ public actor BundleProcessor {
         let delivered = await core.applicationAgent.deliverBundle(bundle)
         
         if delivered {
-            logger.info("Bundle \(bundleId) delivered to application agent for \(bundle.primary.destination)")
+            logger.debug("Bundle \(bundleId) delivered to application agent for \(bundle.primary.destination)")
         } else {
             logger.warning("Bundle \(bundleId) could not be delivered - no registered application for \(bundle.primary.destination)")
         }
         
-        await core.updateStatistics { stats in
-            stats.recordDelivered()
-        }
+        metrics.delivered.add()
         
         // Send delivery status report if requested
         if shouldSendStatusReport(bundle, for: .bundleStatusRequestDelivery) {
@@ -401,7 +506,7 @@ public actor BundleProcessor {
             reason: reason
         )
         
-        logger.debug("Sending status report for bundle \(BundlePack(from: bundle).id): \(status)")
+        logger.debug("Sending status report for bundle \(BundlePack.id(of: bundle)): \(status)")
         
         // Transmit the status report
         try await transmit(bundle: reportBundle)
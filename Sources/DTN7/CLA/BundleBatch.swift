@@ -0,0 +1,45 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+
+/// Several encoded bundles in one HTTP body, each preceded by its length as a
+/// 32-bit big-endian integer. Used by `/push/batch` and `/download/batch`.
+public enum BundleBatch {
+    public static let contentType = "application/x-dtn7-bundle-batch"
+    
+    /// Response header of `/download/batch`: how many of the requested IDs it covers.
+    /// A response that reached its size cap covers a prefix; the rest is asked for again.
+    public static let servedHeader = "DTN-Batch-Served"
+    
+    public static func encode(_ bundles: [[UInt8]]) -> [UInt8] {
+        var body: [UInt8] = []
+        body.reserveCapacity(bundles.reduce(0) { $0 + 4 + $1.count })
+        for bundle in bundles {
+            let length = UInt32(bundle.count)
+            body.append(contentsOf: [UInt8(length >> 24), UInt8((length >> 16) & 0xff), UInt8((length >> 8) & 0xff), UInt8(length & 0xff)])
+            body.append(contentsOf: bundle)
+        }
+        return body
+    }
+    
+    /// Split a body into its bundles, failing on a truncated frame
+    public static func decode(_ body: [UInt8]) throws -> [[UInt8]] {
+        var bundles: [[UInt8]] = []
+        var offset = 0
+        while offset < body.count {
+            guard body.count - offset >= 4 else {
+                throw CLAError.invalidProtocol("Truncated bundle batch header")
+            }
+            let length = body[offset..<offset + 4].reduce(0) { $0 << 8 | Int($1) }
+            offset += 4
+            guard body.count - offset >= length else {
+                throw CLAError.invalidProtocol("Truncated bundle in batch")
+            }
+            bundles.append(Array(body[offset..<offset + length]))
+            offset += length
+        }
+        return bundles
+    }
+}
@@ -23,6 +23,12 @@ public protocol ConvergenceLayerAgent: Sendable {
     /// Send a bundle through this CLA to a specific peer
     func sendBundle(_ bundle: BP7.Bundle, to peer: DtnPeer) async throws
     
+    /// Send a bundle that is already in its wire encoding, e.g. as read from the store
+    func sendBundle(encoded bundleData: [UInt8], bundleId: String, to peer: DtnPeer) async throws
+    
+    /// Send several encoded bundles to the same peer, batched on the wire where the CLA can
+    func sendBundles(_ bundles: [EncodedBundle], to peer: DtnPeer) async throws
+    
     /// Channel for receiving bundles from this CLA
     var incomingBundles: AsyncChannel<(BP7.Bundle, CLAConnection)> { get }
     
@@ -33,6 +39,35 @@ public protocol ConvergenceLayerAgent: Sendable {
     func getConnections() async -> [CLAConnection]
 }
 
+extension ConvergenceLayerAgent {
+    /// Default for CLAs that only send decoded bundles
+    public func sendBundle(encoded bundleData: [UInt8], bundleId: String, to peer: DtnPeer) async throws {
+        let bundle = try BP7.Bundle.decode(from: bundleData)
+        try await sendBundle(bundle, to: peer)
+    }
+    
+    /// Default for CLAs without a batched send: one bundle after the other
+    public func sendBundles(_ bundles: [EncodedBundle], to peer: DtnPeer) async throws {
+        for bundle in bundles {
+            try await sendBundle(encoded: bundle.data, bundleId: bundle.id, to: peer)
+        }
+    }
+}
+
+/// A bundle in its wire encoding, ready to be handed to a CLA
+public struct EncodedBundle: Sendable {
+    public let id: String
+    public let data: [UInt8]
+    /// Set when the bundle was sampled for tracing, to time its send
+    public let trace: BundleTrace?
+    
+    public init(id: String, data: [UInt8], trace: BundleTrace? = nil) {
+        self.id = id
+        self.data = data
+        self.trace = trace
+    }
+}
+
 /// Represents a connection through a CLA
 public struct CLAConnection: Sendable, Equatable {
     public let id: String
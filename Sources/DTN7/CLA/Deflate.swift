@@ -0,0 +1,41 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import CSQLite
+
+/// zlib (RFC 1950) compression of bundles on the wire, the codec the store
+/// also uses for payloads at rest
+enum Deflate {
+    /// HTTP `Content-Encoding` of a deflated body
+    static let contentEncoding = "deflate"
+    
+    /// The compressed bytes, or nil if they would not be smaller
+    static func compress(_ bytes: [UInt8], level: Int32 = -1) -> [UInt8]? {
+        bytes.withUnsafeBufferPointer { buffer in
+            var output: UnsafeMutablePointer<UInt8>?
+            var count = 0
+            guard csqlite_deflate(buffer.baseAddress, buffer.count, level, &output, &count) == CSQLITE_OK,
+                  let compressed = output else {
+                return nil
+            }
+            defer { csqlite_free_data(compressed) }
+            return count < bytes.count ? Array(UnsafeBufferPointer(start: compressed, count: count)) : nil
+        }
+    }
+    
+    /// The original bytes, or nil for corrupt input or more than `maxSize` bytes of output
+    static func decompress(_ bytes: [UInt8], maxSize: Int) -> [UInt8]? {
+        bytes.withUnsafeBufferPointer { buffer in
+            var output: UnsafeMutablePointer<UInt8>?
+            var count = 0
+            guard csqlite_inflate(buffer.baseAddress, buffer.count, max(0, maxSize), &output, &count) == CSQLITE_OK,
+                  let inflated = output else {
+                return nil
+            }
+            defer { csqlite_free_data(inflated) }
+            return Array(UnsafeBufferPointer(start: inflated, count: count))
+        }
+    }
+}
@@ -20,18 +20,30 @@ public actor HTTPCLA: ConvergenceLayerAgent {
     private let logger = Logger(label: "HTTPCLA")
     private var isRunning = false
     private let session: URLSession
+    // Peers answering 404 on /push/batch get one request per bundle
+    private var singlePushPeers: Set<EndpointID> = []
+    // Peers that turned a deflated body down get uncompressed ones
+    private var plainPushPeers: Set<EndpointID> = []
     
     /// Configuration for HTTP CLA
     public struct HTTPCLAConfig: Sendable {
         public let timeout: TimeInterval
         public let maxRetries: Int
+        /// Keep-alive connections held open per peer and reused across requests
+        public let maxConnectionsPerPeer: Int
+        /// Push bodies of at least this many bytes are sent deflated; 0 never compresses
+        public let compressMinSize: Int
         
         public init(
             timeout: TimeInterval = 5.0,
-            maxRetries: Int = 3
+            maxRetries: Int = 3,
+            maxConnectionsPerPeer: Int = 4,
+            compressMinSize: Int = 0
         ) {
             self.timeout = timeout
             self.maxRetries = maxRetries
+            self.maxConnectionsPerPeer = maxConnectionsPerPeer
+            self.compressMinSize = max(0, compressMinSize)
         }
     }
     
@@ -39,9 +51,12 @@ public actor HTTPCLA: ConvergenceLayerAgent {
         self.id = "http"
         self.config = config
         
+        // One session for all peers keeps connections alive per host; URLSession
+        // negotiates HTTP/2 where the peer offers it
         let sessionConfig = URLSessionConfiguration.default
         sessionConfig.timeoutIntervalForRequest = config.timeout
         sessionConfig.timeoutIntervalForResource = config.timeout * 2
+        sessionConfig.httpMaximumConnectionsPerHost = max(1, config.maxConnectionsPerPeer)
         self.session = URLSession(configuration: sessionConfig)
     }
     
@@ -59,33 +74,40 @@ public actor HTTPCLA: ConvergenceLayerAgent {
     }
     
     public func sendBundle(_ bundle: BP7.Bundle, to peer: DtnPeer) async throws {
+        try await sendBundle(encoded: bundle.encode(), bundleId: BundlePack.id(of: bundle), to: peer)
+    }
+    
+    public func sendBundle(encoded bundleData: [UInt8], bundleId: String, to peer: DtnPeer) async throws {
         guard let url = buildPeerURL(for: peer) else {
             throw CLAError.invalidPeerAddress
         }
         
-        let bundleData = bundle.encode()
-        let bundleId = BundlePack(from: bundle).id
-        
-        var lastError: Error?
+        try await push(bundleData, to: url, peer: peer, what: "bundle \(bundleId)")
+        logger.debug("Sent bundle \(bundleId) via HTTP to \(url)")
+    }
         
-        for attempt in 1...config.maxRetries {
-            do {
-                try await sendBundleHTTP(bundleData: Data(bundleData), to: url)
-                logger.debug("Sent bundle \(bundleId) via HTTP to \(url) (attempt \(attempt))")
-                return
-            } catch {
-                lastError = error
-                logger.warning("Failed to send bundle via HTTP (attempt \(attempt)/\(config.maxRetries)): \(error)")
-                
-                if attempt < config.maxRetries {
-                    // Exponential backoff
-                    let delay = TimeInterval(attempt) * 0.5
-                    try await Task.sleep(nanoseconds: UInt64(delay * 1_000_000_000))
-                }
+    /// Push several bundles in one `/push/batch` request, or one request each to peers without it
+    public func sendBundles(_ bundles: [EncodedBundle], to peer: DtnPeer) async throws {
+        guard bundles.count > 1, !singlePushPeers.contains(peer.eid) else {
+            for bundle in bundles {
+                try await sendBundle(encoded: bundle.data, bundleId: bundle.id, to: peer)
             }
+            return
         }
         
-        throw lastError ?? CLAError.connectionFailed
+        guard let url = buildPeerURL(for: peer)?.appendingPathComponent("batch") else {
+            throw CLAError.invalidPeerAddress
+        }
+        
+        let body = BundleBatch.encode(bundles.map(\.data))
+        do {
+            try await push(body, to: url, contentType: BundleBatch.contentType, peer: peer, what: "\(bundles.count) bundles")
+            logger.debug("Sent \(bundles.count) bundles via HTTP to \(url)")
+        } catch HTTPStatusError.notFound {
+            logger.info("Peer \(peer.eid) has no batch push, sending bundles one at a time")
+            singlePushPeers.insert(peer.eid)
+            try await sendBundles(bundles, to: peer)
+        }
     }
     
     public nonisolated func canReach(_ peer: DtnPeer) -> Bool {
@@ -111,12 +133,60 @@ public actor HTTPCLA: ConvergenceLayerAgent {
         return []
     }
     
-    private func sendBundleHTTP(bundleData: Data, to url: URL) async throws {
+    /// POST `body`, deflated if it is large enough and the peer has not turned compressed bodies down
+    private func push(_ body: [UInt8], to url: URL, contentType: String = "application/octet-stream", peer: DtnPeer, what: String) async throws {
+        if config.compressMinSize > 0, body.count >= config.compressMinSize, !plainPushPeers.contains(peer.eid),
+           let compressed = Deflate.compress(body) {
+            do {
+                try await withRetries(what) {
+                    try await sendBundleHTTP(bundleData: Data(compressed), to: url, contentType: contentType, contentEncoding: Deflate.contentEncoding)
+                }
+                return
+            } catch HTTPStatusError.encodingRejected {
+                logger.info("Peer \(peer.eid) does not take deflated bodies, pushing them uncompressed")
+                plainPushPeers.insert(peer.eid)
+            }
+        }
+        
+        try await withRetries(what) {
+            try await sendBundleHTTP(bundleData: Data(body), to: url, contentType: contentType)
+        }
+    }
+    
+    /// Run `body` up to `maxRetries` times with a growing pause between attempts; a 404 or a rejected encoding is not retried
+    private func withRetries(_ what: String, _ body: () async throws -> Void) async throws {
+        var lastError: Error?
+        
+        for attempt in 1...max(1, config.maxRetries) {
+            do {
+                try await body()
+                return
+            } catch let error as HTTPStatusError {
+                throw error
+            } catch {
+                lastError = error
+                logger.warning("Failed to send \(what) via HTTP (attempt \(attempt)/\(config.maxRetries)): \(error)")
+                
+                if attempt < config.maxRetries {
+                    // Exponential backoff
+                    let delay = TimeInterval(attempt) * 0.5
+                    try await Task.sleep(nanoseconds: UInt64(delay * 1_000_000_000))
+                }
+            }
+        }
+        
+        throw lastError ?? CLAError.connectionFailed
+    }
+    
+    private func sendBundleHTTP(bundleData: Data, to url: URL, contentType: String = "application/octet-stream", contentEncoding: String? = nil) async throws {
         var request = URLRequest(url: url)
         request.httpMethod = "POST"
         request.httpBody = bundleData
-        request.setValue("application/octet-stream", forHTTPHeaderField: "Content-Type")
+        request.setValue(contentType, forHTTPHeaderField: "Content-Type")
         request.setValue("\(bundleData.count)", forHTTPHeaderField: "Content-Length")
+        if let contentEncoding {
+            request.setValue(contentEncoding, forHTTPHeaderField: "Content-Encoding")
+        }
         
         let (_, response) = try await session.data(for: request)
         
@@ -124,6 +194,14 @@ public actor HTTPCLA: ConvergenceLayerAgent {
             throw CLAError.invalidResponse
         }
         
+        if httpResponse.statusCode == 404 {
+            throw HTTPStatusError.notFound
+        }
+        // Only a 415 says the peer does not take the encoding; a 400 is about this body
+        // alone and must not turn compression off for the peer
+        if contentEncoding != nil && httpResponse.statusCode == 415 {
+            throw HTTPStatusError.encodingRejected
+        }
         guard (200..<300).contains(httpResponse.statusCode) else {
             throw CLAError.httpError(httpResponse.statusCode)
         }
@@ -179,19 +257,36 @@ public actor HTTPPullCLA: ConvergenceLayerAgent {
     private var isRunning = false
     private let session: URLSession
     private var pollingTask: Task<Void, Never>?
-    private var knownBundles: Set<String> = []
+    private var knownBundles = DuplicateFilter(configuration: DuplicateFilter.Configuration(exactCapacity: 1_000, filterCapacity: 20_000))
+    
+    // Delta listing position per peer, as returned by its /status/bundles/since
+    private var cursors: [EndpointID: String] = [:]
+    // Older peers without the delta listing or batch download
+    private var fullListingPeers: Set<EndpointID> = []
+    private var singleDownloadPeers: Set<EndpointID> = []
+    // Listed IDs whose download failed and the attempts made, retried on the next polls
+    private var failedDownloads: [EndpointID: [String: Int]] = [:]
+    private let maxDownloadAttempts = 5
     
     /// Configuration for HTTP Pull CLA
     public struct HTTPPullCLAConfig: Sendable {
         public let pollingInterval: TimeInterval
         public let timeout: TimeInterval
+        /// Bundles requested per `/download/batch` call
+        public let downloadBatchSize: Int
+        /// Parallel downloads from peers without batch download
+        public let maxConcurrentDownloads: Int
         
         public init(
             pollingInterval: TimeInterval = 30.0,
-            timeout: TimeInterval = 5.0
+            timeout: TimeInterval = 5.0,
+            downloadBatchSize: Int = 64,
+            maxConcurrentDownloads: Int = 4
         ) {
             self.pollingInterval = pollingInterval
             self.timeout = timeout
+            self.downloadBatchSize = max(1, downloadBatchSize)
+            self.maxConcurrentDownloads = max(1, maxConcurrentDownloads)
         }
     }
     
@@ -231,6 +326,10 @@ public actor HTTPPullCLA: ConvergenceLayerAgent {
         throw CLAError.operationNotSupported("HTTP Pull CLA cannot send bundles")
     }
     
+    public func sendBundle(encoded bundleData: [UInt8], bundleId: String, to peer: DtnPeer) async throws {
+        throw CLAError.operationNotSupported("HTTP Pull CLA cannot send bundles")
+    }
+    
     public nonisolated func canReach(_ peer: DtnPeer) -> Bool {
         // HTTP Pull can't actively reach peers
         return false
@@ -261,53 +360,113 @@ public actor HTTPPullCLA: ConvergenceLayerAgent {
         }
         
         do {
-            // Get bundle list from peer
-            let bundleIds = try await fetchBundleList(from: baseURL)
+            // Ask only for what the peer stored since the last poll, plus what failed to download before
+            let (listed, cursor) = try await fetchNewBundleIds(from: peer, baseURL: baseURL)
+            let retries = failedDownloads.removeValue(forKey: peer.eid) ?? [:]
+            var seen = Set<String>()
+            let bundleIds = (Array(retries.keys) + listed).filter { seen.insert($0).inserted }
             
             // Find new bundles
-            let newBundles = bundleIds.filter { !knownBundles.contains($0) }
+            let newBundles = bundleIds.filter { !knownBundles.contains(BundleKey(id: $0)) }
             
-            // Download new bundles
-            for bundleId in newBundles {
-                do {
-                    let bundle = try await downloadBundle(bundleId: bundleId, from: baseURL)
+            let connection = CLAConnection(
+                id: "httppull-\(peer.eid)",
+                remoteEndpointId: peer.eid,
+                remoteAddress: baseURL.absoluteString,
+                claType: "httppull",
+                establishedAt: Date()
+            )
                     
+            // Download new bundles, many per request where the peer supports it
+            var downloaded = 0
+            var failed: [String: Int] = [:]
+            for start in stride(from: 0, to: newBundles.count, by: config.downloadBatchSize) {
+                let chunk = Array(newBundles[start..<min(start + config.downloadBatchSize, newBundles.count)])
+                let bundles = await downloadBundles(chunk, from: peer, baseURL: baseURL)
+                var fetched = Set<BundleKey>()
+                for bundle in bundles {
                     // Add to known bundles
-                    knownBundles.insert(bundleId)
-                    
-                    // Create connection info
-                    let connection = CLAConnection(
-                        id: "httppull-\(peer.eid)",
-                        remoteEndpointId: peer.eid,
-                        remoteAddress: baseURL.absoluteString,
-                        claType: "httppull",
-                        establishedAt: Date()
-                    )
+                    let key = BundleKey(bundle: bundle)
+                    knownBundles.insert(key)
+                    fetched.insert(key)
                     
                     // Send to incoming channel
                     await incomingBundles.send((bundle, connection))
-                    
-                    logger.debug("Downloaded bundle \(bundleId) from \(peer.eid)")
-                    
-                } catch {
-                    logger.error("Failed to download bundle \(bundleId): \(error)")
                 }
+                downloaded += bundles.count
+                
+                for bundleId in chunk where !fetched.contains(BundleKey(id: bundleId)) {
+                    let attempts = (retries[bundleId] ?? 0) + 1
+                    if attempts < maxDownloadAttempts {
+                        failed[bundleId] = attempts
+                    } else {
+                        logger.warning("Giving up on bundle \(bundleId) from \(peer.eid) after \(attempts) failed downloads")
+                    }
+                }
+            }
+            if !failed.isEmpty {
+                failedDownloads[peer.eid] = failed
             }
             
+            // Move past the listing only now that its bundles were fetched or kept for a retry
+            if let cursor {
+                cursors[peer.eid] = cursor
+            }
+            
+            if downloaded > 0 {
+                logger.debug("Downloaded \(downloaded) bundle(s) from \(peer.eid)")
+            }
         } catch {
             logger.error("Failed to poll peer \(peer.eid): \(error)")
         }
     }
     
-    private func fetchBundleList(from baseURL: URL) async throws -> [String] {
-        let url = baseURL.appendingPathComponent("status/bundles")
-        let (data, response) = try await session.data(from: url)
+    /// IDs stored on the peer since its cursor; on first contact, or when the cursor
+    /// cannot be continued, the full listing once. Also returns the cursor to continue
+    /// from, which the caller saves once the bundles were downloaded.
+    private func fetchNewBundleIds(from peer: DtnPeer, baseURL: URL) async throws -> (bundleIds: [String], cursor: String?) {
+        guard !fullListingPeers.contains(peer.eid) else {
+            return (try await fetchBundleList(from: baseURL), nil)
+        }
+        
+        var page: StoreJournal.Page
+        do {
+            page = try await fetchJournalPage(from: baseURL, cursor: cursors[peer.eid])
+        } catch HTTPStatusError.notFound {
+            logger.info("Peer \(peer.eid) has no delta listing, polling its full bundle list")
+            fullListingPeers.insert(peer.eid)
+            return (try await fetchBundleList(from: baseURL), nil)
+        }
+        
+        if page.reset {
+            // The reset carries the current position, so the listing below misses nothing after it
+            return (try await fetchBundleList(from: baseURL), page.cursor)
+        }
+        
+        var bundleIds = page.bundles
+        while page.more {
+            page = try await fetchJournalPage(from: baseURL, cursor: page.cursor)
+            guard !page.reset else { break }
+            bundleIds.append(contentsOf: page.bundles)
+        }
+        return (bundleIds, page.cursor)
+    }
+    
+    private nonisolated func fetchJournalPage(from baseURL: URL, cursor: String?) async throws -> StoreJournal.Page {
+        var components = URLComponents(url: baseURL.appendingPathComponent("status/bundles/since"), resolvingAgainstBaseURL: false)
+        components?.queryItems = cursor.map { [URLQueryItem(name: "cursor", value: $0)] }
         
-        guard let httpResponse = response as? HTTPURLResponse,
-              (200..<300).contains(httpResponse.statusCode) else {
-            throw CLAError.httpError((response as? HTTPURLResponse)?.statusCode ?? 0)
+        guard let url = components?.url else {
+            throw CLAError.invalidPeerAddress
         }
         
+        let data = try await get(url)
+        return try JSONDecoder().decode(StoreJournal.Page.self, from: data)
+    }
+    
+    private nonisolated func fetchBundleList(from baseURL: URL) async throws -> [String] {
+        let data = try await get(baseURL.appendingPathComponent("status/bundles"))
+        
         // Parse JSON response
         struct BundleListResponse: Codable {
             let bundles: [String]
@@ -318,7 +477,78 @@ public actor HTTPPullCLA: ConvergenceLayerAgent {
         return bundleList.bundles
     }
     
-    private func downloadBundle(bundleId: String, from baseURL: URL) async throws -> BP7.Bundle {
+    /// Download bundles with one `/download/batch` request, or concurrently one by one from peers without it
+    private func downloadBundles(_ bundleIds: [String], from peer: DtnPeer, baseURL: URL) async -> [BP7.Bundle] {
+        if !singleDownloadPeers.contains(peer.eid) {
+            do {
+                return try await downloadBatch(bundleIds, from: baseURL)
+            } catch HTTPStatusError.notFound {
+                logger.info("Peer \(peer.eid) has no batch download, fetching bundles one at a time")
+                singleDownloadPeers.insert(peer.eid)
+            } catch {
+                logger.error("Failed to download \(bundleIds.count) bundle(s) from \(peer.eid): \(error)")
+                return []
+            }
+        }
+        
+        let concurrency = config.maxConcurrentDownloads
+        return await withTaskGroup(of: BP7.Bundle?.self) { group in
+            var bundles: [BP7.Bundle] = []
+            var pending = bundleIds.makeIterator()
+            
+            func startNext() {
+                guard let bundleId = pending.next() else { return }
+                group.addTask {
+                    do {
+                        return try await self.downloadBundle(bundleId: bundleId, from: baseURL)
+                    } catch {
+                        self.logger.error("Failed to download bundle \(bundleId): \(error)")
+                        return nil
+                    }
+                }
+            }
+            
+            for _ in 0..<concurrency {
+                startNext()
+            }
+            for await bundle in group {
+                if let bundle = bundle {
+                    bundles.append(bundle)
+                }
+                startNext()
+            }
+            return bundles
+        }
+    }
+    
+    private nonisolated func downloadBatch(_ bundleIds: [String], from baseURL: URL) async throws -> [BP7.Bundle] {
+        struct BatchRequest: Codable {
+            let bundles: [String]
+        }
+        
+        // A response capped by the peer covers a prefix of the IDs; ask again for the rest
+        var bundles: [BP7.Bundle] = []
+        var remaining = bundleIds[...]
+        while !remaining.isEmpty {
+            var request = URLRequest(url: baseURL.appendingPathComponent("download/batch"))
+            request.httpMethod = "POST"
+            request.httpBody = try JSONEncoder().encode(BatchRequest(bundles: Array(remaining)))
+            request.setValue("application/json", forHTTPHeaderField: "Content-Type")
+        
+            let (data, response) = try await session.data(for: request)
+            try Self.check(response)
+        
+            bundles += try BundleBatch.decode(Array(data)).map { try BP7.Bundle.decode(from: $0) }
+            // Peers without the header answer for every ID at once
+            let served = (response as? HTTPURLResponse)?
+                .value(forHTTPHeaderField: BundleBatch.servedHeader)
+                .flatMap { Int($0) } ?? remaining.count
+            remaining = remaining.dropFirst(max(1, served))
+        }
+        return bundles
+    }
+    
+    private nonisolated func downloadBundle(bundleId: String, from baseURL: URL) async throws -> BP7.Bundle {
         var components = URLComponents(url: baseURL.appendingPathComponent("download"), resolvingAgainstBaseURL: false)
         components?.queryItems = [URLQueryItem(name: "bundle", value: bundleId)]
         
@@ -326,24 +556,40 @@ public actor HTTPPullCLA: ConvergenceLayerAgent {
             throw CLAError.invalidPeerAddress
         }
         
+        return try BP7.Bundle.decode(from: Array(try await get(url)))
+    }
+    
+    private nonisolated func get(_ url: URL) async throws -> Data {
         let (data, response) = try await session.data(from: url)
+        try Self.check(response)
+        return data
+    }
         
-        guard let httpResponse = response as? HTTPURLResponse,
-              (200..<300).contains(httpResponse.statusCode) else {
-            throw CLAError.httpError((response as? HTTPURLResponse)?.statusCode ?? 0)
+    private static func check(_ response: URLResponse) throws {
+        let statusCode = (response as? HTTPURLResponse)?.statusCode ?? 0
+        if statusCode == 404 {
+            throw HTTPStatusError.notFound
+        }
+        guard (200..<300).contains(statusCode) else {
+            throw CLAError.httpError(statusCode)
         }
-        
-        return try BP7.Bundle.decode(from: Array(data))
     }
     
     private func buildPeerURL(for peer: DtnPeer) -> URL? {
+        peer.httpBaseURL()
+    }
+}
+
+extension DtnPeer {
+    /// Root URL of the peer's daemon: the port of its HTTP CLA, else `fallbackPort`, else the address port
+    func httpBaseURL(fallbackPort: UInt16? = nil) -> URL? {
         var host: String?
         var port: UInt16?
         
-        switch peer.addr {
+        switch addr {
         case .ip(let h, let p):
             host = h
-            port = UInt16(p)
+            port = UInt16(exactly: p)
         case .generic(let addr):
             // Try to parse as URL
             return URL(string: addr)
@@ -352,13 +598,14 @@ public actor HTTPPullCLA: ConvergenceLayerAgent {
         }
         
         // Check CLA list for HTTP port
-        for (cla, claPort) in peer.claList where cla == "http" || cla == "httppull" {
+        var httpPort: UInt16?
+        for (cla, claPort) in claList where cla == "http" || cla == "httppull" {
             if let claPort = claPort {
-                port = claPort
+                httpPort = claPort
             }
         }
         
-        guard let host = host, let port = port else {
+        guard let host = host, let port = httpPort ?? fallbackPort ?? port else {
             return nil
         }
         
@@ -372,6 +619,13 @@ public actor HTTPPullCLA: ConvergenceLayerAgent {
     }
 }
 
+/// Raised for a 404, which means a peer lacks an endpoint rather than a transient failure
+enum HTTPStatusError: Error {
+    case notFound
+    /// A request with a `Content-Encoding` was answered with 415 Unsupported Media Type
+    case encodingRejected
+}
+
 extension CLAError {
     static let connectionFailed = CLAError.invalidProtocol("Connection failed")
     static let invalidResponse = CLAError.invalidProtocol("Invalid HTTP response")
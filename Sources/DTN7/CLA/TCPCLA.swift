@@ -4,6 +4,7 @@ import FoundationEssentials
 import Foundation
 #endif
 import Network
+import NIOCore
 import BP7
 import AsyncAlgorithms
 import Logging
@@ -29,6 +30,10 @@ public actor TCPCLA: ConvergenceLayerAgent {
         public let keepaliveInterval: TimeInterval
         public let segmentMRU: UInt64
         public let transferMRU: UInt64
+        /// Maximum number of sent segments awaiting XFER_ACK per session, across pipelined transfers
+        public let ackWindow: Int
+        /// Bundles of at least this many bytes are deflated for peers that accept it; 0 never compresses
+        public let compressMinSize: Int
         
         public init(
             port: UInt16 = 4556,
@@ -36,7 +41,9 @@ public actor TCPCLA: ConvergenceLayerAgent {
             refuseExistingBundles: Bool = false,
             keepaliveInterval: TimeInterval = 30,
             segmentMRU: UInt64 = 64000,
-            transferMRU: UInt64 = 64000
+            transferMRU: UInt64 = 64 * 1024 * 1024,
+            ackWindow: Int = 16,
+            compressMinSize: Int = 0
         ) {
             self.port = port
             self.bindAddress = bindAddress
@@ -44,6 +51,8 @@ public actor TCPCLA: ConvergenceLayerAgent {
             self.keepaliveInterval = keepaliveInterval
             self.segmentMRU = segmentMRU
             self.transferMRU = transferMRU
+            self.ackWindow = max(1, ackWindow)
+            self.compressMinSize = max(0, compressMinSize)
         }
     }
     
@@ -103,6 +112,10 @@ public actor TCPCLA: ConvergenceLayerAgent {
     }
     
     public func sendBundle(_ bundle: BP7.Bundle, to peer: DtnPeer) async throws {
+        try await sendBundle(encoded: bundle.encode(), bundleId: BundlePack.id(of: bundle), to: peer)
+    }
+    
+    public func sendBundle(encoded bundleData: [UInt8], bundleId: String, to peer: DtnPeer) async throws {
         guard let peerAddress = extractTCPAddress(from: peer) else {
             throw CLAError.invalidPeerAddress
         }
@@ -111,7 +124,7 @@ public actor TCPCLA: ConvergenceLayerAgent {
         
         // Check if we have an existing connection
         if let connection = connections[connectionId], await connection.isActive {
-            try await connection.sendBundle(bundle)
+            try await connection.sendBundle(encoded: bundleData, bundleId: bundleId)
         } else {
             // Create new connection
             let connection = TCPConnection(
@@ -124,7 +137,7 @@ public actor TCPCLA: ConvergenceLayerAgent {
             
             connections[connectionId] = connection
             try await connection.connect()
-            try await connection.sendBundle(bundle)
+            try await connection.sendBundle(encoded: bundleData, bundleId: bundleId)
         }
     }
     
@@ -189,11 +202,41 @@ actor TCPConnection {
     var isActive: Bool = false
     private var keepaliveTask: Task<Void, Never>?
     
+    // Limits announced in the peer's SESS_INIT; outgoing segments and transfers respect them
+    private var peerSegmentMRU: UInt64
+    private var peerTransferMRU: UInt64
+    private var peerAcceptsDeflate = false
+    
+    // Outgoing transfers. TCPCLv4 does not interleave segments of different transfers,
+    // so one transfer is segmented at a time; the next may start while earlier
+    // segments still await XFER_ACK, up to `config.ackWindow` segments in flight.
+    private var nextTransferId: UInt64 = 1
+    private var transferInProgress = false
+    private var transferWaiters: [CheckedContinuation<Void, Never>] = []
+    private var unackedSegments: [UInt64: Int] = [:]
+    private var unackedTotal = 0
+    private var windowWaiters: [CheckedContinuation<Void, Never>] = []
+    private var refusedTransfers: Set<UInt64> = []
+    
+    // Incoming transfers being reassembled, by transfer ID
+    private var incomingTransfers: [UInt64: Data] = [:]
+    // Bundle sizes of incoming transfers that arrive deflated
+    private var deflatedTransfers: [UInt64: UInt64] = [:]
+    
+    // Received bytes are read in large chunks and decoded into frames here
+    private static let readChunkSize = 64 * 1024
+    private var frameProcessor: NIOSingleStepByteToMessageProcessor<TCPCLFrameDecoder>
+    private var pendingFrames: [TCPCLFrame] = []
+    private var pendingFrameIndex = 0
+    
     init(config: TCPCLA.TCPCLAConfig, nwConnection: NWConnection, incomingBundles: AsyncChannel<(BP7.Bundle, CLAConnection)>) {
         self.config = config
         self.nwConnection = nwConnection
         self.incomingBundles = incomingBundles
         self.id = "\(nwConnection.endpoint)"
+        self.peerSegmentMRU = config.segmentMRU
+        self.peerTransferMRU = config.transferMRU
+        self.frameProcessor = Self.makeFrameProcessor(config: config)
     }
     
     init(config: TCPCLA.TCPCLAConfig, remoteHost: String, remotePort: UInt16, nodeId: EndpointID, incomingBundles: AsyncChannel<(BP7.Bundle, CLAConnection)>) {
@@ -201,11 +244,23 @@ actor TCPConnection {
         self.nodeId = nodeId
         self.incomingBundles = incomingBundles
         self.id = "\(remoteHost):\(remotePort)"
+        self.peerSegmentMRU = config.segmentMRU
+        self.peerTransferMRU = config.transferMRU
+        self.frameProcessor = Self.makeFrameProcessor(config: config)
         
         let endpoint = NWEndpoint.hostPort(host: .init(remoteHost), port: .init(integerLiteral: remotePort))
         self.nwConnection = NWConnection(to: endpoint, using: .tcp)
     }
     
+    private static func makeFrameProcessor(config: TCPCLA.TCPCLAConfig) -> NIOSingleStepByteToMessageProcessor<TCPCLFrameDecoder> {
+        // Room for one maximal segment plus the chunk that completes it
+        let maximumBufferSize = Int(clamping: min(config.segmentMRU, UInt64(Int.max / 2))) + 2 * readChunkSize
+        return NIOSingleStepByteToMessageProcessor(
+            TCPCLFrameDecoder(maxSegmentLength: config.segmentMRU),
+            maximumBufferSize: maximumBufferSize
+        )
+    }
+    
     func connect() async throws {
         nwConnection.start(queue: .global())
         
@@ -254,26 +309,121 @@ actor TCPConnection {
         startReceiving()
     }
     
-    func sendBundle(_ bundle: BP7.Bundle) async throws {
+    func sendBundle(encoded bundleData: [UInt8], bundleId: String) async throws {
         guard isActive else {
             throw CLAError.connectionNotActive
         }
         
-        let bundleData = bundle.encode()
-        let bundleId = BundlePack(from: bundle).id
+        guard UInt64(bundleData.count) <= peerTransferMRU else {
+            throw CLAError.bundleTooLarge(bundleData.count, Int(clamping: peerTransferMRU))
+        }
+        
+        await beginTransfer()
+        defer { endTransfer() }
         
-        // Send transfer segment
-        let message = TCPCLMessage.xferSegment(
-            flags: 0x01, // START flag
-            transferId: 1,
-            extensionItems: [
-                TCPCLExtension.transferLength(UInt64(bundleData.count))
-            ],
-            data: Data(bundleData)
+        let transferId = nextTransferId
+        nextTransferId &+= 1
+        
+        // Compressed when the peer can inflate it and it gets smaller
+        var startExtensions: [TCPCLExtension] = []
+        var transferData = bundleData
+        if config.compressMinSize > 0, peerAcceptsDeflate, bundleData.count >= config.compressMinSize,
+           let compressed = Deflate.compress(bundleData) {
+            transferData = compressed
+            startExtensions.append(.deflate(bundleLength: UInt64(bundleData.count)))
+        }
+        startExtensions.insert(.transferLength(UInt64(transferData.count)), at: 0)
+        
+        // Copied once; every segment's payload is a slice sharing this storage
+        let payload = Data(transferData)
+        let segments = TCPCLMessage.segments(length: payload.count, segmentMRU: peerSegmentMRU)
+        
+        for segment in segments {
+            await reserveAckWindow(for: transferId)
+            
+            guard isActive else {
+                throw CLAError.connectionNotActive
+            }
+            guard !refusedTransfers.contains(transferId) else {
+                refusedTransfers.remove(transferId)
+                throw CLAError.transferRefused(transferId)
+            }
+            
+            let extensions = segment.range.lowerBound == 0 ? startExtensions : []
+            try await sendSegment(
+                flags: segment.flags,
+                transferId: transferId,
+                extensionItems: extensions,
+                payload: payload[segment.range]
+            )
+        }
+        
+        logger.debug("Sent bundle \(bundleId) via TCP as transfer \(transferId) in \(segments.count) segments")
+    }
+    
+    /// Wait until no other outgoing transfer is being segmented
+    private func beginTransfer() async {
+        while transferInProgress && isActive {
+            await withCheckedContinuation { transferWaiters.append($0) }
+        }
+        transferInProgress = true
+    }
+    
+    private func endTransfer() {
+        transferInProgress = false
+        if !transferWaiters.isEmpty {
+            transferWaiters.removeFirst().resume()
+        }
+    }
+    
+    /// Wait for room in the ack window and claim it for one segment of `transferId`
+    private func reserveAckWindow(for transferId: UInt64) async {
+        while unackedTotal >= config.ackWindow && isActive {
+            await withCheckedContinuation { windowWaiters.append($0) }
+        }
+        unackedSegments[transferId, default: 0] += 1
+        unackedTotal += 1
+    }
+    
+    /// Return `count` segments of `transferId` (all of them if nil) to the ack window
+    private func releaseAckWindow(for transferId: UInt64, count: Int? = 1) {
+        // An ack naming a transfer we never sent releases a segment of the oldest one
+        let key = unackedSegments[transferId] != nil ? transferId : (count == nil ? nil : unackedSegments.keys.min())
+        guard let key, let pending = unackedSegments[key] else {
+            return
+        }
+        
+        let released = min(pending, count ?? pending)
+        unackedSegments[key] = pending > released ? pending - released : nil
+        unackedTotal -= released
+        
+        for _ in 0..<min(released, windowWaiters.count) {
+            windowWaiters.removeFirst().resume()
+        }
+    }
+    
+    /// Write a segment header followed by its payload slice in one batch, without
+    /// assembling the payload into a message buffer
+    private func sendSegment(flags: UInt8, transferId: UInt64, extensionItems: [TCPCLExtension], payload: Data) async throws {
+        let header = TCPCLMessage.xferSegmentHeader(
+            flags: flags,
+            transferId: transferId,
+            extensionItems: extensionItems,
+            dataLength: UInt64(payload.count)
         )
         
-        try await send(message)
-        logger.debug("Sent bundle \(bundleId) via TCP")
+        try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
+            nwConnection.batch {
+                nwConnection.send(content: header, completion: .idempotent)
+                nwConnection.send(content: payload, completion: .contentProcessed { error in
+                    if let error = error {
+                        continuation.resume(throwing: error)
+                    } else {
+                        continuation.resume()
+                    }
+                })
+            }
+        }
     }
     
     func close() async {
@@ -290,6 +440,16 @@ actor TCPConnection {
         
         nwConnection.cancel()
         isActive = false
+        
+        // Wake senders waiting on the transfer or the ack window so they can fail
+        let waiters = transferWaiters + windowWaiters
+        transferWaiters.removeAll()
+        windowWaiters.removeAll()
+        incomingTransfers.removeAll()
+        deflatedTransfers.removeAll()
+        for waiter in waiters {
+            waiter.resume()
+        }
     }
     
     func getConnectionInfo() -> CLAConnection {
@@ -313,16 +473,9 @@ actor TCPConnection {
     }
     
     private func receiveContactHeader() async throws {
-        let header = try await receiveData(count: 6)
-        
-        // Verify magic
-        guard header[0...3] == Data([0x64, 0x74, 0x6E, 0x21]) else {
-            throw CLAError.invalidProtocol("Invalid contact header magic")
-        }
-        
-        // Verify version
-        guard header[4] == 0x04 else {
-            throw CLAError.unsupportedVersion(Int(header[4]))
+        // Magic and version are verified by the decoder
+        guard case .contactHeader = try await receiveFrame() else {
+            throw CLAError.invalidProtocol("Expected contact header")
         }
     }
     
@@ -334,7 +487,8 @@ actor TCPConnection {
             segmentMRU: config.segmentMRU,
             transferMRU: config.transferMRU,
             nodeId: nodeIdData,
-            sessionExtensionItems: []
+            // Non-critical, so peers that do not know it ignore it
+            sessionExtensionItems: [.acceptsDeflate]
         )
         
         try await send(message)
@@ -343,10 +497,14 @@ actor TCPConnection {
     private func receiveSessionInit() async throws {
         let message = try await receive()
         
-        guard case .sessInit(_, _, _, let nodeIdData, _) = message else {
+        guard case .sessInit(_, let segmentMRU, let transferMRU, let nodeIdData, let extensions) = message else {
             throw CLAError.invalidProtocol("Expected SESS_INIT message")
         }
         
+        peerSegmentMRU = max(1, segmentMRU)
+        peerTransferMRU = transferMRU
+        peerAcceptsDeflate = extensions.contains { if case .acceptsDeflate = $0 { return true } else { return false } }
+        
         if let nodeIdString = String(data: nodeIdData, encoding: .utf8) {
             nodeId = try? EndpointID.from(nodeIdString)
         }
@@ -382,26 +540,20 @@ actor TCPConnection {
     
     private func handleMessage(_ message: TCPCLMessage) async throws {
         switch message {
-        case .xferSegment(let flags, _, _, let data):
-            if flags & 0x01 != 0 { // START flag
-                // This is a complete bundle
-                if let bundle = try? BP7.Bundle.decode(from: Array(data)) {
-                    let connection = getConnectionInfo()
-                    await incomingBundles.send((bundle, connection))
+        case .xferSegment(let flags, let transferId, let extensions, let data):
+            try await handleSegment(flags: flags, transferId: transferId, extensionItems: extensions, data: data)
                     
-                    // Send acknowledgment
-                    let ack = TCPCLMessage.xferAck(flags: 0, transferId: 1, length: UInt64(data.count))
-                    try await send(ack)
-                }
+        case .xferAck(_, let transferId, _):
+            // One segment acknowledged
+            releaseAckWindow(for: transferId)
+        
+        case .xferRefuse(let reasonCode, let transferId):
+            logger.warning("Bundle transfer \(transferId) refused (reason \(reasonCode))")
+            releaseAckWindow(for: transferId, count: nil)
+            if transferInProgress && transferId == nextTransferId &- 1 {
+                refusedTransfers.insert(transferId)
             }
             
-        case .xferAck:
-            // Bundle acknowledged
-            break
-            
-        case .xferRefuse:
-            logger.warning("Bundle transfer refused")
-            
         case .keepalive:
             // Keepalive received
             break
@@ -417,96 +569,93 @@ actor TCPConnection {
         }
     }
     
-    private func send(_ message: TCPCLMessage) async throws {
-        let data = message.encode()
-        try await sendData(data)
-    }
-    
-    private func receive() async throws -> TCPCLMessage {
-        // Read message type
-        let typeData = try await receiveData(count: 1)
-        let messageType = typeData[0]
-        
-        // Read message based on type
-        switch messageType {
-        case 0x01: // XFER_SEGMENT
-            return try await receiveXferSegment()
-        case 0x02: // XFER_ACK
-            return try await receiveXferAck()
-        case 0x03: // XFER_REFUSE
-            return try await receiveXferRefuse()
-        case 0x04: // KEEPALIVE
-            return .keepalive
-        case 0x05: // SESS_TERM
-            return try await receiveSessTerm()
-        case 0x06: // MSG_REJECT
-            return try await receiveMsgReject()
-        case 0x07: // SESS_INIT
-            return try await receiveSessInit()
-        default:
-            throw CLAError.invalidProtocol("Unknown message type: \(messageType)")
+    /// Reassemble an incoming transfer, acknowledging every segment with the
+    /// cumulative length received so far
+    private func handleSegment(flags: UInt8, transferId: UInt64, extensionItems: [TCPCLExtension], data: Data) async throws {
+        var received: Data
+        
+        if flags & TCPCLMessage.segmentStart != 0 {
+            received = Data()
+            for case .transferLength(let total) in extensionItems where total <= config.transferMRU {
+                received.reserveCapacity(Int(total))
+            }
+            for case .deflate(let bundleLength) in extensionItems {
+                guard bundleLength <= config.transferMRU else {
+                    logger.warning("Refusing transfer \(transferId): bundle exceeds transfer MRU of \(config.transferMRU) bytes")
+                    try await send(.xferRefuse(reasonCode: 0x02, transferId: transferId)) // No Resources
+                    return
+                }
+                deflatedTransfers[transferId] = bundleLength
+            }
+            received.append(data)
+        } else if let partial = incomingTransfers.removeValue(forKey: transferId) {
+            received = partial
+            received.append(data)
+        } else if flags & TCPCLMessage.segmentEnd != 0 {
+            // Single-segment transfer from a peer that only sets END
+            received = data
+        } else {
+            logger.warning("Dropping segment of unknown transfer \(transferId)")
+            return
         }
-    }
-    
-    private func receiveXferSegment() async throws -> TCPCLMessage {
-        let flags = try await receiveData(count: 1)[0]
-        let transferId = try await receiveUInt64()
         
-        // Read extension items length
-        let extensionLength = try await receiveUInt32()
-        let extensionData = try await receiveData(count: Int(extensionLength))
-        let extensions = try TCPCLExtension.parse(from: extensionData)
+        guard UInt64(received.count) <= config.transferMRU else {
+            deflatedTransfers.removeValue(forKey: transferId)
+            logger.warning("Refusing transfer \(transferId): exceeds transfer MRU of \(config.transferMRU) bytes")
+            try await send(.xferRefuse(reasonCode: 0x02, transferId: transferId)) // No Resources
+            return
+        }
         
-        // Read data length
-        let dataLength = try await receiveUInt64()
-        let data = try await receiveData(count: Int(dataLength))
+        try await send(.xferAck(flags: flags, transferId: transferId, length: UInt64(received.count)))
         
-        return .xferSegment(flags: flags, transferId: transferId, extensionItems: extensions, data: data)
-    }
-    
-    private func receiveXferAck() async throws -> TCPCLMessage {
-        let flags = try await receiveData(count: 1)[0]
-        let transferId = try await receiveUInt64()
-        let length = try await receiveUInt64()
-        return .xferAck(flags: flags, transferId: transferId, length: length)
-    }
-    
-    private func receiveXferRefuse() async throws -> TCPCLMessage {
-        let reasonCode = try await receiveData(count: 1)[0]
-        let transferId = try await receiveUInt64()
-        return .xferRefuse(reasonCode: reasonCode, transferId: transferId)
+        guard flags & TCPCLMessage.segmentEnd != 0 else {
+            incomingTransfers[transferId] = received
+            return
+        }
+        
+        var encoded = Array(received)
+        if let bundleLength = deflatedTransfers.removeValue(forKey: transferId) {
+            guard let inflated = Deflate.decompress(encoded, maxSize: Int(bundleLength)), inflated.count == Int(bundleLength) else {
+                logger.warning("Failed to inflate transfer \(transferId)")
+                return
+            }
+            encoded = inflated
+        }
+        
+        if let bundle = try? BP7.Bundle.decode(from: encoded) {
+            await incomingBundles.send((bundle, getConnectionInfo()))
+        } else {
+            logger.warning("Failed to decode bundle from transfer \(transferId)")
+        }
     }
     
-    private func receiveSessTerm() async throws -> TCPCLMessage {
-        let flags = try await receiveData(count: 1)[0]
-        let reasonCode = try await receiveData(count: 1)[0]
-        return .sessTerm(flags: flags, reasonCode: reasonCode)
+    private func send(_ message: TCPCLMessage) async throws {
+        let data = message.encode()
+        try await sendData(data)
     }
     
-    private func receiveMsgReject() async throws -> TCPCLMessage {
-        let reasonCode = try await receiveData(count: 1)[0]
-        let rejectedMessageHeader = try await receiveData(count: 1)[0]
-        return .msgReject(reasonCode: reasonCode, rejectedMessageHeader: rejectedMessageHeader)
+    /// Next message of the session, decoded from buffered reads
+    private func receive() async throws -> TCPCLMessage {
+        guard case .message(let message) = try await receiveFrame() else {
+            throw CLAError.invalidProtocol("Unexpected contact header")
+        }
+        return message
     }
     
-    private func receiveSessInit() async throws -> TCPCLMessage {
-        let keepalive = try await receiveUInt16()
-        let segmentMRU = try await receiveUInt64()
-        let transferMRU = try await receiveUInt64()
-        let nodeIdLength = try await receiveUInt16()
-        let nodeId = try await receiveData(count: Int(nodeIdLength))
+    /// Next decoded frame; reads another chunk from the socket only when none is buffered
+    private func receiveFrame() async throws -> TCPCLFrame {
+        while pendingFrameIndex == pendingFrames.count {
+            pendingFrames.removeAll(keepingCapacity: true)
+            pendingFrameIndex = 0
         
-        let extensionLength = try await receiveUInt32()
-        let extensionData = try await receiveData(count: Int(extensionLength))
-        let extensions = try TCPCLSessionExtension.parse(from: extensionData)
+            let chunk = try await receiveChunk()
+            var frames: [TCPCLFrame] = []
+            try frameProcessor.process(buffer: chunk) { frames.append($0) }
+            pendingFrames = frames
+        }
         
-        return .sessInit(
-            keepalive: keepalive,
-            segmentMRU: segmentMRU,
-            transferMRU: transferMRU,
-            nodeId: nodeId,
-            sessionExtensionItems: extensions
-        )
+        defer { pendingFrameIndex += 1 }
+        return pendingFrames[pendingFrameIndex]
     }
     
     private func sendData(_ data: Data) async throws {
@@ -521,13 +670,13 @@ actor TCPConnection {
         }
     }
     
-    private func receiveData(count: Int) async throws -> Data {
+    private func receiveChunk() async throws -> ByteBuffer {
         try await withCheckedThrowingContinuation { continuation in
-            nwConnection.receive(minimumIncompleteLength: count, maximumLength: count) { data, _, isComplete, error in
+            nwConnection.receive(minimumIncompleteLength: 1, maximumLength: Self.readChunkSize) { data, _, isComplete, error in
                 if let error = error {
                     continuation.resume(throwing: error)
-                } else if let data = data, data.count == count {
-                    continuation.resume(returning: data)
+                } else if let data = data, !data.isEmpty {
+                    continuation.resume(returning: ByteBuffer(bytes: data))
                 } else if isComplete {
                     continuation.resume(throwing: CLAError.connectionClosed)
                 } else {
@@ -536,25 +685,10 @@ actor TCPConnection {
             }
         }
     }
-    
-    private func receiveUInt16() async throws -> UInt16 {
-        let data = try await receiveData(count: 2)
-        return UInt16(bigEndian: data.withUnsafeBytes { $0.load(as: UInt16.self) })
-    }
-    
-    private func receiveUInt32() async throws -> UInt32 {
-        let data = try await receiveData(count: 4)
-        return UInt32(bigEndian: data.withUnsafeBytes { $0.load(as: UInt32.self) })
-    }
-    
-    private func receiveUInt64() async throws -> UInt64 {
-        let data = try await receiveData(count: 8)
-        return UInt64(bigEndian: data.withUnsafeBytes { $0.load(as: UInt64.self) })
-    }
 }
 
 /// TCPCLv4 Message Types
-enum TCPCLMessage {
+package enum TCPCLMessage {
     case xferSegment(flags: UInt8, transferId: UInt64, extensionItems: [TCPCLExtension], data: Data)
     case xferAck(flags: UInt8, transferId: UInt64, length: UInt64)
     case xferRefuse(reasonCode: UInt8, transferId: UInt64)
@@ -563,22 +697,53 @@ enum TCPCLMessage {
     case msgReject(reasonCode: UInt8, rejectedMessageHeader: UInt8)
     case sessInit(keepalive: UInt16, segmentMRU: UInt64, transferMRU: UInt64, nodeId: Data, sessionExtensionItems: [TCPCLSessionExtension])
     
-    func encode() -> Data {
+    /// XFER_SEGMENT flags (RFC 9174 section 5.2.2)
+    package static let segmentEnd: UInt8 = 0x01
+    package static let segmentStart: UInt8 = 0x02
+    
+    /// Split a transfer of `length` bytes into segments of at most `segmentMRU` bytes.
+    /// The first segment carries START, the last END; an empty transfer is one START|END segment.
+    static func segments(length: Int, segmentMRU: UInt64) -> [(range: Range<Int>, flags: UInt8)] {
+        let segmentSize = Int(clamping: max(1, segmentMRU))
+        var segments: [(range: Range<Int>, flags: UInt8)] = []
+        var offset = 0
+        
+        repeat {
+            let end = offset + min(segmentSize, length - offset)
+            var flags: UInt8 = 0
+            if offset == 0 { flags |= segmentStart }
+            if end == length { flags |= segmentEnd }
+            segments.append((offset..<end, flags))
+            offset = end
+        } while offset < length
+        
+        return segments
+    }
+    
+    /// Everything of an XFER_SEGMENT up to and including the data length, so the
+    /// payload can be written separately
+    static func xferSegmentHeader(flags: UInt8, transferId: UInt64, extensionItems: [TCPCLExtension], dataLength: UInt64) -> Data {
+        var data = Data()
+        data.append(0x01) // Message type
+        data.append(flags)
+        data.append(contentsOf: withUnsafeBytes(of: transferId.bigEndian) { Data($0) })
+        
+        // Encode extensions
+        let extensionData = TCPCLExtension.encode(extensionItems)
+        data.append(contentsOf: withUnsafeBytes(of: UInt32(extensionData.count).bigEndian) { Data($0) })
+        data.append(extensionData)
+        
+        // Encode data length
+        data.append(contentsOf: withUnsafeBytes(of: dataLength.bigEndian) { Data($0) })
+        return data
+    }
+    
+    package func encode() -> Data {
         var data = Data()
         
         switch self {
         case .xferSegment(let flags, let transferId, let extensions, let payload):
-            data.append(0x01) // Message type
-            data.append(flags)
-            data.append(contentsOf: withUnsafeBytes(of: transferId.bigEndian) { Data($0) })
-            
-            // Encode extensions
-            let extensionData = TCPCLExtension.encode(extensions)
-            data.append(contentsOf: withUnsafeBytes(of: UInt32(extensionData.count).bigEndian) { Data($0) })
-            data.append(extensionData)
-            
-            // Encode data
-            data.append(contentsOf: withUnsafeBytes(of: UInt64(payload.count).bigEndian) { Data($0) })
+            data = Self.xferSegmentHeader(flags: flags, transferId: transferId, extensionItems: extensions, dataLength: UInt64(payload.count))
             data.append(payload)
             
         case .xferAck(let flags, let transferId, let length):
@@ -623,8 +788,13 @@ enum TCPCLMessage {
 }
 
 /// TCPCL Extension Items
-enum TCPCLExtension {
+package enum TCPCLExtension {
     case transferLength(UInt64)
+    /// The transfer is the deflated bundle, which is `bundleLength` bytes inflated
+    case deflate(bundleLength: UInt64)
+    
+    /// Transfer extension type of `deflate`, from the private use range
+    static let deflateType: UInt16 = 0x8001
     
     static func parse(from data: Data) throws -> [TCPCLExtension] {
         var extensions: [TCPCLExtension] = []
@@ -643,6 +813,9 @@ enum TCPCLExtension {
             if type == 0x0001 && length == 8 {
                 let value = data[offset..<offset+8].withUnsafeBytes { $0.load(as: UInt64.self).bigEndian }
                 extensions.append(.transferLength(value))
+            } else if type == deflateType && length == 8 {
+                let value = data[offset..<offset+8].withUnsafeBytes { $0.load(as: UInt64.self).bigEndian }
+                extensions.append(.deflate(bundleLength: value))
             }
             
             offset += Int(length)
@@ -661,6 +834,12 @@ enum TCPCLExtension {
                 data.append(contentsOf: withUnsafeBytes(of: UInt16(0x0001).bigEndian) { Data($0) }) // Type
                 data.append(contentsOf: withUnsafeBytes(of: UInt16(8).bigEndian) { Data($0) }) // Length
                 data.append(contentsOf: withUnsafeBytes(of: value.bigEndian) { Data($0) }) // Value
+            case .deflate(let bundleLength):
+                // Critical: a peer that cannot inflate must not take the bytes as a bundle
+                data.append(0x01) // Flags
+                data.append(contentsOf: withUnsafeBytes(of: deflateType.bigEndian) { Data($0) }) // Type
+                data.append(contentsOf: withUnsafeBytes(of: UInt16(8).bigEndian) { Data($0) }) // Length
+                data.append(contentsOf: withUnsafeBytes(of: bundleLength.bigEndian) { Data($0) }) // Value
             }
         }
         
@@ -669,8 +848,13 @@ enum TCPCLExtension {
 }
 
 /// TCPCL Session Extension Items
-enum TCPCLSessionExtension {
+package enum TCPCLSessionExtension {
     case keepaliveInterval(UInt16)
+    /// This node inflates transfers carrying the `deflate` transfer extension
+    case acceptsDeflate
+    
+    /// Session extension type of `acceptsDeflate`, from the private use range
+    static let acceptsDeflateType: UInt16 = 0x8001
     
     static func parse(from data: Data) throws -> [TCPCLSessionExtension] {
         var extensions: [TCPCLSessionExtension] = []
@@ -691,6 +875,8 @@ enum TCPCLSessionExtension {
             if type == 0x0001 && length == 2 {
                 let value = data[offset..<offset+2].withUnsafeBytes { $0.load(as: UInt16.self).bigEndian }
                 extensions.append(.keepaliveInterval(value))
+            } else if type == acceptsDeflateType && length == 0 {
+                extensions.append(.acceptsDeflate)
             }
             
             offset += Int(length)
@@ -709,6 +895,10 @@ enum TCPCLSessionExtension {
                 data.append(contentsOf: withUnsafeBytes(of: UInt16(0x0001).bigEndian) { Data($0) }) // Type
                 data.append(contentsOf: withUnsafeBytes(of: UInt16(2).bigEndian) { Data($0) }) // Length
                 data.append(contentsOf: withUnsafeBytes(of: value.bigEndian) { Data($0) }) // Value
+            case .acceptsDeflate:
+                data.append(0x00) // Flags
+                data.append(contentsOf: withUnsafeBytes(of: acceptsDeflateType.bigEndian) { Data($0) }) // Type
+                data.append(contentsOf: withUnsafeBytes(of: UInt16(0).bigEndian) { Data($0) }) // Length
             }
         }
         
@@ -726,4 +916,5 @@ enum CLAError: Error {
     case invalidProtocol(String)
     case unsupportedVersion(Int)
     case invalidMessage(String)
+    case transferRefused(UInt64)
 }
\ No newline at end of file
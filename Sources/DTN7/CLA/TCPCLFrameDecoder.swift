@@ -0,0 +1,163 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import NIOCore
+
+/// A unit read off a TCPCLv4 session: the contact header once, then messages
+package enum TCPCLFrame {
+    case contactHeader(version: UInt8, flags: UInt8)
+    case message(TCPCLMessage)
+}
+
+/// Incremental TCPCLv4 decoder over buffered socket reads.
+///
+/// Driven by `NIOSingleStepByteToMessageProcessor`, which accumulates received
+/// chunks and compacts consumed bytes, so a whole message is parsed from memory
+/// once it has arrived instead of one socket receive per field.
+package struct TCPCLFrameDecoder: NIOSingleStepByteToMessageDecoder {
+    package typealias InboundOut = TCPCLFrame
+    
+    /// Largest XFER_SEGMENT payload accepted, the local segment MRU
+    let maxSegmentLength: UInt64
+    
+    private var awaitingContactHeader = true
+    
+    package init(maxSegmentLength: UInt64) {
+        self.maxSegmentLength = maxSegmentLength
+    }
+    
+    package mutating func decode(buffer: inout ByteBuffer) throws -> TCPCLFrame? {
+        // Parse from a copy of the reader state; `buffer` only advances once a whole frame is there
+        var peek = buffer
+        
+        let frame: TCPCLFrame?
+        if awaitingContactHeader {
+            frame = try Self.readContactHeader(from: &peek)
+            awaitingContactHeader = frame == nil
+        } else {
+            frame = try readMessage(from: &peek).map { .message($0) }
+        }
+        
+        if frame != nil {
+            buffer = peek
+        }
+        return frame
+    }
+    
+    package mutating func decodeLast(buffer: inout ByteBuffer, seenEOF: Bool) throws -> TCPCLFrame? {
+        try decode(buffer: &buffer)
+    }
+    
+    private static func readContactHeader(from buffer: inout ByteBuffer) throws -> TCPCLFrame? {
+        guard let magic = buffer.readBytes(length: 4),
+              let version = buffer.readInteger(as: UInt8.self),
+              let flags = buffer.readInteger(as: UInt8.self) else {
+            return nil
+        }
+        
+        guard magic == [0x64, 0x74, 0x6E, 0x21] else { // "dtn!"
+            throw CLAError.invalidProtocol("Invalid contact header magic")
+        }
+        guard version == 0x04 else {
+            throw CLAError.unsupportedVersion(Int(version))
+        }
+        
+        return .contactHeader(version: version, flags: flags)
+    }
+    
+    private func readMessage(from buffer: inout ByteBuffer) throws -> TCPCLMessage? {
+        guard let messageType = buffer.readInteger(as: UInt8.self) else {
+            return nil
+        }
+        
+        switch messageType {
+        case 0x01: // XFER_SEGMENT
+            guard let flags = buffer.readInteger(as: UInt8.self),
+                  let transferId = buffer.readInteger(as: UInt64.self),
+                  let extensionData = try Self.readLengthPrefixed(UInt32.self, from: &buffer),
+                  let dataLength = buffer.readInteger(as: UInt64.self) else {
+                return nil
+            }
+            guard dataLength <= maxSegmentLength else {
+                throw CLAError.invalidProtocol("Segment of \(dataLength) bytes exceeds segment MRU")
+            }
+            guard let data = Self.readData(length: Int(dataLength), from: &buffer) else {
+                return nil
+            }
+            let extensions = try TCPCLExtension.parse(from: extensionData)
+            return .xferSegment(flags: flags, transferId: transferId, extensionItems: extensions, data: data)
+        
+        case 0x02: // XFER_ACK
+            guard let flags = buffer.readInteger(as: UInt8.self),
+                  let transferId = buffer.readInteger(as: UInt64.self),
+                  let length = buffer.readInteger(as: UInt64.self) else {
+                return nil
+            }
+            return .xferAck(flags: flags, transferId: transferId, length: length)
+        
+        case 0x03: // XFER_REFUSE
+            guard let reasonCode = buffer.readInteger(as: UInt8.self),
+                  let transferId = buffer.readInteger(as: UInt64.self) else {
+                return nil
+            }
+            return .xferRefuse(reasonCode: reasonCode, transferId: transferId)
+        
+        case 0x04: // KEEPALIVE
+            return .keepalive
+        
+        case 0x05: // SESS_TERM
+            guard let flags = buffer.readInteger(as: UInt8.self),
+                  let reasonCode = buffer.readInteger(as: UInt8.self) else {
+                return nil
+            }
+            return .sessTerm(flags: flags, reasonCode: reasonCode)
+        
+        case 0x06: // MSG_REJECT
+            guard let reasonCode = buffer.readInteger(as: UInt8.self),
+                  let rejectedMessageHeader = buffer.readInteger(as: UInt8.self) else {
+                return nil
+            }
+            return .msgReject(reasonCode: reasonCode, rejectedMessageHeader: rejectedMessageHeader)
+        
+        case 0x07: // SESS_INIT
+            guard let keepalive = buffer.readInteger(as: UInt16.self),
+                  let segmentMRU = buffer.readInteger(as: UInt64.self),
+                  let transferMRU = buffer.readInteger(as: UInt64.self),
+                  let nodeId = try Self.readLengthPrefixed(UInt16.self, from: &buffer),
+                  let extensionData = try Self.readLengthPrefixed(UInt32.self, from: &buffer) else {
+                return nil
+            }
+            let extensions = try TCPCLSessionExtension.parse(from: extensionData)
+            return .sessInit(
+                keepalive: keepalive,
+                segmentMRU: segmentMRU,
+                transferMRU: transferMRU,
+                nodeId: nodeId,
+                sessionExtensionItems: extensions
+            )
+        
+        default:
+            throw CLAError.invalidProtocol("Unknown message type: \(messageType)")
+        }
+    }
+    
+    /// Reads a big-endian length followed by that many bytes, or nil if they have not all arrived
+    private static func readLengthPrefixed<Length: FixedWidthInteger>(_ type: Length.Type, from buffer: inout ByteBuffer) throws -> Data? {
+        guard let length = buffer.readInteger(as: Length.self) else {
+            return nil
+        }
+        guard let count = Int(exactly: length) else {
+            throw CLAError.invalidMessage("Field length \(length) out of range")
+        }
+        return readData(length: count, from: &buffer)
+    }
+    
+    private static func readData(length: Int, from buffer: inout ByteBuffer) -> Data? {
+        guard let slice = buffer.readSlice(length: length) else {
+            return nil
+        }
+        return slice.withUnsafeReadableBytes { Data($0) }
+    }
+}
@@ -19,20 +19,33 @@ public actor UDPCLA: ConvergenceLayerAgent {
     private let logger = Logger(label: "UDPCLA")
     private var isRunning = false
     
+    // Long-lived outgoing sockets by "host:port", reused for every send to that peer
+    private struct PooledConnection {
+        let connection: NWConnection
+        let openedAt: Date
+        var lastUsed: Date
+    }
+    private var peerConnections: [String: PooledConnection] = [:]
+    private var pendingConnections: [String: Task<NWConnection, Error>] = [:]
+    
     /// Configuration for UDP CLA
     public struct UDPCLAConfig: Sendable {
         public let port: UInt16
         public let bindAddress: String
         public let maxBundleSize: Int
+        /// Outgoing sockets kept open; the least recently used one is closed beyond this
+        public let maxPeerConnections: Int
         
         public init(
             port: UInt16 = 4556,
             bindAddress: String = "0.0.0.0",
-            maxBundleSize: Int = 65535
+            maxBundleSize: Int = 65535,
+            maxPeerConnections: Int = 64
         ) {
             self.port = port
             self.bindAddress = bindAddress
             self.maxBundleSize = min(maxBundleSize, 65535) // UDP limit
+            self.maxPeerConnections = max(1, maxPeerConnections)
         }
     }
     
@@ -73,31 +86,109 @@ public actor UDPCLA: ConvergenceLayerAgent {
         listener?.cancel()
         listener = nil
         
+        for task in pendingConnections.values {
+            task.cancel()
+        }
+        for pooled in peerConnections.values {
+            pooled.connection.cancel()
+        }
+        pendingConnections.removeAll()
+        peerConnections.removeAll()
+        
         isRunning = false
         logger.info("UDP CLA stopped")
     }
     
     public func sendBundle(_ bundle: BP7.Bundle, to peer: DtnPeer) async throws {
+        try await sendBundle(encoded: bundle.encode(), bundleId: BundlePack.id(of: bundle), to: peer)
+    }
+    
+    public func sendBundle(encoded bundleData: [UInt8], bundleId: String, to peer: DtnPeer) async throws {
+        try await sendBundles([EncodedBundle(id: bundleId, data: bundleData)], to: peer)
+    }
+    
+    /// Send the bundles as datagrams on the peer's pooled socket, in one batch
+    public func sendBundles(_ bundles: [EncodedBundle], to peer: DtnPeer) async throws {
+        guard !bundles.isEmpty else { return }
+        
         guard let peerAddress = extractUDPAddress(from: peer) else {
             throw CLAError.invalidPeerAddress
         }
         
-        let bundleData = bundle.encode()
-        
         // Check bundle size
-        guard bundleData.count <= config.maxBundleSize else {
-            logger.error("Bundle too large for UDP: \(bundleData.count) bytes")
-            throw CLAError.bundleTooLarge(bundleData.count, config.maxBundleSize)
+        for bundle in bundles where bundle.data.count > config.maxBundleSize {
+            logger.error("Bundle too large for UDP: \(bundle.data.count) bytes")
+            throw CLAError.bundleTooLarge(bundle.data.count, config.maxBundleSize)
+        }
+        
+        let connection = try await peerConnection(host: peerAddress.host, port: peerAddress.port)
+        
+        // Network.framework coalesces the datagrams of a batch into as few system calls as it can;
+        // only the last completion is awaited, which also paces callers to the socket
+        try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
+            connection.batch {
+                for bundle in bundles.dropLast() {
+                    connection.send(content: Data(bundle.data), completion: .idempotent)
+                }
+                connection.send(content: Data(bundles[bundles.count - 1].data), completion: .contentProcessed { error in
+                    if let error = error {
+                        continuation.resume(throwing: error)
+                    } else {
+                        continuation.resume()
+                    }
+                })
+            }
+        }
+        
+        if bundles.count == 1 {
+            logger.debug("Sent bundle \(bundles[0].id) via UDP to \(peerAddress.host):\(peerAddress.port)")
+        } else {
+            logger.debug("Sent \(bundles.count) bundles via UDP to \(peerAddress.host):\(peerAddress.port)")
+        }
+    }
+    
+    /// The pooled socket for a peer, opening it on first use
+    private func peerConnection(host: String, port: UInt16) async throws -> NWConnection {
+        let key = "\(host):\(port)"
+        
+        if let pooled = peerConnections[key] {
+            peerConnections[key]?.lastUsed = Date()
+            return pooled.connection
+        }
+        
+        // Concurrent sends to a new peer share one connection attempt
+        if let pending = pendingConnections[key] {
+            return try await pending.value
         }
         
-        // Create UDP connection
         let endpoint = NWEndpoint.hostPort(
-            host: .init(peerAddress.host),
-            port: .init(integerLiteral: peerAddress.port)
+            host: .init(host),
+            port: .init(integerLiteral: port)
         )
+        let task = Task { try await Self.openConnection(to: endpoint) }
+        pendingConnections[key] = task
+        defer { pendingConnections[key] = nil }
+        
+        let connection = try await task.value
         
+        // Drop the socket from the pool once it fails, so the next send reopens it
+        connection.stateUpdateHandler = { [weak self] state in
+            switch state {
+            case .failed, .cancelled:
+                Task { await self?.removePeerConnection(key, connection) }
+            default:
+                break
+            }
+        }
+        
+        let now = Date()
+        peerConnections[key] = PooledConnection(connection: connection, openedAt: now, lastUsed: now)
+        evictIdleConnections()
+        return connection
+    }
+    
+    private static func openConnection(to endpoint: NWEndpoint) async throws -> NWConnection {
         let connection = NWConnection(to: endpoint, using: .udp)
-        connection.start(queue: .global())
         
         // Wait for connection to be ready
         try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
@@ -107,31 +198,32 @@ public actor UDPCLA: ConvergenceLayerAgent {
                     connection.stateUpdateHandler = nil
                     continuation.resume()
                 case .failed(let error):
+                    connection.stateUpdateHandler = nil
                     continuation.resume(throwing: error)
                 case .cancelled:
+                    connection.stateUpdateHandler = nil
                     continuation.resume(throwing: CLAError.connectionCancelled)
                 default:
                     break
                 }
             }
+            connection.start(queue: .global())
         }
         
-        // Send bundle data
-        try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
-            connection.send(content: bundleData, completion: .contentProcessed { error in
-                if let error = error {
-                    continuation.resume(throwing: error)
-                } else {
-                    continuation.resume()
-                }
-            })
+        return connection
+    }
+    
+    private func removePeerConnection(_ key: String, _ connection: NWConnection) {
+        guard peerConnections[key]?.connection === connection else { return }
+        peerConnections[key] = nil
+    }
+    
+    /// Close least recently used sockets beyond `maxPeerConnections`
+    private func evictIdleConnections() {
+        while peerConnections.count > config.maxPeerConnections,
+              let oldest = peerConnections.min(by: { $0.value.lastUsed < $1.value.lastUsed }) {
+            peerConnections.removeValue(forKey: oldest.key)?.connection.cancel()
         }
-        
-        // Close connection
-        connection.cancel()
-        
-        let bundleId = BundlePack(from: bundle).id
-        logger.debug("Sent bundle \(bundleId) via UDP to \(endpoint)")
     }
     
     public nonisolated func canReach(_ peer: DtnPeer) -> Bool {
@@ -140,8 +232,15 @@ public actor UDPCLA: ConvergenceLayerAgent {
     }
     
     public func getConnections() async -> [CLAConnection] {
-        // UDP doesn't maintain persistent connections
-        return []
+        peerConnections.map { key, pooled in
+            CLAConnection(
+                id: "udp-\(key)",
+                remoteEndpointId: nil, // UDP doesn't provide peer ID
+                remoteAddress: key,
+                claType: "udp",
+                establishedAt: pooled.openedAt
+            )
+        }
     }
     
     private func handleIncomingConnection(_ connection: NWConnection) async {
@@ -166,7 +265,7 @@ public actor UDPCLA: ConvergenceLayerAgent {
         do {
             // Parse bundle
             let bundle = try BP7.Bundle.decode(from: Array(data))
-            let bundleId = BundlePack(from: bundle).id
+            let bundleId = BundlePack.id(of: bundle)
             
             logger.debug("Received bundle \(bundleId) via UDP from \(endpoint)")
             
@@ -28,8 +28,8 @@ public struct DtnStatistics: Sendable {
         dups += 1
     }
     
-    public mutating func recordOutgoing() {
-        outgoing += 1
+    public mutating func recordOutgoing(_ count: Int = 1) {
+        outgoing += UInt64(count)
     }
     
     public mutating func recordDelivered() {
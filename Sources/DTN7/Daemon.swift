@@ -4,6 +4,7 @@ import FoundationEssentials
 import Foundation
 #endif
 import Hummingbird
+import HummingbirdWebSocket
 import Logging
 import BP7
 import CBOR
@@ -28,11 +29,20 @@ struct BundlesResponse: Codable {
     let bundles: [String]
 }
 
+struct SendBatchResponse: Codable {
+    /// IDs of the bundles accepted, in request order
+    let sent: [String]
+    /// Why the others were not
+    let errors: [String]
+}
+
 struct PeerInfo: Codable {
     let eid: String
     let type: String
     let lastContact: TimeInterval
     let services: [UInt8: String]
+    /// Bundles waiting in the peer's outbound queue
+    let queueDepth: Int
 }
 
 struct PeersResponse: Codable {
@@ -48,6 +58,7 @@ struct StatsResponse: Codable {
     let failed: UInt64
     let broken: UInt64
     let stored: UInt64
+    let latencies: [String: LatencyHistogram.Snapshot]
 }
 
 enum DaemonError: Error {
@@ -71,17 +82,33 @@ public actor Daemon {
         
         // Initialize store based on config
         let store: any BundleStore
+        let storeOptions = try CSQLiteStore.Options(settings: config.dbSettings)
         switch config.db {
         case "sled", "sneakers":
             // For now, fall back to CSQLite for persistent storage
             logger.info("Using CSQLite store (requested: \(config.db))")
-            store = try CSQLiteStore(path: "\(config.workdir)/bundles.db")
+            store = try CSQLiteStore(path: "\(config.workdir)/bundles.db", options: storeOptions)
+        case "segment":
+            let segmentOptions = try SegmentLogStore.Options(settings: config.dbSettings)
+            logger.info("Using segment log store at: \(config.workdir)/segments (bundles over \(segmentOptions.inlineMaxSize) bytes in the log)")
+            store = try await SegmentLogStore(directory: "\(config.workdir)/segments", options: segmentOptions)
         case "mem":
-            logger.info("Using in-memory store")
-            store = InMemoryBundleStore()
+            let memOptions = InMemoryBundleStore.Options(settings: config.dbSettings)
+            if let budget = memOptions.byteBudget, config.dbSettings["mem_spill"] != "false" {
+                // Spilled bundles are as volatile as the rest of the store, so start from an empty file
+                let spillPath = "\(config.workdir)/spill.db"
+                for suffix in ["", "-wal", "-shm"] {
+                    try? FileManager.default.removeItem(atPath: spillPath + suffix)
+                }
+                logger.info("Using in-memory store with a \(budget) byte budget, spilling to \(spillPath)")
+                store = InMemoryBundleStore(options: memOptions, overflow: try CSQLiteStore(path: spillPath, options: storeOptions))
+            } else {
+                logger.info("Using in-memory store")
+                store = InMemoryBundleStore(options: memOptions)
+            }
         default:
             logger.info("Using CSQLite store at: \(config.workdir)/bundles.db")
-            store = try CSQLiteStore(path: "\(config.workdir)/bundles.db")
+            store = try CSQLiteStore(path: "\(config.workdir)/bundles.db", options: storeOptions)
         }
         
         // Parse node ID
@@ -90,13 +117,13 @@ public actor Daemon {
         // Create DTN core
         self.core = DtnCore(nodeId: nodeId, store: store, config: config)
         
-        // Set up bundle processor reference
-        await core.bundleProcessor.setCore(core)
+        // Set up bundle processor references
+        await core.pipeline.setCore(core)
         
         // Register configured endpoints
         for endpoint in config.endpoints {
             if let eid = try? EndpointID.from(endpoint) {
-                _ = await core.registerEndpoint(eid)
+                await core.registerEndpoint(eid)
             }
         }
         
@@ -143,7 +170,7 @@ public actor Daemon {
         setupApplication()
         
         // Debug: Log registered routes
-        logger.info("Routes registered: /test, /, /status, /bundles, /peers, /stats")
+        logger.info("Routes registered: /test, /, /status, /bundles, /peers, /stats, /metrics, /debug/trace, /send/batch, /ws, /push, /status/bundles, /download, /summary")
         
         // Start the core
         try await core.start()
@@ -157,6 +184,7 @@ public actor Daemon {
     
     /// Set up HTTP routes
     private func setupRoutes(router: Router<some RequestContext>) {
+        let maxSendPayload = config.maxSendPayload
         
         // Simple test route
         router.get("/test") { _, _ in
@@ -177,6 +205,7 @@ public actor Daemon {
             <li><a href="/bundles">Bundles</a></li>
             <li><a href="/peers">Peers</a></li>
             <li><a href="/stats">Statistics</a></li>
+            <li><a href="/metrics">Metrics</a></li>
             </ul>
             </body>
             </html>
@@ -209,11 +238,13 @@ public actor Daemon {
         }
         
         router.get("/bundles") { _, _ in
-            let count = await self.core.store.count()
-            let bundleIds = await self.core.store.allIds()
+            var bundleIds: [String] = []
+            for await bundleId in self.core.store.idStream() {
+                bundleIds.append(bundleId)
+            }
             
             let response = BundlesResponse(
-                count: Int(count),
+                count: bundleIds.count,
                 bundles: bundleIds
             )
             
@@ -228,12 +259,14 @@ public actor Daemon {
         
         router.get("/peers") { _, _ in
             let peers = await self.core.peerManager.getAllPeers()
+            let queueDepths = await self.core.outbound.depths()
             let peerInfos = peers.map { peer in
                 PeerInfo(
                     eid: peer.eid.description,
                     type: peer.claList.first?.0 ?? "unknown",
                     lastContact: peer.lastContact,
-                    services: peer.services
+                    services: peer.services,
+                    queueDepth: queueDepths[peer.eid] ?? 0
                 )
             }
             
@@ -260,7 +293,8 @@ public actor Daemon {
                 delivered: stats.delivered,
                 failed: stats.failed,
                 broken: stats.broken,
-                stored: stats.stored
+                stored: stats.stored,
+                latencies: self.core.metrics.latencies()
             )
             
             let encoder = JSONEncoder()
@@ -272,6 +306,23 @@ public actor Daemon {
             return "{\"error\": \"Failed to encode stats\"}"
         }
         
+        // Prometheus scrape endpoint
+        router.get("/metrics") { _, _ in
+            let stored = await self.core.store.count()
+            return self.core.metrics.prometheusText(stored: stored)
+        }
+        
+        // Spans of the sampled bundles, as plain JSON or, with format=otlp, OTLP/JSON
+        router.get("/debug/trace") { request, _ in
+            let limit = request.uri.queryParameters["limit"].flatMap { Int(String($0)) } ?? 1_000
+            let tracer = self.core.tracer
+            let spans = tracer.recentSpans(limit: limit)
+            if request.uri.queryParameters["format"] == "otlp" {
+                return Self.binary(try tracer.otlpJSON(spans, nodeId: self.core.nodeId.description), contentType: "application/json")
+            }
+            return Self.binary(try tracer.debugJSON(spans), contentType: "application/json")
+        }
+        
         // Application interface endpoints
         router.get("/register") { request, _ in
             guard let endpoint = request.uri.queryParameters["endpoint"] else {
@@ -280,8 +331,7 @@ public actor Daemon {
             
             do {
                 let eid = try EndpointID.from(String(endpoint))
-                _ = await self.core.registerEndpoint(eid)
-                // Store the channel for the application (in a real implementation)
+                await self.core.registerEndpoint(eid)
                 return "Registered endpoint: \(endpoint)"
             } catch {
                 return "Error: Invalid endpoint - \(error)"
@@ -314,36 +364,10 @@ public actor Daemon {
             do {
                 let srcEid = try EndpointID.from(src)
                 let dstEid = try EndpointID.from(String(dst))
-                let payload = try await request.body.collect(upTo: 10 * 1024 * 1024) // 10MB limit
-                
-                // Create bundle using builder pattern
-                let creationTime = CreationTimestamp()
-                let lifetimeSeconds = lifetime / 1000.0 // Convert from ms to seconds
-                
-                // Log bundle creation details
-                print("DEBUG: Creating bundle: lifetime=\(lifetimeSeconds)s, creationTime=\(creationTime)")
-                
-                let primaryBlock = PrimaryBlockBuilder(destination: dstEid)
-                    .source(srcEid)
-                    .reportTo(srcEid)
-                    .creationTimestamp(creationTime)
-                    .lifetime(lifetimeSeconds)
-                    .crc(.crc32(0))
-                    .build()
-                
-                let payloadBlock = CanonicalBlock(
-                    blockType: BlockType.payload.rawValue,
-                    blockNumber: 1,
-                    blockControlFlags: 0,
-                    crc: .crc32(0),
-                    data: .data(Array(payload.readableBytesView))
-                )
-                
-                let bundle = Bundle(
-                    primary: primaryBlock,
-                    canonicals: [payloadBlock]
-                )
+                let payload = try await Self.collectPayload(request, limit: maxSendPayload)
                 
+                // Convert the lifetime from ms to seconds
+                let bundle = Self.makeBundle(from: srcEid, to: dstEid, lifetime: lifetime / 1000.0, payload: payload)
                 try await self.core.submitBundle(bundle)
                 return "Bundle sent from \(src) to \(dst)"
             } catch {
@@ -351,6 +375,36 @@ public actor Daemon {
             }
         }
         
+        // Many bundles per request: a CBOR array of the send requests WebSocket clients use
+        router.post("/send/batch") { request, _ in
+            let body = try await Self.collectPayload(request, limit: maxSendPayload)
+            guard let requests = try? BundleSendRequest.decodeBatch(body) else {
+                throw HTTPError(.badRequest, message: "Body is not a CBOR array of send requests")
+            }
+            
+            var bundles: [BP7.Bundle] = []
+            var errors: [String] = []
+            bundles.reserveCapacity(requests.count)
+            for sendRequest in requests {
+                do {
+                    bundles.append(Self.makeBundle(
+                        from: try EndpointID.from(sendRequest.src),
+                        to: try EndpointID.from(sendRequest.dst),
+                        lifetime: TimeInterval(sendRequest.lifetime) / 1000.0,
+                        payload: Array(sendRequest.data)
+                    ))
+                } catch {
+                    errors.append("\(sendRequest.src) -> \(sendRequest.dst): \(error)")
+                }
+            }
+            
+            let failures = await self.core.submitBundles(bundles)
+            let failed = Set(failures.map(\.id))
+            errors += failures.map { "\($0.id): \($0.error)" }
+            let sent = bundles.map { BundlePack.id(of: $0) }.filter { !failed.contains($0) }
+            return try Self.json(SendBatchResponse(sent: sent, errors: errors))
+        }
+        
         router.get("/endpoint") { request, _ in
             guard let endpoint = request.uri.queryParameters["endpoint"] else {
                 return "Error: Missing endpoint parameter"
@@ -359,20 +413,11 @@ public actor Daemon {
             do {
                 let eid = try EndpointID.from(String(endpoint))
                 
-                // Check if endpoint is registered
-                if await self.core.applicationAgent.isEndpointRegistered(eid) {
-                    // Get pending bundles for this endpoint
-                    let pendingBundles = await self.core.applicationAgent.getPendingBundles(for: eid)
-                    
-                    if let firstBundle = pendingBundles.first {
-                        // Clear the pending bundle
-                        await self.core.applicationAgent.clearPendingBundles(for: eid)
-                        
-                        // Return the bundle as CBOR
-                        let bundleData = firstBundle.encode()
-                        // Return as base64 for text response
-                        return Data(bundleData).base64EncodedString()
-                    }
+                // One bundle per request; the rest stay queued for the next poll
+                if await self.core.applicationAgent.isEndpointRegistered(eid),
+                   let bundle = await self.core.applicationAgent.takePendingBundle(for: eid) {
+                    // Return the bundle as CBOR, base64 encoded for a text response
+                    return Data(bundle.encode()).base64EncodedString()
                 }
                 
                 return "Nothing to receive"
@@ -380,6 +425,185 @@ public actor Daemon {
                 return "Error: Invalid endpoint - \(error)"
             }
         }
+        
+        // HTTP CLA endpoints: peers push bundles here and pull our stored bundles
+        router.post("/push") { request, _ in
+            let body = try await Self.pushedBody(request)
+            try await self.receivePushed([body])
+            return "Received 1 bundle"
+        }
+        
+        router.post("/push/batch") { request, _ in
+            let body = try await Self.pushedBody(request)
+            guard let encoded = try? BundleBatch.decode(body) else {
+                throw HTTPError(.badRequest, message: "Truncated bundle batch")
+            }
+            try await self.receivePushed(encoded)
+            return "Received \(encoded.count) bundle(s)"
+        }
+        
+        router.get("/status/bundles") { _, _ in
+            var bundleIds: [String] = []
+            for await bundleId in self.core.store.idStream() {
+                bundleIds.append(bundleId)
+            }
+            return try Self.json(BundlesResponse(count: bundleIds.count, bundles: bundleIds))
+        }
+        
+        router.get("/status/bundles/since") { request, _ in
+            let cursor = request.uri.queryParameters["cursor"].map(String.init)
+            let limit = request.uri.queryParameters["limit"].flatMap { Int(String($0)) } ?? 1_000
+            return try Self.json(self.core.journal.page(after: cursor, limit: min(limit, 10_000)))
+        }
+        
+        router.get("/summary") { _, _ in
+            let vector = await self.core.summaryVector()
+            return Self.binary(vector.encode(), contentType: SummaryVector.contentType)
+        }
+        
+        router.get("/download") { request, _ in
+            guard let bundleId = request.uri.queryParameters["bundle"] else {
+                throw HTTPError(.badRequest, message: "Missing bundle parameter")
+            }
+            guard await self.core.store.hasItem(bundleId: String(bundleId)) else {
+                throw HTTPError(.notFound, message: "Unknown bundle")
+            }
+            
+            // Written out chunk by chunk from the store rather than read whole
+            let chunks = self.core.store.bundleChunks(bundleId: String(bundleId), chunkSize: Self.streamChunkSize)
+            return Response(
+                status: .ok,
+                headers: [.contentType: "application/octet-stream"],
+                body: ResponseBody { writer in
+                    for await chunk in chunks {
+                        try await writer.write(ByteBuffer(bytes: chunk))
+                    }
+                    try await writer.finish(nil)
+                }
+            )
+        }
+        
+        router.post("/download/batch") { request, _ in
+            struct BatchRequest: Codable {
+                let bundles: [String]
+            }
+            
+            let body = try await request.body.collect(upTo: 1024 * 1024)
+            guard let batch = try? JSONDecoder().decode(BatchRequest.self, from: Data(body.readableBytesView)) else {
+                throw HTTPError(.badRequest, message: "Expected {\"bundles\": [...]}")
+            }
+            
+            // Bundles removed since they were listed are left out. Past the size cap the
+            // response stops, always after at least one bundle, and says how far it got
+            var encoded: [[UInt8]] = []
+            var size = 0
+            var served = 0
+            for bundleId in batch.bundles {
+                if let data = await self.core.store.getBundleBytes(bundleId: bundleId) {
+                    guard encoded.isEmpty || size + 4 + data.count <= Self.maxBundleBody else { break }
+                    encoded.append(data)
+                    size += 4 + data.count
+                }
+                served += 1
+            }
+            var response = Self.binary(BundleBatch.encode(encoded), contentType: BundleBatch.contentType)
+            if let name = HTTPField.Name(BundleBatch.servedHeader) {
+                response.headers[name] = String(served)
+            }
+            return response
+        }
+    }
+    
+    /// Largest body accepted by `/push` and `/push/batch`, before and after inflating,
+    /// and the size a `/download/batch` response stops at
+    private static let maxBundleBody = 64 * 1024 * 1024
+    
+    /// The body of a push, inflated if the peer sent it deflated
+    private static func pushedBody(_ request: Request) async throws -> [UInt8] {
+        let body = Array(try await request.body.collect(upTo: maxBundleBody).readableBytesView)
+        switch request.headers[.contentEncoding]?.lowercased() {
+        case nil, "identity":
+            return body
+        case Deflate.contentEncoding:
+            guard let inflated = Deflate.decompress(body, maxSize: maxBundleBody) else {
+                throw HTTPError(.badRequest, message: "Invalid deflated body")
+            }
+            return inflated
+        default:
+            throw HTTPError(.unsupportedMediaType)
+        }
+    }
+    
+    /// Bytes per chunk when streaming stored bundles out
+    private static let streamChunkSize = 1024 * 1024
+    
+    /// Read a request body of at most `limit` bytes straight into one array, instead of
+    /// collecting it into a buffer and copying that out.
+    ///
+    /// `Content-Length` is only trusted to reject a body up front and for the first chunk
+    /// of capacity; the array grows as bytes actually arrive.
+    private static func collectPayload(_ request: Request, limit: Int) async throws -> [UInt8] {
+        let expected = request.headers[.contentLength].flatMap { Int($0) } ?? 0
+        guard expected <= limit else {
+            throw HTTPError(.contentTooLarge)
+        }
+        
+        var payload: [UInt8] = []
+        payload.reserveCapacity(min(max(0, expected), streamChunkSize))
+        for try await buffer in request.body {
+            guard payload.count + buffer.readableBytes <= limit else {
+                throw HTTPError(.contentTooLarge)
+            }
+            payload.append(contentsOf: buffer.readableBytesView)
+        }
+        return payload
+    }
+    
+    /// Decode pushed bundles and queue them for reception, keeping their bytes
+    private func receivePushed(_ encoded: [[UInt8]]) async throws {
+        var contexts: [BundleContext] = []
+        for data in encoded {
+            guard let bundle = try? BP7.Bundle.decode(from: data) else {
+                throw HTTPError(.badRequest, message: "Invalid bundle")
+            }
+            contexts.append(BundleContext(bundle: bundle, encoded: data))
+        }
+        for context in contexts {
+            await core.pipeline.receive(context)
+        }
+    }
+    
+    /// A bundle with a single payload block, as `/send` and WebSocket clients submit them
+    static func makeBundle(from source: EndpointID, to destination: EndpointID, lifetime: TimeInterval, payload: [UInt8]) -> BP7.Bundle {
+        let primaryBlock = PrimaryBlockBuilder(destination: destination)
+            .source(source)
+            .reportTo(source)
+            .creationTimestamp(CreationTimestamp())
+            .lifetime(lifetime)
+            .crc(.crc32(0))
+            .build()
+        
+        let payloadBlock = CanonicalBlock(
+            blockType: BlockType.payload.rawValue,
+            blockNumber: 1,
+            blockControlFlags: 0,
+            crc: .crc32(0),
+            data: .data(payload)
+        )
+        
+        return Bundle(primary: primaryBlock, canonicals: [payloadBlock])
+    }
+    
+    private static func json(_ value: some Encodable) throws -> String {
+        String(decoding: try JSONEncoder().encode(value), as: UTF8.self)
+    }
+    
+    private static func binary(_ bytes: [UInt8], contentType: String) -> Response {
+        Response(
+            status: .ok,
+            headers: [.contentType: contentType],
+            body: ResponseBody(byteBuffer: ByteBuffer(bytes: bytes))
+        )
     }
     
     /// Create a CLA from configuration
@@ -389,11 +613,16 @@ public actor Daemon {
             let port = UInt16(config.settings["port"] ?? "4556") ?? 4556
             let bindAddress = config.settings["bind"] ?? "0.0.0.0"
             let refuseExisting = config.settings["refuse-existing-bundles"] == "true"
+            let defaults = TCPCLA.TCPCLAConfig()
             
             let tcpConfig = TCPCLA.TCPCLAConfig(
                 port: port,
                 bindAddress: bindAddress,
-                refuseExistingBundles: refuseExisting
+                refuseExistingBundles: refuseExisting,
+                segmentMRU: config.settings["segment-mru"].flatMap(UInt64.init) ?? defaults.segmentMRU,
+                transferMRU: config.settings["transfer-mru"].flatMap(UInt64.init) ?? defaults.transferMRU,
+                ackWindow: config.settings["ack-window"].flatMap(Int.init) ?? defaults.ackWindow,
+                compressMinSize: config.settings["compress-min"].flatMap(Int.init) ?? defaults.compressMinSize
             )
             return TCPCLA(config: tcpConfig)
             
@@ -403,12 +632,16 @@ public actor Daemon {
             
             let udpConfig = UDPCLA.UDPCLAConfig(
                 port: port,
-                bindAddress: bindAddress
+                bindAddress: bindAddress,
+                maxPeerConnections: config.settings["max-connections"].flatMap(Int.init) ?? 64
             )
             return UDPCLA(config: udpConfig)
             
         case "http":
-            return HTTPCLA()
+            let httpConfig = HTTPCLA.HTTPCLAConfig(
+                compressMinSize: config.settings["compress-min"].flatMap(Int.init) ?? 0
+            )
+            return HTTPCLA(config: httpConfig)
             
         case "httppull":
             let pollingInterval = TimeInterval(config.settings["interval"] ?? "30") ?? 30
@@ -426,7 +659,8 @@ public actor Daemon {
     private func createRoutingAgent() async throws -> any RoutingAgent {
         switch config.routing.lowercased() {
         case "epidemic":
-            return EpidemicRouting()
+            // Peers without an HTTP CLA are asked for their summary vector on our own web port
+            return EpidemicRouting(summaryExchange: SummaryVector.httpExchange(fallbackPort: config.webPort))
             
         case "flooding":
             return FloodingRouting()
@@ -447,19 +681,29 @@ public actor Daemon {
             
         default:
             logger.warning("Unknown routing algorithm '\(config.routing)', defaulting to epidemic")
-            return EpidemicRouting()
+            return EpidemicRouting(summaryExchange: SummaryVector.httpExchange(fallbackPort: config.webPort))
         }
     }
     
     /// Set up the application with properly configured routes
     private func setupApplication() {
         // Create a new router with all routes configured
-        let router = Router()
+        let router = Router(context: BasicWebSocketRequestContext.self)
         setupRoutes(router: router)
         
+        // Applications connect here for push delivery
+        let core = self.core
+        router.ws("/ws") { inbound, outbound, _ in
+            try await WebSocketSession(core: core, outbound: outbound).run(inbound)
+        }
+        
         // Replace the app with one that has the properly configured router
         self.app = Application(
             router: router,
+            server: .http1WebSocketUpgrade(
+                webSocketRouter: router,
+                configuration: .init(maxFrameSize: WebSocketSession.maxFrameSize)
+            ),
             configuration: .init(
                 address: .hostname(config.ipv6 ? "::1" : "127.0.0.1", port: Int(config.webPort))
             )
@@ -16,10 +16,15 @@ public struct DtnConfig: Codable, Sendable {
     public var nodeId: String = ""
     public var hostEid: EndpointID?
     public var webPort: UInt16 = 4242
+    /// Largest payload accepted by `/send` and largest body by `/send/batch`, in bytes;
+    /// bodies are collected in memory, so this bounds what one request can make the daemon hold
+    public var maxSendPayload: Int = 16 * 1024 * 1024
     public var announcementInterval: TimeInterval = 60
     public var disableNeighbourDiscovery: Bool = false
     public var discoveryDestinations: [String: UInt32] = [:]
     public var janitorInterval: TimeInterval = 10
+    /// Seconds between snapshots of the duplicate filters and routing state; 0 saves them only on shutdown
+    public var stateSnapshotInterval: TimeInterval = 60
     public var endpoints: [String] = []
     public var clas: [CLAConfig] = []
     public var services: [UInt8: String] = [:]
@@ -40,13 +45,17 @@ public struct DtnConfig: Codable, Sendable {
     public var statics: [DtnPeer] = []
     public var workdir: String = "."
     public var db: String = "mem"
+    public var dbSettings: [String: String] = [:]
+    public var dedupSettings: [String: String] = [:]
+    public var schedulerSettings: [String: String] = [:]
+    public var traceSettings: [String: String] = [:]
     public var generateStatusReports: Bool = false
     public var eclaTcpPort: UInt16 = 4243
     public var eclaEnable: Bool = false
     public var parallelBundleProcessing: Bool = false
     
     enum CodingKeys: String, CodingKey {
-        case debug, unsafeHttpd, ipv4, ipv6, customTimeout, enablePeriod, nodeId, hostEid, webPort, announcementInterval, disableNeighbourDiscovery, discoveryDestinations, janitorInterval, endpoints, clas, services, routing, routingSettings, peerTimeout, statics, workdir, db, generateStatusReports, eclaTcpPort, eclaEnable, parallelBundleProcessing
+        case debug, unsafeHttpd, ipv4, ipv6, customTimeout, enablePeriod, nodeId, hostEid, webPort, maxSendPayload, announcementInterval, disableNeighbourDiscovery, discoveryDestinations, janitorInterval, stateSnapshotInterval, endpoints, clas, services, routing, routingSettings, peerTimeout, statics, workdir, db, dbSettings, dedupSettings, schedulerSettings, traceSettings, generateStatusReports, eclaTcpPort, eclaEnable, parallelBundleProcessing
     }
 
     public init() {}
@@ -64,10 +73,12 @@ public struct DtnConfig: Codable, Sendable {
             hostEid = try EndpointID.from(hostEidString)
         }
         webPort = try container.decode(UInt16.self, forKey: .webPort)
+        maxSendPayload = try container.decodeIfPresent(Int.self, forKey: .maxSendPayload) ?? 16 * 1024 * 1024
         announcementInterval = try container.decode(TimeInterval.self, forKey: .announcementInterval)
         disableNeighbourDiscovery = try container.decode(Bool.self, forKey: .disableNeighbourDiscovery)
         discoveryDestinations = try container.decode([String: UInt32].self, forKey: .discoveryDestinations)
         janitorInterval = try container.decode(TimeInterval.self, forKey: .janitorInterval)
+        stateSnapshotInterval = try container.decodeIfPresent(TimeInterval.self, forKey: .stateSnapshotInterval) ?? 60
         endpoints = try container.decode([String].self, forKey: .endpoints)
         clas = try container.decodeIfPresent([CLAConfig].self, forKey: .clas) ?? []
         services = try container.decode([UInt8: String].self, forKey: .services)
@@ -77,6 +88,10 @@ public struct DtnConfig: Codable, Sendable {
         statics = try container.decode([DtnPeer].self, forKey: .statics)
         workdir = try container.decode(String.self, forKey: .workdir)
         db = try container.decode(String.self, forKey: .db)
+        dbSettings = try container.decodeIfPresent([String: String].self, forKey: .dbSettings) ?? [:]
+        dedupSettings = try container.decodeIfPresent([String: String].self, forKey: .dedupSettings) ?? [:]
+        schedulerSettings = try container.decodeIfPresent([String: String].self, forKey: .schedulerSettings) ?? [:]
+        traceSettings = try container.decodeIfPresent([String: String].self, forKey: .traceSettings) ?? [:]
         generateStatusReports = try container.decode(Bool.self, forKey: .generateStatusReports)
         eclaTcpPort = try container.decode(UInt16.self, forKey: .eclaTcpPort)
         eclaEnable = try container.decode(Bool.self, forKey: .eclaEnable)
@@ -94,10 +109,12 @@ public struct DtnConfig: Codable, Sendable {
         try container.encode(nodeId, forKey: .nodeId)
         try container.encodeIfPresent(hostEid?.description, forKey: .hostEid)
         try container.encode(webPort, forKey: .webPort)
+        try container.encode(maxSendPayload, forKey: .maxSendPayload)
         try container.encode(announcementInterval, forKey: .announcementInterval)
         try container.encode(disableNeighbourDiscovery, forKey: .disableNeighbourDiscovery)
         try container.encode(discoveryDestinations, forKey: .discoveryDestinations)
         try container.encode(janitorInterval, forKey: .janitorInterval)
+        try container.encode(stateSnapshotInterval, forKey: .stateSnapshotInterval)
         try container.encode(endpoints, forKey: .endpoints)
         try container.encode(clas, forKey: .clas)
         try container.encode(services, forKey: .services)
@@ -107,6 +124,10 @@ public struct DtnConfig: Codable, Sendable {
         try container.encode(statics, forKey: .statics)
         try container.encode(workdir, forKey: .workdir)
         try container.encode(db, forKey: .db)
+        try container.encode(dbSettings, forKey: .dbSettings)
+        try container.encode(dedupSettings, forKey: .dedupSettings)
+        try container.encode(schedulerSettings, forKey: .schedulerSettings)
+        try container.encode(traceSettings, forKey: .traceSettings)
         try container.encode(generateStatusReports, forKey: .generateStatusReports)
         try container.encode(eclaTcpPort, forKey: .eclaTcpPort)
         try container.encode(eclaEnable, forKey: .eclaEnable)
@@ -6,24 +6,35 @@ import Foundation
 import BP7
 import Logging
 import AsyncAlgorithms
+import NIOConcurrencyHelpers
 
 /// The central DTN core that manages all components
 public actor DtnCore {
     // Core components
     public let nodeId: EndpointID
     public let store: any BundleStore
-    public let bundleProcessor: BundleProcessor
+    public let pipeline: BundlePipeline
     public let claRegistry: CLARegistry
     public let peerManager: PeerManager
     public let serviceRegistry: ServiceRegistry
     public let applicationAgent: ApplicationAgent
     public let janitor: Janitor
+    public let outbound: OutboundQueues
+    
+    // Recently stored bundle IDs, served to pulling peers as a delta listing
+    public let journal = StoreJournal()
     
     // Routing agent (optional, can be set later)
     private var routingAgent: (any RoutingAgent)?
     
-    // Statistics
-    private var statistics = DtnStatistics()
+    // Counters and latency histograms, updated without going through this actor
+    public let metrics: DtnMetrics
+    
+    // Samples bundles and keeps the spans of their way through the node
+    public let tracer: Tracer
+    
+    // Byte rate budgets by CLA name
+    private let bandwidth: [String: BandwidthBudget]
     
     // Logger
     private let logger = Logger(label: "DtnCore")
@@ -32,7 +43,24 @@ public actor DtnCore {
     private var backgroundTasks: [Task<Void, Never>] = []
     
     // Registered endpoints
-    private var localEndpoints: Set<EndpointID> = []
+    private var localEndpoints: Set<EndpointID> = [] {
+        didSet {
+            let index = LocalEndpoints(localEndpoints)
+            localIndex.withLockedValue { $0 = index }
+        }
+    }
+    
+    // Their index, rebuilt on every change so lookups need neither the actor nor a scan
+    private let localIndex: NIOLockedValueBox<LocalEndpoints>
+    
+    // Summary vector of the store and the journal position it was built at
+    private var summaryCache: (position: String, vector: SummaryVector)?
+    
+    // Where state outliving the process is saved; nil with an in-memory store, whose bundles do not
+    private let stateDirectory: String?
+    
+    // Stored bundle IDs handed to the duplicate filters per call during recovery
+    private static let recoveryBatchSize = 1_024
     
     public init(
         nodeId: EndpointID,
@@ -41,14 +69,20 @@ public actor DtnCore {
     ) {
         self.nodeId = nodeId
         self.store = store
-        self.bundleProcessor = BundleProcessor(config: config)
+        self.metrics = DtnMetrics()
+        self.tracer = Tracer(configuration: Tracer.Configuration(settings: config.traceSettings))
+        self.pipeline = BundlePipeline(config: config, metrics: metrics)
         self.claRegistry = CLARegistry()
         self.peerManager = PeerManager(peerTimeout: config.peerTimeout)
         self.serviceRegistry = ServiceRegistry()
-        self.applicationAgent = ApplicationAgent()
-        self.janitor = Janitor(interval: TimeInterval(config.janitorInterval))
+        self.applicationAgent = ApplicationAgent(store: store)
+        self.janitor = Janitor(interval: TimeInterval(config.janitorInterval), snapshotInterval: config.stateSnapshotInterval)
+        self.outbound = OutboundQueues(configuration: OutboundQueues.Configuration(schedulerSettings: config.schedulerSettings))
+        self.bandwidth = BandwidthBudget.budgets(settings: config.schedulerSettings)
+        self.stateDirectory = config.db == "mem" ? nil : config.workdir
         
         // Register the node ID as a local endpoint
+        self.localIndex = NIOLockedValueBox(LocalEndpoints([nodeId]))
         self.localEndpoints.insert(nodeId)
     }
     
@@ -56,14 +90,21 @@ public actor DtnCore {
     public func start() async throws {
         logger.info("Starting DTN Core for node: \(nodeId)")
         
+        // Recognize bundles already seen before a restart
+        await pipeline.loadDuplicateState()
+        
         // Start peer manager
         await peerManager.start()
         
-        // Start routing agent if configured
+        // Start routing agent if configured, remembering what it forwarded before a restart
         if let agent = routingAgent {
             try await agent.start()
+            await restoreRoutingState(of: agent)
         }
         
+        // Let the outbound queues send through this core
+        await outbound.setCore(self)
+        
         // Set janitor core reference and start it
         await janitor.setCore(self)
         await janitor.start()
@@ -87,15 +128,22 @@ public actor DtnCore {
         // Stop janitor
         await janitor.stop()
         
+        // Drop unsent bundles; they stay in the store for the next run
+        await outbound.removeAll()
+        
         // Stop components
         await peerManager.stop()
         
         if let agent = routingAgent {
+            await saveRoutingState(of: agent)
             try await agent.stop()
         }
         
         try await claRegistry.stopAll()
         
+        // Drain received bundles and save the duplicate filters
+        await pipeline.stop()
+        
         logger.info("DTN Core stopped")
     }
     
@@ -130,11 +178,19 @@ public actor DtnCore {
     
     // MARK: - Endpoint Management
     
-    /// Register a local endpoint
-    public func registerEndpoint(_ endpoint: EndpointID) async -> AsyncChannel<BP7.Bundle> {
+    /// Register a local endpoint; its bundles wait in the application agent
+    /// until an application subscribes or polls for them
+    public func registerEndpoint(_ endpoint: EndpointID) async {
         localEndpoints.insert(endpoint)
         logger.info("Registered local endpoint: \(endpoint)")
         // Also register with application agent for bundle delivery
+        await applicationAgent.register(endpoint)
+    }
+    
+    /// Register a local endpoint and receive its bundles on the returned channel
+    public func registerEndpointChannel(_ endpoint: EndpointID) async -> AsyncChannel<BP7.Bundle> {
+        localEndpoints.insert(endpoint)
+        logger.info("Registered local endpoint: \(endpoint)")
         return await applicationAgent.registerEndpoint(endpoint)
     }
     
@@ -146,43 +202,44 @@ public actor DtnCore {
     }
     
     /// Check if an endpoint is local
-    public func isLocalEndpoint(_ endpoint: EndpointID) -> Bool {
-        // Check exact match
-        if localEndpoints.contains(endpoint) {
-            return true
-        }
-        
-        // Check pattern matching for group endpoints
-        for local in localEndpoints {
-            if matchesEndpoint(endpoint, pattern: local) {
-                return true
-            }
-        }
+    public nonisolated func isLocalEndpoint(_ endpoint: EndpointID) -> Bool {
+        localEndpointSnapshot().contains(endpoint)
+    }
         
-        return false
+    /// The registered endpoints, for checking many bundles after a single call
+    public nonisolated func localEndpointSnapshot() -> LocalEndpoints {
+        localIndex.withLockedValue { $0 }
     }
     
     // MARK: - Bundle Operations
     
     /// Submit a bundle for transmission
     public func submitBundle(_ bundle: BP7.Bundle) async throws {
-        statistics.recordIncoming()
+        metrics.incoming.add()
         
-        // Store the bundle
-        try await store.push(bundle: bundle)
+        // Process it; the processor stores it once its source is checked
+        try await pipeline.transmit(submissionContext(for: bundle))
+    }
         
-        // Process it
-        try await bundleProcessor.transmit(bundle: bundle)
+    /// Submit several bundles at once; returns the ones that failed and why
+    public func submitBundles(_ bundles: [BP7.Bundle]) async -> [(id: String, error: any Error)] {
+        metrics.incoming.add(UInt64(bundles.count))
+        return await pipeline.transmit(bundles.map(submissionContext(for:)))
+    }
+    
+    private func submissionContext(for bundle: BP7.Bundle) -> BundleContext {
+        var context = BundleContext(bundle: bundle)
+        context.trace = tracer.sample(context.id, receivedAt: context.receivedAt)
+        return context
     }
     
     /// Get routing decision for a bundle
     public func getRoutingDecision(for bundle: BP7.Bundle) async -> RoutingDecision {
         guard let agent = routingAgent else {
             // Default: try all known peers
-            let peers = await peerManager.getAllPeers()
             return RoutingDecision(
-                bundleId: BundlePack(from: bundle).id,
-                nextHops: peers,
+                bundleId: BundlePack.id(of: bundle),
+                nextHops: Array(peerManager.peerTable.peers.values),
                 isLocalDelivery: isLocalEndpoint(bundle.primary.destination)
             )
         }
@@ -190,45 +247,222 @@ public actor DtnCore {
         return await agent.getNextHops(for: bundle)
     }
     
+    /// Get routing decisions for several stored bundles from their metadata, in the order given
+    public func getRoutingDecisions(for bundles: [BundlePack]) async -> [RoutingDecision] {
+        guard let agent = routingAgent else {
+            // Default: try all known peers
+            let peers = Array(peerManager.peerTable.peers.values)
+            let local = localEndpointSnapshot()
+            return bundles.map { pack in
+                RoutingDecision(bundleId: pack.id, nextHops: peers, isLocalDelivery: local.contains(pack.destination))
+            }
+        }
+        
+        return await agent.getNextHops(for: bundles)
+    }
+    
     /// Send a bundle to specific peers
     public func sendBundle(_ bundle: BP7.Bundle, to peers: [DtnPeer]) async {
+        guard !peers.isEmpty else { return }
+        
+        // Forward the stored encoding as is; only bundles not in the store are encoded here
+        let bundleId = BundlePack.id(of: bundle)
+        let bundleData = await store.getBundleBytes(bundleId: bundleId) ?? bundle.encode()
+        let pack = BundlePack(from: bundle, id: bundleId, size: UInt64(bundleData.count))
+        await sendBundles([OutboundBundle(pack: pack, data: bundleData)], to: peers)
+    }
+        
+    /// Send a bundle whose encoding was computed on ingest to specific peers
+    public func sendBundle(_ context: BundleContext, to peers: [DtnPeer]) async {
+        await sendBundles([OutboundBundle(context: context)], to: peers)
+    }
+    
+    private func sendBundles(_ bundles: [OutboundBundle], to peers: [DtnPeer]) async {
         for peer in peers {
-            let clas = await claRegistry.findCLAsForPeer(peer)
+            await sendBundles(bundles, to: peer)
+        }
+    }
             
-            for cla in clas {
-                do {
-                    try await cla.sendBundle(bundle, to: peer)
-                    statistics.recordOutgoing()
-                    await peerManager.recordSuccess(for: peer.eid)
-                    break // Success, don't try other CLAs
-                } catch {
-                    logger.warning("Failed to send bundle via \(cla.name): \(error)")
-                    await peerManager.recordFailure(for: peer.eid)
+    /// Queue encoded bundles for one peer and return without waiting for the CLA.
+    ///
+    /// Each peer's queue is drained by its own task, in the order set by the
+    /// scheduler settings, so a slow or failing peer holds up neither the other
+    /// peers nor this actor.
+    public nonisolated func sendBundles(_ bundles: [OutboundBundle], to peer: DtnPeer) async {
+        if await !outbound.enqueue(bundles, to: peer) {
+            // Dropped bundles stay in the store; let the Janitor offer them again
+            await janitor.retryForwarding(to: peer)
+        }
+    }
+    
+    /// Send several encoded bundles to one peer in a single CLA call, so the CLA can batch them.
+    /// Called by the peer's outbound queue.
+    nonisolated func transmit(_ bundles: [EncodedBundle], to peer: DtnPeer) async -> Bool {
+        guard !bundles.isEmpty else { return true }
+            
+        let clas = await claRegistry.findCLAsForPeer(peer)
+        
+        for cla in clas {
+            do {
+                // Pace CLAs that have a bandwidth budget
+                if let budget = bandwidth[cla.name] {
+                    await budget.reserve(bundles.reduce(0) { $0 + $1.data.count })
                 }
+                
+                let sendStart = ContinuousClock.now
+                try await cla.sendBundles(bundles, to: peer)
+                metrics.claSendTime(cla.name).record(since: sendStart)
+                if tracer.isEnabled {
+                    for bundle in bundles {
+                        bundle.trace?.record(.send, from: sendStart, attributes: ["cla": cla.name, "peer": peer.eid.description, "batch": "\(bundles.count)"])
+                    }
+                }
+                metrics.outgoing.add(UInt64(bundles.count))
+                await peerManager.recordSuccess(for: peer.eid)
+                await forwarded(bundles.map(\.id))
+                return true // Success, don't try other CLAs
+            } catch {
+                logger.warning("Failed to send \(bundles.count) bundle(s) via \(cla.name): \(error)")
+                await peerManager.recordFailure(for: peer.eid)
+            }
+        }
+        
+        // Let the Janitor retry the forwarding queue towards this peer
+        if !clas.isEmpty {
+            await janitor.retryForwarding(to: peer)
+        }
+        return false
+    }
+    
+    /// Take bundles a CLA accepted off the persistent forwarding queue, unless the
+    /// routing agent keeps copies for peers it meets later. Without an agent every
+    /// known peer is a next hop, so bundles stay queued for the ones still to come.
+    private func forwarded(_ bundleIds: [String]) async {
+        guard let agent = routingAgent, !agent.keepsCopies else { return }
+        
+        for bundleId in bundleIds {
+            guard var bundlePack = await store.getMetadata(bundleId: bundleId),
+                  bundlePack.constraints.contains(.forwardPending) else {
+                continue
+            }
+            
+            bundlePack.constraints.remove(.forwardPending)
+            do {
+                try await store.updateMetadata(bundlePack: bundlePack)
+            } catch {
+                logger.warning("Failed to take bundle \(bundleId) off the forwarding queue: \(error)")
+            }
+        }
+    }
+    
+    /// Summary vector of the stored bundles, served to peers on contact.
+    ///
+    /// Rebuilt only once the store journal has moved on; bundles deleted since the
+    /// last build stay in it until then, which at worst withholds them from a peer
+    /// that already had them.
+    public func summaryVector() async -> SummaryVector {
+        let position = journal.position
+        if let cached = summaryCache, cached.position == position {
+            return cached.vector
+        }
+        
+        var vector = SummaryVector(capacity: Int(await store.count()))
+        for await bundleId in store.idStream() {
+            vector.insert(BundleKey(id: bundleId))
+        }
+        summaryCache = (position, vector)
+        return vector
+    }
+    
+    // MARK: - State
+    
+    /// Save the duplicate filters and the routing agent's state; the Janitor calls this
+    /// periodically so a node that loses power comes back knowing what it had seen and forwarded
+    public func saveState() async {
+        await pipeline.saveDuplicateState()
+        if let agent = routingAgent {
+            await saveRoutingState(of: agent)
+        }
+    }
+    
+    private func routingStatePath(of agent: any RoutingAgent) -> String? {
+        stateDirectory.map { "\($0)/routing.\(agent.algorithmName).state" }
+    }
+    
+    private func saveRoutingState(of agent: any RoutingAgent) async {
+        guard let path = routingStatePath(of: agent),
+              let snapshot = await agent.stateSnapshot() else {
+            return
+        }
+        
+        do {
+            try snapshot.write(to: URL(fileURLWithPath: path), options: .atomic)
+        } catch {
+            logger.error("Failed to save routing state: \(error)")
+        }
+    }
+    
+    private func restoreRoutingState(of agent: any RoutingAgent) async {
+        guard let path = routingStatePath(of: agent),
+              let snapshot = try? Data(contentsOf: URL(fileURLWithPath: path)) else {
+            return
+        }
+        
+        if await !agent.restoreState(from: snapshot) {
+            logger.warning("Ignoring unreadable routing state at \(path)")
+        }
+    }
+    
+    /// Catch the in-memory state of a restarted node up with its store, in the background
+    /// while the node already takes bundles. Stored bundles join the duplicate filters, in
+    /// case the last snapshot predates them, and the summary vector peers ask for on
+    /// contact is built from the same pass over the IDs.
+    private func recoverStoredBundles() async {
+        let start = ContinuousClock.now
+        let position = journal.position
+        var vector = SummaryVector(capacity: Int(await store.count()))
+        var keys: [BundleKey] = []
+        keys.reserveCapacity(Self.recoveryBatchSize)
+        var recovered = 0
+        
+        for await bundleId in store.idStream() {
+            guard !Task.isCancelled else { return }
+            let key = BundleKey(id: bundleId)
+            vector.insert(key)
+            keys.append(key)
+            if keys.count >= Self.recoveryBatchSize {
+                await pipeline.markSeen(keys)
+                recovered += keys.count
+                keys.removeAll(keepingCapacity: true)
             }
         }
+        await pipeline.markSeen(keys)
+        recovered += keys.count
+        
+        // A listing built meanwhile is at least as recent
+        if summaryCache == nil {
+            summaryCache = (position, vector)
+        }
+        if recovered > 0 {
+            logger.info("Recovered \(recovered) stored bundle(s) in \(ContinuousClock.now - start)")
+        }
     }
     
     // MARK: - Statistics
     
-    /// Get current statistics
-    public func getStatistics() async -> DtnStatistics {
-        var stats = statistics
+    /// Get current statistics; reads the counters directly rather than through the actor
+    public nonisolated func getStatistics() async -> DtnStatistics {
+        var stats = metrics.statistics()
         stats.updateStored(await store.count())
         return stats
     }
     
-    /// Update statistics
-    public func updateStatistics(_ update: (inout DtnStatistics) -> Void) {
-        update(&statistics)
-    }
-    
     // MARK: - Service Management
     
     /// Register a service
     public func registerService(_ service: DtnService) async {
         await serviceRegistry.register(service)
-        _ = await registerEndpoint(service.endpoint)
+        await registerEndpoint(service.endpoint)
     }
     
     /// Get services for an endpoint
@@ -246,28 +480,39 @@ public actor DtnCore {
             }
         }
         backgroundTasks.append(peerTask)
+        
+        // Bundles kept from a previous run
+        backgroundTasks.append(Task {
+            await recoverStoredBundles()
+        })
+        
+        // Trace exporter, if a collector is configured
+        if tracer.configuration.otlpEndpoint != nil {
+            let tracer = tracer
+            let nodeId = nodeId.description
+            backgroundTasks.append(Task {
+                await tracer.runExporter(nodeId: nodeId)
+            })
+        }
     }
     
-    private func listenForBundles(from cla: any ConvergenceLayerAgent) async {
+    /// Feed bundles from a CLA into the pipeline; runs off the core actor so each CLA's
+    /// bundles are encoded and queued in parallel, and waits only while their shard is busy
+    private nonisolated func listenForBundles(from cla: any ConvergenceLayerAgent) async {
         for await (bundle, connection) in cla.incomingBundles {
-            do {
-                logger.info("Received bundle from \(cla.name): \(BundlePack(from: bundle).id)")
+            var context = BundleContext(bundle: bundle)
+            context.trace = tracer.sample(context.id, receivedAt: context.receivedAt)
+            logger.trace("Received bundle from \(cla.name): \(context.id)")
                 
-                // Update peer info if available
-                if let remoteEid = connection.remoteEndpointId {
-                    if await peerManager.getPeer(remoteEid) != nil {
-                        await peerManager.recordSuccess(for: remoteEid)
-                    }
+            // Update peer info if available
+            if let remoteEid = connection.remoteEndpointId {
+                if await peerManager.getPeer(remoteEid) != nil {
+                    await peerManager.recordSuccess(for: remoteEid)
                 }
-                
-                // Process the bundle
-                try await bundleProcessor.receive(bundle: bundle)
-                statistics.recordIncoming()
-                
-            } catch {
-                logger.error("Failed to process bundle from \(cla.name): \(error)")
-                statistics.recordFailed()
             }
+                
+            // Process the bundle on its shard; failures are counted there
+            await pipeline.receive(context)
         }
     }
     
@@ -278,23 +523,38 @@ public actor DtnCore {
             if let agent = routingAgent {
                 await agent.handleNotification(.notifyPeerEncountered(peer: peer))
             }
+            await janitor.retryForwarding(to: peer)
+        
+        case .connectionEstablished(let peer, _):
+            logger.info("Connection established with peer: \(peer.eid)")
+            await janitor.retryForwarding(to: peer)
             
         case .lost(let peer):
             logger.info("Peer lost: \(peer.eid)")
+            await outbound.remove(peer.eid)
             if let agent = routingAgent {
                 await agent.handleNotification(.notifyPeerLost(peer: peer))
             }
             
-        case .updated, .connectionEstablished, .connectionLost:
+        case .updated, .connectionLost:
             // Handle other events as needed
             break
         }
     }
+}
+    
+/// A copy of the node's registered endpoints, taken once and checked without the core actor
+public struct LocalEndpoints: Sendable {
+    private let index: EndpointIndex
+    
+    init(_ endpoints: Set<EndpointID>) {
+        // For now a registered endpoint also matches as a prefix, which covers group endpoints
+        self.index = EndpointIndex(coveringPrefixes: endpoints)
+    }
     
-    private func matchesEndpoint(_ endpoint: EndpointID, pattern: EndpointID) -> Bool {
-        // Simple pattern matching - can be enhanced
-        // For now, just check if pattern is a prefix
-        return endpoint.description.hasPrefix(pattern.description)
+    /// Whether `endpoint` is registered or falls under a registered endpoint
+    public func contains(_ endpoint: EndpointID) -> Bool {
+        index.contains(endpoint)
     }
 }
 
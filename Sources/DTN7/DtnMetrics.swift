@@ -0,0 +1,208 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import Atomics
+import NIOConcurrencyHelpers
+
+/// A monotonically increasing counter spread over several atomics.
+///
+/// Each increment touches one stripe picked by the calling task, so concurrent
+/// shards and CLAs rarely contend on the same word; reading sums the stripes.
+public final class StripedCounter: Sendable {
+    /// One stripe per active processor, rounded up to a power of two
+    public static let defaultStripes = ProcessInfo.processInfo.activeProcessorCount
+    
+    private let stripes: [ManagedAtomic<UInt64>]
+    private let mask: Int
+    
+    public init(stripes count: Int = StripedCounter.defaultStripes) {
+        var size = 1
+        while size < count {
+            size <<= 1
+        }
+        self.stripes = (0..<size).map { _ in ManagedAtomic<UInt64>(0) }
+        self.mask = size - 1
+    }
+    
+    public func add(_ amount: UInt64 = 1) {
+        stripes[Self.stripeHint() & mask].wrappingIncrement(by: amount, ordering: .relaxed)
+    }
+    
+    public var value: UInt64 {
+        stripes.reduce(0) { $0 &+ $1.load(ordering: .relaxed) }
+    }
+    
+    /// The current task stands in for the current core, which Swift does not expose
+    private static func stripeHint() -> Int {
+        withUnsafeCurrentTask { task in task?.hashValue ?? 0 }
+    }
+}
+
+/// Latency distribution over power-of-two microsecond buckets, recorded without locks
+public final class LatencyHistogram: Sendable {
+    /// Finite buckets; bucket `i` holds durations up to 2^i µs, so the last one ends near 67 s
+    public static let bucketCount = 27
+    
+    /// A point-in-time copy of a histogram
+    public struct Snapshot: Sendable, Codable, Equatable {
+        /// Samples per bucket (not cumulative); the last entry counts samples above every bound
+        public let buckets: [UInt64]
+        public let count: UInt64
+        public let sumSeconds: Double
+    }
+    
+    private let buckets: [ManagedAtomic<UInt64>]
+    private let totalMicroseconds = ManagedAtomic<UInt64>(0)
+    
+    public init() {
+        self.buckets = (0...Self.bucketCount).map { _ in ManagedAtomic<UInt64>(0) }
+    }
+    
+    /// Upper bound of bucket `index` in seconds
+    public static func upperBound(ofBucket index: Int) -> Double {
+        Double(UInt64(1) << UInt64(index)) / 1_000_000
+    }
+    
+    public func record(_ duration: Duration) {
+        let (seconds, attoseconds) = duration.components
+        let microseconds = UInt64(max(0, seconds)) &* 1_000_000 &+ UInt64(max(0, attoseconds / 1_000_000_000_000))
+        buckets[Self.bucketIndex(microseconds: microseconds)].wrappingIncrement(ordering: .relaxed)
+        totalMicroseconds.wrappingIncrement(by: microseconds, ordering: .relaxed)
+    }
+    
+    /// Record the time elapsed since `start`
+    public func record(since start: ContinuousClock.Instant) {
+        record(ContinuousClock.now - start)
+    }
+    
+    public func snapshot() -> Snapshot {
+        let counts = buckets.map { $0.load(ordering: .relaxed) }
+        return Snapshot(
+            buckets: counts,
+            count: counts.reduce(0, &+),
+            sumSeconds: Double(totalMicroseconds.load(ordering: .relaxed)) / 1_000_000
+        )
+    }
+    
+    static func bucketIndex(microseconds: UInt64) -> Int {
+        guard microseconds > 1 else { return 0 }
+        // Smallest i with microseconds <= 2^i
+        return min(64 - (microseconds - 1).leadingZeroBitCount, bucketCount)
+    }
+}
+
+/// Node-wide counters and latency histograms, shared by the core, the bundle
+/// processing shards and the send path without going through any actor.
+public final class DtnMetrics: Sendable {
+    public let incoming = StripedCounter()
+    public let duplicates = StripedCounter()
+    public let outgoing = StripedCounter()
+    public let delivered = StripedCounter()
+    public let failed = StripedCounter()
+    public let broken = StripedCounter()
+    
+    /// From a bundle entering the node until it is in the store
+    public let ingestToStore = LatencyHistogram()
+    /// From a bundle being stored until it is handed to the CLAs
+    public let storeToForward = LatencyHistogram()
+    
+    /// Time spent in `sendBundles` per CLA, keyed by CLA name
+    private let claSendTimes = NIOLockedValueBox<[String: LatencyHistogram]>([:])
+    
+    public init() {}
+    
+    /// The send time histogram of the CLA called `name`
+    public func claSendTime(_ name: String) -> LatencyHistogram {
+        claSendTimes.withLockedValue { histograms in
+            if let histogram = histograms[name] {
+                return histogram
+            }
+            let histogram = LatencyHistogram()
+            histograms[name] = histogram
+            return histogram
+        }
+    }
+    
+    /// Current counter values; `stored` is left for the caller to fill in
+    public func statistics() -> DtnStatistics {
+        var statistics = DtnStatistics()
+        statistics.incoming = incoming.value
+        statistics.dups = duplicates.value
+        statistics.outgoing = outgoing.value
+        statistics.delivered = delivered.value
+        statistics.failed = failed.value
+        statistics.broken = broken.value
+        return statistics
+    }
+    
+    /// Snapshots of every histogram: `ingest_to_store`, `store_to_forward` and `cla_send.<name>`
+    public func latencies() -> [String: LatencyHistogram.Snapshot] {
+        var latencies = [
+            "ingest_to_store": ingestToStore.snapshot(),
+            "store_to_forward": storeToForward.snapshot()
+        ]
+        for (name, histogram) in claSendTimes.withLockedValue({ $0 }) {
+            latencies["cla_send.\(name)"] = histogram.snapshot()
+        }
+        return latencies
+    }
+    
+    /// All metrics in the Prometheus text exposition format
+    public func prometheusText(stored: UInt64) -> String {
+        var lines: [String] = []
+        
+        let counters: [(String, String, StripedCounter)] = [
+            ("incoming", "Bundles received", incoming),
+            ("duplicates", "Duplicate bundles dropped", duplicates),
+            ("outgoing", "Bundles sent", outgoing),
+            ("delivered", "Bundles delivered locally", delivered),
+            ("failed", "Bundles that failed processing", failed),
+            ("broken", "Broken bundles", broken)
+        ]
+        for (name, help, counter) in counters {
+            lines.append("# HELP dtn7_bundles_\(name)_total \(help)")
+            lines.append("# TYPE dtn7_bundles_\(name)_total counter")
+            lines.append("dtn7_bundles_\(name)_total \(counter.value)")
+        }
+        
+        lines.append("# HELP dtn7_bundles_stored Bundles in the store")
+        lines.append("# TYPE dtn7_bundles_stored gauge")
+        lines.append("dtn7_bundles_stored \(stored)")
+        
+        Self.appendHistogram("dtn7_ingest_to_store_seconds", help: "Time from bundle arrival until it is stored", labels: [], ingestToStore.snapshot(), to: &lines)
+        Self.appendHistogram("dtn7_store_to_forward_seconds", help: "Time from bundle storage until it is handed to the CLAs", labels: [], storeToForward.snapshot(), to: &lines)
+        
+        let claHistograms = claSendTimes.withLockedValue { $0 }.sorted { $0.key < $1.key }
+        for (index, (name, histogram)) in claHistograms.enumerated() {
+            Self.appendHistogram(
+                "dtn7_cla_send_seconds",
+                help: index == 0 ? "Time spent sending bundles per CLA" : nil,
+                labels: ["cla=\"\(name)\""],
+                histogram.snapshot(),
+                to: &lines
+            )
+        }
+        
+        return lines.joined(separator: "\n") + "\n"
+    }
+    
+    private static func appendHistogram(_ name: String, help: String?, labels: [String], _ snapshot: LatencyHistogram.Snapshot, to lines: inout [String]) {
+        if let help = help {
+            lines.append("# HELP \(name) \(help)")
+            lines.append("# TYPE \(name) histogram")
+        }
+        
+        let labelPrefix = labels.map { $0 + "," }.joined()
+        let labelSet = labels.isEmpty ? "" : "{\(labels.joined(separator: ","))}"
+        var cumulative: UInt64 = 0
+        for (index, count) in snapshot.buckets.enumerated() {
+            cumulative += count
+            let bound = index < LatencyHistogram.bucketCount ? "\(LatencyHistogram.upperBound(ofBucket: index))" : "+Inf"
+            lines.append("\(name)_bucket{\(labelPrefix)le=\"\(bound)\"} \(cumulative)")
+        }
+        lines.append("\(name)_sum\(labelSet) \(snapshot.sumSeconds)")
+        lines.append("\(name)_count\(labelSet) \(snapshot.count)")
+    }
+}
@@ -0,0 +1,404 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import BP7
+
+/// Compact identity of a bundle for duplicate detection: a 128-bit hash of its
+/// source, creation timestamp and sequence number.
+///
+/// Sixteen bytes per key instead of the ID string, and the same key whether it
+/// is built from a decoded bundle or from a bundle ID.
+public struct BundleKey: Hashable, Sendable {
+    public let high: UInt64
+    public let low: UInt64
+    
+    public init(high: UInt64, low: UInt64) {
+        self.high = high
+        self.low = low
+    }
+    
+    public init(source: String, timestamp: UInt64, sequenceNumber: UInt64) {
+        let sourceHigh = Self.fnv1a(source.utf8, basis: 0xcbf29ce484222325)
+        let sourceLow = Self.fnv1a(source.utf8, basis: 0x84222325cbf29ce4)
+        self.high = Self.mix(Self.mix(Self.mix(sourceHigh) ^ timestamp) ^ sequenceNumber)
+        self.low = Self.mix(Self.mix(Self.mix(sourceLow ^ 0x9e3779b97f4a7c15) ^ sequenceNumber) ^ timestamp)
+    }
+    
+    public init(bundle: BP7.Bundle) {
+        self.init(
+            source: bundle.primary.source.description,
+            timestamp: bundle.primary.creationTimestamp.getDtnTime(),
+            sequenceNumber: bundle.primary.creationTimestamp.getSequenceNumber()
+        )
+    }
+    
+    /// Key for a bundle ID as built by `BundlePack.id(of:)`; IDs of another shape are hashed whole
+    public init(id: String) {
+        let parts = id.split(separator: "-", omittingEmptySubsequences: false)
+        if parts.count >= 3,
+           let sequenceNumber = UInt64(parts[parts.count - 1]),
+           let timestamp = UInt64(parts[parts.count - 2]) {
+            self.init(source: parts.dropLast(2).joined(separator: "-"), timestamp: timestamp, sequenceNumber: sequenceNumber)
+        } else {
+            self.init(source: id, timestamp: .max, sequenceNumber: .max)
+        }
+    }
+    
+    private static func fnv1a(_ bytes: String.UTF8View, basis: UInt64) -> UInt64 {
+        var hash = basis
+        for byte in bytes {
+            hash ^= UInt64(byte)
+            hash = hash &* 0x100000001b3
+        }
+        return hash
+    }
+    
+    /// splitmix64 finalizer
+    private static func mix(_ value: UInt64) -> UInt64 {
+        var z = value &+ 0x9e3779b97f4a7c15
+        z = (z ^ (z >> 30)) &* 0xbf58476d1ce4e5b9
+        z = (z ^ (z >> 27)) &* 0x94d049bb133111eb
+        return z ^ (z >> 31)
+    }
+}
+
+/// Fixed-size Bloom filter over bundle keys, probed by double hashing the two key halves
+struct BloomFilter: Sendable, Equatable {
+    let bitCount: Int
+    let hashCount: Int
+    /// Bit storage, allocated on the first insert so unused filters cost nothing
+    private(set) var words: [UInt64] = []
+    /// Keys inserted so far
+    private(set) var count = 0
+    
+    /// Size a filter for `capacity` keys at no more than `falsePositiveRate`.
+    ///
+    /// Uses k = ⌈-log₂ p⌉ probes and k / ln 2 bits per key, the optimum with k
+    /// rounded up to a whole probe, so no math library is needed.
+    init(capacity: Int, falsePositiveRate: Double) {
+        let rate = min(max(falsePositiveRate, 1e-15), 0.5)
+        let hashCount = max(1, -Int(rate.exponent))
+        let bits = (Double(max(capacity, 1)) * Double(hashCount) / 0.6931471805599453).rounded(.up)
+        self.hashCount = hashCount
+        self.bitCount = max(64, Int(bits))
+    }
+    
+    init(bitCount: Int, hashCount: Int, words: [UInt64], count: Int) {
+        self.bitCount = bitCount
+        self.hashCount = hashCount
+        self.words = words
+        self.count = count
+    }
+    
+    var isEmpty: Bool { count == 0 }
+    
+    /// Bytes held by the bit array
+    var byteCount: Int { words.count * MemoryLayout<UInt64>.size }
+    
+    mutating func insert(_ key: BundleKey) {
+        if words.isEmpty {
+            words = [UInt64](repeating: 0, count: (bitCount + 63) / 64)
+        }
+        var probe = key.high
+        for _ in 0..<hashCount {
+            let bit = Int(probe % UInt64(bitCount))
+            words[bit >> 6] |= 1 << UInt64(bit & 63)
+            probe = probe &+ Self.step(key)
+        }
+        count += 1
+    }
+    
+    func contains(_ key: BundleKey) -> Bool {
+        guard !words.isEmpty else { return false }
+        var probe = key.high
+        for _ in 0..<hashCount {
+            let bit = Int(probe % UInt64(bitCount))
+            if words[bit >> 6] & (1 << UInt64(bit & 63)) == 0 {
+                return false
+            }
+            probe = probe &+ Self.step(key)
+        }
+        return true
+    }
+    
+    /// Distance between probes; odd so they never collapse onto one bit
+    private static func step(_ key: BundleKey) -> UInt64 {
+        key.low | 1
+    }
+}
+
+/// Memory-bounded duplicate detector for bundle keys.
+///
+/// The most recent keys are held exactly in an LRU; keys pushed out of it go into
+/// a time-windowed pair of Bloom filters. The current generation takes new keys and
+/// is retired once `window` has passed or it holds `filterCapacity` keys, and the
+/// previous one is dropped at that point, so memory stays fixed while every key is
+/// remembered for at least one window unless the node sees more than
+/// `filterCapacity` keys in it. A key can only be reported as seen when it was not
+/// (at `falsePositiveRate`), never the other way round.
+public struct DuplicateFilter: Sendable {
+    public struct Configuration: Sendable, Equatable {
+        /// Keys tracked exactly before they spill into the Bloom filters
+        public var exactCapacity: Int
+        /// Keys per Bloom filter generation
+        public var filterCapacity: Int
+        /// Target false positive rate of each Bloom filter generation
+        public var falsePositiveRate: Double
+        /// How long a Bloom filter generation takes new keys
+        public var window: TimeInterval
+        
+        public static let `default` = Configuration()
+        
+        public init(
+            exactCapacity: Int = 10_000,
+            filterCapacity: Int = 100_000,
+            falsePositiveRate: Double = 0.0001,
+            window: TimeInterval = 86_400
+        ) {
+            self.exactCapacity = max(1, exactCapacity)
+            self.filterCapacity = max(1, filterCapacity)
+            self.falsePositiveRate = falsePositiveRate
+            self.window = window
+        }
+        
+        /// Build a configuration from `DtnConfig.dedupSettings`, starting from `default`.
+        ///
+        /// Recognized keys: `exact_capacity` (keys), `filter_capacity` (keys per
+        /// generation), `fp_rate` (0-0.5) and `window` (seconds).
+        public init(settings: [String: String]) {
+            self = .default
+            
+            if let exactCapacity = settings["exact_capacity"].flatMap({ Int($0) }), exactCapacity > 0 {
+                self.exactCapacity = exactCapacity
+            }
+            if let filterCapacity = settings["filter_capacity"].flatMap({ Int($0) }), filterCapacity > 0 {
+                self.filterCapacity = filterCapacity
+            }
+            if let rate = settings["fp_rate"].flatMap({ Double($0) }), rate > 0, rate <= 0.5 {
+                self.falsePositiveRate = rate
+            }
+            if let window = settings["window"].flatMap({ TimeInterval($0) }), window > 0 {
+                self.window = window
+            }
+        }
+        
+        /// The share of this configuration for one of `shards` filters that split the keys between them
+        public func split(into shards: Int) -> Configuration {
+            guard shards > 1 else { return self }
+            return Configuration(
+                exactCapacity: exactCapacity / shards,
+                filterCapacity: filterCapacity / shards,
+                falsePositiveRate: falsePositiveRate,
+                window: window
+            )
+        }
+    }
+    
+    private struct Entry: Sendable {
+        let key: BundleKey
+        let stamp: UInt64
+    }
+    
+    public let configuration: Configuration
+    
+    // Exact LRU: key -> stamp of its latest use, plus uses in order. Entries whose
+    // stamp no longer matches were superseded by a later use and are skipped.
+    private var recent: [BundleKey: UInt64] = [:]
+    private var order: [Entry] = []
+    private var orderStart = 0
+    private var nextStamp: UInt64 = 0
+    
+    private var current: BloomFilter
+    private var previous: BloomFilter
+    private var generationStart: Date
+    
+    public init(configuration: Configuration = .default, now: Date = Date()) {
+        self.configuration = configuration
+        self.current = BloomFilter(capacity: configuration.filterCapacity, falsePositiveRate: configuration.falsePositiveRate)
+        self.previous = current
+        self.generationStart = now
+    }
+    
+    /// Approximate number of keys remembered, exact and filtered
+    public var count: Int {
+        recent.count + current.count + previous.count
+    }
+    
+    /// Approximate bytes held, for status reporting
+    public var byteCount: Int {
+        recent.count * (MemoryLayout<BundleKey>.stride + MemoryLayout<UInt64>.stride)
+            + (order.count - orderStart) * MemoryLayout<Entry>.stride
+            + current.byteCount + previous.byteCount
+    }
+    
+    /// Whether `key` was (probably) seen before
+    public func contains(_ key: BundleKey) -> Bool {
+        recent[key] != nil || current.contains(key) || previous.contains(key)
+    }
+    
+    /// Record `key` as seen and report whether it (probably) was already
+    @discardableResult
+    public mutating func insert(_ key: BundleKey, now: Date = Date()) -> Bool {
+        rotateIfNeeded(now: now)
+        let seen = contains(key)
+        touch(key, now: now)
+        return seen
+    }
+    
+    /// Forget every key
+    public mutating func removeAll(now: Date = Date()) {
+        self = DuplicateFilter(configuration: configuration, now: now)
+    }
+    
+    private mutating func touch(_ key: BundleKey, now: Date) {
+        let stamp = nextStamp
+        nextStamp += 1
+        recent[key] = stamp
+        order.append(Entry(key: key, stamp: stamp))
+        
+        while recent.count > configuration.exactCapacity, orderStart < order.count {
+            let oldest = order[orderStart]
+            orderStart += 1
+            if recent[oldest.key] == oldest.stamp {
+                recent.removeValue(forKey: oldest.key)
+                spill(oldest.key, now: now)
+            }
+        }
+        
+        // Drop consumed and superseded entries once they outnumber the live ones
+        if order.count - orderStart > 2 * configuration.exactCapacity || orderStart > configuration.exactCapacity {
+            order = order[orderStart...].filter { recent[$0.key] == $0.stamp }
+            orderStart = 0
+        }
+    }
+    
+    private mutating func spill(_ key: BundleKey, now: Date) {
+        if current.count >= configuration.filterCapacity {
+            rotate(now: now)
+        }
+        current.insert(key)
+    }
+    
+    private mutating func rotateIfNeeded(now: Date) {
+        if now.timeIntervalSince(generationStart) >= configuration.window {
+            rotate(now: now)
+        }
+    }
+    
+    private mutating func rotate(now: Date) {
+        previous = current
+        current = BloomFilter(capacity: configuration.filterCapacity, falsePositiveRate: configuration.falsePositiveRate)
+        generationStart = now
+    }
+    
+    // MARK: - Persistence
+    
+    private static let magic: [UInt8] = [0x44, 0x54, 0x4E, 0x46] // "DTNF"
+    private static let formatVersion: UInt8 = 1
+    
+    /// Binary snapshot of the filter for `init?(serialized:configuration:)`
+    public func serialized() -> Data {
+        var data = Data(Self.magic)
+        data.append(Self.formatVersion)
+        Self.append(generationStart.timeIntervalSince1970.bitPattern, to: &data)
+        for filter in [current, previous] {
+            Self.append(UInt64(filter.bitCount), to: &data)
+            Self.append(UInt64(filter.hashCount), to: &data)
+            Self.append(UInt64(filter.count), to: &data)
+            Self.append(UInt64(filter.words.count), to: &data)
+            for word in filter.words {
+                Self.append(word, to: &data)
+            }
+        }
+        
+        // Exact keys, oldest first, so reloading them restores the LRU order
+        let live = order[orderStart...].filter { recent[$0.key] == $0.stamp }
+        Self.append(UInt64(live.count), to: &data)
+        for entry in live {
+            Self.append(entry.key.high, to: &data)
+            Self.append(entry.key.low, to: &data)
+        }
+        return data
+    }
+    
+    /// Restore a snapshot taken by `serialized()`, or nil if it is not one.
+    ///
+    /// Bloom filters sized differently from `configuration` are dropped; the exact
+    /// keys are always kept, spilling into the fresh filters if there are too many.
+    public init?(serialized data: Data, configuration: Configuration = .default) {
+        var reader = Reader(bytes: [UInt8](data))
+        guard reader.read(count: Self.magic.count) == Self.magic,
+              reader.read(count: 1) == [Self.formatVersion],
+              let startBits = reader.readUInt64() else {
+            return nil
+        }
+        
+        var filters: [BloomFilter] = []
+        for _ in 0..<2 {
+            guard let bitCount = reader.readInt(),
+                  let hashCount = reader.readInt(),
+                  let count = reader.readInt(),
+                  let wordCount = reader.readInt(),
+                  wordCount == 0 || wordCount == (bitCount + 63) / 64,
+                  let words = reader.readWords(wordCount) else {
+                return nil
+            }
+            filters.append(BloomFilter(bitCount: bitCount, hashCount: hashCount, words: words, count: count))
+        }
+        
+        guard let keyCount = reader.readInt() else { return nil }
+        var keys: [BundleKey] = []
+        keys.reserveCapacity(min(keyCount, configuration.exactCapacity * 2))
+        for _ in 0..<keyCount {
+            guard let high = reader.readUInt64(), let low = reader.readUInt64() else { return nil }
+            keys.append(BundleKey(high: high, low: low))
+        }
+        
+        self.init(configuration: configuration, now: Date(timeIntervalSince1970: TimeInterval(bitPattern: startBits)))
+        let fresh = BloomFilter(capacity: configuration.filterCapacity, falsePositiveRate: configuration.falsePositiveRate)
+        if filters.allSatisfy({ $0.bitCount == fresh.bitCount && $0.hashCount == fresh.hashCount }) {
+            current = filters[0]
+            previous = filters[1]
+        }
+        for key in keys {
+            touch(key, now: generationStart)
+        }
+    }
+    
+    private static func append(_ value: UInt64, to data: inout Data) {
+        withUnsafeBytes(of: value.bigEndian) { data.append(contentsOf: $0) }
+    }
+    
+    private struct Reader {
+        let bytes: [UInt8]
+        var offset = 0
+        
+        mutating func read(count: Int) -> [UInt8]? {
+            guard count >= 0, bytes.count - offset >= count else { return nil }
+            defer { offset += count }
+            return Array(bytes[offset..<offset + count])
+        }
+        
+        mutating func readUInt64() -> UInt64? {
+            guard let chunk = read(count: 8) else { return nil }
+            return chunk.reduce(0) { $0 << 8 | UInt64($1) }
+        }
+        
+        mutating func readInt() -> Int? {
+            readUInt64().flatMap { Int(exactly: $0) }
+        }
+        
+        mutating func readWords(_ count: Int) -> [UInt64]? {
+            guard count <= (bytes.count - offset) / 8 else { return nil }
+            var words: [UInt64] = []
+            words.reserveCapacity(count)
+            for _ in 0..<count {
+                guard let word = readUInt64() else { return nil }
+                words.append(word)
+            }
+            return words
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import BP7
+
+/// Registered endpoints arranged so matching a destination takes time
+/// proportional to the length of its EID rather than to the number of
+/// registrations.
+///
+/// Exact registrations are a hash map. Registrations that cover every EID
+/// starting with them sit in a byte trie over their description, walked once
+/// along the destination. Group registrations (`/~`) are keyed by scheme and
+/// node, the part of the EID they are compared on.
+public struct EndpointIndex: Sendable {
+    /// How a registration matches destinations
+    public enum Match: Sendable {
+        /// Only the registered EID itself
+        case exact
+        /// Every EID whose description starts with this string
+        case prefix(String)
+        /// Every group EID on the registration's scheme and node
+        case group
+    }
+    
+    private struct Node: Sendable {
+        var children: [UInt8: Int32] = [:]
+        /// The registration ending here, for prefix matches
+        var endpoint: EndpointID?
+    }
+    
+    private var exact: [EndpointID: EndpointID] = [:]
+    private var trie: [Node] = [Node()]
+    private var groups: [String: EndpointID] = [:]
+    
+    public private(set) var count = 0
+    
+    public init() {}
+    
+    /// An index where every endpoint also covers the EIDs it is a prefix of,
+    /// as the node's local endpoints do
+    public init(coveringPrefixes endpoints: some Sequence<EndpointID>) {
+        for endpoint in endpoints {
+            insert(endpoint, matching: .prefix(endpoint.description))
+        }
+    }
+    
+    /// An index of application registrations: `…/*` covers what starts with
+    /// the part before the wildcard, `/~` registrations are groups and the
+    /// rest match exactly
+    public init(registrations endpoints: some Sequence<EndpointID>) {
+        for endpoint in endpoints {
+            insert(endpoint, matching: Self.match(forRegistration: endpoint))
+        }
+    }
+    
+    public static func match(forRegistration endpoint: EndpointID) -> Match {
+        let description = endpoint.description
+        if description.hasSuffix("/*") {
+            return .prefix(String(description.dropLast(2)))
+        }
+        if description.contains("/~") {
+            return .group
+        }
+        return .exact
+    }
+    
+    public mutating func insert(_ endpoint: EndpointID, matching match: Match) {
+        count += 1
+        exact[endpoint] = endpoint
+        
+        switch match {
+        case .exact:
+            break
+        
+        case .prefix(let prefix):
+            var node = 0
+            for byte in prefix.utf8 {
+                if let child = trie[node].children[byte] {
+                    node = Int(child)
+                } else {
+                    trie.append(Node())
+                    trie[node].children[byte] = Int32(trie.count - 1)
+                    node = trie.count - 1
+                }
+            }
+            trie[node].endpoint = endpoint
+        
+        case .group:
+            if let key = Self.groupKey(of: endpoint.description) {
+                groups[key] = endpoint
+            }
+        }
+    }
+    
+    /// The registration covering `endpoint`: the endpoint itself, else the
+    /// longest registered prefix of it, else its group registration
+    public func match(_ endpoint: EndpointID) -> EndpointID? {
+        if let registered = exact[endpoint] {
+            return registered
+        }
+        
+        let description = endpoint.description
+        if trie.count > 1 {
+            var node = 0
+            var longest: EndpointID?
+            for byte in description.utf8 {
+                guard let child = trie[node].children[byte] else { break }
+                node = Int(child)
+                longest = trie[node].endpoint ?? longest
+            }
+            if let longest {
+                return longest
+            }
+        }
+        
+        if !groups.isEmpty, let key = Self.groupKey(of: description) {
+            return groups[key]
+        }
+        return nil
+    }
+    
+    public func contains(_ endpoint: EndpointID) -> Bool {
+        match(endpoint) != nil
+    }
+    
+    /// Scheme and node of a group EID, `dtn:` and `global` for `dtn://global/~news`
+    private static func groupKey(of description: String) -> String? {
+        guard description.contains("/~") else { return nil }
+        let parts = description.split(separator: "/")
+        guard parts.count >= 2 else { return nil }
+        return "\(parts[0])/\(parts[1])"
+    }
+}
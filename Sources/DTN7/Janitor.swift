@@ -6,11 +6,24 @@ import Logging
 public actor Janitor {
     private let logger = Logger(label: "dtnd.janitor")
     private let interval: TimeInterval
+    // Seconds between state snapshots, 0 for none
+    private let snapshotInterval: TimeInterval
+    private var lastSnapshot = ContinuousClock.now
     private weak var core: DtnCore?
     private var task: Task<Void, Never>?
     
-    public init(interval: TimeInterval = 10.0) {
+    // Peers to retry the forwarding queue against on the next pass
+    private var retryPeers: Set<EndpointID> = []
+    // The first pass retries the queue against every peer, picking up work left by a previous run
+    private var retryAllPeers = true
+    // Queued bundles handed to a peer's outbound queue per call
+    private let sendBatchSize = 32
+    // Queued bundles routed per call into the routing agent
+    private let routingBatchSize = 256
+    
+    public init(interval: TimeInterval = 10.0, snapshotInterval: TimeInterval = 60) {
         self.interval = interval
+        self.snapshotInterval = snapshotInterval
     }
     
     /// Set the DtnCore reference
@@ -28,6 +41,10 @@ public actor Janitor {
         task = Task {
             logger.info("Starting janitor task with interval: \(interval)s")
             
+            // Hand bundles left by a previous run to the peers already reachable
+            // rather than a full interval later
+            await processBundles()
+            
             while !Task.isCancelled {
                 do {
                     // Wait for the interval
@@ -61,74 +78,54 @@ public actor Janitor {
         // Process peers (clean up failed connections, etc.)
         await processPeers()
         
-        // Reprocess bundles for forwarding
+        // Retry the forwarding queue
         await processBundles()
+        
+        // Snapshot duplicate and routing state
+        await snapshotStateIfDue()
+    }
+    
+    /// Save the core's duplicate and routing state once `snapshotInterval` has passed,
+    /// so a node that loses power does not come back having forgotten it
+    private func snapshotStateIfDue() async {
+        guard let core = core, snapshotInterval > 0,
+              ContinuousClock.now - lastSnapshot >= .milliseconds(Int64(snapshotInterval * 1000)) else {
+            return
+        }
+        
+        lastSnapshot = .now
+        await core.saveState()
+        logger.debug("Saved duplicate and routing state")
     }
     
     /// Delete expired bundles from the store
+    ///
+    /// Uses the store's expiry index, so a pass only touches expired bundles
+    /// and never reads payloads.
     private func deleteExpiredBundles() async {
         guard let core = core else { 
             logger.warning("No core reference, skipping bundle cleanup")
             return 
         }
         
-        logger.info("Starting bundle expiration check")
-        
-        let allBundleIds = await core.store.allIds()
-        logger.info("Found \(allBundleIds.count) bundle(s) in store")
+        logger.debug("Starting bundle expiration check")
         
-        var expiredCount = 0
         let currentTime = DisruptionTolerantNetworkingTime.now()
         
-        for bundleId in allBundleIds {
-            if let bundle = await core.store.getBundle(bundleId: bundleId) {
-                let creationTime = bundle.primary.creationTimestamp.getDtnTime()
-                let age = TimeInterval(currentTime - creationTime) / 1000.0
-                
-                logger.info("Bundle \(bundleId): lifetime=\(bundle.primary.lifetime)s, age=\(age)s, expired=\(isExpired(bundle))")
-                
-                if isExpired(bundle) {
-                    logger.info("Bundle \(bundleId) has expired, removing from store")
-                    do {
-                        try await core.store.remove(bundleId: bundleId)
-                        expiredCount += 1
-                        logger.info("Successfully removed expired bundle \(bundleId)")
-                    } catch {
-                        logger.error("Failed to remove expired bundle \(bundleId): \(error)")
-                    }
-                } else {
-                    logger.debug("Bundle \(bundleId) is still valid")
+        do {
+            let expired = try await core.store.removeExpired(before: currentTime)
+            // Listing every bundle is only worth the loop when someone reads it
+            if logger.logLevel <= .debug {
+                for bundleId in expired {
+                    logger.debug("Removed expired bundle \(bundleId)")
                 }
-            } else {
-                logger.warning("Could not retrieve bundle \(bundleId) from store")
             }
+            if !expired.isEmpty {
+                logger.info("Bundle cleanup complete: removed \(expired.count) expired bundle(s)")
+            }
+        } catch {
+            logger.error("Failed to remove expired bundles: \(error)")
         }
-        
-        logger.info("Bundle cleanup complete: removed \(expiredCount) expired bundle(s)")
-    }
-    
-    /// Check if a bundle has expired based on its lifetime
-    private func isExpired(_ bundle: BP7.Bundle) -> Bool {
-        // If lifetime is 0, bundle never expires
-        guard bundle.primary.lifetime > 0 else {
-            return false
-        }
-        
-        // Check primary block lifetime
-        let creationTime = bundle.primary.creationTimestamp.getDtnTime()
-        let currentTime = DisruptionTolerantNetworkingTime.now()
-        let age = TimeInterval(currentTime - creationTime) / 1000.0 // Convert ms to seconds
-        
-        if age >= bundle.primary.lifetime {
-            logger.debug("Bundle expired: age=\(age)s >= lifetime=\(bundle.primary.lifetime)s")
-            return true
-        }
-        
-        // TODO: Check bundle age block if present
-        // Currently the BP7 library doesn't expose public access to CanonicalBlock.data
-        // This would require updating the BP7 library
-        
-        return false
     }
     
     /// Process peers - clean up failed connections
@@ -147,14 +144,24 @@ public actor Janitor {
         }
     }
     
-    /// Reprocess bundles for forwarding
+    /// Retry the forwarding queue towards `peer` on the next pass, e.g. because it just
+    /// became reachable or a send to it failed
+    public func retryForwarding(to peer: DtnPeer) {
+        retryPeers.insert(peer.eid)
+    }
+    
+    /// Retry queued bundles whose next hops include a peer marked for retry
+    ///
+    /// Only bundles marked `forwardPending` are considered, and nothing is
+    /// read while no peer is waiting for a retry. Bundles are routed from their
+    /// metadata, so only those with a next hop being retried are read, and none are decoded.
     private func processBundles() async {
         guard let core = core else { return }
         
-        logger.debug("Reprocessing bundles")
-        
-        // Get all bundle IDs
-        let bundleIds = await core.store.allIds()
+        guard retryAllPeers || !retryPeers.isEmpty else {
+            logger.debug("No peers to retry, skipping bundle forwarding")
+            return
+        }
         
         // Check if any CLAs are accepting connections
         let hasActiveCLA = await core.claRegistry.hasActiveCLA()
@@ -163,26 +170,64 @@ public actor Janitor {
             return
         }
         
-        // Process bundles that need forwarding
-        for bundleId in bundleIds {
-            if let bundle = await core.store.getBundle(bundleId: bundleId) {
-                // Skip if bundle is for local delivery
-                if await core.isLocalEndpoint(bundle.primary.destination) {
-                    continue
-                }
+        let targets = retryPeers
+        let allPeers = retryAllPeers
+        retryPeers.removeAll()
+        retryAllPeers = false
                 
-                // Skip if bundle has expired
-                if isExpired(bundle) {
+        logger.debug("Reprocessing forwarding queue for \(allPeers ? "all" : String(targets.count)) peer(s)")
+                
+        let currentTime = DisruptionTolerantNetworkingTime.now()
+        var retried = 0
+        
+        // Bundles bound for the same peer are queued for it in batches; the peer's
+        // outbound queue then decides the order they are sent in
+        var batches: [EndpointID: (peer: DtnPeer, bundles: [OutboundBundle])] = [:]
+        
+        // Route queued bundles a chunk at a time: one call into the routing agent per chunk
+        // instead of one per bundle, and bytes are read only for bundles with a next hop
+        var pending: [BundlePack] = []
+        func route(_ packs: [BundlePack]) async {
+            let decisions = await core.getRoutingDecisions(for: packs)
+            for (pack, decision) in zip(packs, decisions) where !decision.isLocalDelivery {
+                let nextHops = allPeers ? decision.nextHops : decision.nextHops.filter { targets.contains($0.eid) }
+                guard !nextHops.isEmpty,
+                      let bundleData = await core.store.getBundleBytes(bundleId: pack.id) else {
                     continue
                 }
                 
-                // Try to forward the bundle
-                // Get routing decision and send to peers
-                let decision = await core.getRoutingDecision(for: bundle)
-                if !decision.nextHops.isEmpty && !decision.isLocalDelivery {
-                    await core.sendBundle(bundle, to: decision.nextHops)
+                let outbound = OutboundBundle(pack: pack, data: bundleData)
+                for peer in nextHops {
+                    batches[peer.eid, default: (peer: peer, bundles: [])].bundles.append(outbound)
+                    if let batch = batches[peer.eid], batch.bundles.count >= sendBatchSize {
+                        batches[peer.eid] = nil
+                        await core.sendBundles(batch.bundles, to: batch.peer)
+                    }
                 }
+                retried += 1
+            }
+        }
+        
+        for await bundlePack in core.store.forwardPendingStream() {
+            // Skip if bundle has expired; the next expiry pass removes it
+            if bundlePack.expiresAt > 0 && bundlePack.expiresAt <= currentTime {
+                continue
+            }
+            
+            pending.append(bundlePack)
+            if pending.count >= routingBatchSize {
+                await route(pending)
+                pending.removeAll(keepingCapacity: true)
             }
         }
+        if !pending.isEmpty {
+            await route(pending)
+        }
+        
+        for batch in batches.values {
+            await core.sendBundles(batch.bundles, to: batch.peer)
+        }
+        
+        logger.debug("Forwarding queue pass complete: retried \(retried) bundle(s)")
     }
 }
\ No newline at end of file
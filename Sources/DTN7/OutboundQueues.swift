@@ -0,0 +1,232 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import BP7
+import Logging
+import Atomics
+
+/// Hands encoded bundles to the CLAs for one peer and reports whether any CLA took them
+public typealias BundleTransmitter = @Sendable ([EncodedBundle], DtnPeer) async -> Bool
+
+/// Outbound bundles for one peer, drained by a task of its own.
+///
+/// Bundles leave in the order of a `TransmissionScheduler`, up to
+/// `maxConcurrentSends` CLA calls at a time. After a failed send the queue
+/// waits with exponential backoff before trying this peer again, which delays
+/// only this peer's bundles.
+public actor PeerOutbox {
+    public let eid: EndpointID
+    
+    /// Bundles waiting, readable without entering the actor
+    public nonisolated var depth: Int { queued.load(ordering: .relaxed) }
+    
+    private let configuration: OutboundQueues.Configuration
+    private let transmit: BundleTransmitter
+    private let logger = Logger(label: "PeerOutbox")
+    
+    private var peer: DtnPeer
+    private var pending: TransmissionScheduler
+    private nonisolated let queued = ManagedAtomic<Int>(0)
+    private var drainTask: Task<Void, Never>?
+    
+    // Bundles queued or being sent. Routing a bundle again while it waits, as the
+    // Janitor does after a failed send, adds nothing.
+    private var outstanding: Set<String> = []
+    
+    // Backoff state
+    private var consecutiveFailures = 0
+    private var retryAt: ContinuousClock.Instant?
+    
+    init(peer: DtnPeer, configuration: OutboundQueues.Configuration, transmit: @escaping BundleTransmitter) {
+        self.eid = peer.eid
+        self.peer = peer
+        self.configuration = configuration
+        self.transmit = transmit
+        self.pending = TransmissionScheduler(configuration: configuration.schedule)
+    }
+    
+    /// Queue bundles and return; bundles already queued or in flight are skipped,
+    /// bundles beyond the queue limit are dropped and `false` is returned
+    @discardableResult
+    public func enqueue(_ bundles: [OutboundBundle], peer: DtnPeer) -> Bool {
+        // Keep the latest addresses and CLAs for the sends still to come
+        self.peer = peer
+        
+        let room = max(0, configuration.queueLimit - pending.count)
+        var accepted = 0
+        var dropped = 0
+        for bundle in bundles where !outstanding.contains(bundle.encoded.id) {
+            guard accepted < room else {
+                dropped += 1
+                continue
+            }
+            outstanding.insert(bundle.encoded.id)
+            pending.push(bundle)
+            accepted += 1
+        }
+        queued.store(pending.count, ordering: .relaxed)
+        
+        if drainTask == nil && !pending.isEmpty {
+            drainTask = Task { await self.drain() }
+        }
+        
+        if dropped > 0 {
+            logger.warning("Outbound queue for \(eid) is full, dropped \(dropped) bundle(s)")
+            return false
+        }
+        return true
+    }
+    
+    /// Stop draining and drop whatever is still queued
+    public func cancel() {
+        drainTask?.cancel()
+        drainTask = nil
+        pending.removeAll()
+        outstanding.removeAll()
+        queued.store(0, ordering: .relaxed)
+    }
+    
+    private func drain() async {
+        await withTaskGroup(of: (sent: Bool, ids: [String]).self) { group in
+            var running = 0
+            
+            while !Task.isCancelled {
+                // Wait out the backoff once nothing is in flight
+                if running == 0, let retryAt = retryAt, !pending.isEmpty {
+                    try? await Task.sleep(until: retryAt, clock: .continuous)
+                    self.retryAt = nil
+                    if Task.isCancelled { break }
+                }
+                
+                while running < configuration.maxConcurrentSends, retryAt == nil, !pending.isEmpty {
+                    var batch: [EncodedBundle] = []
+                    while batch.count < configuration.batchSize,
+                          let next = pending.pop(expired: { self.outstanding.remove($0.encoded.id) }) {
+                        batch.append(next.encoded)
+                    }
+                    queued.store(pending.count, ordering: .relaxed)
+                    // Everything left had expired
+                    guard !batch.isEmpty else { break }
+                    
+                    let peer = self.peer
+                    let transmit = self.transmit
+                    group.addTask { (await transmit(batch, peer), batch.map(\.id)) }
+                    running += 1
+                }
+                
+                guard running > 0, let result = await group.next() else { break }
+                running -= 1
+                // Sent or given up; a failed batch is retried from the store by the Janitor
+                outstanding.subtract(result.ids)
+                recordResult(result.sent)
+            }
+        }
+        
+        guard !Task.isCancelled else { return }
+        drainTask = nil
+        // Bundles queued while the last sends finished need a new drain
+        if !pending.isEmpty {
+            drainTask = Task { await self.drain() }
+        }
+    }
+    
+    private func recordResult(_ sent: Bool) {
+        guard !sent else {
+            consecutiveFailures = 0
+            return
+        }
+        
+        consecutiveFailures += 1
+        let doublings = min(consecutiveFailures - 1, 16)
+        let delay = min(configuration.initialBackoff * Double(1 << doublings), configuration.maxBackoff)
+        retryAt = .now + .milliseconds(Int64(delay * 1000))
+        logger.debug("Backing off \(eid) for \(delay)s after \(consecutiveFailures) failed send(s)")
+    }
+}
+
+/// One outbound queue per peer, so a slow or failing peer only delays its own bundles
+public actor OutboundQueues {
+    public struct Configuration: Sendable {
+        /// CLA calls in flight per peer
+        public var maxConcurrentSends: Int
+        /// Bundles handed to the CLA per call
+        public var batchSize: Int
+        /// Bundles a peer's queue holds before new ones are dropped
+        public var queueLimit: Int
+        /// Seconds to wait after the first failed send, doubled per further failure
+        public var initialBackoff: TimeInterval
+        public var maxBackoff: TimeInterval
+        /// Priority classes and fair queuing weights applied to every peer's queue
+        var schedule: TransmissionScheduler.Configuration
+        
+        /// `schedulerSettings` takes the `priority.*`, `weight.*` and `default_priority` keys of `DtnConfig.schedulerSettings`
+        public init(
+            maxConcurrentSends: Int = 2,
+            batchSize: Int = 32,
+            queueLimit: Int = 4_096,
+            initialBackoff: TimeInterval = 0.5,
+            maxBackoff: TimeInterval = 30,
+            schedulerSettings: [String: String] = [:]
+        ) {
+            self.maxConcurrentSends = max(1, maxConcurrentSends)
+            self.batchSize = max(1, batchSize)
+            self.queueLimit = max(1, queueLimit)
+            self.initialBackoff = initialBackoff
+            self.maxBackoff = maxBackoff
+            self.schedule = TransmissionScheduler.Configuration(settings: schedulerSettings)
+        }
+    }
+    
+    private let configuration: Configuration
+    private var transmit: BundleTransmitter?
+    private var outboxes: [EndpointID: PeerOutbox] = [:]
+    
+    public init(configuration: Configuration = Configuration(), transmit: BundleTransmitter? = nil) {
+        self.configuration = configuration
+        self.transmit = transmit
+    }
+    
+    /// Send through `core`, which picks the CLAs and records the outcome
+    public func setCore(_ core: DtnCore) {
+        transmit = { [weak core] bundles, peer in
+            await core?.transmit(bundles, to: peer) ?? false
+        }
+    }
+    
+    /// Queue bundles for a peer and return without waiting for them to be sent
+    @discardableResult
+    public func enqueue(_ bundles: [OutboundBundle], to peer: DtnPeer) async -> Bool {
+        guard !bundles.isEmpty else { return true }
+        guard let outbox = outbox(for: peer) else { return false }
+        return await outbox.enqueue(bundles, peer: peer)
+    }
+    
+    /// Queued bundles per peer
+    public func depths() -> [EndpointID: Int] {
+        outboxes.mapValues { $0.depth }
+    }
+    
+    /// Drop a peer's queue, e.g. when the peer is lost; the Janitor retries its bundles later
+    public func remove(_ eid: EndpointID) async {
+        await outboxes.removeValue(forKey: eid)?.cancel()
+    }
+    
+    public func removeAll() async {
+        for outbox in outboxes.values {
+            await outbox.cancel()
+        }
+        outboxes.removeAll()
+    }
+    
+    private func outbox(for peer: DtnPeer) -> PeerOutbox? {
+        if let outbox = outboxes[peer.eid] {
+            return outbox
+        }
+        guard let transmit = transmit else { return nil }
+        let outbox = PeerOutbox(peer: peer, configuration: configuration, transmit: transmit)
+        outboxes[peer.eid] = outbox
+        return outbox
+    }
+}
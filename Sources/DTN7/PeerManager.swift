@@ -5,6 +5,7 @@ import Foundation
 #endif
 import BP7
 import AsyncAlgorithms
+import NIOConcurrencyHelpers
 
 /// Events that can occur related to peers
 public enum PeerEvent: Sendable {
@@ -15,9 +16,28 @@ public enum PeerEvent: Sendable {
     case connectionLost(DtnPeer, CLAConnection)
 }
 
+/// An immutable, EID-keyed view of the known peers for routing decisions
+public struct PeerTable: Sendable {
+    public let peers: [EndpointID: DtnPeer]
+    /// Peers with at least one CLA, the ones bundles can be forwarded to
+    public let reachable: [DtnPeer]
+    
+    public init(peers: [EndpointID: DtnPeer] = [:]) {
+        self.peers = peers
+        self.reachable = peers.values.filter { !$0.claList.isEmpty }
+    }
+    
+    public subscript(eid: EndpointID) -> DtnPeer? {
+        peers[eid]
+    }
+    
+    public var count: Int { peers.count }
+}
+
 /// Manages DTN peers and their lifecycle
 public actor PeerManager {
     private var peers: [EndpointID: DtnPeer] = [:]
+    private let publishedTable = NIOLockedValueBox(PeerTable())
     private let peerTimeout: TimeInterval
     private var peerTimeoutTask: Task<Void, Never>?
     
@@ -49,6 +69,7 @@ public actor PeerManager {
         updatedPeer.fails = 0
         
         peers[peer.eid] = updatedPeer
+        publishTable()
         
         if isNew {
             await peerEvents.send(.discovered(updatedPeer))
@@ -60,6 +81,7 @@ public actor PeerManager {
     /// Remove a peer
     public func removePeer(_ eid: EndpointID) async {
         if let peer = peers.removeValue(forKey: eid) {
+            publishTable()
             await peerEvents.send(.lost(peer))
         }
     }
@@ -74,6 +96,15 @@ public actor PeerManager {
         Array(peers.values)
     }
     
+    /// The current peers, readable without awaiting the actor or copying them.
+    ///
+    /// Rebuilt when a peer is added, updated or removed. Contact bookkeeping from
+    /// `recordFailure(for:)` and `recordSuccess(for:)`, which runs per bundle, is not
+    /// republished, so `lastContact` and `fails` in the table may lag behind `getPeer(_:)`.
+    public nonisolated var peerTable: PeerTable {
+        publishedTable.withLockedValue { $0 }
+    }
+    
     /// Get peers that haven't been seen recently
     public func getStalePeers() -> [DtnPeer] {
         let cutoff = Date.now.timeIntervalSince1970 - peerTimeout
@@ -97,6 +128,12 @@ public actor PeerManager {
         }
     }
     
+    /// Rebuild `peerTable` after peers were added, updated or removed
+    private func publishTable() {
+        let table = PeerTable(peers: peers)
+        publishedTable.withLockedValue { $0 = table }
+    }
+    
     /// Run periodic timeout check
     private func runPeerTimeoutCheck() async {
         while !Task.isCancelled {
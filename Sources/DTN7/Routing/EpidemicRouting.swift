@@ -6,17 +6,32 @@ import Foundation
 import BP7
 import Logging
 
-/// Epidemic routing algorithm - controlled flooding where each bundle is sent exactly once to each peer
+/// Epidemic routing algorithm - controlled flooding where each bundle is sent exactly once to each peer.
+///
+/// On contact the peer's summary vector is fetched, and bundles it already holds
+/// are not sent to it, so a restart or a new encounter does not flood the store.
 public actor EpidemicRouting: RoutingAgent {
     public let algorithmName = "epidemic"
+    public let keepsCopies = true
     
     private let logger = Logger(label: "EpidemicRouting")
     
-    // Bundle forwarding history: bundleId -> Set of node names that have received it
-    private var forwardingHistory: [String: Set<String>] = [:]
+    // Bundle forwarding history: node name -> bundles it has received from us
+    private var forwardingHistory: [String: DuplicateFilter] = [:]
     
-    // Track which peer sent us each bundle to avoid loops
-    private var incomingBundleSource: [String: String] = [:]
+    // Track which peer sent us each bundle to avoid loops: node name -> bundles it sent
+    private var incomingBundleSource: [String: DuplicateFilter] = [:]
+    
+    // Sizing of each per-peer filter; smaller than the node-wide one since there is one per peer
+    private let historyConfiguration: DuplicateFilter.Configuration
+    
+    // Bundles each peer held when it was last asked: node name -> summary vector
+    private var peerSummaries: [String: SummaryVector] = [:]
+    
+    // Peers whose summary is being fetched; bundles wait for it instead of being sent blind
+    private var pendingSummaries: Set<String> = []
+    
+    private let summaryExchange: SummaryExchange?
     
     // Reference to peer manager
     private weak var peerManager: PeerManager?
@@ -24,7 +39,14 @@ public actor EpidemicRouting: RoutingAgent {
     // Reference to core for local endpoint checks
     private weak var core: DtnCore?
     
-    public init() {}
+    /// Without a `summaryExchange` peers are offered every bundle they have not received from or sent to this node
+    public init(
+        historyConfiguration: DuplicateFilter.Configuration = DuplicateFilter.Configuration(exactCapacity: 1_000, filterCapacity: 20_000),
+        summaryExchange: SummaryExchange? = nil
+    ) {
+        self.historyConfiguration = historyConfiguration
+        self.summaryExchange = summaryExchange
+    }
     
     /// Set required references
     public func configure(peerManager: PeerManager, core: DtnCore) async {
@@ -40,11 +62,12 @@ public actor EpidemicRouting: RoutingAgent {
         logger.info("Epidemic routing agent stopped")
         forwardingHistory.removeAll()
         incomingBundleSource.removeAll()
+        peerSummaries.removeAll()
+        pendingSummaries.removeAll()
     }
     
     public func getNextHops(for bundle: BP7.Bundle) async -> RoutingDecision {
-        let bundleId = BundlePack(from: bundle).id
-        let destination = bundle.primary.destination
+        let bundleId = BundlePack.id(of: bundle)
         
         guard let peerManager = peerManager,
               let core = core else {
@@ -52,57 +75,82 @@ public actor EpidemicRouting: RoutingAgent {
             return RoutingDecision(bundleId: bundleId)
         }
         
+        return route(
+            bundleId: bundleId,
+            key: BundleKey(bundle: bundle),
+            destination: bundle.primary.destination,
+            peers: peerManager.peerTable,
+            local: core.localEndpointSnapshot()
+        )
+    }
+    
+    public func getNextHops(for bundles: [BundlePack]) async -> [RoutingDecision] {
+        guard let peerManager = peerManager,
+              let core = core else {
+            logger.error("Missing required references")
+            return bundles.map { RoutingDecision(bundleId: $0.id) }
+        }
+        
+        // Current peers, read without copying
+        let peers = peerManager.peerTable
+        let local = core.localEndpointSnapshot()
+        return bundles.map { pack in
+            route(bundleId: pack.id, key: BundleKey(id: pack.id), destination: pack.destination, peers: peers, local: local)
+        }
+    }
+    
+    private func route(bundleId: String, key bundleKey: BundleKey, destination: EndpointID, peers: PeerTable, local: LocalEndpoints) -> RoutingDecision {
         // Check if this is for local delivery
-        if await core.isLocalEndpoint(destination) {
+        if local.contains(destination) {
             logger.debug("Bundle \(bundleId) is for local delivery")
             return RoutingDecision(bundleId: bundleId, nextHops: [], isLocalDelivery: true)
         }
         
-        // Get all current peers
-        let allPeers = await peerManager.getAllPeers()
-        
         // Check if destination is a direct peer (optimization)
-        if let destinationPeer = allPeers.first(where: { $0.eid == destination }) {
-            logger.info("Direct delivery possible for bundle \(bundleId) to \(destination)")
+        if let destinationPeer = peers[destination] {
+            logger.debug("Direct delivery possible for bundle \(bundleId) to \(destination)")
             // Mark this peer as having received the bundle
-            markBundleSent(bundleId: bundleId, to: destination.description)
+            markBundleSent(bundleKey, to: destination.description)
             return RoutingDecision(bundleId: bundleId, nextHops: [destinationPeer])
         }
         
         // Build list of peers that haven't received this bundle yet
         var candidatePeers: [DtnPeer] = []
-        let bundleHistory = forwardingHistory[bundleId] ?? Set<String>()
         
-        for peer in allPeers {
+        for peer in peers.reachable {
             let peerName = peer.eid.description
             
             // Skip if we already sent to this peer
-            if bundleHistory.contains(peerName) {
+            if forwardingHistory[peerName]?.contains(bundleKey) == true {
                 logger.trace("Skipping peer \(peerName) - already sent bundle \(bundleId)")
                 continue
             }
             
             // Skip if this peer sent us the bundle (avoid loops)
-            if let source = incomingBundleSource[bundleId], source == peerName {
+            if incomingBundleSource[peerName]?.contains(bundleKey) == true {
                 logger.trace("Skipping peer \(peerName) - they sent us bundle \(bundleId)")
                 continue
             }
             
-            // Skip if peer has no CLAs
-            if peer.claList.isEmpty {
-                logger.trace("Skipping peer \(peerName) - no CLAs available")
+            // Skip if the peer already holds the bundle, or hold it back until we know
+            if pendingSummaries.contains(peerName) {
+                logger.trace("Deferring bundle \(bundleId) for \(peerName) until its summary vector arrives")
+                continue
+            }
+            if peerSummaries[peerName]?.contains(bundleKey) == true {
+                logger.trace("Skipping peer \(peerName) - its summary vector lists bundle \(bundleId)")
                 continue
             }
             
             candidatePeers.append(peer)
             // Mark as sent (optimistically - will be removed if sending fails)
-            markBundleSent(bundleId: bundleId, to: peerName)
+            markBundleSent(bundleKey, to: peerName)
         }
         
         if candidatePeers.isEmpty {
             logger.debug("No new peers to forward bundle \(bundleId) to")
         } else {
-            logger.info("Forwarding bundle \(bundleId) to \(candidatePeers.count) peers: \(candidatePeers.map { $0.eid.description }.joined(separator: ", "))")
+            logger.debug("Forwarding bundle \(bundleId) to \(candidatePeers.count) peers: \(candidatePeers.map { $0.eid.description }.joined(separator: ", "))")
         }
         
         return RoutingDecision(bundleId: bundleId, nextHops: candidatePeers)
@@ -120,7 +168,7 @@ public actor EpidemicRouting: RoutingAgent {
             
         case .notifyPeerEncountered(let peer):
             logger.info("New peer encountered: \(peer.eid)")
-            // Epidemic routing will automatically consider new peers
+            requestSummary(from: peer)
             
         case .notifyPeerLost(let peer):
             logger.info("Peer lost: \(peer.eid)")
@@ -129,7 +177,7 @@ public actor EpidemicRouting: RoutingAgent {
             
         case .requestNextHop(let bundle):
             // This is handled by getNextHops
-            logger.trace("Received requestNextHop for bundle \(BundlePack(from: bundle).id)")
+            logger.trace("Received requestNextHop for bundle \(BundlePack.id(of: bundle))")
             
         default:
             break
@@ -141,48 +189,101 @@ public actor EpidemicRouting: RoutingAgent {
             "algorithm": algorithmName,
             "forwarding_history_size": "\(forwardingHistory.count)",
             "total_forwards": "\(forwardingHistory.values.reduce(0) { $0 + $1.count })",
-            "tracked_bundles": "\(forwardingHistory.count) bundles"
+            "tracked_bundles": "\(forwardingHistory.count) peers",
+            "peer_summaries": "\(peerSummaries.count)",
+            "history_bytes": "\((forwardingHistory.values.map(\.byteCount) + incomingBundleSource.values.map(\.byteCount)).reduce(0, +))"
         ]
     }
     
     // MARK: - Helper Methods
     
     /// Mark a bundle as sent to a specific peer
-    private func markBundleSent(bundleId: String, to peer: String) {
-        if forwardingHistory[bundleId] == nil {
-            forwardingHistory[bundleId] = Set<String>()
-        }
-        forwardingHistory[bundleId]!.insert(peer)
+    private func markBundleSent(_ bundleKey: BundleKey, to peer: String) {
+        forwardingHistory[peer, default: DuplicateFilter(configuration: historyConfiguration)].insert(bundleKey)
     }
     
     /// Remove a peer from all forwarding histories (e.g., when peer is lost)
     private func removePeerFromHistory(_ peer: String) {
-        for bundleId in forwardingHistory.keys {
-            forwardingHistory[bundleId]?.remove(peer)
-        }
+        forwardingHistory.removeValue(forKey: peer)
         
         // Also remove from incoming bundle sources
-        incomingBundleSource = incomingBundleSource.filter { $0.value != peer }
+        incomingBundleSource.removeValue(forKey: peer)
+        
+        // The next contact fetches a fresh summary
+        peerSummaries.removeValue(forKey: peer)
+        pendingSummaries.remove(peer)
+    }
+    
+    /// Fetch a peer's summary vector, then offer it the bundles that were held back meanwhile
+    private func requestSummary(from peer: DtnPeer) {
+        guard let summaryExchange = summaryExchange else { return }
+        let peerName = peer.eid.description
+        guard pendingSummaries.insert(peerName).inserted else { return }
+        
+        Task {
+            let summary = await summaryExchange(peer)
+            await self.receiveSummary(summary, from: peer)
+        }
+    }
+    
+    private func receiveSummary(_ summary: SummaryVector?, from peer: DtnPeer) async {
+        let peerName = peer.eid.description
+        // The peer was lost while we asked
+        guard pendingSummaries.remove(peerName) != nil else { return }
+        
+        if let summary = summary {
+            logger.debug("Peer \(peerName) holds \(summary.count) bundle(s)")
+            peerSummaries[peerName] = summary
+        } else {
+            peerSummaries.removeValue(forKey: peerName)
+        }
+        await core?.janitor.retryForwarding(to: peer)
     }
     
     /// Record which peer sent us a bundle (for loop prevention)
     public func recordIncomingBundle(_ bundleId: String, from peer: String) {
-        incomingBundleSource[bundleId] = peer
+        incomingBundleSource[peer, default: DuplicateFilter(configuration: historyConfiguration)].insert(BundleKey(id: bundleId))
     }
     
-    /// Clean up old history entries (could be called periodically)
-    public func cleanupHistory(olderThan: TimeInterval) {
-        // In a production system, we'd track timestamps and remove old entries
-        // For now, simple size limit
-        let maxHistorySize = 10000
+    // MARK: - Persistence
+    
+    private struct Snapshot: Codable {
+        static let currentVersion = 1
         
-        if forwardingHistory.count > maxHistorySize {
-            // Remove oldest entries (simplified - in production use LRU)
-            let toRemove = forwardingHistory.count - maxHistorySize
-            for key in forwardingHistory.keys.prefix(toRemove) {
-                forwardingHistory.removeValue(forKey: key)
-                incomingBundleSource.removeValue(forKey: key)
-            }
+        let version: Int
+        /// Peer name to its serialized `DuplicateFilter`
+        let forwardingHistory: [String: Data]
+        let incomingBundleSource: [String: Data]
+    }
+    
+    /// The per-peer histories; summary vectors are fetched fresh on the next contact
+    public func stateSnapshot() async -> Data? {
+        let snapshot = Snapshot(
+            version: Snapshot.currentVersion,
+            forwardingHistory: forwardingHistory.mapValues { $0.serialized() },
+            incomingBundleSource: incomingBundleSource.mapValues { $0.serialized() }
+        )
+        return try? JSONEncoder().encode(snapshot)
+    }
+    
+    public func restoreState(from data: Data) async -> Bool {
+        guard let snapshot = try? JSONDecoder().decode(Snapshot.self, from: data),
+              snapshot.version == Snapshot.currentVersion else {
+            return false
         }
+        
+        // Peers already met in this run keep what was recorded for them since
+        let configuration = historyConfiguration
+        forwardingHistory.merge(snapshot.forwardingHistory.compactMapValues { DuplicateFilter(serialized: $0, configuration: configuration) }) { current, _ in current }
+        incomingBundleSource.merge(snapshot.incomingBundleSource.compactMapValues { DuplicateFilter(serialized: $0, configuration: configuration) }) { current, _ in current }
+        logger.info("Restored forwarding history for \(snapshot.forwardingHistory.count) peer(s)")
+        return true
+    }
+    
+    /// Clean up old history entries (could be called periodically)
+    public func cleanupHistory(olderThan: TimeInterval) {
+        // Each peer's filter is fixed in size and ages out entries on its own window;
+        // a peer's whole history goes when the peer is lost
+        logger.trace("Forwarding history is bounded per peer, nothing to clean up")
     }
 }
\ No newline at end of file
@@ -9,6 +9,7 @@ import Logging
 /// Flooding routing algorithm - simplest routing that sends all bundles to all peers repeatedly
 public actor FloodingRouting: RoutingAgent {
     public let algorithmName = "flooding"
+    public let keepsCopies = true
     
     private let logger = Logger(label: "FloodingRouting")
     
@@ -39,8 +40,7 @@ public actor FloodingRouting: RoutingAgent {
     }
     
     public func getNextHops(for bundle: BP7.Bundle) async -> RoutingDecision {
-        let bundleId = BundlePack(from: bundle).id
-        let destination = bundle.primary.destination
+        let bundleId = BundlePack.id(of: bundle)
         
         guard let peerManager = peerManager,
               let core = core else {
@@ -48,26 +48,39 @@ public actor FloodingRouting: RoutingAgent {
             return RoutingDecision(bundleId: bundleId)
         }
         
+        return route(bundleId: bundleId, destination: bundle.primary.destination, peers: peerManager.peerTable, local: core.localEndpointSnapshot())
+    }
+    
+    public func getNextHops(for bundles: [BundlePack]) async -> [RoutingDecision] {
+        guard let peerManager = peerManager,
+              let core = core else {
+            logger.error("Missing required references")
+            return bundles.map { RoutingDecision(bundleId: $0.id) }
+        }
+        
+        let peers = peerManager.peerTable
+        let local = core.localEndpointSnapshot()
+        return bundles.map { route(bundleId: $0.id, destination: $0.destination, peers: peers, local: local) }
+    }
+    
+    private func route(bundleId: String, destination: EndpointID, peers: PeerTable, local: LocalEndpoints) -> RoutingDecision {
         totalRoutingDecisions += 1
         
         // Check if this is for local delivery
-        if await core.isLocalEndpoint(destination) {
+        if local.contains(destination) {
             logger.debug("Bundle \(bundleId) is for local delivery")
             return RoutingDecision(bundleId: bundleId, nextHops: [], isLocalDelivery: true)
         }
         
-        // Get all current peers
-        let allPeers = await peerManager.getAllPeers()
-        
-        // Filter peers that have CLAs available
-        let peersWithCLAs = allPeers.filter { !$0.claList.isEmpty }
+        // Peers that have CLAs available
+        let peersWithCLAs = peers.reachable
         
         totalPeersReturned += peersWithCLAs.count
         
         if peersWithCLAs.isEmpty {
             logger.debug("No peers with CLAs available for bundle \(bundleId)")
         } else {
-            logger.info("Flooding bundle \(bundleId) to \(peersWithCLAs.count) peers")
+            logger.debug("Flooding bundle \(bundleId) to \(peersWithCLAs.count) peers")
         }
         
         // Always forward to all available peers (no history tracking)
@@ -47,11 +47,44 @@ public protocol RoutingAgent: Sendable {
     /// Get next hops for a bundle
     func getNextHops(for bundle: BP7.Bundle) async -> RoutingDecision
     
+    /// Get next hops for several stored bundles from their metadata, one decision per bundle in order.
+    /// Agents answer the whole batch from one peer table and local endpoint snapshot.
+    func getNextHops(for bundles: [BundlePack]) async -> [RoutingDecision]
+    
     /// Handle routing notifications
     func handleNotification(_ notification: RoutingCommand) async
     
     /// Get current routing state (for monitoring)
     func getState() async -> [String: String]
+    
+    /// Snapshot of what the agent remembers about past forwarding, saved so a
+    /// restarted node does not offer peers the bundles it already gave them.
+    /// Nil for agents that keep no such state.
+    func stateSnapshot() async -> Data?
+    
+    /// Restore a snapshot taken by `stateSnapshot()`; false if it is not one
+    func restoreState(from snapshot: Data) async -> Bool
+    
+    /// Whether bundles stay in the forwarding queue after a peer took them, to be
+    /// offered to peers met later. Agents that hand a bundle to one next hop keep none.
+    var keepsCopies: Bool { get }
+}
+
+extension RoutingAgent {
+    /// Default for stateless agents
+    public func stateSnapshot() async -> Data? {
+        nil
+    }
+    
+    /// Default for stateless agents
+    public func restoreState(from snapshot: Data) async -> Bool {
+        false
+    }
+    
+    /// Default for agents that forward each bundle once
+    public var keepsCopies: Bool {
+        false
+    }
 }
 
 /// Base implementation for routing agents
@@ -37,13 +37,20 @@ public actor SinkRouting: RoutingAgent {
     }
     
     public func getNextHops(for bundle: BP7.Bundle) async -> RoutingDecision {
-        let bundleId = BundlePack(from: bundle).id
-        let destination = bundle.primary.destination
+        let local = core?.localEndpointSnapshot()
+        return route(bundleId: BundlePack.id(of: bundle), destination: bundle.primary.destination, local: local)
+    }
         
+    public func getNextHops(for bundles: [BundlePack]) async -> [RoutingDecision] {
+        let local = core?.localEndpointSnapshot()
+        return bundles.map { route(bundleId: $0.id, destination: $0.destination, local: local) }
+    }
+    
+    private func route(bundleId: String, destination: EndpointID, local: LocalEndpoints?) -> RoutingDecision {
         totalBundlesProcessed += 1
         
         // Check if this is for local delivery
-        if let core = core, await core.isLocalEndpoint(destination) {
+        if let local = local, local.contains(destination) {
             logger.debug("Bundle \(bundleId) is for local delivery")
             localDeliveries += 1
             return RoutingDecision(bundleId: bundleId, nextHops: [], isLocalDelivery: true)
@@ -7,7 +7,7 @@ import BP7
 import Logging
 
 /// Bundle metadata for Spray and Wait routing
-struct SprayAndWaitBundleData: Sendable {
+struct SprayAndWaitBundleData: Sendable, Codable {
     var remainingCopies: Int
     var nodesWithCopy: Set<String>
 }
@@ -17,6 +17,7 @@ struct SprayAndWaitBundleData: Sendable {
 /// In wait phase, only direct delivery is possible
 public actor SprayAndWaitRouting: RoutingAgent {
     public let algorithmName = "sprayandwait"
+    public let keepsCopies = true
     
     private let logger = Logger(label: "SprayAndWaitRouting")
     
@@ -61,8 +62,7 @@ public actor SprayAndWaitRouting: RoutingAgent {
     }
     
     public func getNextHops(for bundle: BP7.Bundle) async -> RoutingDecision {
-        let bundleId = BundlePack(from: bundle).id
-        let destination = bundle.primary.destination
+        let bundleId = BundlePack.id(of: bundle)
         
         guard let peerManager = peerManager,
               let core = core else {
@@ -70,17 +70,42 @@ public actor SprayAndWaitRouting: RoutingAgent {
             return RoutingDecision(bundleId: bundleId)
         }
         
+        return route(
+            bundleId: bundleId,
+            source: bundle.primary.source,
+            destination: bundle.primary.destination,
+            peers: peerManager.peerTable,
+            local: core.localEndpointSnapshot()
+        )
+    }
+    
+    public func getNextHops(for bundles: [BundlePack]) async -> [RoutingDecision] {
+        guard let peerManager = peerManager,
+              let core = core else {
+            logger.error("Missing required references")
+            return bundles.map { RoutingDecision(bundleId: $0.id) }
+        }
+        
+        // Current peers, read without copying
+        let peers = peerManager.peerTable
+        let local = core.localEndpointSnapshot()
+        return bundles.map { pack in
+            route(bundleId: pack.id, source: pack.source, destination: pack.destination, peers: peers, local: local)
+        }
+    }
+    
+    private func route(bundleId: String, source: EndpointID, destination: EndpointID, peers: PeerTable, local: LocalEndpoints) -> RoutingDecision {
         totalBundlesProcessed += 1
         
         // Check if this is for local delivery
-        if await core.isLocalEndpoint(destination) {
+        if local.contains(destination) {
             logger.debug("Bundle \(bundleId) is for local delivery")
             return RoutingDecision(bundleId: bundleId, nextHops: [], isLocalDelivery: true)
         }
         
         // Initialize bundle metadata if this is a new bundle
         if bundleHistory[bundleId] == nil {
-            await initializeBundleMetadata(bundleId: bundleId, source: bundle.primary.source)
+            initializeBundleMetadata(bundleId: bundleId, isOwnBundle: local.contains(source))
         }
         
         guard var metadata = bundleHistory[bundleId] else {
@@ -88,16 +113,13 @@ public actor SprayAndWaitRouting: RoutingAgent {
             return RoutingDecision(bundleId: bundleId)
         }
         
-        // Get all current peers
-        let allPeers = await peerManager.getAllPeers()
-        
         // Check if we're in wait phase (only 1 copy left)
         if metadata.remainingCopies < 2 {
             bundlesInWaitPhase += 1
             
             // In wait phase - only direct delivery
-            if let destinationPeer = allPeers.first(where: { $0.eid == destination }) {
-                logger.info("Direct delivery possible for bundle \(bundleId) to \(destination)")
+            if let destinationPeer = peers[destination] {
+                logger.debug("Direct delivery possible for bundle \(bundleId) to \(destination)")
                 directDeliveries += 1
                 
                 // Mark as sent and use last copy
@@ -116,7 +138,7 @@ public actor SprayAndWaitRouting: RoutingAgent {
         bundlesInSprayPhase += 1
         var candidatePeers: [DtnPeer] = []
         
-        for peer in allPeers {
+        for peer in peers.reachable {
             let peerName = peer.eid.description
             
             // Skip if we already sent to this peer
@@ -124,11 +146,6 @@ public actor SprayAndWaitRouting: RoutingAgent {
                 continue
             }
             
-            // Skip if peer has no CLAs
-            if peer.claList.isEmpty {
-                continue
-            }
-            
             // Skip if we've run out of copies
             if metadata.remainingCopies <= 0 {
                 break
@@ -150,7 +167,7 @@ public actor SprayAndWaitRouting: RoutingAgent {
         if candidatePeers.isEmpty {
             logger.debug("No new peers to spray bundle \(bundleId) to")
         } else {
-            logger.info("Spraying bundle \(bundleId) to \(candidatePeers.count) peers")
+            logger.debug("Spraying bundle \(bundleId) to \(candidatePeers.count) peers")
         }
         
         return RoutingDecision(bundleId: bundleId, nextHops: candidatePeers)
@@ -171,7 +188,7 @@ public actor SprayAndWaitRouting: RoutingAgent {
             // For failed transmissions, we could restore copies, but keeping it simple
             
         case .requestNextHop(let bundle):
-            logger.trace("Received requestNextHop for bundle \(BundlePack(from: bundle).id)")
+            logger.trace("Received requestNextHop for bundle \(BundlePack.id(of: bundle))")
             
         default:
             break
@@ -197,11 +214,7 @@ public actor SprayAndWaitRouting: RoutingAgent {
     // MARK: - Helper Methods
     
     /// Initialize metadata for a new bundle
-    private func initializeBundleMetadata(bundleId: String, source: EndpointID) async {
-        guard let core = core else { return }
-        
-        let isOwnBundle = await core.isLocalEndpoint(source)
-        
+    private func initializeBundleMetadata(bundleId: String, isOwnBundle: Bool) {
         let metadata = SprayAndWaitBundleData(
             remainingCopies: isOwnBundle ? maxCopies : 1,  // Own bundles get L copies, received bundles get 1
             nodesWithCopy: []
@@ -212,6 +225,33 @@ public actor SprayAndWaitRouting: RoutingAgent {
         logger.debug("Initialized bundle \(bundleId) with \(metadata.remainingCopies) copies (own bundle: \(isOwnBundle))")
     }
     
+    // MARK: - Persistence
+    
+    private struct Snapshot: Codable {
+        static let currentVersion = 1
+        
+        let version: Int
+        let bundleHistory: [String: SprayAndWaitBundleData]
+    }
+    
+    /// Remaining copies and the peers holding one, per bundle
+    public func stateSnapshot() async -> Data? {
+        try? JSONEncoder().encode(Snapshot(version: Snapshot.currentVersion, bundleHistory: bundleHistory))
+    }
+    
+    /// Copy counts are kept as they were, even if `maxCopies` changed since; bundles
+    /// routed in this run before the restore keep their current state
+    public func restoreState(from data: Data) async -> Bool {
+        guard let snapshot = try? JSONDecoder().decode(Snapshot.self, from: data),
+              snapshot.version == Snapshot.currentVersion else {
+            return false
+        }
+        
+        bundleHistory.merge(snapshot.bundleHistory) { current, _ in current }
+        logger.info("Restored spray state for \(snapshot.bundleHistory.count) bundle(s)")
+        return true
+    }
+    
     /// Clean up old history entries (could be called periodically)
     public func cleanupHistory(olderThan: TimeInterval) {
         let maxHistorySize = 10000
@@ -0,0 +1,169 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+
+/// A `*` / `?` glob over EID strings, classified once so common shapes skip the general matcher.
+///
+/// `?` matches a single UTF-8 byte, which is one character for the ASCII EIDs in use.
+struct GlobPattern: Sendable {
+    enum Kind: Sendable {
+        /// `*`
+        case any
+        /// No wildcards
+        case literal
+        /// Wildcard-free text followed by a single trailing `*`
+        case prefix
+        /// Anything else
+        case glob
+    }
+    
+    let kind: Kind
+    /// The pattern text, without the trailing `*` for `prefix`
+    let text: String
+    private let bytes: [UInt8]
+    
+    private static let star = UInt8(ascii: "*")
+    private static let question = UInt8(ascii: "?")
+    
+    init(_ pattern: String) {
+        let wildcards = pattern.utf8.filter { $0 == Self.star || $0 == Self.question }.count
+        if pattern == "*" {
+            kind = .any
+            text = ""
+        } else if wildcards == 0 {
+            kind = .literal
+            text = pattern
+        } else if wildcards == 1 && pattern.utf8.last == Self.star {
+            kind = .prefix
+            text = String(pattern.dropLast())
+        } else {
+            kind = .glob
+            text = pattern
+        }
+        bytes = Array(text.utf8)
+    }
+    
+    func matches(_ string: String) -> Bool {
+        switch kind {
+        case .any:
+            return true
+        case .literal:
+            return string == text
+        case .prefix:
+            return string.utf8.starts(with: bytes)
+        case .glob:
+            return Self.globMatch(Array(string.utf8), bytes)
+        }
+    }
+    
+    /// Greedy wildcard match that backtracks only to the last `*`
+    private static func globMatch(_ string: [UInt8], _ pattern: [UInt8]) -> Bool {
+        var s = 0
+        var p = 0
+        var lastStar: Int?
+        var starMatchEnd = 0
+        
+        while s < string.count {
+            if p < pattern.count && pattern[p] == star {
+                lastStar = p
+                starMatchEnd = s
+                p += 1
+            } else if p < pattern.count && (pattern[p] == question || pattern[p] == string[s]) {
+                s += 1
+                p += 1
+            } else if let starPosition = lastStar {
+                // Let the last `*` swallow one more byte and retry from there
+                p = starPosition + 1
+                starMatchEnd += 1
+                s = starMatchEnd
+            } else {
+                return false
+            }
+        }
+        
+        while p < pattern.count && pattern[p] == star {
+            p += 1
+        }
+        return p == pattern.count
+    }
+}
+
+/// Static routes compiled for lookup by destination EID.
+///
+/// Literal destinations are found by hash, `prefix*` destinations (including `*`)
+/// by walking a byte trie along the destination, and the remaining globs are kept
+/// in one list checked on every lookup. Candidates are then filtered by source and
+/// returned in route order, so the result equals scanning every route sorted by index.
+struct StaticRouteTable: Sendable {
+    private struct TrieNode: Sendable {
+        var children: [UInt8: Int] = [:]
+        var routes: [Int] = []
+    }
+    
+    /// Routes sorted by index, ties in insertion order
+    let routes: [StaticRoute]
+    
+    private let sources: [GlobPattern]
+    private var literal: [String: [Int]] = [:]
+    private var trie: [TrieNode] = [TrieNode()]
+    private var fallback: [(position: Int, pattern: GlobPattern)] = []
+    
+    init(routes: [StaticRoute] = []) {
+        let sorted = routes.enumerated()
+            .sorted { ($0.element.index, $0.offset) < ($1.element.index, $1.offset) }
+            .map(\.element)
+        self.routes = sorted
+        self.sources = sorted.map { GlobPattern($0.sourcePattern) }
+        
+        for (position, route) in sorted.enumerated() {
+            let destination = GlobPattern(route.destinationPattern)
+            switch destination.kind {
+            case .literal:
+                literal[destination.text, default: []].append(position)
+            case .any, .prefix:
+                insertPrefix(destination.text, position: position)
+            case .glob:
+                fallback.append((position, destination))
+            }
+        }
+    }
+    
+    var isEmpty: Bool { routes.isEmpty }
+    
+    /// Routes whose source and destination patterns both match, in route order
+    func matches(source: String, destination: String) -> [StaticRoute] {
+        var positions = literal[destination] ?? []
+        
+        var node = 0
+        positions.append(contentsOf: trie[node].routes)
+        for byte in destination.utf8 {
+            guard let child = trie[node].children[byte] else { break }
+            node = child
+            positions.append(contentsOf: trie[node].routes)
+        }
+        
+        for (position, pattern) in fallback where pattern.matches(destination) {
+            positions.append(position)
+        }
+        
+        return positions.sorted()
+            .filter { sources[$0].matches(source) }
+            .map { routes[$0] }
+    }
+    
+    private mutating func insertPrefix(_ prefix: String, position: Int) {
+        var node = 0
+        for byte in prefix.utf8 {
+            if let child = trie[node].children[byte] {
+                node = child
+            } else {
+                trie.append(TrieNode())
+                trie[node].children[byte] = trie.count - 1
+                node = trie.count - 1
+            }
+        }
+        trie[node].routes.append(position)
+    }
+}
@@ -27,8 +27,11 @@ public actor StaticRouting: RoutingAgent {
     
     private let logger = Logger(label: "StaticRouting")
     
-    // Routing table
-    private var routes: [StaticRoute] = []
+    // Routing table, compiled for lookup whenever it changes
+    private var routes: [StaticRoute] = [] {
+        didSet { table = StaticRouteTable(routes: routes) }
+    }
+    private var table = StaticRouteTable()
     
     // Configuration
     private let routesFile: String?
@@ -68,9 +71,7 @@ public actor StaticRouting: RoutingAgent {
     }
     
     public func getNextHops(for bundle: BP7.Bundle) async -> RoutingDecision {
-        let bundleId = BundlePack(from: bundle).id
-        let source = bundle.primary.source
-        let destination = bundle.primary.destination
+        let bundleId = BundlePack.id(of: bundle)
         
         guard let peerManager = peerManager,
               let core = core else {
@@ -78,36 +79,54 @@ public actor StaticRouting: RoutingAgent {
             return RoutingDecision(bundleId: bundleId)
         }
         
+        return route(
+            bundleId: bundleId,
+            source: bundle.primary.source,
+            destination: bundle.primary.destination,
+            peers: peerManager.peerTable,
+            local: core.localEndpointSnapshot()
+        )
+    }
+        
+    public func getNextHops(for bundles: [BundlePack]) async -> [RoutingDecision] {
+        guard let peerManager = peerManager,
+              let core = core else {
+            logger.error("Missing required references")
+            return bundles.map { RoutingDecision(bundleId: $0.id) }
+        }
+        
+        // Current peers, read without copying
+        let peers = peerManager.peerTable
+        let local = core.localEndpointSnapshot()
+        return bundles.map { pack in
+            route(bundleId: pack.id, source: pack.source, destination: pack.destination, peers: peers, local: local)
+        }
+    }
+    
+    private func route(bundleId: String, source: EndpointID, destination: EndpointID, peers: PeerTable, local: LocalEndpoints) -> RoutingDecision {
         totalRoutingDecisions += 1
         
         // Check if this is for local delivery
-        if await core.isLocalEndpoint(destination) {
+        if local.contains(destination) {
             logger.debug("Bundle \(bundleId) is for local delivery")
             return RoutingDecision(bundleId: bundleId, nextHops: [], isLocalDelivery: true)
         }
         
-        // Get all current peers
-        let allPeers = await peerManager.getAllPeers()
-        
         // Find matching route
-        for route in routes.sorted(by: { $0.index < $1.index }) {
-            if matchesPattern(source.description, pattern: route.sourcePattern) &&
-               matchesPattern(destination.description, pattern: route.destinationPattern) {
-                
-                logger.debug("Bundle \(bundleId) matches route #\(route.index): \(route.sourcePattern) -> \(route.destinationPattern) via \(route.viaNode)")
+        for route in table.matches(source: source.description, destination: destination.description) {
+            logger.debug("Bundle \(bundleId) matches route #\(route.index): \(route.sourcePattern) -> \(route.destinationPattern) via \(route.viaNode)")
                 
-                // Find the peer matching the via node
-                if let peer = allPeers.first(where: { $0.eid == route.viaNode }) {
-                    if !peer.claList.isEmpty {
-                        matchedRoutes += 1
-                        logger.info("Routing bundle \(bundleId) via \(peer.eid) using route #\(route.index)")
-                        return RoutingDecision(bundleId: bundleId, nextHops: [peer])
-                    } else {
-                        logger.warning("Via node \(route.viaNode) has no CLAs available")
-                    }
+            // Find the peer matching the via node
+            if let peer = peers[route.viaNode] {
+                if !peer.claList.isEmpty {
+                    matchedRoutes += 1
+                    logger.debug("Routing bundle \(bundleId) via \(peer.eid) using route #\(route.index)")
+                    return RoutingDecision(bundleId: bundleId, nextHops: [peer])
                 } else {
-                    logger.warning("Via node \(route.viaNode) is not currently a peer")
+                    logger.warning("Via node \(route.viaNode) has no CLAs available")
                 }
+            } else {
+                logger.warning("Via node \(route.viaNode) is not currently a peer")
             }
         }
         
@@ -136,7 +155,7 @@ public actor StaticRouting: RoutingAgent {
     }
     
     public func getState() async -> [String: String] {
-        let routesInfo = routes.map { route in
+        let routesInfo = table.routes.map { route in
             "#\(route.index): \(route.sourcePattern) -> \(route.destinationPattern) via \(route.viaNode.description)"
         }.joined(separator: "; ")
         
@@ -208,27 +227,4 @@ public actor StaticRouting: RoutingAgent {
         routes.removeAll()
         logger.info("Cleared all routes")
     }
-    
-    /// Check if a string matches a glob pattern
-    private func matchesPattern(_ string: String, pattern: String) -> Bool {
-        // Simple pattern matching with * wildcard
-        if pattern == "*" {
-            return true
-        }
-        
-        // Convert glob pattern to regex
-        let escapedPattern = NSRegularExpression.escapedPattern(for: pattern)
-        let finalPattern = escapedPattern
-            .replacingOccurrences(of: "\\*", with: ".*")
-            .replacingOccurrences(of: "\\?", with: ".")
-        
-        do {
-            let regex = try NSRegularExpression(pattern: "^\\(finalPattern)$", options: [])
-            let range = NSRange(location: 0, length: string.count)
-            return regex.firstMatch(in: string, options: [], range: range) != nil
-        } catch {
-            logger.error("Invalid pattern: \(pattern)")
-            return false
-        }
-    }
 }
\ No newline at end of file
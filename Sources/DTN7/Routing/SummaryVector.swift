@@ -0,0 +1,114 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import BP7
+import Logging
+#if canImport(FoundationNetworking)
+import FoundationNetworking
+#endif
+
+/// Compact set of the bundles a node holds, exchanged on contact so epidemic
+/// routing sends a peer only what it lacks.
+///
+/// A Bloom filter over bundle keys: a bundle the node holds is always reported,
+/// one it lacks is wrongly reported at `falsePositiveRate` and then reaches that
+/// peer over another contact instead.
+public struct SummaryVector: Sendable, Equatable {
+    public static let contentType = "application/x-dtn7-summary-vector"
+    public static let defaultFalsePositiveRate = 0.001
+    
+    private static let formatVersion: UInt8 = 1
+    
+    private var filter: BloomFilter
+    
+    /// An empty vector sized for `capacity` bundles
+    public init(capacity: Int, falsePositiveRate: Double = SummaryVector.defaultFalsePositiveRate) {
+        self.filter = BloomFilter(capacity: max(capacity, 1_024), falsePositiveRate: falsePositiveRate)
+    }
+    
+    /// Bundles inserted
+    public var count: Int { filter.count }
+    
+    public mutating func insert(_ key: BundleKey) {
+        filter.insert(key)
+    }
+    
+    public func contains(_ key: BundleKey) -> Bool {
+        filter.contains(key)
+    }
+    
+    /// Version, probe count, bit count and key count, then the bit array, all big-endian
+    public func encode() -> [UInt8] {
+        var bytes: [UInt8] = [Self.formatVersion, UInt8(filter.hashCount)]
+        bytes.reserveCapacity(10 + filter.byteCount)
+        Self.append(UInt32(filter.bitCount), to: &bytes)
+        Self.append(UInt32(filter.count), to: &bytes)
+        for word in filter.words {
+            Self.append(UInt32(word >> 32), to: &bytes)
+            Self.append(UInt32(word & 0xffff_ffff), to: &bytes)
+        }
+        return bytes
+    }
+    
+    /// Decode a vector from `encode()`, or nil if the bytes are not one
+    public init?(encoded bytes: [UInt8]) {
+        guard bytes.count >= 10, bytes[0] == Self.formatVersion, bytes[1] > 0 else {
+            return nil
+        }
+        let bitCount = Int(Self.readUInt32(bytes, at: 2))
+        let count = Int(Self.readUInt32(bytes, at: 6))
+        let wordCount = (bitCount + 63) / 64
+        let body = bytes.count - 10
+        // The bit array is left out while the filter is empty
+        guard bitCount >= 64, body == 0 || body == wordCount * 8 else {
+            return nil
+        }
+        
+        let words = stride(from: 10, to: bytes.count, by: 8).map {
+            UInt64(Self.readUInt32(bytes, at: $0)) << 32 | UInt64(Self.readUInt32(bytes, at: $0 + 4))
+        }
+        self.filter = BloomFilter(bitCount: bitCount, hashCount: Int(bytes[1]), words: words, count: words.isEmpty ? 0 : count)
+    }
+    
+    private static func append(_ value: UInt32, to bytes: inout [UInt8]) {
+        bytes.append(contentsOf: [UInt8(value >> 24), UInt8((value >> 16) & 0xff), UInt8((value >> 8) & 0xff), UInt8(value & 0xff)])
+    }
+    
+    private static func readUInt32(_ bytes: [UInt8], at offset: Int) -> UInt32 {
+        bytes[offset..<offset + 4].reduce(0) { $0 << 8 | UInt32($1) }
+    }
+}
+
+/// Fetches the summary vector of a peer, or nil if the peer offers none
+public typealias SummaryExchange = @Sendable (DtnPeer) async -> SummaryVector?
+
+extension SummaryVector {
+    /// Ask a peer's daemon for `/summary`, at the port of its HTTP CLA or else at `fallbackPort`
+    public static func httpExchange(fallbackPort: UInt16? = nil, timeout: TimeInterval = 5.0) -> SummaryExchange {
+        let sessionConfig = URLSessionConfiguration.default
+        sessionConfig.timeoutIntervalForRequest = timeout
+        sessionConfig.timeoutIntervalForResource = timeout * 2
+        let session = URLSession(configuration: sessionConfig)
+        let logger = Logger(label: "SummaryExchange")
+        
+        return { peer in
+            guard let url = peer.httpBaseURL(fallbackPort: fallbackPort)?.appendingPathComponent("summary") else {
+                return nil
+            }
+            do {
+                let (data, response) = try await session.data(from: url)
+                guard let httpResponse = response as? HTTPURLResponse,
+                      (200..<300).contains(httpResponse.statusCode) else {
+                    logger.debug("Peer \(peer.eid) offers no summary vector")
+                    return nil
+                }
+                return SummaryVector(encoded: Array(data))
+            } catch {
+                logger.debug("Failed to fetch summary vector from \(peer.eid): \(error)")
+                return nil
+            }
+        }
+    }
+}
@@ -10,6 +10,13 @@ public protocol BundleStore: Sendable {
     /// Adds a bundle to the store.
     func push(bundle: BP7.Bundle) async throws
     
+    /// Adds a bundle whose ID and encoding were computed on ingest.
+    func push(_ context: BundleContext) async throws
+    
+    /// Adds several bundles to the store in one operation.
+    /// Bundles that are already stored are skipped.
+    func pushBatch(bundles: [BP7.Bundle]) async throws
+    
     /// Updates the metadata of a bundle in the store.
     func updateMetadata(bundlePack: BundlePack) async throws
 
@@ -28,11 +35,97 @@ public protocol BundleStore: Sendable {
     /// Returns all bundles in the store.
     func allBundles() async -> [BundlePack]
 
+    /// Streams all bundle IDs, fetching `pageSize` at a time.
+    func idStream(pageSize: Int) -> StoreCursor<String>
+    
+    /// Streams the metadata of all bundles, fetching `pageSize` at a time.
+    func bundleStream(pageSize: Int) -> StoreCursor<BundlePack>
+    
+    /// Streams the metadata of bundles marked `forwardPending`, the persistent forwarding queue.
+    func forwardPendingStream(pageSize: Int) -> StoreCursor<BundlePack>
+    
     /// Returns a bundle from the store.
     func getBundle(bundleId: String) async -> BP7.Bundle?
 
+    /// Returns the stored wire encoding of a bundle, so it can be forwarded without a decode/encode round trip.
+    func getBundleBytes(bundleId: String) async -> [UInt8]?
+    
+    /// Streams the stored wire encoding of a bundle in chunks of up to `chunkSize` bytes,
+    /// so large bundles can be served without holding the whole encoding in memory.
+    /// Ends early if the bundle is removed while it is read.
+    func bundleChunks(bundleId: String, chunkSize: Int) -> StoreCursor<[UInt8]>
+    
     /// Returns the metadata of a bundle from the store.
     func getMetadata(bundleId: String) async -> BundlePack?
+    
+    /// Removes every bundle whose `expiresAt` is at or before `time` (DTN time in milliseconds).
+    /// Returns the IDs of the removed bundles.
+    @discardableResult
+    func removeExpired(before time: UInt64) async throws -> [String]
+}
+
+extension BundleStore {
+    /// Default page size for `idStream()` and `bundleStream()`
+    public static var defaultPageSize: Int { 256 }
+    
+    /// Streams all bundle IDs in pages of `defaultPageSize`
+    public func idStream() -> StoreCursor<String> {
+        idStream(pageSize: Self.defaultPageSize)
+    }
+    
+    /// Streams the metadata of all bundles in pages of `defaultPageSize`
+    public func bundleStream() -> StoreCursor<BundlePack> {
+        bundleStream(pageSize: Self.defaultPageSize)
+    }
+    
+    /// Streams the forwarding queue in pages of `defaultPageSize`
+    public func forwardPendingStream() -> StoreCursor<BundlePack> {
+        forwardPendingStream(pageSize: Self.defaultPageSize)
+    }
+    
+    /// Default for stores that keep decoded bundles: encode on demand
+    public func getBundleBytes(bundleId: String) async -> [UInt8]? {
+        await getBundle(bundleId: bundleId)?.encode()
+    }
+    
+    /// Default for stores that keep whole bundles in memory: the encoding as one chunk
+    public func bundleChunks(bundleId: String, chunkSize: Int) -> StoreCursor<[UInt8]> {
+        StoreCursor(snapshot: {
+            await self.getBundleBytes(bundleId: bundleId).map { [$0] } ?? []
+        })
+    }
+    
+    /// Default forwarding queue for stores that hold everything in memory
+    public func forwardPendingStream(pageSize: Int) -> StoreCursor<BundlePack> {
+        StoreCursor(snapshot: {
+            await self.allBundles().filter {
+                $0.constraints.contains(.forwardPending) && !$0.constraints.contains(.deleted)
+            }
+        })
+    }
+    
+    /// Default ID stream for stores that hold everything in memory
+    public func idStream(pageSize: Int) -> StoreCursor<String> {
+        StoreCursor(snapshot: { await self.allIds() })
+    }
+    
+    /// Default metadata stream for stores that hold everything in memory
+    public func bundleStream(pageSize: Int) -> StoreCursor<BundlePack> {
+        StoreCursor(snapshot: { await self.allBundles() })
+    }
+    
+    /// Default for stores that keep decoded bundles
+    public func push(_ context: BundleContext) async throws {
+        try await push(bundle: context.bundle)
+    }
+    
+    /// Default batch insert for stores without a cheaper bulk path
+    public func pushBatch(bundles: [BP7.Bundle]) async throws {
+        for bundle in bundles {
+            guard await !hasItem(bundleId: BundlePack.id(of: bundle)) else { continue }
+            try await push(bundle: bundle)
+        }
+    }
 }
 
 /// A struct to hold metadata about a bundle.
@@ -42,22 +135,45 @@ public struct BundlePack: Codable, Equatable, Sendable {
     public let destination: EndpointID
     public let creationTime: UInt64
     public let size: UInt64
+    /// Absolute expiry time in DTN milliseconds, 0 if the bundle never expires
+    public let expiresAt: UInt64
     // In the Rust code, constraints are a bitfield. We'll use an OptionSet for a more Swift-idiomatic approach.
     public var constraints: Constraints = []
 
+    /// Builds the metadata of a bundle, encoding it to measure its size.
+    /// Prefer `BundleContext.pack` where the encoding is already at hand.
     public init(from bundle: BP7.Bundle) {
-        // Generate a unique ID based on source, timestamp, and sequence number
+        self.init(from: bundle, id: Self.id(of: bundle), size: UInt64(bundle.encode().count))
+    }
+    
+    /// Builds the metadata of a bundle whose ID and encoded size are already known
+    public init(from bundle: BP7.Bundle, id: String, size: UInt64) {
         let timestamp = bundle.primary.creationTimestamp.getDtnTime()
-        let sequenceNumber = bundle.primary.creationTimestamp.getSequenceNumber()
-        self.id = "\(bundle.primary.source)-\(timestamp)-\(sequenceNumber)"
+        self.id = id
         self.source = bundle.primary.source
         self.destination = bundle.primary.destination
         self.creationTime = timestamp
-        self.size = UInt64(bundle.encode().count)
+        self.size = size
+        self.expiresAt = Self.expiry(creationTime: timestamp, lifetime: bundle.primary.lifetime)
+    }
+    
+    /// The store ID of a bundle, built from source, timestamp, and sequence number without encoding it
+    public static func id(of bundle: BP7.Bundle) -> String {
+        let timestamp = bundle.primary.creationTimestamp.getDtnTime()
+        let sequenceNumber = bundle.primary.creationTimestamp.getSequenceNumber()
+        return "\(bundle.primary.source)-\(timestamp)-\(sequenceNumber)"
+    }
+    
+    /// Expiry time for a bundle created at `creationTime` (DTN ms) with `lifetime` seconds; 0 means never
+    static func expiry(creationTime: UInt64, lifetime: TimeInterval) -> UInt64 {
+        guard lifetime > 0 else { return 0 }
+        let lifetimeMs = lifetime * 1000
+        guard lifetimeMs < Double(UInt64.max - creationTime) else { return UInt64.max }
+        return creationTime + UInt64(lifetimeMs)
     }
 
     enum CodingKeys: String, CodingKey {
-        case id, source, destination, creationTime, size, constraints
+        case id, source, destination, creationTime, size, expiresAt, constraints
     }
 
     public init(from decoder: Decoder) throws {
@@ -69,6 +185,7 @@ public struct BundlePack: Codable, Equatable, Sendable {
         destination = try EndpointID.from(destString)
         creationTime = try container.decode(UInt64.self, forKey: .creationTime)
         size = try container.decode(UInt64.self, forKey: .size)
+        expiresAt = try container.decodeIfPresent(UInt64.self, forKey: .expiresAt) ?? 0
         constraints = try container.decode(Constraints.self, forKey: .constraints)
     }
 
@@ -79,6 +196,7 @@ public struct BundlePack: Codable, Equatable, Sendable {
         try container.encode(destination.description, forKey: .destination)
         try container.encode(creationTime, forKey: .creationTime)
         try container.encode(size, forKey: .size)
+        try container.encode(expiresAt, forKey: .expiresAt)
         try container.encode(constraints, forKey: .constraints)
     }
 }
@@ -92,6 +210,7 @@ public struct Constraints: OptionSet, Codable, Sendable {
     }
 
     public static let dispatchPending = Constraints(rawValue: 1 << 0)
+    /// Waiting for a forwarding opportunity; stores index this bit as the forwarding queue
     public static let forwardPending = Constraints(rawValue: 1 << 1)
     public static let reassemblyPending = Constraints(rawValue: 1 << 2)
     public static let contraindicated = Constraints(rawValue: 1 << 3)
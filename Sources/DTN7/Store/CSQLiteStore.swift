@@ -12,10 +12,24 @@ private struct SendableDB: @unchecked Sendable {
 }
 
 /// A persistent bundle store implementation using SQLite.
+///
+/// The connection and its cached prepared statements are owned by `queue`;
+/// every call into the C layer is serialized on it.
 public final class CSQLiteStore: BundleStore, @unchecked Sendable {
     private let db: OpaquePointer
     private let path: String
     private let queue = DispatchQueue(label: "csqlite.store.queue")
+    private let options: Options
+    
+    /// Pushes waiting for the next group commit; only touched on `queue`
+    private var pendingPushes: [PendingPush] = []
+    private var groupCommitScheduled = false
+    
+    private struct PendingPush {
+        let metadata: BundlePack
+        let data: [UInt8]
+        let continuation: CheckedContinuation<Void, Error>
+    }
     
     /// Error types specific to CSQLiteStore
     public enum CSQLiteStoreError: Error {
@@ -23,19 +37,136 @@ public final class CSQLiteStore: BundleStore, @unchecked Sendable {
         case notFound
         case constraintViolation
         case invalidData
+        /// A `dbSettings` value the store does not accept
+        case invalidSetting(String)
+    }
+    
+    /// SQLite `synchronous` levels
+    public enum Synchronous: Int32, Sendable {
+        case off = 0
+        case normal = 1
+        case full = 2
+        case extra = 3
+    }
+    
+    /// Connection profile applied when the database is opened.
+    /// `nil` values keep the SQLite defaults.
+    public struct Options: Sendable, Equatable {
+        public var journalMode: String?
+        public var synchronous: Synchronous?
+        public var mmapSize: Int64?
+        public var cacheSize: Int64?
+        public var pageSize: Int?
+        /// How long `push` waits for other pushes to share its commit; 0 commits every push on its own
+        public var groupCommitWindow: TimeInterval
+        /// Number of waiting pushes that triggers a commit before the window closes
+        public var groupCommitMaxBatch: Int
+        /// Payloads of at least this many bytes are stored once per content and shared; 0 stores every bundle whole
+        public var dedupMinSize: Int
+        /// Shared payloads of at least this many bytes are deflated at rest; 0 never compresses
+        public var compressMinSize: Int
+        /// zlib level 0-9, or -1 for the zlib default
+        public var compressLevel: Int
+        
+        /// WAL journaling with `synchronous = NORMAL`: one fsync per checkpoint instead of per commit
+        public static let `default` = Options(journalMode: "WAL", synchronous: .normal)
+        
+        /// Leaves every setting at the SQLite default (rollback journal, `synchronous = FULL`)
+        public static let sqliteDefaults = Options()
+        
+        /// Values `journalMode` may take
+        public static let journalModes: Set<String> = ["DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"]
+        
+        public init(
+            journalMode: String? = nil,
+            synchronous: Synchronous? = nil,
+            mmapSize: Int64? = nil,
+            cacheSize: Int64? = nil,
+            pageSize: Int? = nil,
+            groupCommitWindow: TimeInterval = 0,
+            groupCommitMaxBatch: Int = 256,
+            dedupMinSize: Int = 1024,
+            compressMinSize: Int = 0,
+            compressLevel: Int = -1
+        ) {
+            self.journalMode = journalMode
+            self.synchronous = synchronous
+            self.mmapSize = mmapSize
+            self.cacheSize = cacheSize
+            self.pageSize = pageSize
+            self.groupCommitWindow = groupCommitWindow
+            self.groupCommitMaxBatch = groupCommitMaxBatch
+            self.dedupMinSize = max(0, dedupMinSize)
+            self.compressMinSize = max(0, compressMinSize)
+            self.compressLevel = min(9, max(-1, compressLevel))
+        }
+        
+        /// Build options from `DtnConfig.dbSettings`, starting from `default`.
+        ///
+        /// Recognized keys: `journal_mode` (one of `journalModes`), `synchronous` (off, normal, full, extra or 0-3),
+        /// `mmap_size` (bytes), `cache_size` (pages, or KiB if negative), `page_size` (bytes),
+        /// `group_commit_ms` (window in milliseconds), `group_commit_max` (pushes per commit),
+        /// `dedup_min` and `compress_min` (bytes) and `compress_level` (-1 to 9).
+        public init(settings: [String: String]) throws {
+            self = .default
+            
+            if let journalMode = settings["journal_mode"] {
+                guard Self.journalModes.contains(journalMode.uppercased()) else {
+                    throw CSQLiteStoreError.invalidSetting("journal_mode = \(journalMode)")
+                }
+                self.journalMode = journalMode.uppercased()
+            }
+            if let synchronous = settings["synchronous"] {
+                switch synchronous.lowercased() {
+                case "off", "0": self.synchronous = .off
+                case "normal", "1": self.synchronous = .normal
+                case "full", "2": self.synchronous = .full
+                case "extra", "3": self.synchronous = .extra
+                default: break
+                }
+            }
+            if let mmapSize = settings["mmap_size"].flatMap({ Int64($0) }) {
+                self.mmapSize = mmapSize
+            }
+            if let cacheSize = settings["cache_size"].flatMap({ Int64($0) }) {
+                self.cacheSize = cacheSize
+            }
+            if let pageSize = settings["page_size"].flatMap({ Int($0) }) {
+                self.pageSize = pageSize
+            }
+            if let windowMs = settings["group_commit_ms"].flatMap({ Double($0) }), windowMs >= 0 {
+                self.groupCommitWindow = windowMs / 1000
+            }
+            if let maxBatch = settings["group_commit_max"].flatMap({ Int($0) }), maxBatch > 0 {
+                self.groupCommitMaxBatch = maxBatch
+            }
+            if let dedupMin = settings["dedup_min"].flatMap({ Int($0) }), dedupMin >= 0 {
+                self.dedupMinSize = dedupMin
+            }
+            if let compressMin = settings["compress_min"].flatMap({ Int($0) }), compressMin >= 0 {
+                self.compressMinSize = compressMin
+            }
+            if let level = settings["compress_level"].flatMap({ Int($0) }), (-1...9).contains(level) {
+                self.compressLevel = level
+            }
+        }
     }
     
     /// Initialize a new CSQLiteStore with the given database path
-    public init(path: String) throws {
+    public init(path: String, options: Options = .default) throws {
         self.path = path
+        self.options = options
         
-        var result = CSQLiteResult(rawValue: 0)
-        guard let database = csqlite_open(path, &result),
-              result == CSQLITE_OK else {
+        guard let database = Self.open(path: path, options: options) else {
             throw CSQLiteStoreError.databaseError("Failed to open database at \(path)")
         }
         
         self.db = database
+        
+        // Rows written before the expires_at column existed still read 0
+        if csqlite_schema_upgraded_from(database) < 1 && csqlite_count_bundles(database) > 0 {
+            Self.backfillExpiry(database)
+        }
     }
     
     deinit {
@@ -45,298 +176,697 @@ public final class CSQLiteStore: BundleStore, @unchecked Sendable {
     // MARK: - BundleStore Protocol Implementation
     
     public func push(bundle: BP7.Bundle) async throws {
-        let metadata = BundlePack(from: bundle)
-        let bundleId = metadata.id
-        let bundleData = bundle.encode()
+        try await push(BundleContext(bundle: bundle))
+    }
+    
+    public func push(_ context: BundleContext) async throws {
+        try await push(encoded: context.encoded, metadata: context.pack)
+    }
         
-        try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
-            queue.async {
-                bundleId.withCString { idCStr in
-                    metadata.source.description.withCString { sourceCStr in
-                        metadata.destination.description.withCString { destCStr in
-                            bundleData.withUnsafeBytes { dataBytes in
-                                var cMetadata = CSQLiteBundleMetadata(
-                                    id: idCStr,
-                                    source: sourceCStr,
-                                    destination: destCStr,
-                                    creation_time: metadata.creationTime,
-                                    size: metadata.size,
-                                    constraints: Int32(metadata.constraints.rawValue)
-                                )
-                                
-                                let result = csqlite_store_bundle(
-                                    self.db,
-                                    idCStr,
-                                    dataBytes.bindMemory(to: UInt8.self).baseAddress,
-                                    bundleData.count,
-                                    &cMetadata
-                                )
-                                
-                                switch result {
-                                case CSQLITE_OK:
-                                    continuation.resume()
-                                case CSQLITE_CONSTRAINT:
-                                    continuation.resume(throwing: CSQLiteStoreError.constraintViolation)
-                                default:
-                                    continuation.resume(throwing: CSQLiteStoreError.databaseError("Failed to store bundle"))
-                                }
-                            }
-                        }
-                    }
+    /// Store an encoding and its metadata as they are, e.g. a bundle moved out of another store
+    func push(encoded bundleData: [UInt8], metadata: BundlePack) async throws {
+        if options.groupCommitWindow > 0 {
+            try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
+                queue.async {
+                    self.enqueueGroupCommit(PendingPush(metadata: metadata, data: bundleData, continuation: continuation))
                 }
             }
+            return
+        }
+        
+        try await perform { db in
+            let result = Self.store(db, metadata: metadata, data: bundleData)
+            
+            switch result {
+            case CSQLITE_OK:
+                return
+            case CSQLITE_CONSTRAINT:
+                throw CSQLiteStoreError.constraintViolation
+            default:
+                throw CSQLiteStoreError.databaseError("Failed to store bundle")
+            }
+        }
+    }
+    
+    /// Store encodings and their metadata in one transaction, e.g. rows whose bodies live elsewhere.
+    /// Returns whether each record was stored; bundles already stored are skipped.
+    func push(encodedBatch records: [(metadata: BundlePack, data: [UInt8])]) async throws -> [Bool] {
+        guard !records.isEmpty else { return [] }
+        
+        return try await perform { db in
+            let (result, results) = Self.storeBatch(db, records: records)
+            
+            guard result == CSQLITE_OK else {
+                throw CSQLiteStoreError.databaseError("Failed to store bundle batch")
+            }
+            return results.map { $0 == CSQLITE_OK }
+        }
+    }
+    
+    public func pushBatch(bundles: [BP7.Bundle]) async throws {
+        guard !bundles.isEmpty else { return }
+        let records = bundles.map { bundle in
+            let context = BundleContext(bundle: bundle)
+            return (metadata: context.pack, data: context.encoded)
+        }
+        
+        try await perform { db in
+            let (result, _) = Self.storeBatch(db, records: records)
+            
+            // Duplicates are skipped, any other failure rolled back the batch
+            guard result == CSQLITE_OK else {
+                throw CSQLiteStoreError.databaseError("Failed to store bundle batch")
+            }
         }
     }
     
     public func updateMetadata(bundlePack: BundlePack) async throws {
-        // Prepare strings outside of nested closures
-        let idCopy = bundlePack.id
-        let sourceCopy = bundlePack.source.description
-        let destCopy = bundlePack.destination.description
-        
-        try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
-            idCopy.withCString { idCStr in
-                sourceCopy.withCString { sourceCStr in
-                    destCopy.withCString { destCStr in
-                        var cMetadata = CSQLiteBundleMetadata(
-                            id: idCStr,
-                            source: sourceCStr,
-                            destination: destCStr,
-                            creation_time: bundlePack.creationTime,
-                            size: bundlePack.size,
-                            constraints: Int32(bundlePack.constraints.rawValue)
-                        )
-                        
-                        let result = csqlite_update_metadata(
-                            db,
-                            &cMetadata
-                        )
-                        
-                        switch result {
-                        case CSQLITE_OK:
-                            continuation.resume()
-                        case CSQLITE_NOT_FOUND:
-                            continuation.resume(throwing: CSQLiteStoreError.notFound)
-                        default:
-                            continuation.resume(throwing: CSQLiteStoreError.databaseError("Failed to update metadata"))
-                        }
-                    }
-                }
+        try await perform { db in
+            let result = Self.withCMetadata(bundlePack) { cMetadata in
+                csqlite_update_metadata(db, &cMetadata)
+            }
+            
+            switch result {
+            case CSQLITE_OK:
+                return
+            case CSQLITE_NOT_FOUND:
+                throw CSQLiteStoreError.notFound
+            default:
+                throw CSQLiteStoreError.databaseError("Failed to update metadata")
             }
         }
     }
     
     public func remove(bundleId: String) async throws {
-        let idCopy = bundleId
-        
-        try await withCheckedThrowingContinuation { (continuation: CheckedContinuation<Void, Error>) in
-            idCopy.withCString { idCStr in
-                let result = csqlite_remove_bundle(
-                    db,
-                    idCStr
-                )
-                
-                switch result {
-                case CSQLITE_OK:
-                    continuation.resume()
-                case CSQLITE_NOT_FOUND:
-                    continuation.resume(throwing: CSQLiteStoreError.notFound)
-                default:
-                    continuation.resume(throwing: CSQLiteStoreError.databaseError("Failed to remove bundle"))
-                }
+        try await perform { db in
+            let result = csqlite_remove_bundle(db, bundleId)
+            
+            switch result {
+            case CSQLITE_OK:
+                return
+            case CSQLITE_NOT_FOUND:
+                throw CSQLiteStoreError.notFound
+            default:
+                throw CSQLiteStoreError.databaseError("Failed to remove bundle")
             }
         }
     }
     
     public func count() async -> UInt64 {
-        return await withCheckedContinuation { continuation in
-            queue.async {
-                let count = csqlite_count_bundles(self.db)
-                continuation.resume(returning: count)
+        await query { db in
+            csqlite_count_bundles(db)
+        }
+    }
+    
+    /// Space taken by shared payloads
+    public struct PayloadStats: Sendable, Equatable {
+        /// Distinct payloads stored
+        public let payloads: UInt64
+        /// Bundles pointing at them
+        public let references: UInt64
+        /// Bytes the payloads take up, after compression
+        public let storedBytes: UInt64
+        /// Bytes the bundles would take up storing their payloads on their own
+        public let referencedBytes: UInt64
+    }
+    
+    public func payloadStats() async -> PayloadStats? {
+        await query { db in
+            var stats = CSQLitePayloadStats()
+            guard csqlite_payload_stats(db, &stats) == CSQLITE_OK else {
+                return nil
             }
+            return PayloadStats(
+                payloads: stats.payloads,
+                references: stats.references,
+                storedBytes: stats.stored_bytes,
+                referencedBytes: stats.referenced_bytes
+            )
         }
     }
     
     public func allIds() async -> [String] {
-        var ids: UnsafeMutablePointer<UnsafeMutablePointer<CChar>?>?
-        var count: Int = 0
-        
-        let result = csqlite_get_all_ids(
-            db,
-            &ids,
-            &count
-        )
-        
-        guard result == CSQLITE_OK, let idsPtr = ids else {
-            return []
-        }
-        
-        var swiftIds: [String] = []
-        for i in 0..<count {
-            if let cStr = idsPtr[i] {
-                swiftIds.append(String(cString: cStr))
+        await query { db in
+            var ids: UnsafeMutablePointer<UnsafeMutablePointer<CChar>?>?
+            var count: Int = 0
+            
+            let result = csqlite_get_all_ids(db, &ids, &count)
+            
+            guard result == CSQLITE_OK, let idsPtr = ids else {
+                return []
             }
+            
+            var swiftIds: [String] = []
+            swiftIds.reserveCapacity(count)
+            for i in 0..<count {
+                if let cStr = idsPtr[i] {
+                    swiftIds.append(String(cString: cStr))
+                }
+            }
+            
+            csqlite_free_ids(ids, count)
+            return swiftIds
         }
-        
-        csqlite_free_ids(ids, count)
-        return swiftIds
     }
     
     public func hasItem(bundleId: String) async -> Bool {
-        let idCopy = bundleId
-        
-        return await withCheckedContinuation { continuation in
-            idCopy.withCString { idCStr in
-                var exists: Bool = false
-                let result = csqlite_has_bundle(
-                    db,
-                    idCStr,
-                    &exists
-                )
-                
-                continuation.resume(returning: result == CSQLITE_OK && exists)
-            }
+        await query { db in
+            var exists: Bool = false
+            let result = csqlite_has_bundle(db, bundleId, &exists)
+            return result == CSQLITE_OK && exists
         }
     }
     
     public func allBundles() async -> [BundlePack] {
-        var metadataPtr: UnsafeMutablePointer<CSQLiteBundleMetadata>?
-        var count: Int = 0
-        
-        let result = csqlite_get_all_metadata(
-            db,
-            &metadataPtr,
-            &count
-        )
-        
-        guard result == CSQLITE_OK, let metadata = metadataPtr else {
-            return []
-        }
-        
-        var bundlePacks: [BundlePack] = []
-        
-        for i in 0..<count {
-            let meta = metadata[i]
+        await query { db in
+            var columnsPtr: UnsafeMutablePointer<CSQLiteMetadataColumns>?
+            
+            guard csqlite_get_all_metadata(db, &columnsPtr) == CSQLITE_OK, let block = columnsPtr else {
+                return []
+            }
+            defer { csqlite_free_metadata_columns(block) }
+            
+            let columns = block.pointee
+            guard columns.count > 0, let strings = columns.strings else {
+                return []
+            }
             
-            // Create BundlePack from C metadata
-            if let id = meta.id,
-               let source = meta.source,
-               let destination = meta.destination,
-               let sourceEid = try? EndpointID.from(String(cString: source)),
-               let destEid = try? EndpointID.from(String(cString: destination)) {
+            // Rows with the same EID share its offset, so each EID is parsed once
+            var endpoints: [UInt32: EndpointID?] = [:]
+            func endpoint(at offset: UInt32) -> EndpointID? {
+                if let known = endpoints[offset] {
+                    return known
+                }
+                let eid = try? EndpointID.from(String(cString: strings + Int(offset)))
+                endpoints[offset] = eid
+                return eid
+            }
+            
+            var bundlePacks: [BundlePack] = []
+            bundlePacks.reserveCapacity(columns.count)
+            for i in 0..<columns.count {
+                guard let source = endpoint(at: columns.source[i]),
+                      let destination = endpoint(at: columns.destination[i]) else {
+                    continue
+                }
                 
                 var pack = BundlePack(
-                    id: String(cString: id),
-                    source: sourceEid,
-                    destination: destEid,
-                    creationTime: meta.creation_time,
-                    size: meta.size
+                    id: String(cString: strings + Int(columns.id[i])),
+                    source: source,
+                    destination: destination,
+                    creationTime: columns.creation_time[i],
+                    size: columns.size[i],
+                    expiresAt: columns.expires_at[i]
                 )
-                pack.constraints = Constraints(rawValue: Int(meta.constraints))
+                pack.constraints = Constraints(rawValue: Int(columns.constraints[i]))
                 bundlePacks.append(pack)
             }
+            return bundlePacks
         }
-        
-        csqlite_free_metadata_array(metadata, count)
-        return bundlePacks
+    }
+    
+    public func idStream(pageSize: Int) -> StoreCursor<String> {
+        StoreCursor(makePageSource: { [self] in
+            let cursor = Cursor(store: self, kind: CSQLITE_ITER_IDS, pageSize: pageSize)
+            return {
+                await cursor.nextPage { row in
+                    row.id.map { String(cString: $0) }
+                }
+            }
+        })
+    }
+    
+    public func bundleStream(pageSize: Int) -> StoreCursor<BundlePack> {
+        StoreCursor(makePageSource: { [self] in
+            let cursor = Cursor(store: self, kind: CSQLITE_ITER_METADATA, pageSize: pageSize)
+            return {
+                await cursor.nextPage { row in
+                    Self.bundlePack(from: row)
+                }
+            }
+        })
+    }
+    
+    public func forwardPendingStream(pageSize: Int) -> StoreCursor<BundlePack> {
+        StoreCursor(makePageSource: { [self] in
+            let cursor = Cursor(store: self, kind: CSQLITE_ITER_FORWARD_PENDING, pageSize: pageSize)
+            return {
+                await cursor.nextPage { row in
+                    Self.bundlePack(from: row)
+                }
+            }
+        })
     }
     
     public func getBundle(bundleId: String) async -> BP7.Bundle? {
-        let idCopy = bundleId
+        await query { db in
+            Self.readBundle(db, bundleId: bundleId)
+        }
+    }
+    
+    public func getBundleBytes(bundleId: String) async -> [UInt8]? {
+        await query { db in
+            Self.readBundleBytes(db, bundleId: bundleId)
+        }
+    }
+    
+    public func bundleChunks(bundleId: String, chunkSize: Int) -> StoreCursor<[UInt8]> {
+        StoreCursor(makePageSource: { [self] in
+            let reader = ChunkReader(bundleId: bundleId, chunkSize: chunkSize)
+            return {
+                await self.query { db in
+                    reader.nextChunk(db)
+                }
+            }
+        })
+    }
+    
+    public func getMetadata(bundleId: String) async -> BundlePack? {
+        await query { db in
+            var cMetadata = CSQLiteBundleMetadata()
+            
+            let result = csqlite_get_metadata(db, bundleId, &cMetadata)
+            
+            guard result == CSQLITE_OK else {
+                return nil
+            }
+            
+            let pack = Self.bundlePack(from: cMetadata)
+            
+            // Free the allocated strings
+            csqlite_free_data(UnsafeMutableRawPointer(mutating: cMetadata.id))
+            csqlite_free_data(UnsafeMutableRawPointer(mutating: cMetadata.source))
+            csqlite_free_data(UnsafeMutableRawPointer(mutating: cMetadata.destination))
+            
+            return pack
+        }
+    }
+    
+    public func removeExpired(before time: UInt64) async throws -> [String] {
+        try await perform { db in
+            var ids: UnsafeMutablePointer<UnsafeMutablePointer<CChar>?>?
+            var count: Int = 0
+            
+            guard csqlite_remove_expired(db, time, &ids, &count) == CSQLITE_OK else {
+                throw CSQLiteStoreError.databaseError("Failed to remove expired bundles")
+            }
+            
+            var removed: [String] = []
+            removed.reserveCapacity(count)
+            if let idsPtr = ids {
+                for i in 0..<count {
+                    if let cStr = idsPtr[i] {
+                        removed.append(String(cString: cStr))
+                    }
+                }
+            }
+            
+            csqlite_free_ids(ids, count)
+            return removed
+        }
+    }
+    
+    // MARK: - Cursors
+    
+    /// State of one iteration over a `csqlite_iter_*` cursor. Only touched on the store queue.
+    private final class Cursor: @unchecked Sendable {
+        private let store: CSQLiteStore
+        private let kind: CSQLiteIterKind
+        private let pageSize: Int
+        private var iterator: OpaquePointer?
+        private var finished = false
+        
+        init(store: CSQLiteStore, kind: CSQLiteIterKind, pageSize: Int) {
+            self.store = store
+            self.kind = kind
+            self.pageSize = max(1, pageSize)
+        }
         
-        return try? await withCheckedThrowingContinuation { continuation in
-            idCopy.withCString { idCStr in
-                var bundleData: UnsafeMutablePointer<UInt8>?
-                var bundleSize: Int = 0
+        deinit {
+            // Only frees memory owned by the iterator, so it is safe off the queue
+            csqlite_iter_close(iterator)
+        }
+        
+        /// Fetch the next page, converting each row with `transform`
+        func nextPage<T: Sendable>(_ transform: @escaping @Sendable (CSQLiteBundleMetadata) -> T?) async -> StoreCursor<T>.Page {
+            await store.query { db in
+                guard !self.finished else { return ([], true) }
                 
-                let result = csqlite_get_bundle(
-                    db,
-                    idCStr,
-                    &bundleData,
-                    &bundleSize
-                )
+                if self.iterator == nil {
+                    var result = CSQLiteResult(rawValue: 0)
+                    self.iterator = csqlite_iter_open(db, self.kind, self.pageSize, &result)
+                }
                 
-                guard result == CSQLITE_OK,
-                      let dataPtr = bundleData,
-                      bundleSize > 0 else {
-                    continuation.resume(throwing: CSQLiteStoreError.notFound)
-                    return
+                guard let iterator = self.iterator else {
+                    self.finished = true
+                    return ([], true)
                 }
                 
-                let data = Data(bytes: dataPtr, count: bundleSize)
-                csqlite_free_data(bundleData)
+                var rows: UnsafePointer<CSQLiteBundleMetadata>?
+                var count: Int = 0
+                
+                guard csqlite_iter_next(iterator, &rows, &count) == CSQLITE_OK, let rows else {
+                    self.finished = true
+                    return ([], true)
+                }
+                
+                var elements: [T] = []
+                elements.reserveCapacity(count)
+                for i in 0..<count {
+                    if let element = transform(rows[i]) {
+                        elements.append(element)
+                    }
+                }
                 
+                // A short page means the cursor reached the end of the table
+                self.finished = count < self.pageSize
+                return (elements, self.finished)
+            }
+        }
+    }
+    
+    /// Position of one chunked read of a bundle's encoding. Only touched on the store queue.
+    ///
+    /// The blob is opened per chunk rather than held across queue hops, so writes
+    /// in between never find it open.
+    private final class ChunkReader: @unchecked Sendable {
+        private let bundleId: String
+        private let chunkSize: Int
+        private var offset = 0
+        
+        init(bundleId: String, chunkSize: Int) {
+            self.bundleId = bundleId
+            self.chunkSize = max(1, chunkSize)
+        }
+        
+        func nextChunk(_ db: OpaquePointer) -> StoreCursor<[UInt8]>.Page {
+            var result = CSQLiteResult(rawValue: 0)
+            var size: Int = 0
+            
+            guard let blob = csqlite_blob_open(db, bundleId, &size, &result),
+                  result == CSQLITE_OK else {
+                return ([], true)
+            }
+            defer { csqlite_blob_close(blob) }
+            
+            let count = min(chunkSize, size - offset)
+            guard count > 0 else {
+                return ([], true)
+            }
+            
+            var readResult = CSQLITE_ERROR
+            let chunk = [UInt8](unsafeUninitializedCapacity: count) { buffer, initializedCount in
+                readResult = csqlite_blob_read(blob, buffer.baseAddress, offset, count)
+                initializedCount = readResult == CSQLITE_OK ? count : 0
+            }
+            guard readResult == CSQLITE_OK else {
+                return ([], true)
+            }
+            
+            offset += count
+            return ([chunk], offset >= size)
+        }
+    }
+    
+    // MARK: - Group Commit
+    
+    /// Queue a push for the next group commit. Must run on `queue`.
+    private func enqueueGroupCommit(_ push: PendingPush) {
+        pendingPushes.append(push)
+        
+        if pendingPushes.count >= options.groupCommitMaxBatch {
+            flushGroupCommit()
+        } else if !groupCommitScheduled {
+            groupCommitScheduled = true
+            queue.asyncAfter(deadline: .now() + options.groupCommitWindow) { [weak self] in
+                self?.flushGroupCommit()
+            }
+        }
+    }
+    
+    /// Commit every waiting push in one transaction and resume their callers. Must run on `queue`.
+    private func flushGroupCommit() {
+        groupCommitScheduled = false
+        guard !pendingPushes.isEmpty else { return }
+        
+        let batch = pendingPushes
+        pendingPushes.removeAll(keepingCapacity: true)
+        
+        let (_, results) = Self.storeBatch(db, records: batch.map { (metadata: $0.metadata, data: $0.data) })
+        
+        for (push, result) in zip(batch, results) {
+            switch result {
+            case CSQLITE_OK:
+                push.continuation.resume()
+            case CSQLITE_CONSTRAINT:
+                push.continuation.resume(throwing: CSQLiteStoreError.constraintViolation)
+            default:
+                push.continuation.resume(throwing: CSQLiteStoreError.databaseError("Failed to store bundle"))
+            }
+        }
+    }
+    
+    // MARK: - Queue Helpers
+    
+    /// Run a throwing database operation on the store queue
+    private func perform<T: Sendable>(_ body: @escaping @Sendable (OpaquePointer) throws -> T) async throws -> T {
+        try await withCheckedThrowingContinuation { continuation in
+            queue.async {
                 do {
-                    // Convert Data to [UInt8] array for BP7 Bundle decoding
-                    let bytes = Array(data)
-                    let bundle = try BP7.Bundle.decode(from: bytes)
-                    continuation.resume(returning: bundle)
+                    continuation.resume(returning: try body(self.db))
                 } catch {
-                    continuation.resume(throwing: CSQLiteStoreError.invalidData)
+                    continuation.resume(throwing: error)
                 }
             }
         }
     }
     
-    public func getMetadata(bundleId: String) async -> BundlePack? {
-        let idCopy = bundleId
+    /// Run a non-throwing database operation on the store queue
+    private func query<T: Sendable>(_ body: @escaping @Sendable (OpaquePointer) -> T) async -> T {
+        await withCheckedContinuation { continuation in
+            queue.async {
+                continuation.resume(returning: body(self.db))
+            }
+        }
+    }
         
-        return try? await withCheckedThrowingContinuation { continuation in
-            idCopy.withCString { idCStr in
-                var cMetadata = CSQLiteBundleMetadata()
-                
-                let result = csqlite_get_metadata(
-                    db,
-                    idCStr,
-                    &cMetadata
+    // MARK: - C Bridging
+                        
+    private static func open(path: String, options: Options) -> OpaquePointer? {
+        var cOptions = CSQLiteOptions()
+        csqlite_default_options(&cOptions)
+        cOptions.synchronous = options.synchronous?.rawValue ?? -1
+        cOptions.mmap_size = options.mmapSize ?? -1
+        cOptions.cache_size = options.cacheSize ?? 0
+        cOptions.page_size = Int32(options.pageSize ?? 0)
+        cOptions.dedup_min_size = Int64(options.dedupMinSize)
+        cOptions.compress_min_size = Int64(options.compressMinSize)
+        cOptions.compress_level = Int32(options.compressLevel)
+                        
+        var result = CSQLiteResult(rawValue: 0)
+        let database: OpaquePointer?
+        
+        if let journalMode = options.journalMode {
+            database = journalMode.withCString { modeCStr in
+                cOptions.journal_mode = modeCStr
+                return csqlite_open_with_options(path, &cOptions, &result)
+            }
+        } else {
+            database = csqlite_open_with_options(path, &cOptions, &result)
+        }
+        
+        guard result == CSQLITE_OK else {
+            return nil
+        }
+        return database
+    }
+    
+    /// Call `body` with a C view of `pack` whose strings live for the duration of the call
+    private static func withCMetadata<R>(_ pack: BundlePack, _ body: (inout CSQLiteBundleMetadata) -> R) -> R {
+        pack.id.withCString { idCStr in
+            pack.source.description.withCString { sourceCStr in
+                pack.destination.description.withCString { destCStr in
+                    var cMetadata = CSQLiteBundleMetadata(
+                        id: idCStr,
+                        source: sourceCStr,
+                        destination: destCStr,
+                        creation_time: pack.creationTime,
+                        size: pack.size,
+                        constraints: Int32(pack.constraints.rawValue),
+                        expires_at: pack.expiresAt
+                    )
+                    return body(&cMetadata)
+                }
+            }
+        }
+    }
+    
+    private static func store(_ db: OpaquePointer, metadata: BundlePack, data: [UInt8]) -> CSQLiteResult {
+        withCMetadata(metadata) { cMetadata in
+            data.withUnsafeBufferPointer { dataBytes in
+                csqlite_store_bundle(db, cMetadata.id, dataBytes.baseAddress, dataBytes.count, &cMetadata)
+            }
+        }
+    }
+    
+    /// Store `records` in one transaction, returning the batch result and one result per record
+    private static func storeBatch(_ db: OpaquePointer, records: [(metadata: BundlePack, data: [UInt8])]) -> (CSQLiteResult, [CSQLiteResult]) {
+        // The C side needs every record's strings and bytes alive at once
+        var strings: [UnsafeMutablePointer<CChar>?] = []
+        var buffers: [UnsafeMutableBufferPointer<UInt8>] = []
+        defer {
+            strings.forEach { csqlite_free_data($0) }
+            buffers.forEach { $0.deallocate() }
+        }
+        
+        strings.reserveCapacity(records.count * 3)
+        buffers.reserveCapacity(records.count)
+        var cRecords: [CSQLiteBundleRecord] = []
+        cRecords.reserveCapacity(records.count)
+        
+        for record in records {
+            let id = csqlite_strdup(record.metadata.id)
+            let source = csqlite_strdup(record.metadata.source.description)
+            let destination = csqlite_strdup(record.metadata.destination.description)
+            strings.append(contentsOf: [id, source, destination])
+            
+            let buffer = UnsafeMutableBufferPointer<UInt8>.allocate(capacity: record.data.count)
+            _ = buffer.initialize(from: record.data)
+            buffers.append(buffer)
+            
+            cRecords.append(CSQLiteBundleRecord(
+                bundle_id: UnsafePointer(id),
+                bundle_data: UnsafePointer(buffer.baseAddress),
+                bundle_size: buffer.count,
+                metadata: CSQLiteBundleMetadata(
+                    id: UnsafePointer(id),
+                    source: UnsafePointer(source),
+                    destination: UnsafePointer(destination),
+                    creation_time: record.metadata.creationTime,
+                    size: record.metadata.size,
+                    constraints: Int32(record.metadata.constraints.rawValue),
+                    expires_at: record.metadata.expiresAt
                 )
-                
-                guard result == CSQLITE_OK,
-                      let id = cMetadata.id,
-                      let source = cMetadata.source,
-                      let destination = cMetadata.destination else {
-                    continuation.resume(throwing: CSQLiteStoreError.notFound)
-                    return
+            ))
+        }
+        
+        var results = [CSQLiteResult](repeating: CSQLITE_ERROR, count: records.count)
+        let result = cRecords.withUnsafeBufferPointer { recordsPtr in
+            results.withUnsafeMutableBufferPointer { resultsPtr in
+                csqlite_store_bundles_batch(db, recordsPtr.baseAddress, recordsPtr.count, resultsPtr.baseAddress)
+            }
+        }
+        return (result, results)
+    }
+    
+    private static func readBundle(_ db: OpaquePointer, bundleId: String) -> BP7.Bundle? {
+        var bundleData: UnsafeMutablePointer<UInt8>?
+        var bundleSize: Int = 0
+        
+        let result = csqlite_get_bundle(db, bundleId, &bundleData, &bundleSize)
+        
+        guard result == CSQLITE_OK,
+              let dataPtr = bundleData,
+              bundleSize > 0 else {
+            return nil
+        }
+        
+        // Convert to [UInt8] array for BP7 Bundle decoding
+        let bytes = Array(UnsafeBufferPointer(start: dataPtr, count: bundleSize))
+        csqlite_free_data(bundleData)
+        
+        return try? BP7.Bundle.decode(from: bytes)
+    }
+    
+    /// Copy a bundle's stored encoding straight from the database into a new array with incremental blob I/O
+    private static func readBundleBytes(_ db: OpaquePointer, bundleId: String) -> [UInt8]? {
+        var result = CSQLiteResult(rawValue: 0)
+        var size: Int = 0
+        
+        guard let blob = csqlite_blob_open(db, bundleId, &size, &result),
+              result == CSQLITE_OK else {
+            return nil
+        }
+        defer { csqlite_blob_close(blob) }
+        
+        guard size > 0 else {
+            return nil
+        }
+        
+        var readResult = CSQLITE_ERROR
+        let bytes = [UInt8](unsafeUninitializedCapacity: size) { buffer, initializedCount in
+            readResult = csqlite_blob_read(blob, buffer.baseAddress, 0, size)
+            initializedCount = readResult == CSQLITE_OK ? size : 0
+        }
+        
+        return readResult == CSQLITE_OK ? bytes : nil
+    }
+    
+    /// Compute `expires_at` for rows stored before the column existed. Runs once, before the store is shared.
+    private static func backfillExpiry(_ db: OpaquePointer) {
+        var result = CSQLiteResult(rawValue: 0)
+        guard let iterator = csqlite_iter_open(db, CSQLITE_ITER_METADATA, 256, &result) else {
+            return
+        }
+        defer { csqlite_iter_close(iterator) }
+        
+        var rows: UnsafePointer<CSQLiteBundleMetadata>?
+        var count: Int = 0
+        
+        while csqlite_iter_next(iterator, &rows, &count) == CSQLITE_OK, let page = rows, count > 0 {
+            for i in 0..<count {
+                var row = page[i]
+                guard row.expires_at == 0,
+                      let id = row.id,
+                      let bundle = readBundle(db, bundleId: String(cString: id)) else {
+                    continue
                 }
                 
-                do {
-                    let sourceEid = try EndpointID.from(String(cString: source))
-                    let destEid = try EndpointID.from(String(cString: destination))
-                    
-                    var pack = BundlePack(
-                        id: String(cString: id),
-                        source: sourceEid,
-                        destination: destEid,
-                        creationTime: cMetadata.creation_time,
-                        size: cMetadata.size
-                    )
-                    pack.constraints = Constraints(rawValue: Int(cMetadata.constraints))
-                    
-                    // Free the allocated strings
-                    csqlite_free_data(UnsafeMutableRawPointer(mutating: cMetadata.id))
-                    csqlite_free_data(UnsafeMutableRawPointer(mutating: cMetadata.source))
-                    csqlite_free_data(UnsafeMutableRawPointer(mutating: cMetadata.destination))
-                    
-                    continuation.resume(returning: pack)
-                } catch {
-                    continuation.resume(throwing: CSQLiteStoreError.invalidData)
+                row.expires_at = BundlePack.expiry(
+                    creationTime: bundle.primary.creationTimestamp.getDtnTime(),
+                    lifetime: bundle.primary.lifetime
+                )
+                if row.expires_at > 0 {
+                    _ = csqlite_update_metadata(db, &row)
                 }
             }
         }
     }
+    
+    /// Convert a C metadata row into a BundlePack
+    private static func bundlePack(from meta: CSQLiteBundleMetadata) -> BundlePack? {
+        guard let id = meta.id,
+              let source = meta.source,
+              let destination = meta.destination,
+              let sourceEid = try? EndpointID.from(String(cString: source)),
+              let destEid = try? EndpointID.from(String(cString: destination)) else {
+            return nil
+        }
+        
+        var pack = BundlePack(
+            id: String(cString: id),
+            source: sourceEid,
+            destination: destEid,
+            creationTime: meta.creation_time,
+            size: meta.size,
+            expiresAt: meta.expires_at
+        )
+        pack.constraints = Constraints(rawValue: Int(meta.constraints))
+        return pack
+    }
 }
 
 // MARK: - BundlePack Extension
 
 extension BundlePack {
     /// Initialize BundlePack with explicit values (needed for CSQLiteStore)
-    init(id: String, source: EndpointID, destination: EndpointID, creationTime: UInt64, size: UInt64) {
+    init(id: String, source: EndpointID, destination: EndpointID, creationTime: UInt64, size: UInt64, expiresAt: UInt64 = 0) {
         self.id = id
         self.source = source
         self.destination = destination
         self.creationTime = creationTime
         self.size = size
+        self.expiresAt = expiresAt
         self.constraints = []
     }
 }
-
@@ -6,64 +6,250 @@ import Foundation
 import BP7
 
 /// An in-memory implementation of the `BundleStore` protocol.
+///
+/// Bundles are held as their wire encoding, one contiguous array each, rather
+/// than as decoded bundles. With a byte budget, the least recently used
+/// encodings are moved to an overflow `CSQLiteStore` once the budget is
+/// exceeded, so recently stored bundles stay in memory and a growing queue
+/// spills to disk. Without an overflow store, pushes beyond the budget fail
+/// with `BundleStoreError.storeFull`. Metadata always stays in memory.
 public actor InMemoryBundleStore: BundleStore {
-    private var bundles: [String: BP7.Bundle] = [:]
+    public struct Options: Sendable, Equatable {
+        /// Bytes of bundle encodings held in memory, nil for no limit
+        public var byteBudget: Int?
+        
+        public init(byteBudget: Int? = nil) {
+            self.byteBudget = byteBudget.map { max(1, $0) }
+        }
+        
+        /// Build options from `DtnConfig.dbSettings`.
+        ///
+        /// Recognized keys: `mem_budget` (bytes).
+        public init(settings: [String: String]) {
+            self.init(byteBudget: settings["mem_budget"].flatMap { Int($0) }.flatMap { $0 > 0 ? $0 : nil })
+        }
+    }
+    
+    private struct Use: Sendable {
+        let bundleId: String
+        let stamp: UInt64
+    }
+    
+    public let options: Options
+    private let overflow: CSQLiteStore?
+    
+    // Encodings held in memory and their total size
+    private var encodings: [String: [UInt8]] = [:]
+    private var bytes = 0
+    
+    // Bundles moved to the overflow store
+    private var spilled: Set<String> = []
+    
+    // Metadata of the bundles held, in memory or spilled; dropped with the bundle
     private var metadata: [String: BundlePack] = [:]
-
-    public init() {}
-
-    public func push(bundle: BP7.Bundle) throws {
+    
+    // LRU over `encodings`: ID -> stamp of its latest use, plus uses in order. Uses
+    // whose stamp no longer matches were superseded by a later one and are skipped.
+    private var lastUse: [String: UInt64] = [:]
+    private var uses: [Use] = []
+    private var usesStart = 0
+    private var nextStamp: UInt64 = 0
+    
+    private var isEvicting = false
+    
+    /// `overflow` takes the bundles evicted over `options.byteBudget`
+    public init(options: Options = Options(), overflow: CSQLiteStore? = nil) {
+        self.options = options
+        self.overflow = overflow
+    }
+    
+    /// Bytes of bundle encodings held in memory
+    public var residentBytes: Int { bytes }
+    
+    /// Number of bundles moved to the overflow store
+    public var spilledCount: Int { spilled.count }
+    
+    public func push(bundle: BP7.Bundle) async throws {
         let bundlePack = BundlePack(from: bundle)
-        if bundles[bundlePack.id] == nil {
-            metadata[bundlePack.id] = bundlePack
+        try await insert(bundle.encode(), pack: bundlePack)
+    }
+    
+    public func push(_ context: BundleContext) async throws {
+        try await insert(context.encoded, pack: context.pack)
+    }
+    
+    private func insert(_ encoded: [UInt8], pack bundlePack: BundlePack) async throws {
+        let bundleId = bundlePack.id
+        // Already on disk; the encoding of one bundle ID does not change
+        guard !spilled.contains(bundleId) else { return }
+        
+        let previous = encodings[bundleId]?.count ?? 0
+        if let budget = options.byteBudget, overflow == nil, bytes - previous + encoded.count > budget {
+            throw BundleStoreError.storeFull
+        }
+        
+        if encodings[bundleId] == nil {
+            metadata[bundleId] = bundlePack
         }
-        bundles[bundlePack.id] = bundle
+        encodings[bundleId] = encoded
+        bytes += encoded.count - previous
+        touch(bundleId)
+        
+        await evictIfNeeded()
     }
-
+    
     public func updateMetadata(bundlePack: BundlePack) throws {
         guard metadata[bundlePack.id] != nil else {
             throw BundleStoreError.bundleNotFound
         }
         metadata[bundlePack.id] = bundlePack
     }
-
+    
     public func remove(bundleId: String) async throws {
-        guard var meta = await getMetadata(bundleId: bundleId) else {
+        guard metadata[bundleId] != nil else {
             throw BundleStoreError.bundleNotFound
         }
-        meta.constraints.insert(.deleted)
-        try updateMetadata(bundlePack: meta)
         
-        guard bundles.removeValue(forKey: bundleId) != nil else {
+        if let encoded = encodings.removeValue(forKey: bundleId) {
+            bytes -= encoded.count
+            lastUse.removeValue(forKey: bundleId)
+        } else if spilled.remove(bundleId) != nil {
+            try await overflow?.remove(bundleId: bundleId)
+        } else {
             throw BundleStoreError.bundleNotFound
         }
+        metadata.removeValue(forKey: bundleId)
     }
-
+    
     public func count() -> UInt64 {
-        return UInt64(bundles.count)
+        return UInt64(encodings.count + spilled.count)
     }
-
+    
     public func allIds() -> [String] {
-        return Array(bundles.keys)
+        return Array(encodings.keys) + spilled
     }
-
+    
     public func hasItem(bundleId: String) -> Bool {
-        return bundles[bundleId] != nil
+        return encodings[bundleId] != nil || spilled.contains(bundleId)
     }
-
+    
     public func allBundles() -> [BundlePack] {
         return Array(metadata.values)
     }
-
-    public func getBundle(bundleId: String) -> BP7.Bundle? {
-        return bundles[bundleId]
+    
+    public func getBundle(bundleId: String) async -> BP7.Bundle? {
+        guard let encoded = await getBundleBytes(bundleId: bundleId) else {
+            return nil
+        }
+        return try? BP7.Bundle.decode(from: encoded)
     }
-
+    
+    public func getBundleBytes(bundleId: String) async -> [UInt8]? {
+        if let encoded = encodings[bundleId] {
+            touch(bundleId)
+            return encoded
+        }
+        guard spilled.contains(bundleId) else {
+            return nil
+        }
+        return await overflow?.getBundleBytes(bundleId: bundleId)
+    }
+    
     public func getMetadata(bundleId: String) -> BundlePack? {
         return metadata[bundleId]
     }
+    
+    public func removeExpired(before time: UInt64) async throws -> [String] {
+        let expired = metadata.values
+            .filter { $0.expiresAt > 0 && $0.expiresAt <= time && encodings[$0.id] != nil }
+            .map(\.id)
+        
+        for bundleId in expired {
+            if let encoded = encodings.removeValue(forKey: bundleId) {
+                bytes -= encoded.count
+                lastUse.removeValue(forKey: bundleId)
+            }
+            metadata.removeValue(forKey: bundleId)
+        }
+        
+        // The overflow store finds its own expired rows by index
+        var removedSpilled: [String] = []
+        if let overflow = overflow, !spilled.isEmpty {
+            for bundleId in try await overflow.removeExpired(before: time) where spilled.remove(bundleId) != nil {
+                metadata.removeValue(forKey: bundleId)
+                removedSpilled.append(bundleId)
+            }
+        }
+        return expired + removedSpilled
+    }
+    
+    // MARK: - Eviction
+    
+    private func touch(_ bundleId: String) {
+        // Recency only matters when there is somewhere to evict to
+        guard options.byteBudget != nil, overflow != nil else { return }
+        
+        let stamp = nextStamp
+        nextStamp += 1
+        lastUse[bundleId] = stamp
+        uses.append(Use(bundleId: bundleId, stamp: stamp))
+        
+        // Rebuild the log from the live uses once superseded ones make up most of it
+        if uses.count - usesStart > 2 * lastUse.count + 1_024 {
+            uses = lastUse.map { Use(bundleId: $0.key, stamp: $0.value) }.sorted { $0.stamp < $1.stamp }
+            usesStart = 0
+        }
+    }
+    
+    /// The least recently used bundle still in memory
+    private func popLeastRecentlyUsed() -> String? {
+        while usesStart < uses.count {
+            let use = uses[usesStart]
+            usesStart += 1
+            if lastUse[use.bundleId] == use.stamp {
+                lastUse.removeValue(forKey: use.bundleId)
+                return use.bundleId
+            }
+        }
+        return nil
+    }
+    
+    /// Move the coldest bundles to the overflow store until a tenth of the budget is free again
+    private func evictIfNeeded() async {
+        guard let budget = options.byteBudget, let overflow = overflow,
+              bytes > budget, !isEvicting else {
+            return
+        }
+        isEvicting = true
+        defer { isEvicting = false }
+        
+        let target = budget - budget / 10
+        while bytes > target, let bundleId = popLeastRecentlyUsed() {
+            guard let encoded = encodings[bundleId], let pack = metadata[bundleId] else { continue }
+            
+            do {
+                try await overflow.push(encoded: encoded, metadata: pack)
+            } catch {
+                // Keep it in memory; the next push tries again
+                touch(bundleId)
+                return
+            }
+            
+            // Removed, or used again, while it was written out
+            guard let current = encodings[bundleId], lastUse[bundleId] == nil else {
+                try? await overflow.remove(bundleId: bundleId)
+                continue
+            }
+            
+            encodings.removeValue(forKey: bundleId)
+            bytes -= current.count
+            spilled.insert(bundleId)
+        }
+    }
 }
 
 public enum BundleStoreError: Error {
     case bundleNotFound
-} 
\ No newline at end of file
+    /// The store's byte budget is used up and it has nowhere to move bundles to
+    case storeFull
+}
@@ -0,0 +1,813 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+#if canImport(Glibc)
+import Glibc
+#elseif canImport(Musl)
+import Musl
+#elseif canImport(Darwin)
+import Darwin
+#endif
+import BP7
+import CSQLite
+
+/// A bundle store that keeps metadata in SQLite and bundle encodings in an
+/// append-only log of memory-mapped segment files.
+///
+/// Bundles larger than `Options.inlineMaxSize` are appended to the newest
+/// segment with sequential writes and read back straight from its mapping.
+/// Their SQLite row holds the metadata and a one byte placeholder, so the
+/// database stays small and churn never fragments its pages. Smaller bundles
+/// are stored in the database as `CSQLiteStore` would.
+///
+/// Every record names its bundle, so the log describes itself: on open the
+/// segments are scanned and the newest record of each bundle that still has a
+/// row is its encoding. Removing a bundle only drops its row and leaves a dead
+/// record behind. Once enough of a sealed segment is dead, its live records are
+/// appended to the newest segment in the background and the file is deleted.
+///
+/// Segment state is owned by `queue`; metadata goes to the wrapped `CSQLiteStore`.
+public final class SegmentLogStore: BundleStore, @unchecked Sendable {
+    /// Error types specific to SegmentLogStore
+    public enum SegmentLogStoreError: Error {
+        case ioError(String)
+        case bundleTooLarge
+    }
+    
+    public struct Options: Sendable, Equatable {
+        /// Connection profile of the metadata database
+        public var metadata: CSQLiteStore.Options
+        /// Bytes written to a segment before the next one is started; a larger bundle gets a segment of its own
+        public var segmentSize: Int
+        /// Bundles of at most this many bytes are stored in the metadata database; 0 logs every bundle
+        public var inlineMaxSize: Int
+        /// Share of a sealed segment that must be dead before its live records are moved;
+        /// segments with nothing live are always deleted, 0 never moves records
+        public var compactRatio: Double
+        /// Flush segment writes to disk before their metadata is committed
+        public var sync: Bool
+        
+        public init(
+            metadata: CSQLiteStore.Options = .default,
+            segmentSize: Int = 64 * 1024 * 1024,
+            inlineMaxSize: Int = 4096,
+            compactRatio: Double = 0.5,
+            sync: Bool = false
+        ) {
+            self.metadata = metadata
+            self.segmentSize = max(4096, segmentSize)
+            self.inlineMaxSize = max(0, inlineMaxSize)
+            self.compactRatio = min(1, max(0, compactRatio))
+            self.sync = sync
+        }
+        
+        /// Build options from `DtnConfig.dbSettings`.
+        ///
+        /// Recognized keys: those of `CSQLiteStore.Options` for the metadata database,
+        /// `segment_size` and `inline_max` (bytes), `compact_ratio` (0-1) and `segment_sync` (true or false).
+        public init(settings: [String: String]) throws {
+            self.init(metadata: try CSQLiteStore.Options(settings: settings))
+            
+            if let segmentSize = settings["segment_size"].flatMap({ Int($0) }), segmentSize > 0 {
+                self.segmentSize = max(4096, segmentSize)
+            }
+            if let inlineMax = settings["inline_max"].flatMap({ Int($0) }), inlineMax >= 0 {
+                self.inlineMaxSize = inlineMax
+            }
+            if let ratio = settings["compact_ratio"].flatMap({ Double($0) }), (0...1).contains(ratio) {
+                self.compactRatio = ratio
+            }
+            if let sync = settings["segment_sync"].flatMap({ Bool($0) }) {
+                self.sync = sync
+            }
+        }
+    }
+    
+    /// Space taken by the log
+    public struct SegmentStats: Sendable, Equatable {
+        /// Segment files on disk
+        public let segments: Int
+        /// Bundles whose encoding is in the log
+        public let bundles: Int
+        /// Bytes of records written to the segments
+        public let bytes: UInt64
+        /// Bytes of records that still hold a stored bundle
+        public let liveBytes: UInt64
+    }
+    
+    /// Where a bundle's encoding sits in the log
+    fileprivate struct Location: Sendable, Equatable {
+        let segment: UInt64
+        /// Offset of the record header
+        let record: Int
+        /// Offset and length of the encoding
+        let offset: Int
+        let length: Int
+        
+        /// Bytes the whole record takes
+        var size: Int { offset + length - record }
+    }
+    
+    /// Row body of a bundle whose encoding is in the log; no bundle encodes to a single byte
+    private static let placeholder: [UInt8] = [0]
+    
+    /// Bytes of records moved per hop onto the queue while compacting
+    private static let compactionBatch = 4 * 1024 * 1024
+    
+    private let directory: String
+    private let options: Options
+    private let metadata: CSQLiteStore
+    private let queue = DispatchQueue(label: "segmentlog.store.queue")
+    
+    // Only touched on `queue`
+    private var segments: [UInt64: Segment] = [:]
+    private var active: Segment?
+    private var nextSegment: UInt64 = 1
+    private var locations: [String: Location] = [:]
+    private var compaction: Task<Int, Never>?
+    /// Segments compaction appended to since a segment was last dropped
+    private var unsynced: Set<UInt64> = []
+    /// A segment file was created since the directory was last synced
+    private var directoryChanged = false
+    
+    /// Open the store in `directory`, creating it if needed, and index the segments found there
+    public init(directory: String, options: Options = Options()) async throws {
+        self.directory = directory
+        self.options = options
+        
+        try FileManager.default.createDirectory(atPath: directory, withIntermediateDirectories: true)
+        self.metadata = try CSQLiteStore(path: "\(directory)/metadata.db", options: options.metadata)
+        
+        var stored = Set<String>()
+        var logged: [String] = []
+        for await pack in metadata.bundleStream(pageSize: 1024) {
+            stored.insert(pack.id)
+            if pack.size > UInt64(options.inlineMaxSize) {
+                logged.append(pack.id)
+            }
+        }
+        
+        let rows = stored
+        try await perform { try self.openSegments(keeping: rows) }
+        
+        // Rows whose encoding never reached the disk, e.g. lost to a power cut with `sync` off
+        let candidates = logged
+        let missing = await query { candidates.filter { self.locations[$0] == nil } }
+        for bundleId in missing {
+            if await metadata.getBundleBytes(bundleId: bundleId) == Self.placeholder {
+                try? await metadata.remove(bundleId: bundleId)
+            }
+        }
+        
+        await query { self.scheduleCompaction() }
+    }
+    
+    // MARK: - BundleStore Protocol Implementation
+    
+    public func push(bundle: BP7.Bundle) async throws {
+        try await push(BundleContext(bundle: bundle))
+    }
+    
+    public func push(_ context: BundleContext) async throws {
+        guard context.encoded.count > options.inlineMaxSize else {
+            try await metadata.push(encoded: context.encoded, metadata: context.pack)
+            return
+        }
+        
+        let records = [(id: context.id, data: context.encoded)]
+        guard let location = try await perform({ try self.log(records) })[0] else {
+            throw CSQLiteStore.CSQLiteStoreError.constraintViolation
+        }
+        
+        do {
+            try await metadata.push(encoded: Self.placeholder, metadata: context.pack)
+        } catch {
+            await forget([(id: context.id, location: location)])
+            throw error
+        }
+    }
+    
+    public func pushBatch(bundles: [BP7.Bundle]) async throws {
+        guard !bundles.isEmpty else { return }
+        let contexts = bundles.map { BundleContext(bundle: $0) }
+        
+        // All encodings for the log go out in one hop, their rows in one transaction
+        let large = contexts.filter { $0.encoded.count > options.inlineMaxSize }.map { (id: $0.id, data: $0.encoded) }
+        var logged = try await perform { try self.log(large) }.makeIterator()
+        
+        var records: [(metadata: BundlePack, data: [UInt8])] = []
+        var recordLocations: [Location?] = []
+        records.reserveCapacity(contexts.count)
+        recordLocations.reserveCapacity(contexts.count)
+        for context in contexts {
+            if context.encoded.count > options.inlineMaxSize {
+                // Already in the log, so already stored
+                guard let location = logged.next() ?? nil else { continue }
+                records.append((metadata: context.pack, data: Self.placeholder))
+                recordLocations.append(location)
+            } else {
+                records.append((metadata: context.pack, data: context.encoded))
+                recordLocations.append(nil)
+            }
+        }
+        
+        do {
+            let stored = try await metadata.push(encodedBatch: records)
+            
+            // Another push stored its row first; the record just written is dead
+            var skipped: [(id: String, location: Location)] = []
+            for (index, wasStored) in stored.enumerated() where !wasStored {
+                if let location = recordLocations[index] {
+                    skipped.append((id: records[index].metadata.id, location: location))
+                }
+            }
+            if !skipped.isEmpty {
+                await forget(skipped)
+            }
+        } catch {
+            var appended: [(id: String, location: Location)] = []
+            for (index, location) in recordLocations.enumerated() {
+                if let location {
+                    appended.append((id: records[index].metadata.id, location: location))
+                }
+            }
+            await forget(appended)
+            throw error
+        }
+    }
+    
+    public func updateMetadata(bundlePack: BundlePack) async throws {
+        try await metadata.updateMetadata(bundlePack: bundlePack)
+    }
+    
+    public func remove(bundleId: String) async throws {
+        try await metadata.remove(bundleId: bundleId)
+        await release([bundleId])
+    }
+    
+    public func count() async -> UInt64 {
+        await metadata.count()
+    }
+    
+    public func allIds() async -> [String] {
+        await metadata.allIds()
+    }
+    
+    public func hasItem(bundleId: String) async -> Bool {
+        await metadata.hasItem(bundleId: bundleId)
+    }
+    
+    public func allBundles() async -> [BundlePack] {
+        await metadata.allBundles()
+    }
+    
+    public func idStream(pageSize: Int) -> StoreCursor<String> {
+        metadata.idStream(pageSize: pageSize)
+    }
+    
+    public func bundleStream(pageSize: Int) -> StoreCursor<BundlePack> {
+        metadata.bundleStream(pageSize: pageSize)
+    }
+    
+    public func forwardPendingStream(pageSize: Int) -> StoreCursor<BundlePack> {
+        metadata.forwardPendingStream(pageSize: pageSize)
+    }
+    
+    public func getBundle(bundleId: String) async -> BP7.Bundle? {
+        guard let bytes = await getBundleBytes(bundleId: bundleId) else {
+            return nil
+        }
+        return try? BP7.Bundle.decode(from: bytes)
+    }
+    
+    public func getBundleBytes(bundleId: String) async -> [UInt8]? {
+        let logged = await query { () -> [UInt8]? in
+            guard let location = self.locations[bundleId], let segment = self.segments[location.segment] else {
+                return nil
+            }
+            return Array(UnsafeRawBufferPointer(start: segment.base + location.offset, count: location.length))
+        }
+        if let logged {
+            return logged
+        }
+        
+        let bytes = await metadata.getBundleBytes(bundleId: bundleId)
+        return bytes == Self.placeholder ? nil : bytes
+    }
+    
+    public func bundleChunks(bundleId: String, chunkSize: Int) -> StoreCursor<[UInt8]> {
+        StoreCursor(makePageSource: { [self] in
+            let reader = ChunkReader(bundleId: bundleId, chunkSize: chunkSize)
+            return {
+                await self.nextChunk(reader)
+            }
+        })
+    }
+    
+    public func getMetadata(bundleId: String) async -> BundlePack? {
+        await metadata.getMetadata(bundleId: bundleId)
+    }
+    
+    public func removeExpired(before time: UInt64) async throws -> [String] {
+        let removed = try await metadata.removeExpired(before: time)
+        if !removed.isEmpty {
+            await release(removed)
+        }
+        return removed
+    }
+    
+    public func segmentStats() async -> SegmentStats {
+        await query {
+            SegmentStats(
+                segments: self.segments.count,
+                bundles: self.locations.count,
+                bytes: self.segments.values.reduce(0) { $0 + UInt64($1.end) },
+                liveBytes: self.segments.values.reduce(0) { $0 + UInt64(max(0, $1.liveBytes)) }
+            )
+        }
+    }
+    
+    // MARK: - Log
+    
+    /// Append `records` to the newest segment, starting another whenever it fills up.
+    /// Bundles already in the log get `nil` and are not written again. Must run on `queue`.
+    private func log(_ records: [(id: String, data: [UInt8])]) throws -> [Location?] {
+        var written: [Location?] = []
+        written.reserveCapacity(records.count)
+        var touched: [Segment] = []
+        
+        for record in records {
+            guard locations[record.id] == nil else {
+                written.append(nil)
+                continue
+            }
+            let location = try record.data.withUnsafeBytes { try append(record.id, $0) }
+            setLocation(location, of: record.id)
+            written.append(location)
+            if let segment = active, touched.last !== segment {
+                touched.append(segment)
+            }
+        }
+        
+        if options.sync {
+            for segment in touched {
+                try segment.sync()
+            }
+            if directoryChanged {
+                try syncDirectory()
+            }
+        }
+        return written
+    }
+    
+    /// Write one record for `bundleId` at the end of the newest segment. Must run on `queue`.
+    private func append(_ bundleId: String, _ bytes: UnsafeRawBufferPointer) throws -> Location {
+        let id = Array(bundleId.utf8)
+        guard bytes.count <= UInt32.max, id.count <= UInt16.max else {
+            throw SegmentLogStoreError.bundleTooLarge
+        }
+        
+        let header = Segment.header(id: id, body: bytes)
+        let size = header.count + bytes.count
+        
+        if active.map({ $0.end + size > $0.capacity }) ?? true {
+            let number = nextSegment
+            guard let segment = try Segment.map(number: number, path: path(of: number), creatingWith: max(options.segmentSize, size)) else {
+                throw SegmentLogStoreError.ioError("Failed to create segment \(number)")
+            }
+            nextSegment += 1
+            segments[number] = segment
+            active = segment
+            directoryChanged = true
+            
+            // The segment just sealed may already be mostly dead
+            scheduleCompaction()
+        }
+        
+        let segment = active!
+        let record = segment.end
+        try header.withUnsafeBytes { try segment.write($0, at: record) }
+        try segment.write(bytes, at: record + header.count)
+        segment.end = record + size
+        
+        return Location(segment: segment.number, record: record, offset: record + header.count, length: bytes.count)
+    }
+    
+    /// Point `bundleId` at `location`, moving its bytes between the segments' live counts. Must run on `queue`.
+    private func setLocation(_ location: Location?, of bundleId: String) {
+        let previous: Location?
+        if let location {
+            previous = locations.updateValue(location, forKey: bundleId)
+            segments[location.segment]?.liveBytes += location.size
+        } else {
+            previous = locations.removeValue(forKey: bundleId)
+        }
+        if let previous {
+            segments[previous.segment]?.liveBytes -= previous.size
+        }
+    }
+    
+    /// Records whose rows were never written become dead
+    private func forget(_ records: [(id: String, location: Location)]) async {
+        await query {
+            for record in records where self.locations[record.id] == record.location {
+                self.setLocation(nil, of: record.id)
+            }
+            self.scheduleCompaction()
+        }
+    }
+    
+    /// The records of removed bundles become dead
+    private func release(_ bundleIds: [String]) async {
+        await query {
+            for bundleId in bundleIds {
+                self.setLocation(nil, of: bundleId)
+            }
+            self.scheduleCompaction()
+        }
+    }
+    
+    /// Map the segment files and point every stored bundle at its newest record. Must run on `queue`.
+    private func openSegments(keeping stored: Set<String>) throws {
+        let numbers = try FileManager.default.contentsOfDirectory(atPath: directory)
+            .compactMap { name in name.hasSuffix(".seg") ? UInt64(name.dropLast(4)) : nil }
+            .sorted()
+        
+        for number in numbers {
+            // Only a segment created just before a crash is empty
+            guard let segment = try Segment.map(number: number, path: path(of: number)) else {
+                unlink(path(of: number))
+                continue
+            }
+            segments[number] = segment
+            
+            // Later records of a bundle supersede earlier ones, e.g. copies made by compaction
+            for (id, location) in segment.scan() where stored.contains(id) {
+                setLocation(location, of: id)
+            }
+        }
+        nextSegment = (numbers.last ?? 0) + 1
+    }
+    
+    private func path(of segment: UInt64) -> String {
+        let number = String(segment)
+        return "\(directory)/\(String(repeating: "0", count: max(0, 16 - number.count)))\(number).seg"
+    }
+    
+    // MARK: - Chunked Reads
+    
+    /// Position of one chunked read. Logged encodings are looked up again for every
+    /// chunk, so one moved by compaction in between reads on from its new place.
+    private final class ChunkReader: @unchecked Sendable {
+        let bundleId: String
+        let chunkSize: Int
+        var offset = 0
+        /// The encoding of a bundle stored in the database, read whole as it is small
+        var inline: [UInt8]?
+        
+        init(bundleId: String, chunkSize: Int) {
+            self.bundleId = bundleId
+            self.chunkSize = max(1, chunkSize)
+        }
+    }
+    
+    private func nextChunk(_ reader: ChunkReader) async -> StoreCursor<[UInt8]>.Page {
+        if reader.inline == nil {
+            let logged = await query { () -> StoreCursor<[UInt8]>.Page? in
+                guard let location = self.locations[reader.bundleId], let segment = self.segments[location.segment] else {
+                    return nil
+                }
+                let count = min(reader.chunkSize, location.length - reader.offset)
+                guard count > 0 else {
+                    return ([], true)
+                }
+                let chunk = Array(UnsafeRawBufferPointer(start: segment.base + location.offset + reader.offset, count: count))
+                reader.offset += count
+                return ([chunk], reader.offset >= location.length)
+            }
+            if let logged {
+                return logged
+            }
+            
+            // Not in the log, or removed while it was read
+            guard reader.offset == 0,
+                  let bytes = await metadata.getBundleBytes(bundleId: reader.bundleId),
+                  bytes != Self.placeholder else {
+                return ([], true)
+            }
+            reader.inline = bytes
+        }
+        
+        guard let bytes = reader.inline, reader.offset < bytes.count else {
+            return ([], true)
+        }
+        let end = min(bytes.count, reader.offset + reader.chunkSize)
+        let chunk = Array(bytes[reader.offset..<end])
+        reader.offset = end
+        return ([chunk], end >= bytes.count)
+    }
+    
+    // MARK: - Compaction
+    
+    /// Run a compaction pass over every segment that qualifies, or wait for the one
+    /// already running in the background. Returns the number of segment files deleted.
+    @discardableResult
+    public func compact() async -> Int {
+        var reclaimed = 0
+        while let pass = await query({ () -> Task<Int, Never>? in
+            self.scheduleCompaction()
+            return self.compaction
+        }) {
+            let deleted = await pass.value
+            reclaimed += deleted
+            guard deleted > 0 else { break }
+        }
+        return reclaimed
+    }
+    
+    /// The oldest sealed segment with nothing live, or with at least `compactRatio` of it dead. Must run on `queue`.
+    private func compactable() -> UInt64? {
+        segments.values
+            .filter { segment in
+                guard segment !== active else { return false }
+                if segment.liveBytes <= 0 {
+                    return true
+                }
+                return options.compactRatio > 0 && Double(segment.end - segment.liveBytes) >= options.compactRatio * Double(segment.end)
+            }
+            .map(\.number)
+            .min()
+    }
+    
+    /// Start a background pass unless one is running or nothing qualifies. Must run on `queue`.
+    private func scheduleCompaction() {
+        guard compaction == nil, compactable() != nil else { return }
+        
+        compaction = Task.detached(priority: .background) { [self] in
+            let deleted = await compactSegments()
+            await query {
+                self.compaction = nil
+                // A pass that deleted nothing failed; removals start the next one
+                if deleted > 0 {
+                    self.scheduleCompaction()
+                }
+            }
+            return deleted
+        }
+    }
+    
+    /// Move the live records out of each compactable segment in turn and delete it
+    private func compactSegments() async -> Int {
+        var deleted = 0
+        while let number = await query({ self.compactable() }) {
+            do {
+                // A batch at a time, so pushes and reads get the queue in between
+                var position: Int? = 0
+                while let start = position {
+                    position = try await perform { try self.moveRecords(of: number, from: start) }
+                }
+                guard try await perform({ try self.drop(number) }) else { break }
+                deleted += 1
+            } catch {
+                break
+            }
+        }
+        return deleted
+    }
+    
+    /// Append the live records of segment `number` from `start` on, up to `compactionBatch`
+    /// bytes, to the newest segment. Returns where to carry on, nil once done. Must run on `queue`.
+    private func moveRecords(of number: UInt64, from start: Int) throws -> Int? {
+        guard let segment = segments[number] else { return nil }
+        
+        var position = start
+        var moved = 0
+        while position < segment.end, moved < Self.compactionBatch {
+            guard let next = segment.record(at: position) else { return nil }
+            let (id, location) = next
+            if locations[id] == location {
+                let copy = try append(id, UnsafeRawBufferPointer(start: segment.base + location.offset, count: location.length))
+                setLocation(copy, of: id)
+                unsynced.insert(copy.segment)
+                moved += location.size
+            }
+            position = location.offset + location.length
+        }
+        return position < segment.end ? position : nil
+    }
+    
+    /// Delete segment `number` if nothing in it is live any more. Must run on `queue`.
+    private func drop(_ number: UInt64) throws -> Bool {
+        guard let segment = segments[number], segment !== active, segment.liveBytes <= 0 else {
+            return false
+        }
+        
+        // The moved records, and the files they went to, reach the disk before
+        // their originals go, whatever `sync` says
+        for written in unsynced.sorted() {
+            try segments[written]?.sync()
+        }
+        unsynced.removeAll()
+        if directoryChanged {
+            try syncDirectory()
+        }
+        
+        unlink(segment.path)
+        segments[number] = nil
+        return true
+    }
+    
+    /// Make the creation of segment files durable. Must run on `queue`.
+    private func syncDirectory() throws {
+        let descriptor = open(directory, O_RDONLY)
+        guard descriptor >= 0 else {
+            throw SegmentLogStoreError.ioError("Failed to open \(directory)")
+        }
+        defer { close(descriptor) }
+        
+        guard fsync(descriptor) == 0 else {
+            throw SegmentLogStoreError.ioError("Failed to sync \(directory)")
+        }
+        directoryChanged = false
+    }
+    
+    // MARK: - Queue Helpers
+    
+    /// Run a throwing operation on the store queue
+    private func perform<T: Sendable>(_ body: @escaping @Sendable () throws -> T) async throws -> T {
+        try await withCheckedThrowingContinuation { continuation in
+            queue.async {
+                do {
+                    continuation.resume(returning: try body())
+                } catch {
+                    continuation.resume(throwing: error)
+                }
+            }
+        }
+    }
+    
+    /// Run a non-throwing operation on the store queue
+    private func query<T: Sendable>(_ body: @escaping @Sendable () -> T) async -> T {
+        await withCheckedContinuation { continuation in
+            queue.async {
+                continuation.resume(returning: body())
+            }
+        }
+    }
+}
+
+// MARK: - Segment
+
+extension SegmentLogStore {
+    /// One segment file, mapped whole. Only touched on the store queue.
+    ///
+    /// A record is a 16 byte header (magic, encoding length, ID length, two
+    /// reserved bytes and the CRC-32 of ID and encoding, little endian), the
+    /// bundle ID and the encoding. The file is sized up front, so a torn write can
+    /// leave a header over zeros; the log ends at the first record that is not
+    /// whole or fails its checksum.
+    fileprivate final class Segment {
+        static let headerSize = 16
+        static let magic: UInt32 = 0x5347_4C44
+        
+        let number: UInt64
+        let path: String
+        let descriptor: Int32
+        let capacity: Int
+        let base: UnsafeMutableRawPointer
+        /// End of the last record
+        var end = 0
+        /// Bytes of records that still hold a stored bundle
+        var liveBytes = 0
+        
+        private init(number: UInt64, path: String, descriptor: Int32, capacity: Int, base: UnsafeMutableRawPointer) {
+            self.number = number
+            self.path = path
+            self.descriptor = descriptor
+            self.capacity = capacity
+            self.base = base
+        }
+        
+        deinit {
+            munmap(base, capacity)
+            close(descriptor)
+        }
+        
+        /// Map the file at `path`, creating it with room for `capacity` bytes if given.
+        /// Returns nil for an existing file that is empty.
+        static func map(number: UInt64, path: String, creatingWith capacity: Int? = nil) throws -> Segment? {
+            let descriptor = capacity == nil ? open(path, O_RDWR) : open(path, O_RDWR | O_CREAT | O_EXCL, 0o644)
+            guard descriptor >= 0 else {
+                throw SegmentLogStoreError.ioError("Failed to open segment \(path)")
+            }
+            
+            var size = 0
+            if let capacity {
+                guard ftruncate(descriptor, off_t(capacity)) == 0 else {
+                    close(descriptor)
+                    throw SegmentLogStoreError.ioError("Failed to size segment \(path)")
+                }
+                size = capacity
+            } else {
+                var info = stat()
+                guard fstat(descriptor, &info) == 0 else {
+                    close(descriptor)
+                    throw SegmentLogStoreError.ioError("Failed to stat segment \(path)")
+                }
+                size = Int(info.st_size)
+            }
+            
+            guard size > 0 else {
+                close(descriptor)
+                return nil
+            }
+            
+            guard let base = mmap(nil, size, PROT_READ, MAP_SHARED, descriptor, 0),
+                  base != UnsafeMutableRawPointer(bitPattern: -1) else {
+                close(descriptor)
+                throw SegmentLogStoreError.ioError("Failed to map segment \(path)")
+            }
+            return Segment(number: number, path: path, descriptor: descriptor, capacity: size, base: base)
+        }
+        
+        /// Header and ID of the record holding `body`
+        static func header(id: [UInt8], body: UnsafeRawBufferPointer) -> [UInt8] {
+            let crc = id.withUnsafeBytes { checksum(id: $0, body: body) }
+            
+            var header: [UInt8] = []
+            header.reserveCapacity(headerSize + id.count)
+            withUnsafeBytes(of: magic.littleEndian) { header.append(contentsOf: $0) }
+            withUnsafeBytes(of: UInt32(body.count).littleEndian) { header.append(contentsOf: $0) }
+            withUnsafeBytes(of: UInt16(id.count).littleEndian) { header.append(contentsOf: $0) }
+            header.append(contentsOf: [0, 0])
+            withUnsafeBytes(of: crc.littleEndian) { header.append(contentsOf: $0) }
+            header.append(contentsOf: id)
+            return header
+        }
+        
+        static func checksum(id: UnsafeRawBufferPointer, body: UnsafeRawBufferPointer) -> UInt32 {
+            let crc = csqlite_crc32(0, id.baseAddress?.assumingMemoryBound(to: UInt8.self), id.count)
+            return csqlite_crc32(crc, body.baseAddress?.assumingMemoryBound(to: UInt8.self), body.count)
+        }
+        
+        /// The record starting at `position`, nil if there is no whole one.
+        /// With `verify` the record must also match its checksum.
+        func record(at position: Int, verify: Bool = false) -> (id: String, location: Location)? {
+            guard position >= 0, position + Self.headerSize <= capacity,
+                  UInt32(littleEndian: base.loadUnaligned(fromByteOffset: position, as: UInt32.self)) == Self.magic else {
+                return nil
+            }
+            
+            let length = Int(UInt32(littleEndian: base.loadUnaligned(fromByteOffset: position + 4, as: UInt32.self)))
+            let idLength = Int(UInt16(littleEndian: base.loadUnaligned(fromByteOffset: position + 8, as: UInt16.self)))
+            let offset = position + Self.headerSize + idLength
+            guard offset + length <= capacity else {
+                return nil
+            }
+            
+            let idBytes = UnsafeRawBufferPointer(start: base + position + Self.headerSize, count: idLength)
+            if verify {
+                let crc = UInt32(littleEndian: base.loadUnaligned(fromByteOffset: position + 12, as: UInt32.self))
+                guard Self.checksum(id: idBytes, body: UnsafeRawBufferPointer(start: base + offset, count: length)) == crc else {
+                    return nil
+                }
+            }
+            
+            let id = String(decoding: idBytes, as: UTF8.self)
+            return (id, Location(segment: number, record: position, offset: offset, length: length))
+        }
+        
+        /// Every record from the start of the file, checksums verified, which also finds where the log ends
+        func scan() -> [(id: String, location: Location)] {
+            var records: [(id: String, location: Location)] = []
+            var position = 0
+            while let next = record(at: position, verify: true) {
+                records.append(next)
+                position = next.location.offset + next.location.length
+            }
+            end = position
+            return records
+        }
+        
+        /// Write `bytes` at `offset`, retrying short writes
+        func write(_ bytes: UnsafeRawBufferPointer, at offset: Int) throws {
+            var written = 0
+            while written < bytes.count {
+                let result = pwrite(descriptor, bytes.baseAddress! + written, bytes.count - written, off_t(offset + written))
+                if result < 0 {
+                    if errno == EINTR { continue }
+                    throw SegmentLogStoreError.ioError("Failed to write segment \(path)")
+                }
+                written += result
+            }
+        }
+        
+        func sync() throws {
+            guard fsync(descriptor) == 0 else {
+                throw SegmentLogStoreError.ioError("Failed to sync segment \(path)")
+            }
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+
+/// An `AsyncSequence` over store contents that fetches one page at a time.
+///
+/// Each iteration asks its own page source for the next page only when the
+/// previous one is used up, so callers never hold more than a page in memory.
+public struct StoreCursor<Element: Sendable>: AsyncSequence, Sendable {
+    /// One page of results; `isLast` ends the sequence after `elements`
+    public typealias Page = (elements: [Element], isLast: Bool)
+    
+    /// Fetches the next page for one iteration
+    public typealias PageSource = @Sendable () async -> Page
+    
+    private let makePageSource: @Sendable () -> PageSource
+    
+    /// Create a cursor whose iterations each get a fresh page source from `makePageSource`
+    public init(makePageSource: @escaping @Sendable () -> PageSource) {
+        self.makePageSource = makePageSource
+    }
+    
+    /// Create a cursor over a snapshot taken when iteration starts, for stores that already hold everything in memory
+    public init(snapshot: @escaping @Sendable () async -> [Element]) {
+        self.makePageSource = {
+            { (elements: await snapshot(), isLast: true) }
+        }
+    }
+    
+    public func makeAsyncIterator() -> AsyncIterator {
+        AsyncIterator(nextPage: makePageSource())
+    }
+    
+    public struct AsyncIterator: AsyncIteratorProtocol, Sendable {
+        private let nextPage: PageSource
+        private var buffer: [Element] = []
+        private var index = 0
+        private var finished = false
+        
+        init(nextPage: @escaping PageSource) {
+            self.nextPage = nextPage
+        }
+        
+        public mutating func next() async -> Element? {
+            while index == buffer.count {
+                guard !finished else { return nil }
+                let page = await nextPage()
+                buffer = page.elements
+                index = 0
+                finished = page.isLast
+            }
+            
+            defer { index += 1 }
+            return buffer[index]
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import NIOConcurrencyHelpers
+
+/// The IDs of recently stored bundles in arrival order, so pulling peers can ask
+/// for what arrived since their last poll instead of the whole store listing.
+///
+/// Cursors name a process run and a position, `<epoch>-<sequence>`. A cursor from
+/// an earlier run, or older than the retained entries, cannot be continued and is
+/// answered with `reset`, after which the peer lists the store once.
+public final class StoreJournal: Sendable {
+    /// Entries kept before the oldest are forgotten
+    public static let defaultCapacity = 65_536
+    
+    /// One page of a delta listing
+    public struct Page: Codable, Sendable, Equatable {
+        /// Where the next request continues
+        public let cursor: String
+        public let bundles: [String]
+        /// More entries follow `cursor`
+        public let more: Bool
+        /// The requested cursor could not be continued; `bundles` is empty
+        public let reset: Bool
+    }
+    
+    private struct State {
+        var ring: [String] = []
+        /// Sequence number the next entry gets; entry `s` lives at `ring[s % capacity]`
+        var next: UInt64 = 0
+    }
+    
+    private let epoch: UInt64
+    private let capacity: Int
+    private let state = NIOLockedValueBox(State())
+    
+    public init(capacity: Int = StoreJournal.defaultCapacity) {
+        self.capacity = max(1, capacity)
+        self.epoch = UInt64.random(in: 1...UInt64.max)
+    }
+    
+    public func append(_ bundleId: String) {
+        state.withLockedValue { state in
+            if state.ring.count < capacity {
+                state.ring.append(bundleId)
+            } else {
+                state.ring[Int(state.next % UInt64(capacity))] = bundleId
+            }
+            state.next += 1
+        }
+    }
+    
+    /// Cursor of the next entry to be appended
+    public var position: String {
+        state.withLockedValue { format($0.next) }
+    }
+    
+    /// Up to `limit` entries after `cursor`; a missing or stale cursor gets a reset with the current position
+    public func page(after cursor: String?, limit: Int) -> Page {
+        state.withLockedValue { state in
+            let oldest = state.next - UInt64(state.ring.count)
+            guard let position = cursor.flatMap(parse), position >= oldest, position <= state.next else {
+                return Page(cursor: format(state.next), bundles: [], more: false, reset: true)
+            }
+            
+            let end = min(state.next, position + UInt64(max(1, limit)))
+            let bundles = (position..<end).map { state.ring[Int($0 % UInt64(capacity))] }
+            return Page(cursor: format(end), bundles: bundles, more: end < state.next, reset: false)
+        }
+    }
+    
+    private func format(_ position: UInt64) -> String {
+        "\(String(epoch, radix: 16))-\(position)"
+    }
+    
+    private func parse(_ cursor: String) -> UInt64? {
+        let parts = cursor.split(separator: "-")
+        guard parts.count == 2, UInt64(parts[0], radix: 16) == epoch else { return nil }
+        return UInt64(parts[1])
+    }
+}
@@ -0,0 +1,421 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import Atomics
+import Logging
+import NIOConcurrencyHelpers
+#if canImport(FoundationNetworking)
+import FoundationNetworking
+#endif
+
+/// The stages a bundle passes on its way through the node, one span each
+public enum TraceStage: String, Sendable, CaseIterable {
+    /// Waiting in its shard's receive queue
+    case queue
+    /// Duplicate detection
+    case dedup
+    /// Writing the bundle to the store
+    case store
+    /// Asking the routing agent for next hops
+    case route
+    /// Handing the bundle to a local application
+    case deliver
+    /// One CLA `sendBundles` call the bundle was part of
+    case send = "cla.send"
+    
+    /// Whether the stage runs after the root span has ended. Sends happen once a
+    /// peer outbox drains, long after processing returned, so their spans link to
+    /// the root instead of sitting outside its time range as children.
+    var outlivesRoot: Bool { self == .send }
+}
+
+/// A 128-bit trace identifier, as OpenTelemetry uses
+public struct TraceID: Sendable, Hashable {
+    public let high: UInt64
+    public let low: UInt64
+    
+    public var hex: String { Tracer.hex(high) + Tracer.hex(low) }
+}
+
+/// The trace of one sampled bundle, carried along its context.
+///
+/// Bundles that were not sampled carry nil instead, so every stage costs them a
+/// single optional check and not even a clock read.
+public struct BundleTrace: Sendable {
+    let tracer: Tracer
+    public let traceId: TraceID
+    /// The span covering the bundle's processing; every stage but `send` is its child
+    public let rootSpanId: UInt64
+    public let bundleId: String
+    public let start: ContinuousClock.Instant
+    
+    /// Start timing `stage`; the span is recorded once it ends
+    public func begin(_ stage: TraceStage) -> TraceSpan {
+        TraceSpan(trace: self, stage: stage, start: .now)
+    }
+    
+    /// Record `stage` as having run from `start` to `end`
+    public func record(_ stage: TraceStage, from start: ContinuousClock.Instant, to end: ContinuousClock.Instant = .now, attributes: [String: String] = [:]) {
+        let detached = stage.outlivesRoot
+        tracer.record(Tracer.Span(
+            traceId: traceId,
+            spanId: Tracer.randomSpanId(),
+            parentSpanId: detached ? nil : rootSpanId,
+            linkedSpanId: detached ? rootSpanId : nil,
+            name: stage.rawValue,
+            bundleId: bundleId,
+            start: start,
+            end: end,
+            attributes: attributes
+        ))
+    }
+    
+    /// Record the root span, from the bundle entering the node until now
+    public func finish(attributes: [String: String] = [:]) {
+        tracer.record(Tracer.Span(
+            traceId: traceId,
+            spanId: rootSpanId,
+            parentSpanId: nil,
+            linkedSpanId: nil,
+            name: "bundle",
+            bundleId: bundleId,
+            start: start,
+            end: .now,
+            attributes: attributes
+        ))
+    }
+}
+
+/// A stage of a traced bundle that has begun but not yet ended
+public struct TraceSpan: Sendable {
+    let trace: BundleTrace
+    let stage: TraceStage
+    let start: ContinuousClock.Instant
+    
+    public func end(attributes: [String: String] = [:]) {
+        trace.record(stage, from: start, attributes: attributes)
+    }
+}
+
+/// Samples bundles for tracing and keeps their most recent spans.
+///
+/// Spans go into a fixed-size ring served at `/debug/trace`, as plain JSON or
+/// in the OTLP/JSON encoding, and are pushed to an OpenTelemetry collector when
+/// one is configured. With sampling off, `sample` is a single branch.
+public final class Tracer: Sendable {
+    public struct Configuration: Sendable {
+        /// Trace one bundle out of this many; 0 turns tracing off
+        public var sampleEvery: Int
+        /// Spans kept for `/debug/trace` and the exporter
+        public var capacity: Int
+        /// OTLP/HTTP traces endpoint to push spans to, e.g. `http://localhost:4318/v1/traces`
+        public var otlpEndpoint: String?
+        /// Seconds between pushes to `otlpEndpoint`
+        public var exportInterval: TimeInterval
+        
+        public static let `default` = Configuration()
+        
+        public init(sampleEvery: Int = 0, capacity: Int = 4_096, otlpEndpoint: String? = nil, exportInterval: TimeInterval = 5) {
+            self.sampleEvery = max(0, sampleEvery)
+            self.capacity = max(1, capacity)
+            self.otlpEndpoint = otlpEndpoint
+            self.exportInterval = exportInterval
+        }
+        
+        /// Build a configuration from `DtnConfig.traceSettings`, starting from `default`.
+        ///
+        /// Recognized keys: `sample` (fraction of bundles to trace, 0-1, rounded
+        /// to one in N), `capacity` (spans), `otlp_endpoint` (URL) and
+        /// `export_interval` (seconds).
+        public init(settings: [String: String]) {
+            self = .default
+            
+            if let fraction = settings["sample"].flatMap({ Double($0) }), fraction > 0, fraction <= 1 {
+                self.sampleEvery = max(1, Int((1 / fraction).rounded()))
+            }
+            if let capacity = settings["capacity"].flatMap({ Int($0) }), capacity > 0 {
+                self.capacity = capacity
+            }
+            if let endpoint = settings["otlp_endpoint"], !endpoint.isEmpty {
+                self.otlpEndpoint = endpoint
+            }
+            if let interval = settings["export_interval"].flatMap({ TimeInterval($0) }), interval > 0 {
+                self.exportInterval = interval
+            }
+        }
+    }
+    
+    /// A finished span
+    public struct Span: Sendable {
+        public let traceId: TraceID
+        public let spanId: UInt64
+        public let parentSpanId: UInt64?
+        /// A span of the same trace this one follows from without being its child
+        public let linkedSpanId: UInt64?
+        public let name: String
+        public let bundleId: String
+        public let start: ContinuousClock.Instant
+        public let end: ContinuousClock.Instant
+        public let attributes: [String: String]
+    }
+    
+    public let configuration: Configuration
+    public var isEnabled: Bool { configuration.sampleEvery > 0 }
+    
+    private let sampled = ManagedAtomic<UInt64>(0)
+    private let ring: NIOLockedValueBox<SpanRing>
+    private let logger = Logger(label: "Tracer")
+    
+    // Wall clock time at `clockAnchor`, to turn monotonic instants into Unix timestamps
+    private let wallAnchor: Double
+    private let clockAnchor: ContinuousClock.Instant
+    
+    public init(configuration: Configuration = .default) {
+        self.configuration = configuration
+        self.ring = NIOLockedValueBox(SpanRing(capacity: configuration.capacity))
+        self.wallAnchor = Date().timeIntervalSince1970
+        self.clockAnchor = .now
+    }
+    
+    /// A trace for the bundle `bundleId` if it is picked for sampling, nil otherwise
+    public func sample(_ bundleId: String, receivedAt: ContinuousClock.Instant = .now) -> BundleTrace? {
+        let every = configuration.sampleEvery
+        guard every > 0 else { return nil }
+        guard sampled.loadThenWrappingIncrement(ordering: .relaxed) % UInt64(every) == 0 else { return nil }
+        
+        return BundleTrace(
+            tracer: self,
+            traceId: TraceID(high: .random(in: 1...UInt64.max), low: .random(in: 1...UInt64.max)),
+            rootSpanId: Self.randomSpanId(),
+            bundleId: bundleId,
+            start: receivedAt
+        )
+    }
+    
+    func record(_ span: Span) {
+        ring.withLockedValue { $0.append(span) }
+    }
+    
+    /// The most recent spans, oldest first
+    public func recentSpans(limit: Int = .max) -> [Span] {
+        ring.withLockedValue { ring in
+            ring.spans(after: ring.recorded - UInt64(min(max(0, limit), ring.spans.count)))
+        }
+    }
+    
+    /// Spans recorded after `position` that are still in the ring, and the position after the last of them
+    public func spans(after position: UInt64) -> (spans: [Span], position: UInt64) {
+        ring.withLockedValue { ($0.spans(after: position), $0.recorded) }
+    }
+    
+    /// Unix time of `instant` in nanoseconds
+    public func unixNanoseconds(_ instant: ContinuousClock.Instant) -> UInt64 {
+        let seconds = wallAnchor + (instant - clockAnchor).seconds
+        return UInt64(max(0, seconds * 1e9))
+    }
+    
+    // MARK: - Export
+    
+    /// Spans as served by `/debug/trace`
+    public func debugJSON(_ spans: [Span]) throws -> [UInt8] {
+        let response = DebugTrace(
+            sampleEvery: configuration.sampleEvery,
+            spans: spans.map { span in
+                DebugTrace.Span(
+                    traceId: span.traceId.hex,
+                    spanId: Self.hex(span.spanId),
+                    parentSpanId: span.parentSpanId.map(Self.hex),
+                    linkedSpanId: span.linkedSpanId.map(Self.hex),
+                    name: span.name,
+                    bundleId: span.bundleId,
+                    startTimeUnixNano: unixNanoseconds(span.start),
+                    durationMicroseconds: (span.end - span.start).seconds * 1e6,
+                    attributes: span.attributes
+                )
+            }
+        )
+        return Array(try JSONEncoder().encode(response))
+    }
+    
+    /// Spans in the OTLP/JSON encoding of an `ExportTraceServiceRequest`
+    public func otlpJSON(_ spans: [Span], nodeId: String) throws -> [UInt8] {
+        let request = OTLPRequest(resourceSpans: [
+            OTLPRequest.ResourceSpans(
+                resource: OTLPRequest.Resource(attributes: [
+                    .init(key: "service.name", value: "dtn7"),
+                    .init(key: "dtn.node_id", value: nodeId),
+                ]),
+                scopeSpans: [
+                    OTLPRequest.ScopeSpans(
+                        scope: OTLPRequest.Scope(name: "dtn7"),
+                        spans: spans.map { span in
+                            OTLPRequest.Span(
+                                traceId: span.traceId.hex,
+                                spanId: Self.hex(span.spanId),
+                                parentSpanId: span.parentSpanId.map(Self.hex),
+                                name: span.name,
+                                kind: 1, // SPAN_KIND_INTERNAL
+                                links: span.linkedSpanId.map { [OTLPRequest.Link(traceId: span.traceId.hex, spanId: Self.hex($0))] } ?? [],
+                                startTimeUnixNano: String(unixNanoseconds(span.start)),
+                                endTimeUnixNano: String(unixNanoseconds(span.end)),
+                                attributes: [.init(key: "bundle.id", value: span.bundleId)]
+                                    + span.attributes.sorted { $0.key < $1.key }.map { .init(key: $0.key, value: $0.value) }
+                            )
+                        }
+                    )
+                ]
+            )
+        ])
+        return Array(try JSONEncoder().encode(request))
+    }
+    
+    /// Push the spans recorded since the last push to `otlpEndpoint` every `exportInterval`, until cancelled.
+    ///
+    /// Tracing is best effort: spans a failed push carried are not sent again.
+    public func runExporter(nodeId: String) async {
+        guard let endpoint = configuration.otlpEndpoint, let url = URL(string: endpoint) else { return }
+        
+        logger.info("Exporting traces to \(endpoint)")
+        var position: UInt64 = 0
+        while !Task.isCancelled {
+            try? await Task.sleep(for: .milliseconds(Int64(configuration.exportInterval * 1000)))
+            let (batch, next) = self.spans(after: position)
+            position = next
+            guard !batch.isEmpty else { continue }
+            
+            do {
+                var request = URLRequest(url: url)
+                request.httpMethod = "POST"
+                request.setValue("application/json", forHTTPHeaderField: "Content-Type")
+                request.httpBody = Data(try otlpJSON(batch, nodeId: nodeId))
+                let (_, response) = try await URLSession.shared.data(for: request)
+                if let status = (response as? HTTPURLResponse)?.statusCode, !(200..<300).contains(status) {
+                    logger.warning("Trace collector answered \(status), dropped \(batch.count) span(s)")
+                }
+            } catch {
+                logger.warning("Failed to export \(batch.count) span(s): \(error)")
+            }
+        }
+    }
+    
+    // MARK: - Helpers
+    
+    static func randomSpanId() -> UInt64 {
+        .random(in: 1...UInt64.max)
+    }
+    
+    /// 16 lowercase hex digits, the OTLP/JSON form of span IDs
+    static func hex(_ value: UInt64) -> String {
+        let digits = String(value, radix: 16)
+        return String(repeating: "0", count: 16 - digits.count) + digits
+    }
+}
+
+/// The last `capacity` spans; the span with sequence number `n` sits at `n % capacity`
+private struct SpanRing: Sendable {
+    let capacity: Int
+    var spans: [Tracer.Span] = []
+    /// Spans ever recorded
+    var recorded: UInt64 = 0
+    
+    init(capacity: Int) {
+        self.capacity = capacity
+        self.spans.reserveCapacity(min(capacity, 1_024))
+    }
+    
+    mutating func append(_ span: Tracer.Span) {
+        if spans.count < capacity {
+            spans.append(span)
+        } else {
+            spans[Int(recorded % UInt64(capacity))] = span
+        }
+        recorded += 1
+    }
+    
+    /// The spans with sequence numbers from `position` on that were not overwritten yet, oldest first
+    func spans(after position: UInt64) -> [Tracer.Span] {
+        let first = max(position, recorded - UInt64(spans.count))
+        guard first < recorded else { return [] }
+        return (first..<recorded).map { spans[Int($0 % UInt64(capacity))] }
+    }
+}
+
+private struct DebugTrace: Encodable {
+    struct Span: Encodable {
+        let traceId: String
+        let spanId: String
+        let parentSpanId: String?
+        let linkedSpanId: String?
+        let name: String
+        let bundleId: String
+        let startTimeUnixNano: UInt64
+        let durationMicroseconds: Double
+        let attributes: [String: String]
+    }
+    
+    let sampleEvery: Int
+    let spans: [Span]
+}
+
+/// The subset of the OTLP trace export request that dtn7 fills in
+private struct OTLPRequest: Encodable {
+    struct ResourceSpans: Encodable {
+        let resource: Resource
+        let scopeSpans: [ScopeSpans]
+    }
+    
+    struct Resource: Encodable {
+        let attributes: [KeyValue]
+    }
+    
+    struct ScopeSpans: Encodable {
+        let scope: Scope
+        let spans: [Span]
+    }
+    
+    struct Scope: Encodable {
+        let name: String
+    }
+    
+    struct Span: Encodable {
+        let traceId: String
+        let spanId: String
+        let parentSpanId: String?
+        let name: String
+        let kind: Int
+        let links: [Link]
+        // 64-bit integers are strings in OTLP/JSON
+        let startTimeUnixNano: String
+        let endTimeUnixNano: String
+        let attributes: [KeyValue]
+    }
+    
+    struct Link: Encodable {
+        let traceId: String
+        let spanId: String
+    }
+    
+    struct KeyValue: Encodable {
+        struct Value: Encodable {
+            let stringValue: String
+        }
+        
+        let key: String
+        let value: Value
+        
+        init(key: String, value: String) {
+            self.key = key
+            self.value = Value(stringValue: value)
+        }
+    }
+    
+    let resourceSpans: [ResourceSpans]
+}
+
+private extension Duration {
+    var seconds: Double {
+        Double(components.seconds) + Double(components.attoseconds) / 1e18
+    }
+}
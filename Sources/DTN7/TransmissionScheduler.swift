@@ -0,0 +1,243 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import BP7
+import NIOConcurrencyHelpers
+
+/// An encoded bundle waiting for transmission, with the metadata it is scheduled by
+public struct OutboundBundle: Sendable {
+    public let encoded: EncodedBundle
+    public let destination: EndpointID
+    /// Absolute expiry time in DTN milliseconds, 0 if the bundle never expires
+    public let expiresAt: UInt64
+    
+    public init(encoded: EncodedBundle, destination: EndpointID, expiresAt: UInt64) {
+        self.encoded = encoded
+        self.destination = destination
+        self.expiresAt = expiresAt
+    }
+    
+    /// A stored bundle and its bytes
+    public init(pack: BundlePack, data: [UInt8]) {
+        self.init(encoded: EncodedBundle(id: pack.id, data: data), destination: pack.destination, expiresAt: pack.expiresAt)
+    }
+    
+    /// A bundle whose encoding was computed on ingest
+    public init(context: BundleContext) {
+        self.init(
+            encoded: EncodedBundle(id: context.id, data: context.encoded, trace: context.trace),
+            destination: context.bundle.primary.destination,
+            expiresAt: context.pack.expiresAt
+        )
+    }
+    
+    public var size: Int { encoded.data.count }
+}
+
+/// Orders the bundles queued for one contact.
+///
+/// Bundles fall into priority classes by destination; a lower class is always
+/// sent first. Within a class, destinations share the link by weighted fair
+/// queuing, each taking bytes in proportion to its weight, and a destination's
+/// own bundles go out soonest-expiring first, then smallest first. Bundles that
+/// expire while queued are dropped instead of sent.
+struct TransmissionScheduler: Sendable {
+    struct Configuration: Sendable {
+        /// Class for destinations no rule matches
+        var defaultClass: Int
+        /// Destination pattern to priority class, most specific pattern first
+        var classRules: [(pattern: GlobPattern, priorityClass: Int)]
+        /// Destination pattern to fair queuing weight, most specific pattern first
+        var weightRules: [(pattern: GlobPattern, weight: Double)]
+        
+        init(defaultClass: Int = 1, classes: [String: Int] = [:], weights: [String: Double] = [:]) {
+            self.defaultClass = defaultClass
+            self.classRules = Self.bySpecificity(classes).map { (GlobPattern($0.key), $0.value) }
+            self.weightRules = Self.bySpecificity(weights.filter { $0.value > 0 }).map { (GlobPattern($0.key), $0.value) }
+        }
+        
+        /// Build a configuration from `DtnConfig.schedulerSettings`.
+        ///
+        /// Recognized keys: `default_priority` (class), `priority.<pattern>` (class,
+        /// 0 is most urgent) and `weight.<pattern>` (relative share, default 1),
+        /// where `<pattern>` is a destination EID glob such as `dtn://*/telemetry`.
+        init(settings: [String: String]) {
+            var classes: [String: Int] = [:]
+            var weights: [String: Double] = [:]
+            for (key, value) in settings {
+                if let pattern = key.dropPrefix("priority."), let priorityClass = Int(value) {
+                    classes[pattern] = priorityClass
+                } else if let pattern = key.dropPrefix("weight."), let weight = Double(value) {
+                    weights[pattern] = weight
+                }
+            }
+            self.init(defaultClass: settings["default_priority"].flatMap { Int($0) } ?? 1, classes: classes, weights: weights)
+        }
+        
+        func priorityClass(of destination: String) -> Int {
+            classRules.first { $0.pattern.matches(destination) }?.priorityClass ?? defaultClass
+        }
+        
+        func weight(of destination: String) -> Double {
+            weightRules.first { $0.pattern.matches(destination) }?.weight ?? 1
+        }
+        
+        /// Longer patterns are taken as more specific; ties are broken by the pattern text to stay deterministic
+        private static func bySpecificity<Value>(_ rules: [String: Value]) -> [(key: String, value: Value)] {
+            rules.sorted { ($0.key.count, $1.key) > ($1.key.count, $0.key) }
+        }
+    }
+    
+    private struct Entry: Sendable {
+        let bundle: OutboundBundle
+        let sequence: UInt64
+        
+        /// Soonest expiry first, bundles without a lifetime last, then smaller bundles, then arrival order
+        func precedes(_ other: Entry) -> Bool {
+            let expiry = bundle.expiresAt == 0 ? UInt64.max : bundle.expiresAt
+            let otherExpiry = other.bundle.expiresAt == 0 ? UInt64.max : other.bundle.expiresAt
+            return (expiry, bundle.size, sequence) < (otherExpiry, other.bundle.size, other.sequence)
+        }
+    }
+    
+    /// The bundles of one destination in one class, kept in reverse send order so the next one is last
+    private struct Flow: Sendable {
+        var entries: [Entry] = []
+        let weight: Double
+        /// Bytes served divided by weight; the flow with the lowest tag goes next
+        var finishTag: Double = 0
+        
+        mutating func insert(_ entry: Entry) {
+            var low = 0
+            var high = entries.count
+            while low < high {
+                let middle = (low + high) / 2
+                if entries[middle].precedes(entry) {
+                    high = middle
+                } else {
+                    low = middle + 1
+                }
+            }
+            entries.insert(entry, at: low)
+        }
+    }
+    
+    private struct PriorityClass: Sendable {
+        var flows: [EndpointID: Flow] = [:]
+        /// Finish tag of the last flow served, where flows that were idle start again
+        var virtualTime: Double = 0
+    }
+    
+    let configuration: Configuration
+    private var classes: [Int: PriorityClass] = [:]
+    private var nextSequence: UInt64 = 0
+    private(set) var count = 0
+    
+    init(configuration: Configuration = Configuration()) {
+        self.configuration = configuration
+    }
+    
+    var isEmpty: Bool { count == 0 }
+    
+    mutating func push(_ bundle: OutboundBundle) {
+        let destination = bundle.destination.description
+        let priorityClass = configuration.priorityClass(of: destination)
+        let entry = Entry(bundle: bundle, sequence: nextSequence)
+        nextSequence &+= 1
+        
+        var queue = classes[priorityClass] ?? PriorityClass()
+        var flow = queue.flows[bundle.destination] ?? Flow(weight: configuration.weight(of: destination))
+        if flow.entries.isEmpty {
+            // An idle destination does not get credit for the time it had nothing to send
+            flow.finishTag = max(flow.finishTag, queue.virtualTime)
+        }
+        flow.insert(entry)
+        queue.flows[bundle.destination] = flow
+        classes[priorityClass] = queue
+        count += 1
+    }
+    
+    /// The next bundle to send, skipping bundles that expired while queued and passing them to `expired`
+    mutating func pop(now: UInt64 = DisruptionTolerantNetworkingTime.now(), expired: (OutboundBundle) -> Void = { _ in }) -> OutboundBundle? {
+        while let priorityClass = classes.keys.min() {
+            guard var queue = classes[priorityClass],
+                  let destination = queue.flows.min(by: { $0.value.finishTag < $1.value.finishTag })?.key,
+                  var flow = queue.flows[destination],
+                  let entry = flow.entries.popLast() else {
+                classes[priorityClass] = nil
+                continue
+            }
+            count -= 1
+            
+            flow.finishTag += Double(max(1, entry.bundle.size)) / flow.weight
+            queue.virtualTime = flow.finishTag
+            queue.flows[destination] = flow.entries.isEmpty ? nil : flow
+            classes[priorityClass] = queue.flows.isEmpty ? nil : queue
+            
+            if entry.bundle.expiresAt > 0 && entry.bundle.expiresAt <= now {
+                expired(entry.bundle)
+                continue
+            }
+            return entry.bundle
+        }
+        return nil
+    }
+    
+    mutating func removeAll() {
+        classes.removeAll()
+        count = 0
+    }
+}
+
+/// A token bucket pacing one CLA to a byte rate, shared by every peer it sends to
+public final class BandwidthBudget: Sendable {
+    /// Bytes per second
+    public let rate: Double
+    
+    private struct Bucket {
+        var tokens: Double
+        var updatedAt: ContinuousClock.Instant
+    }
+    
+    private let bucket: NIOLockedValueBox<Bucket>
+    
+    /// A budget of `bytesPerSecond`, allowing bursts of up to one second's worth
+    public init(bytesPerSecond: Double) {
+        self.rate = max(1, bytesPerSecond)
+        self.bucket = NIOLockedValueBox(Bucket(tokens: max(1, bytesPerSecond), updatedAt: .now))
+    }
+    
+    /// Take `bytes` from the budget, waiting until the bucket has refilled enough to cover them
+    public func reserve(_ bytes: Int) async {
+        let wait = bucket.withLockedValue { bucket -> Double in
+            let now = ContinuousClock.now
+            let elapsed = now - bucket.updatedAt
+            let seconds = Double(elapsed.components.seconds) + Double(elapsed.components.attoseconds) / 1e18
+            bucket.tokens = min(rate, bucket.tokens + seconds * rate) - Double(bytes)
+            bucket.updatedAt = now
+            return bucket.tokens < 0 ? -bucket.tokens / rate : 0
+        }
+        if wait > 0 {
+            try? await Task.sleep(for: .milliseconds(Int64((wait * 1000).rounded(.up))))
+        }
+    }
+    
+    /// Budgets by CLA name from `DtnConfig.schedulerSettings` keys `bandwidth.<cla>` (bytes per second)
+    static func budgets(settings: [String: String]) -> [String: BandwidthBudget] {
+        var budgets: [String: BandwidthBudget] = [:]
+        for (key, value) in settings {
+            if let cla = key.dropPrefix("bandwidth."), let rate = Double(value), rate > 0 {
+                budgets[cla] = BandwidthBudget(bytesPerSecond: rate)
+            }
+        }
+        return budgets
+    }
+}
+
+private extension String {
+    func dropPrefix(_ prefix: String) -> String? {
+        hasPrefix(prefix) ? String(dropFirst(prefix.count)) : nil
+    }
+}
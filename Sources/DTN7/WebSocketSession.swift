@@ -0,0 +1,308 @@
+#if canImport(FoundationEssentials)
+import FoundationEssentials
+#else
+import Foundation
+#endif
+import HummingbirdWebSocket
+import NIOCore
+import NIOWebSocket
+import BP7
+import CBOR
+import Logging
+
+/// One application connected to `/ws`, the server side of `WebSocketApplicationInterface`.
+///
+/// Text frames are commands: `/data`, `/json` or `/bundle` pick how bundles are
+/// framed, `/subscribe <endpoint>` and `/unsubscribe <endpoint>` attach to an
+/// endpoint's mailbox and `/window <n>` turns on acknowledgements. Binary frames
+/// from the application are bundles to send.
+///
+/// Bundles of subscribed endpoints are pushed as binary frames as soon as they
+/// are delivered. Without a window a bundle counts as delivered once its frame
+/// is written, as dtn7-rs clients expect. With one, at most n bundles are out
+/// unacknowledged and each stays in the mailbox until `/ack <bundle id>`, so a
+/// slow reader holds bundles back rather than buffering them and a dropped
+/// connection loses none.
+actor WebSocketSession {
+    /// Largest frame sent or accepted; longer messages use continuation frames
+    static let maxFrameSize = 64 * 1024
+    
+    /// Largest message reassembled from continuation frames
+    static let maxMessageSize = 256 * 1024 * 1024
+    
+    /// Bundles fetched from a mailbox at a time when there is no window
+    static let batchSize = 64
+    
+    private let logger = Logger(label: "WebSocketSession")
+    private let core: DtnCore
+    private let outbound: WebSocketOutboundWriter
+    
+    private var mode: TransmissionMode = .data
+    
+    /// Subscribed endpoints and the subscription the agent knows them by
+    private var subscriptions: [EndpointID: Int] = [:]
+    
+    /// Unacknowledged bundles allowed at once; 0 while acknowledgements are off
+    private var window = 0
+    
+    /// Pushed and not yet acknowledged, with the endpoint each belongs to
+    private var inFlight: [String: EndpointID] = [:]
+    
+    /// Command replies, written by the push loop so they never land between
+    /// the frames of a bundle
+    private var replies: [String] = []
+    
+    /// Rung when there is something to write: queued bundles, room in the window or replies
+    private let doorbell: AsyncStream<Void>
+    private let ring: AsyncStream<Void>.Continuation
+    
+    init(core: DtnCore, outbound: WebSocketOutboundWriter) {
+        self.core = core
+        self.outbound = outbound
+        (doorbell, ring) = AsyncStream.makeStream(of: Void.self, bufferingPolicy: .bufferingNewest(1))
+    }
+    
+    /// Serve the connection until the application closes it
+    nonisolated func run(_ inbound: WebSocketInboundStream) async throws {
+        do {
+            try await withThrowingTaskGroup(of: Void.self) { group in
+                group.addTask { try await self.pushBundles() }
+                
+                for try await message in inbound.messages(maxSize: Self.maxMessageSize) {
+                    await handle(message)
+                }
+                group.cancelAll()
+            }
+        } catch {
+            await close()
+            throw error
+        }
+        await close()
+    }
+    
+    // MARK: - Commands
+    
+    private func handle(_ message: WebSocketMessage) async {
+        switch message {
+        case .text(let text):
+            await command(text.trimmingCharacters(in: .whitespacesAndNewlines))
+        case .binary(let buffer):
+            await submit(Array(buffer.readableBytesView))
+        }
+    }
+    
+    private func command(_ text: String) async {
+        let parts = text.split(separator: " ", maxSplits: 1).map(String.init)
+        let argument = parts.count > 1 ? parts[1] : ""
+        
+        switch parts.first ?? "" {
+        case "/data", "/json", "/bundle":
+            mode = TransmissionMode(rawValue: parts[0])!
+            reply("200 tx mode: \(mode)")
+        
+        case "/subscribe":
+            guard let endpoint = resolve(argument) else {
+                reply("Error: Invalid endpoint \(argument)")
+                return
+            }
+            await core.registerEndpoint(endpoint)
+            subscriptions[endpoint] = await core.applicationAgent.subscribe(endpoint, doorbell: ring)
+            reply("Subscribed to \(endpoint)")
+        
+        case "/unsubscribe":
+            guard let endpoint = resolve(argument), let subscription = subscriptions.removeValue(forKey: endpoint) else {
+                reply("Error: Not subscribed to \(argument)")
+                return
+            }
+            await core.applicationAgent.unsubscribe(endpoint, subscription: subscription)
+            inFlight = inFlight.filter { $0.value != endpoint }
+            reply("Unsubscribed from \(endpoint)")
+        
+        case "/window":
+            guard let size = Int(argument), size >= 0 else {
+                reply("Error: Invalid window \(argument)")
+                return
+            }
+            window = size
+            reply("200 window: \(size)")
+        
+        case "/ack":
+            guard let endpoint = inFlight.removeValue(forKey: argument) else {
+                reply("Error: Bundle \(argument) is not in flight")
+                return
+            }
+            await core.applicationAgent.acknowledge(argument, for: endpoint)
+            ring.yield()
+        
+        default:
+            reply("Error: Unknown command \(text)")
+        }
+    }
+    
+    /// Send a bundle the application framed according to the current mode
+    private func submit(_ bytes: [UInt8]) async {
+        do {
+            let bundle: BP7.Bundle
+            switch mode {
+            case .data:
+                let request = try CBORDecoder().decode(BundleSendRequest.self, from: bytes)
+                bundle = try makeBundle(request.src, request.dst, lifetime: request.lifetime, payload: Array(request.data))
+            
+            case .json:
+                let request = try JSONDecoder().decode(JSONSendRequest.self, from: Data(bytes))
+                guard let payload = Data(base64Encoded: request.data) else {
+                    throw ApplicationInterfaceError.serializationError("Payload is not base64")
+                }
+                bundle = try makeBundle(request.src, request.dst, lifetime: request.lifetime, payload: Array(payload))
+            
+            case .bundle:
+                bundle = try BP7.Bundle.decode(from: bytes)
+            }
+            
+            try await core.submitBundle(bundle)
+            reply("Sent bundle \(BundlePack.id(of: bundle)) with \(bundle.payload()?.count ?? 0) bytes")
+        } catch {
+            reply("Error: Failed to send bundle - \(error)")
+        }
+    }
+    
+    private func makeBundle(_ source: String, _ destination: String, lifetime: UInt64, payload: [UInt8]) throws -> BP7.Bundle {
+        // The lifetime comes in milliseconds
+        Daemon.makeBundle(
+            from: try EndpointID.from(source),
+            to: try EndpointID.from(destination),
+            lifetime: TimeInterval(lifetime) / 1000.0,
+            payload: payload
+        )
+    }
+    
+    /// An endpoint ID, or a service name on this node such as `incoming`
+    private func resolve(_ name: String) -> EndpointID? {
+        guard !name.isEmpty else { return nil }
+        if name.contains(":") {
+            return try? EndpointID.from(name)
+        }
+        var node = core.nodeId.description
+        while node.hasSuffix("/") {
+            node.removeLast()
+        }
+        return try? EndpointID.from("\(node)/\(name)")
+    }
+    
+    private func reply(_ text: String) {
+        replies.append(text)
+        ring.yield()
+    }
+    
+    // MARK: - Delivery
+    
+    /// The only writer on the connection
+    private func pushBundles() async throws {
+        for await _ in doorbell {
+            for text in replies {
+                try await outbound.write(.text(text))
+            }
+            replies.removeAll()
+            
+            try await pushQueued()
+        }
+    }
+    
+    /// Push queued bundles of every subscription while the window has room
+    private func pushQueued() async throws {
+        var pushed = true
+        while pushed {
+            pushed = false
+            for endpoint in subscriptions.keys {
+                let room = window > 0 ? window - inFlight.count : Self.batchSize
+                guard room > 0 else { return }
+                
+                let bundles = await core.applicationAgent.takeBundles(for: endpoint, limit: room)
+                for bundle in bundles {
+                    let bundleId = BundlePack.id(of: bundle)
+                    if window > 0 {
+                        inFlight[bundleId] = endpoint
+                    }
+                    try await write(try encode(bundle))
+                    if window == 0 {
+                        await core.applicationAgent.acknowledge(bundleId, for: endpoint)
+                    }
+                    pushed = true
+                }
+            }
+        }
+    }
+    
+    private func encode(_ bundle: BP7.Bundle) throws -> [UInt8] {
+        switch mode {
+        case .data:
+            let data = WsRecvData(
+                bid: BundlePack.id(of: bundle),
+                src: bundle.primary.source.description,
+                dst: bundle.primary.destination.description,
+                cts: bundle.primary.creationTimestamp.getDtnTime(),
+                lifetime: UInt64(bundle.primary.lifetime * 1000),
+                data: Data(bundle.payload() ?? [])
+            )
+            return try CBOREncoder().encode(data)
+        
+        case .json:
+            let data = JSONRecvData(
+                bid: BundlePack.id(of: bundle),
+                src: bundle.primary.source.description,
+                dst: bundle.primary.destination.description,
+                cts: bundle.primary.creationTimestamp.getDtnTime(),
+                lifetime: UInt64(bundle.primary.lifetime * 1000),
+                data: Data(bundle.payload() ?? []).base64EncodedString()
+            )
+            return Array(try JSONEncoder().encode(data))
+        
+        case .bundle:
+            return bundle.encode()
+        }
+    }
+    
+    /// Write one binary message, split into frames of at most `maxFrameSize` bytes
+    private func write(_ bytes: [UInt8]) async throws {
+        var offset = 0
+        repeat {
+            let end = min(bytes.count, offset + Self.maxFrameSize)
+            let frame = WebSocketFrame(
+                fin: end == bytes.count,
+                opcode: offset == 0 ? .binary : .continuation,
+                data: ByteBuffer(bytes: bytes[offset..<end])
+            )
+            try await outbound.write(.custom(frame))
+            offset = end
+        } while offset < bytes.count
+    }
+    
+    /// Hand unacknowledged bundles back to their mailboxes
+    private func close() async {
+        ring.finish()
+        for (endpoint, subscription) in subscriptions {
+            await core.applicationAgent.unsubscribe(endpoint, subscription: subscription)
+        }
+        subscriptions.removeAll()
+        inFlight.removeAll()
+    }
+}
+
+/// `WsRecvData` in JSON mode, with the payload base64 encoded
+private struct JSONRecvData: Codable {
+    let bid: String
+    let src: String
+    let dst: String
+    let cts: UInt64
+    let lifetime: UInt64
+    let data: String
+}
+
+/// `BundleSendRequest` in JSON mode, with the payload base64 encoded
+private struct JSONSendRequest: Codable {
+    let src: String
+    let dst: String
+    let delivery_notification: Bool?
+    let lifetime: UInt64
+    let data: String
+}
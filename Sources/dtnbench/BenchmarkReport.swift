@@ -0,0 +1,95 @@
+import Foundation
+
+/// One measured quantity of a benchmark run
+struct BenchmarkResult: Codable, Sendable {
+    let name: String
+    let unit: String
+    let value: Double
+    /// Smaller values are better (times, memory) rather than larger ones (rates)
+    let lowerIsBetter: Bool
+}
+
+/// The results of one `dtnbench` run, kept as JSON to compare later runs against
+struct BenchmarkReport: Codable, Sendable {
+    /// `micro` or `macro`
+    let suite: String
+    let date: Date
+    let host: String
+    /// The options the suite ran with; runs are only comparable with the same ones
+    let parameters: [String: String]
+    let results: [BenchmarkResult]
+    
+    init(suite: String, parameters: [String: String], results: [BenchmarkResult]) {
+        self.suite = suite
+        self.date = Date()
+        self.host = "\(ProcessInfo.processInfo.hostName) (\(ProcessInfo.processInfo.activeProcessorCount) cores, \(ProcessInfo.processInfo.operatingSystemVersionString))"
+        self.parameters = parameters
+        self.results = results
+    }
+    
+    static func read(from path: String) throws -> BenchmarkReport {
+        let decoder = JSONDecoder()
+        decoder.dateDecodingStrategy = .iso8601
+        return try decoder.decode(BenchmarkReport.self, from: Data(contentsOf: URL(fileURLWithPath: path)))
+    }
+    
+    func write(to path: String) throws {
+        let encoder = JSONEncoder()
+        encoder.outputFormatting = [.prettyPrinted, .sortedKeys]
+        encoder.dateEncodingStrategy = .iso8601
+        try encoder.encode(self).write(to: URL(fileURLWithPath: path))
+    }
+    
+    func printSummary() {
+        print("\(suite) benchmarks on \(host)")
+        let width = results.map(\.name.count).max() ?? 0
+        for result in results {
+            print("  \(result.name.padding(toLength: width, withPad: " ", startingAt: 0))  \(Self.format(result.value)) \(result.unit)")
+        }
+    }
+    
+    static func format(_ value: Double) -> String {
+        value >= 100 ? String(format: "%.0f", value) : String(format: "%.3f", value)
+    }
+}
+
+/// A result of one run set against the same result of a baseline run
+struct BenchmarkComparison {
+    let name: String
+    let unit: String
+    let baseline: Double
+    let current: Double
+    /// Relative change, positive when the value grew
+    let change: Double
+    /// Worse than the baseline by more than the threshold
+    let regressed: Bool
+    
+    /// Results present in both reports; `threshold` is the tolerated relative change, e.g. 0.1
+    static func compare(_ current: BenchmarkReport, against baseline: BenchmarkReport, threshold: Double) -> [BenchmarkComparison] {
+        let baselineResults = Dictionary(baseline.results.map { ($0.name, $0) }, uniquingKeysWith: { first, _ in first })
+        return current.results.compactMap { result in
+            guard let previous = baselineResults[result.name], previous.unit == result.unit else {
+                return nil
+            }
+            let change = previous.value == 0 ? 0 : (result.value - previous.value) / previous.value
+            return BenchmarkComparison(
+                name: result.name,
+                unit: result.unit,
+                baseline: previous.value,
+                current: result.value,
+                change: change,
+                regressed: result.lowerIsBetter ? change > threshold : change < -threshold
+            )
+        }
+    }
+    
+    /// Print the comparisons and return whether any regressed
+    static func printTable(_ comparisons: [BenchmarkComparison]) -> Bool {
+        let width = comparisons.map(\.name.count).max() ?? 0
+        for comparison in comparisons {
+            let change = String(format: "%+.1f%%", comparison.change * 100)
+            print("  \(comparison.name.padding(toLength: width, withPad: " ", startingAt: 0))  \(BenchmarkReport.format(comparison.baseline)) -> \(BenchmarkReport.format(comparison.current)) \(comparison.unit)  \(change)\(comparison.regressed ? "  REGRESSION" : "")")
+        }
+        return comparisons.contains { $0.regressed }
+    }
+}
@@ -0,0 +1,202 @@
+import Foundation
+import ArgumentParser
+
+@main
+struct DtnBench: AsyncParsableCommand {
+    static let configuration = CommandConfiguration(
+        commandName: "dtnbench",
+        abstract: "Benchmark the store, framing and routing in process, or a chain of dtnd nodes end to end",
+        subcommands: [Micro.self, Macro.self, Compare.self])
+}
+
+/// Where a run's results go and what they are held against
+struct ReportOptions: ParsableArguments {
+    @Option(name: .shortAndLong, help: "Write the results as JSON to this file")
+    var output: String?
+    
+    @Option(name: .shortAndLong, help: "Compare the results with those of an earlier run")
+    var baseline: String?
+    
+    @Option(name: .long, help: "Change against the baseline tolerated before a result counts as a regression, in percent")
+    var threshold: Double = 10
+    
+    /// Print, save and compare `report`; exits with status 1 if a result regressed
+    func finish(_ report: BenchmarkReport) throws {
+        report.printSummary()
+        if let output {
+            try report.write(to: output)
+            print("Results written to \(output)")
+        }
+        if let baseline {
+            print("Against \(baseline):")
+            let comparisons = BenchmarkComparison.compare(report, against: try BenchmarkReport.read(from: baseline), threshold: threshold / 100)
+            if BenchmarkComparison.printTable(comparisons) {
+                throw ExitCode(1)
+            }
+        }
+    }
+}
+
+extension DtnBench {
+    struct Micro: AsyncParsableCommand {
+        static let configuration = CommandConfiguration(
+            abstract: "Time CSQLiteStore push/get/scan, BundlePack construction, TCPCL framing and each routing agent")
+        
+        @Option(name: .long, help: "Bundles per run")
+        var bundles: Int = 2000
+        
+        @Option(name: .long, help: "Payload size in bytes")
+        var payloadSize: Int = 1024
+        
+        @Option(name: .long, help: "Peers known to the routing agents")
+        var peers: Int = 32
+        
+        @Option(name: .shortAndLong, help: "Runs per benchmark; the median is reported")
+        var repetitions: Int = 5
+        
+        @Option(name: .long, parsing: .upToNextOption, help: "Only run benchmarks whose name contains one of these (e.g. 'store' 'routing.epidemic')")
+        var filter: [String] = []
+        
+        @OptionGroup var report: ReportOptions
+        
+        func validate() throws {
+            guard bundles > 0, payloadSize >= 0, peers > 0, repetitions > 0 else {
+                throw ValidationError("bundles, peers and repetitions must be positive")
+            }
+        }
+        
+        func run() async throws {
+            let benchmarks = MicroBenchmarks(
+                bundleCount: bundles,
+                payloadSize: payloadSize,
+                peerCount: peers,
+                repetitions: repetitions,
+                filter: filter
+            )
+            let results = try await benchmarks.run()
+            try report.finish(BenchmarkReport(
+                suite: "micro",
+                parameters: [
+                    "bundles": "\(bundles)",
+                    "payload_size": "\(payloadSize)",
+                    "peers": "\(peers)",
+                    "repetitions": "\(repetitions)",
+                ],
+                results: results
+            ))
+        }
+    }
+    
+    struct Macro: AsyncParsableCommand {
+        static let configuration = CommandConfiguration(
+            abstract: "Run a chain of dtnd nodes and measure bundles/s, ping latency and memory")
+        
+        @Option(name: .long, help: "Directory with the dtnd, dtnping and dtnecho executables (default: next to dtnbench)")
+        var binDir: String?
+        
+        @Option(name: .shortAndLong, help: "Nodes in the chain, at least 2")
+        var nodes: Int = 3
+        
+        @Option(name: .long, help: "Bundles sent for the throughput run (0 skips it)")
+        var bundles: Int = 1000
+        
+        @Option(name: .long, help: "Payload size in bytes")
+        var payloadSize: Int = 1024
+        
+        @Option(name: .long, help: "Pings for the latency run (0 skips it)")
+        var pings: Int = 50
+        
+        @Option(name: .long, help: "Bundle submissions in flight at once")
+        var concurrency: Int = 16
+        
+        @Option(name: .shortAndLong, help: "Routing algorithm of every node")
+        var routing: String = "epidemic"
+        
+        @Option(name: .long, help: "Bundle store of every node: mem or sqlite")
+        var db: String = "mem"
+        
+        @Option(name: .long, help: "Web ports are base+1..base+n, TCPCL ports base+101..base+100+n")
+        var basePort: Int = 37000
+        
+        @Option(name: .long, help: "Seconds to wait for all bundles to arrive")
+        var timeout: Int = 60
+        
+        @Flag(name: .long, help: "Keep the node logs and stores")
+        var keepLogs = false
+        
+        @OptionGroup var report: ReportOptions
+        
+        func validate() throws {
+            guard nodes >= 2 else {
+                throw ValidationError("A chain needs at least 2 nodes")
+            }
+            guard bundles >= 0, pings >= 0, concurrency > 0, timeout > 0, payloadSize >= 0 else {
+                throw ValidationError("Counts must not be negative; concurrency and timeout must be positive")
+            }
+        }
+        
+        func run() async throws {
+            let binDirectory = binDir.map { URL(fileURLWithPath: $0) }
+                ?? Bundle.main.executableURL?.deletingLastPathComponent()
+                ?? URL(fileURLWithPath: ".")
+            let benchmark = MacroBenchmark(
+                binDirectory: binDirectory,
+                nodeCount: nodes,
+                bundleCount: bundles,
+                payloadSize: payloadSize,
+                pingCount: pings,
+                concurrency: concurrency,
+                routing: routing,
+                store: db,
+                basePort: basePort,
+                timeout: .seconds(timeout),
+                keepLogs: keepLogs
+            )
+            let results = try await benchmark.run()
+            try report.finish(BenchmarkReport(
+                suite: "macro",
+                parameters: [
+                    "nodes": "\(nodes)",
+                    "bundles": "\(bundles)",
+                    "payload_size": "\(payloadSize)",
+                    "pings": "\(pings)",
+                    "concurrency": "\(concurrency)",
+                    "routing": routing,
+                    "db": db,
+                ],
+                results: results
+            ))
+        }
+    }
+    
+    struct Compare: ParsableCommand {
+        static let configuration = CommandConfiguration(
+            abstract: "Compare two result files; exits with status 1 if a result regressed")
+        
+        @Argument(help: "Results of the earlier run")
+        var baseline: String
+        
+        @Argument(help: "Results of the run to check")
+        var current: String
+        
+        @Option(name: .long, help: "Change tolerated before a result counts as a regression, in percent")
+        var threshold: Double = 10
+        
+        func run() throws {
+            let baselineReport = try BenchmarkReport.read(from: baseline)
+            let currentReport = try BenchmarkReport.read(from: current)
+            if baselineReport.parameters != currentReport.parameters {
+                print("Warning: the runs used different parameters")
+            }
+            if BenchmarkComparison.printTable(BenchmarkComparison.compare(currentReport, against: baselineReport, threshold: threshold / 100)) {
+                throw ExitCode(1)
+            }
+        }
+    }
+}
+
+extension Duration {
+    var seconds: Double {
+        Double(components.seconds) + Double(components.attoseconds) / 1e18
+    }
+}
@@ -0,0 +1,290 @@
+import Foundation
+#if canImport(FoundationNetworking)
+import FoundationNetworking
+#endif
+
+/// Runs a chain of `dtnd` nodes on the loopback interface, connected by TCPCL
+/// static peers, and measures it from the outside. Node 1 is the source, the
+/// last node the destination and those in between relay.
+///
+/// Latency is the `dtnping` round trip to a `dtnecho` on the last node.
+/// Throughput is the rate at which bundles submitted to node 1 through `/send`,
+/// the API `dtnsend` uses, arrive at the last node.
+struct MacroBenchmark {
+    /// Directory holding the `dtnd`, `dtnping` and `dtnecho` executables
+    let binDirectory: URL
+    let nodeCount: Int
+    let bundleCount: Int
+    let payloadSize: Int
+    let pingCount: Int
+    /// Submissions to node 1 in flight at once
+    let concurrency: Int
+    let routing: String
+    let store: String
+    let basePort: Int
+    let timeout: Duration
+    let keepLogs: Bool
+    
+    private struct Node {
+        let index: Int
+        let webPort: Int
+        let tcpPort: Int
+        let process: Process
+        
+        var eid: String { "dtn://node\(index)" }
+    }
+    
+    private struct Stats: Decodable {
+        let incoming: UInt64
+    }
+    
+    enum HarnessError: Error, CustomStringConvertible {
+        case missingExecutable(String)
+        case nodeNotReady(Int, log: String)
+        case sendFailed(String)
+        
+        var description: String {
+            switch self {
+            case .missingExecutable(let path): return "Executable not found: \(path) (build first or pass --bin-dir)"
+            case .nodeNotReady(let index, let log): return "Node \(index) did not come up, see \(log)"
+            case .sendFailed(let message): return "Submitting a bundle failed: \(message)"
+            }
+        }
+    }
+    
+    func run() async throws -> [BenchmarkResult] {
+        for tool in ["dtnd", "dtnping", "dtnecho"] {
+            let path = binDirectory.appendingPathComponent(tool).path
+            guard FileManager.default.isExecutableFile(atPath: path) else {
+                throw HarnessError.missingExecutable(path)
+            }
+        }
+        
+        let workdir = FileManager.default.temporaryDirectory.appendingPathComponent("dtnbench-\(UUID().uuidString)")
+        try FileManager.default.createDirectory(at: workdir, withIntermediateDirectories: true)
+        var processes: [Process] = []
+        defer {
+            for process in processes where process.isRunning {
+                process.terminate()
+            }
+            if keepLogs {
+                print("Logs kept in \(workdir.path)")
+            } else {
+                try? FileManager.default.removeItem(at: workdir)
+            }
+        }
+        
+        var nodes: [Node] = []
+        for index in 1...nodeCount {
+            let node = try launchNode(index, workdir: workdir)
+            processes.append(node.process)
+            nodes.append(node)
+        }
+        for node in nodes {
+            try await waitUntilReady(node, log: workdir.appendingPathComponent("node\(node.index).log"))
+        }
+        let source = nodes[0]
+        let destination = nodes[nodes.count - 1]
+        
+        var results: [BenchmarkResult] = []
+        
+        // Round trips on the otherwise idle chain
+        if pingCount > 0 {
+            let echo = try launch("dtnecho", ["-p", "\(destination.webPort)", "--node", destination.eid], log: workdir.appendingPathComponent("echo.log"))
+            processes.append(echo)
+            // The echo service registers over its WebSocket after start
+            try await Task.sleep(for: .seconds(1))
+            
+            let pingLog = workdir.appendingPathComponent("ping.log")
+            let ping = try launch("dtnping", [
+                "-p", "\(source.webPort)", "--node", source.eid,
+                "-d", "\(destination.eid)/echo",
+                "-c", "\(pingCount)", "-s", "\(payloadSize)",
+                "-t", "\(min(5_000, Int(timeout.seconds * 1000)))", "--interval", "100",
+            ], log: pingLog)
+            processes.append(ping)
+            while ping.isRunning {
+                try await Task.sleep(for: .milliseconds(20))
+            }
+            
+            let latencies = Self.pingLatencies(in: (try? String(contentsOf: pingLog, encoding: .utf8)) ?? "").sorted()
+            results.append(BenchmarkResult(name: "macro.ping.answered", unit: "fraction", value: Double(latencies.count) / Double(pingCount), lowerIsBetter: false))
+            if !latencies.isEmpty {
+                results.append(BenchmarkResult(name: "macro.latency.p50", unit: "ms", value: Self.percentile(latencies, 0.5), lowerIsBetter: true))
+                results.append(BenchmarkResult(name: "macro.latency.p99", unit: "ms", value: Self.percentile(latencies, 0.99), lowerIsBetter: true))
+            }
+        }
+        
+        // Bulk transfer end to end
+        if bundleCount > 0 {
+            let before = try await incoming(at: destination)
+            let clock = ContinuousClock()
+            let start = clock.now
+            
+            let port = source.webPort
+            let sender = "\(source.eid)/bench"
+            let receiver = "\(destination.eid)/bench"
+            let size = payloadSize
+            try await withThrowingTaskGroup(of: Void.self) { group in
+                for index in 0..<bundleCount {
+                    if index >= concurrency {
+                        _ = try await group.next()
+                    }
+                    group.addTask {
+                        try await Self.submit(index, port: port, from: sender, to: receiver, payloadSize: size)
+                    }
+                }
+                try await group.waitForAll()
+            }
+            let submitted = clock.now - start
+            
+            let deadline = clock.now + timeout
+            var arrived: UInt64 = 0
+            while clock.now < deadline {
+                arrived = try await incoming(at: destination) - before
+                if arrived >= UInt64(bundleCount) {
+                    break
+                }
+                try await Task.sleep(for: .milliseconds(10))
+            }
+            let elapsed = clock.now - start
+            
+            results.append(BenchmarkResult(name: "macro.submit_rate", unit: "bundles/s", value: Double(bundleCount) / submitted.seconds, lowerIsBetter: false))
+            results.append(BenchmarkResult(name: "macro.throughput", unit: "bundles/s", value: Double(min(arrived, UInt64(bundleCount))) / elapsed.seconds, lowerIsBetter: false))
+            results.append(BenchmarkResult(name: "macro.delivered", unit: "fraction", value: Double(min(arrived, UInt64(bundleCount))) / Double(bundleCount), lowerIsBetter: false))
+        }
+        
+        // Memory after the load
+        var largest = 0.0
+        for node in nodes {
+            guard let resident = Self.residentKiB(of: node.process.processIdentifier) else { continue }
+            largest = max(largest, resident)
+            results.append(BenchmarkResult(name: "macro.rss.node\(node.index)", unit: "KiB", value: resident, lowerIsBetter: true))
+        }
+        if largest > 0 {
+            results.append(BenchmarkResult(name: "macro.rss.max", unit: "KiB", value: largest, lowerIsBetter: true))
+        }
+        
+        return results
+    }
+    
+    // MARK: - Nodes
+    
+    private func launchNode(_ index: Int, workdir: URL) throws -> Node {
+        let directory = workdir.appendingPathComponent("node\(index)")
+        try FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true)
+        
+        let neighbours = [index - 1, index + 1].filter { (1...nodeCount).contains($0) }
+        let arguments = [
+            "-n", "dtn://node\(index)",
+            "-W", directory.path,
+            "-w", "\(webPort(of: index))",
+            "-r", routing,
+            "-D", store,
+            "--disable-nd",
+            "-C", "tcp:port=\(tcpPort(of: index)):bind=127.0.0.1",
+            "-s",
+        ] + neighbours.map { "tcp://127.0.0.1:\(tcpPort(of: $0))/node\($0)" }
+        
+        let process = try launch("dtnd", arguments, log: workdir.appendingPathComponent("node\(index).log"))
+        return Node(index: index, webPort: webPort(of: index), tcpPort: tcpPort(of: index), process: process)
+    }
+    
+    private func webPort(of index: Int) -> Int { basePort + index }
+    
+    private func tcpPort(of index: Int) -> Int { basePort + 100 + index }
+    
+    private func launch(_ tool: String, _ arguments: [String], log: URL) throws -> Process {
+        FileManager.default.createFile(atPath: log.path, contents: nil)
+        let output = try FileHandle(forWritingTo: log)
+        
+        let process = Process()
+        process.executableURL = binDirectory.appendingPathComponent(tool)
+        process.arguments = arguments
+        // The tools prefer DTN_WEB_PORT over their port option
+        var environment = ProcessInfo.processInfo.environment
+        environment.removeValue(forKey: "DTN_WEB_PORT")
+        process.environment = environment
+        process.standardOutput = output
+        process.standardError = output
+        try process.run()
+        return process
+    }
+    
+    private func waitUntilReady(_ node: Node, log: URL) async throws {
+        let url = URL(string: "http://127.0.0.1:\(node.webPort)/status")!
+        let deadline = ContinuousClock.now + .seconds(30)
+        while ContinuousClock.now < deadline && node.process.isRunning {
+            let response = try? await URLSession.shared.data(from: url).1
+            if (response as? HTTPURLResponse)?.statusCode == 200 {
+                return
+            }
+            try await Task.sleep(for: .milliseconds(100))
+        }
+        throw HarnessError.nodeNotReady(node.index, log: log.path)
+    }
+    
+    private func incoming(at node: Node) async throws -> UInt64 {
+        let (data, _) = try await URLSession.shared.data(from: URL(string: "http://127.0.0.1:\(node.webPort)/stats")!)
+        return try JSONDecoder().decode(Stats.self, from: data).incoming
+    }
+    
+    private static func submit(_ index: Int, port: Int, from source: String, to destination: String, payloadSize: Int) async throws {
+        var components = URLComponents(string: "http://127.0.0.1:\(port)/send")!
+        components.queryItems = [
+            URLQueryItem(name: "dst", value: destination),
+            URLQueryItem(name: "src", value: source),
+        ]
+        var request = URLRequest(url: components.url!)
+        request.httpMethod = "POST"
+        request.setValue("application/octet-stream", forHTTPHeaderField: "Content-Type")
+        
+        // Distinct payloads, so no two bundles share their content
+        var payload = Data(repeating: 0x61, count: max(8, payloadSize))
+        withUnsafeBytes(of: UInt64(index).bigEndian) { payload.replaceSubrange(0..<8, with: $0) }
+        
+        let (data, response) = try await URLSession.shared.upload(for: request, from: payload)
+        let message = String(decoding: data, as: UTF8.self)
+        guard (response as? HTTPURLResponse)?.statusCode == 200, message.hasPrefix("Bundle sent") else {
+            throw HarnessError.sendFailed(message)
+        }
+    }
+    
+    // MARK: - Measurements
+    
+    /// Round trips in milliseconds from `dtnping` reply lines, `[<] #3 : 1.234ms`
+    static func pingLatencies(in output: String) -> [Double] {
+        output.split(separator: "\n").compactMap { line in
+            guard line.hasPrefix("[<]"), line.hasSuffix("ms"), let colon = line.lastIndex(of: ":") else {
+                return nil
+            }
+            return Double(line[line.index(after: colon)...].dropLast(2).trimmingCharacters(in: .whitespaces))
+        }
+    }
+    
+    /// Nearest-rank percentile of ascending `values`
+    static func percentile(_ values: [Double], _ fraction: Double) -> Double {
+        let rank = Int((fraction * Double(values.count)).rounded(.up))
+        return values[min(values.count - 1, max(0, rank - 1))]
+    }
+    
+    /// Peak resident set size on Linux (`VmHWM`), the current one from `ps` elsewhere
+    static func residentKiB(of pid: Int32) -> Double? {
+        if let status = try? String(contentsOfFile: "/proc/\(pid)/status", encoding: .utf8) {
+            for line in status.split(separator: "\n") where line.hasPrefix("VmHWM:") {
+                let fields = line.split(whereSeparator: \.isWhitespace)
+                return fields.count >= 2 ? Double(fields[1]) : nil
+            }
+        }
+        
+        let ps = Process()
+        ps.executableURL = URL(fileURLWithPath: "/bin/ps")
+        ps.arguments = ["-o", "rss=", "-p", "\(pid)"]
+        let pipe = Pipe()
+        ps.standardOutput = pipe
+        guard (try? ps.run()) != nil else { return nil }
+        let output = pipe.fileHandleForReading.readDataToEndOfFile()
+        ps.waitUntilExit()
+        return Double(String(decoding: output, as: UTF8.self).trimmingCharacters(in: .whitespacesAndNewlines))
+    }
+}
@@ -0,0 +1,257 @@
+import Foundation
+import DTN7
+import BP7
+import NIOCore
+
+/// In-process benchmarks of the work a relay does per bundle: building its
+/// metadata, storing and reading it, framing it for TCPCL and routing it.
+/// Each is reported as the median time per bundle over several runs.
+struct MicroBenchmarks {
+    let bundleCount: Int
+    let payloadSize: Int
+    let peerCount: Int
+    let repetitions: Int
+    /// Only benchmarks whose name contains one of these run; empty runs all
+    let filter: [String]
+    
+    func run() async throws -> [BenchmarkResult] {
+        let recorder = Recorder(repetitions: repetitions, filter: filter)
+        let clock = ContinuousClock()
+        let bundles = makeBundles()
+        let packs = bundles.map { BundlePack(from: $0) }
+        
+        await recorder.measure("bundlepack.init", operations: bundles.count) {
+            clock.measure {
+                for bundle in bundles {
+                    blackHole(BundlePack(from: bundle))
+                }
+            }
+        }
+        
+        try await benchmarkStores(bundles, packs: packs, recorder: recorder)
+        try await benchmarkFraming(bundles.map { $0.encode() }, recorder: recorder)
+        try await benchmarkRouting(packs, recorder: recorder)
+        return recorder.results
+    }
+    
+    // MARK: - Suites
+    
+    private func benchmarkStores(_ bundles: [BP7.Bundle], packs: [BundlePack], recorder: Recorder) async throws {
+        let clock = ContinuousClock()
+        let ids = packs.map(\.id)
+        
+        try await recorder.measure("store.sqlite.push", operations: bundles.count) {
+            try await withTemporaryStore { store in
+                try await clock.measure {
+                    for bundle in bundles {
+                        try await store.push(bundle: bundle)
+                    }
+                }
+            }
+        }
+        
+        try await recorder.measure("store.sqlite.push_batch", operations: bundles.count) {
+            try await withTemporaryStore { store in
+                try await clock.measure {
+                    try await store.pushBatch(bundles: bundles)
+                }
+            }
+        }
+        
+        if recorder.selects("store.sqlite.get") || recorder.selects("store.sqlite.scan") {
+            try await withTemporaryStore { store in
+                try await store.pushBatch(bundles: bundles)
+                
+                await recorder.measure("store.sqlite.get", operations: ids.count) {
+                    await clock.measure {
+                        for bundleId in ids {
+                            blackHole(await store.getBundleBytes(bundleId: bundleId))
+                        }
+                    }
+                }
+                
+                await recorder.measure("store.sqlite.scan", operations: ids.count) {
+                    await clock.measure {
+                        blackHole(await store.allBundles())
+                    }
+                }
+            }
+        }
+        
+        try await recorder.measure("store.memory.push", operations: bundles.count) {
+            let store = InMemoryBundleStore()
+            return try await clock.measure {
+                for bundle in bundles {
+                    try await store.push(bundle: bundle)
+                }
+            }
+        }
+        
+        if recorder.selects("store.memory.get") {
+            let store = InMemoryBundleStore()
+            try await store.pushBatch(bundles: bundles)
+            await recorder.measure("store.memory.get", operations: ids.count) {
+                await clock.measure {
+                    for bundleId in ids {
+                        blackHole(await store.getBundleBytes(bundleId: bundleId))
+                    }
+                }
+            }
+        }
+    }
+    
+    private func benchmarkFraming(_ encoded: [[UInt8]], recorder: Recorder) async throws {
+        let clock = ContinuousClock()
+        let segments = encoded.enumerated().map { index, bundle in
+            TCPCLMessage.xferSegment(
+                flags: TCPCLMessage.segmentStart | TCPCLMessage.segmentEnd,
+                transferId: UInt64(index),
+                extensionItems: [.transferLength(UInt64(bundle.count))],
+                data: Data(bundle)
+            )
+        }
+        
+        await recorder.measure("tcpcl.encode", operations: segments.count) {
+            clock.measure {
+                for segment in segments {
+                    blackHole(segment.encode())
+                }
+            }
+        }
+        
+        // One session's worth of reads: the contact header, then every segment, in 64 KiB chunks
+        var stream = Data([0x64, 0x74, 0x6E, 0x21, 0x04, 0x00])
+        for segment in segments {
+            stream.append(segment.encode())
+        }
+        let chunks = stride(from: 0, to: stream.count, by: 65_536).map {
+            ByteBuffer(bytes: stream[$0..<min($0 + 65_536, stream.count)])
+        }
+        let maxSegmentLength = UInt64(encoded.map(\.count).max() ?? 0)
+        
+        try await recorder.measure("tcpcl.decode", operations: segments.count) {
+            try clock.measure {
+                var processor = NIOSingleStepByteToMessageProcessor(TCPCLFrameDecoder(maxSegmentLength: maxSegmentLength))
+                for chunk in chunks {
+                    try processor.process(buffer: chunk) { blackHole($0) }
+                }
+            }
+        }
+    }
+    
+    private func benchmarkRouting(_ packs: [BundlePack], recorder: Recorder) async throws {
+        let clock = ContinuousClock()
+        let core = DtnCore(nodeId: try EndpointID.from("dtn://bench"), store: InMemoryBundleStore(), config: DtnConfig())
+        let peerManager = PeerManager()
+        for index in 0..<peerCount {
+            await peerManager.addOrUpdatePeer(DtnPeer(
+                eid: try EndpointID.from("dtn://peer\(index)"),
+                addr: .ip(host: "127.0.0.1", port: 4556 + index),
+                conType: .static,
+                period: nil,
+                claList: [("tcp", UInt16(4556 + index))],
+                services: [:],
+                lastContact: Date().timeIntervalSince1970,
+                fails: 0
+            ))
+        }
+        
+        // Every destination goes through the first peer
+        let routesFile = FileManager.default.temporaryDirectory.appendingPathComponent("dtnbench-routes-\(UUID().uuidString).txt")
+        try "1 * * dtn://peer0\n".write(to: routesFile, atomically: true, encoding: .utf8)
+        defer { try? FileManager.default.removeItem(at: routesFile) }
+        
+        let agents: [(String, any RoutingAgent)] = [
+            ("epidemic", EpidemicRouting()),
+            ("flooding", FloodingRouting()),
+            ("sprayandwait", SprayAndWaitRouting()),
+            ("static", StaticRouting(routesFile: routesFile.path)),
+            ("sink", SinkRouting()),
+        ]
+        for (name, agent) in agents where recorder.selects("routing.\(name).next_hops") {
+            await agent.configure(peerManager: peerManager, core: core)
+            try await agent.start()
+            await recorder.measure("routing.\(name).next_hops", operations: packs.count) {
+                await clock.measure {
+                    blackHole(await agent.getNextHops(for: packs))
+                }
+            }
+            try await agent.stop()
+        }
+    }
+    
+    // MARK: - Helpers
+    
+    /// Bundles to 100 destinations, none of them a known peer, with distinct payloads
+    private func makeBundles() -> [BP7.Bundle] {
+        let source = try! EndpointID.from("dtn://bench/source")
+        var state: UInt64 = 0x9E37_79B9_7F4A_7C15
+        return (0..<bundleCount).map { index in
+            let payload = (0..<payloadSize).map { _ -> UInt8 in
+                // xorshift64, so payloads neither repeat nor compress
+                state ^= state << 13
+                state ^= state >> 7
+                state ^= state << 17
+                return UInt8(truncatingIfNeeded: state)
+            }
+            let primary = PrimaryBlock(
+                bundleControlFlags: BundleControlFlags(),
+                destination: try! EndpointID.from("dtn://dest\(index % 100)/inbox"),
+                source: source,
+                reportTo: source,
+                creationTimestamp: CreationTimestamp(time: 0, sequenceNumber: UInt64(index)),
+                lifetime: 3600
+            )
+            let payloadBlock = CanonicalBlock(
+                blockType: BlockType.payload.rawValue,
+                blockNumber: 1,
+                blockControlFlags: 0,
+                crc: .crc32(0),
+                data: .data(payload)
+            )
+            return BP7.Bundle(primary: primary, canonicals: [payloadBlock])
+        }
+    }
+    
+    private func withTemporaryStore<T>(_ body: (CSQLiteStore) async throws -> T) async throws -> T {
+        let path = FileManager.default.temporaryDirectory.appendingPathComponent("dtnbench-\(UUID().uuidString).db").path
+        defer {
+            for suffix in ["", "-wal", "-shm"] {
+                try? FileManager.default.removeItem(atPath: path + suffix)
+            }
+        }
+        return try await body(try CSQLiteStore(path: path))
+    }
+}
+
+/// Runs the selected benchmarks and keeps the median time per operation of each
+private final class Recorder {
+    let repetitions: Int
+    let filter: [String]
+    private(set) var results: [BenchmarkResult] = []
+    
+    init(repetitions: Int, filter: [String]) {
+        self.repetitions = repetitions
+        self.filter = filter
+    }
+    
+    func selects(_ name: String) -> Bool {
+        filter.isEmpty || filter.contains { name.contains($0) }
+    }
+    
+    /// `run` performs `operations` operations and returns how long the timed part took
+    func measure(_ name: String, operations: Int, _ run: () async throws -> Duration) async rethrows {
+        guard selects(name) else { return }
+        
+        var samples: [Double] = []
+        for _ in 0..<repetitions {
+            samples.append(try await run().seconds * 1e9 / Double(max(1, operations)))
+        }
+        samples.sort()
+        results.append(BenchmarkResult(name: name, unit: "ns/op", value: samples[samples.count / 2], lowerIsBetter: true))
+    }
+}
+
+/// Keeps the optimizer from dropping work whose result is unused
+@inline(never)
+func blackHole<T>(_ value: T) {}
@@ -36,12 +36,18 @@ struct Dtnd: AsyncParsableCommand {
     @Option(name: [.customShort("w"), .long], help: "Sets web interface port")
     var webPort: UInt16 = 3000
     
+    @Option(name: .long, help: "Sets the largest payload accepted by /send and body by /send/batch, in bytes")
+    var maxSendPayload: Int?
+    
     @Option(name: .shortAndLong, help: "Sets service discovery interval (e.g., '2s', '3m')")
     var interval: String?
     
     @Option(name: .shortAndLong, help: "Sets janitor interval for cleanup")
     var janitor: String?
     
+    @Option(name: .long, help: "Sets the interval between snapshots of duplicate and routing state (e.g. 60s; 0s saves them only on shutdown)")
+    var stateInterval: String?
+    
     @Option(name: [.customShort("p"), .long], help: "Sets timeout to remove peer")
     var peerTimeout: String = "20s"
     
@@ -73,9 +79,21 @@ struct Dtnd: AsyncParsableCommand {
     var disableNd = false
     
     // Storage
-    @Option(name: [.customShort("D"), .long], help: "Set bundle store: mem, sled, sneakers")
+    @Option(name: [.customShort("D"), .long], help: "Set bundle store: mem, sled, sneakers, segment")
     var db: String = "mem"
     
+    @Option(name: .long, parsing: .upToNextOption, help: "Set bundle store options (e.g., 'journal_mode=WAL', 'synchronous=normal', 'mmap_size=268435456')")
+    var dbOption: [String] = []
+    
+    @Option(name: .long, parsing: .upToNextOption, help: "Set duplicate filter options (e.g., 'exact_capacity=10000', 'filter_capacity=100000', 'fp_rate=0.0001', 'window=86400')")
+    var dedupOption: [String] = []
+    
+    @Option(name: .long, parsing: .upToNextOption, help: "Set transmission scheduling options (e.g., 'priority.dtn://*/telemetry=0', 'weight.dtn://ground/*=3', 'bandwidth.udp=125000')")
+    var scheduleOption: [String] = []
+    
+    @Option(name: .long, parsing: .upToNextOption, help: "Set tracing options (e.g., 'sample=0.01', 'capacity=4096', 'otlp_endpoint=http://localhost:4318/v1/traces')")
+    var traceOption: [String] = []
+    
     // Advanced Options
     @Option(name: [.customShort("S"), .long], parsing: .upToNextOption, help: "Add custom services with specific tags")
     var service: [String] = []
@@ -83,7 +101,7 @@ struct Dtnd: AsyncParsableCommand {
     @Flag(name: [.customShort("g"), .long], help: "Generate status report bundles")
     var generateStatusReports = false
     
-    @Flag(name: .long, help: "Process bundles in parallel")
+    @Flag(name: .long, help: "Process bundles in parallel, sharded by bundle across all cores")
     var parallelBundleProcessing = false
     
     @Flag(name: [.customShort("U"), .long], help: "Allow httpd RPC calls from anywhere")
@@ -119,6 +137,9 @@ struct Dtnd: AsyncParsableCommand {
         
         config.endpoints = endpoint
         config.webPort = webPort
+        if let maxSendPayload = maxSendPayload {
+            config.maxSendPayload = max(1, maxSendPayload)
+        }
         
         // Parse time intervals
         if let interval = interval {
@@ -127,6 +148,9 @@ struct Dtnd: AsyncParsableCommand {
         if let janitor = janitor {
             config.janitorInterval = parseHumanTime(janitor)
         }
+        if let stateInterval = stateInterval {
+            config.stateSnapshotInterval = parseHumanTime(stateInterval)
+        }
         config.peerTimeout = parseHumanTime(peerTimeout)
         
         config.routing = routing
@@ -188,6 +212,37 @@ struct Dtnd: AsyncParsableCommand {
         config.disableNeighbourDiscovery = disableNd
         config.db = db
         
+        // Parse store options
+        for option in dbOption {
+            let kvParts = option.split(separator: "=", maxSplits: 1)
+            if kvParts.count == 2 {
+                config.dbSettings[String(kvParts[0])] = String(kvParts[1])
+            }
+        }
+        
+        // Parse duplicate filter options
+        for option in dedupOption {
+            let kvParts = option.split(separator: "=", maxSplits: 1)
+            if kvParts.count == 2 {
+                config.dedupSettings[String(kvParts[0])] = String(kvParts[1])
+            }
+        }
+        
+        // Parse scheduling options, splitting at the last '=' since EID patterns may contain one
+        for option in scheduleOption {
+            if let separator = option.lastIndex(of: "=") {
+                config.schedulerSettings[String(option[..<separator])] = String(option[option.index(after: separator)...])
+            }
+        }
+        
+        // Parse tracing options
+        for option in traceOption {
+            let kvParts = option.split(separator: "=", maxSplits: 1)
+            if kvParts.count == 2 {
+                config.traceSettings[String(kvParts[0])] = String(kvParts[1])
+            }
+        }
+        
         // Parse services
         var services: [UInt8: String] = [:]
         for service in service {
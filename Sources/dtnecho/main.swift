@@ -19,6 +19,9 @@ struct DTNEcho: AsyncParsableCommand {
     @Flag(name: .shortAndLong, help: "Verbose output")
     var verbose: Bool = false
     
+    @Option(name: .long, help: "Node ID of the local daemon")
+    var node: String = "dtn://node1"
+    
     func run() async throws {
         // Get port from environment or command line
         let actualPort: UInt16
@@ -35,8 +38,7 @@ struct DTNEcho: AsyncParsableCommand {
         let wsInterface = WebSocketApplicationInterface(host: host, port: Int(actualPort))
         try await wsInterface.connect()
         
-        // Get node ID from daemon status
-        let nodeIdStr = "dtn://node1" // Default, will be replaced if we can get actual node ID
+        let nodeIdStr = node
         
         // Create DTN client
         let client = DTNClient(
@@ -31,6 +31,15 @@ struct DTNPing: AsyncParsableCommand {
     @Option(name: .shortAndLong, help: "Timeout to wait for reply in milliseconds")
     var timeout: Int = 5000
     
+    @Option(name: .long, help: "Pause between pings in milliseconds")
+    var interval: Int = 1000
+    
+    @Option(name: .long, help: "Node ID of the local daemon")
+    var node: String = "dtn://node1"
+    
+    @Option(name: .shortAndLong, help: "Pings in flight at once")
+    var window: Int = 1
+    
     func run() async throws {
         // Get port from environment or command line
         let actualPort: UInt16
@@ -43,8 +52,7 @@ struct DTNPing: AsyncParsableCommand {
         
         let host = ipv6 ? "::1" : "127.0.0.1"
         
-        // Get node ID (default)
-        let nodeIdStr = "dtn://node1" // Default node ID
+        let nodeIdStr = node
         
         // Create DTN client
         let client = DTNClient(
@@ -61,12 +69,12 @@ struct DTNPing: AsyncParsableCommand {
         // Determine endpoint based on scheme
         let endpoint = nodeIdStr.hasPrefix("dtn://") ? "ping" : "7007"
         
-        // Register endpoint
+        // Register endpoint; replies are matched to pings by the sequence number leading their payload
         let fullEndpoint = "\(nodeIdStr)/\(endpoint)"
-        var receivedBundles: [ReceivedBundle] = []
+        let (replies, replyContinuation) = AsyncStream.makeStream(of: ReceivedBundle.self)
         
         try await client.registerService(endpoint) { bundle in
-            receivedBundles.append(bundle)
+            replyContinuation.yield(bundle)
         }
         
         if verbose {
@@ -75,80 +83,155 @@ struct DTNPing: AsyncParsableCommand {
         
         print("\nPING: \(fullEndpoint) -> \(destination)")
         
-        var sequenceNumber: Int = 0
-        var successfulPings: Int = 0
+        let pings = PingWindow(size: window)
+        let verbose = self.verbose
         
-        while count < 0 || sequenceNumber < count {
-            sequenceNumber += 1
-            
-            // Generate random payload
-            let payload = generateRandomPayload(size: size)
-            
-            print("[>] #\(sequenceNumber) size=\(size)")
-            fflush(stdout)
-            
-            let startTime = Date()
-            
-            // Clear received bundles
-            receivedBundles.removeAll()
-            
-            // Send ping bundle
-            try await client.sendBundle(
-                to: destination,
-                payload: payload,
-                lifetime: 3600 * 24 // 24 hours
-            )
-            
-            // Wait for reply with timeout
-            let timeoutNanos = UInt64(timeout) * 1_000_000
-            let startNanos = DispatchTime.now().uptimeNanoseconds
+        let receiver = Task {
+            for await reply in replies {
+                guard let sequenceNumber = Self.sequenceNumber(of: reply),
+                      let elapsed = await pings.complete(sequenceNumber) else {
+                    continue
+                }
+                print("[<] #\(sequenceNumber) : \(String(format: "%.3f", elapsed * 1000))ms")
             
-            var replyReceived = false
-            while DispatchTime.now().uptimeNanoseconds - startNanos < timeoutNanos {
-                if !receivedBundles.isEmpty {
-                    let replyBundle = receivedBundles[0]
-                    let elapsed = Date().timeIntervalSince(startTime)
-                    print("[<] #\(sequenceNumber) : \(String(format: "%.3f", elapsed * 1000))ms")
-                    successfulPings += 1
-                    
-                    if verbose {
-                        print("    Bundle-Id: \(replyBundle.bundleId)")
-                        print("    From: \(replyBundle.source)")
-                        print("    To: \(replyBundle.destination)")
-                        if let payloadStr = replyBundle.text {
-                            print("    Data: \(payloadStr)")
-                        }
+                if verbose {
+                    print("    Bundle-Id: \(reply.bundleId)")
+                    print("    From: \(reply.source)")
+                    print("    To: \(reply.destination)")
+                    if let payloadStr = reply.text {
+                        print("    Data: \(payloadStr)")
                     }
-                    
-                    replyReceived = true
-                    break
                 }
+            }
+        }
+        
+        let count = self.count
+        let size = self.size
+        let interval = self.interval
+        let destination = self.destination
+        let sender = Task {
+            var sequenceNumber = 0
+            while count < 0 || sequenceNumber < count {
+                sequenceNumber += 1
+        
+                // Wait for room in the window
+                await pings.start(sequenceNumber)
+                
+                print("[>] #\(sequenceNumber) size=\(size)")
+                fflush(stdout)
                 
-                // Small sleep to avoid busy waiting
-                try await Task.sleep(nanoseconds: 10_000_000) // 10ms
+                // Send ping bundle; one that fails to go out times out like a lost one
+                do {
+                    try await client.sendBundle(
+                        to: destination,
+                        payload: Self.payload(sequenceNumber, size: size),
+                        lifetime: 3600 * 24 // 24 hours
+                    )
+                } catch {
+                    print("[!] #\(sequenceNumber) failed to send: \(error)")
+                }
+                
+                if (count < 0 || sequenceNumber < count) && interval > 0 {
+                    try? await Task.sleep(nanoseconds: UInt64(interval) * 1_000_000)
+                }
             }
-            
-            if !replyReceived {
-                print("[!] *** timeout ***")
+            await pings.finish()
+        }
+        
+        // Time out pings until every one is answered or given up on
+        let timeoutSeconds = Double(timeout) / 1000
+        while true {
+            for sequenceNumber in await pings.expire(after: timeoutSeconds) {
+                print("[!] #\(sequenceNumber) *** timeout ***")
             }
-            
-            // Wait 1 second between pings
-            if count < 0 || sequenceNumber < count {
-                try await Task.sleep(nanoseconds: 1_000_000_000)
+            if await pings.finished, await pings.outstanding == 0 {
+                break
             }
+            
+            // Small sleep to avoid busy waiting
+            try await Task.sleep(nanoseconds: 10_000_000) // 10ms
         }
+        sender.cancel()
+        receiver.cancel()
         
-        print("\n[*] \(successfulPings) of \(sequenceNumber) pings successful")
+        let sent = await pings.started
+        let successfulPings = await pings.answered
+        print("\n[*] \(successfulPings) of \(sent) pings successful")
         
-        if successfulPings < sequenceNumber {
+        if successfulPings < sent {
             throw ExitCode(1)
         }
     }
     
-    private func generateRandomPayload(size: Int) -> Data {
+    /// The sequence number, then random letters up to `size` bytes
+    private static func payload(_ sequenceNumber: Int, size: Int) -> Data {
+        let prefix = "\(sequenceNumber) "
+        return Data((prefix + generateRandomPayload(size: max(0, size - prefix.utf8.count))).utf8)
+    }
+    
+    private static func sequenceNumber(of reply: ReceivedBundle) -> Int? {
+        reply.text?.split(separator: " ", maxSplits: 1).first.flatMap { Int($0) }
+    }
+    
+    private static func generateRandomPayload(size: Int) -> String {
         let letters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
-        let randomString = String((0..<size).map { _ in letters.randomElement()! })
-        return randomString.data(using: .utf8) ?? Data()
+        return String((0..<size).map { _ in letters.randomElement()! })
+    }
+}
+
+/// Pings in flight: at most `size` are unanswered, and a new one waits for a slot
+actor PingWindow {
+    let size: Int
+    private var sentAt: [Int: ContinuousClock.Instant] = [:]
+    private var waiting: [CheckedContinuation<Void, Never>] = []
+    private(set) var started = 0
+    private(set) var answered = 0
+    /// Set once every ping has been sent
+    private(set) var finished = false
+    
+    init(size: Int) {
+        self.size = max(1, size)
+    }
+    
+    var outstanding: Int { sentAt.count }
+    
+    /// Take a slot for ping `sequenceNumber`, waiting while the window is full
+    func start(_ sequenceNumber: Int) async {
+        while sentAt.count >= size {
+            await withCheckedContinuation { waiting.append($0) }
+        }
+        sentAt[sequenceNumber] = .now
+        started += 1
+    }
+    
+    /// Round trip of an answered ping in seconds, nil if it was not outstanding
+    func complete(_ sequenceNumber: Int) -> Double? {
+        guard let start = sentAt.removeValue(forKey: sequenceNumber) else { return nil }
+        answered += 1
+        release()
+        let elapsed = ContinuousClock.now - start
+        return Double(elapsed.components.seconds) + Double(elapsed.components.attoseconds) / 1e18
+    }
+    
+    /// Give up on pings unanswered for longer than `timeout` seconds
+    func expire(after timeout: Double) -> [Int] {
+        let deadline = ContinuousClock.now - .milliseconds(Int64(timeout * 1000))
+        let expired = sentAt.filter { $0.value < deadline }.keys.sorted()
+        for sequenceNumber in expired {
+            sentAt.removeValue(forKey: sequenceNumber)
+            release()
+        }
+        return expired
+    }
+    
+    func finish() {
+        finished = true
+    }
+    
+    private func release() {
+        if !waiting.isEmpty {
+            waiting.removeFirst().resume()
+        }
     }
 }
 
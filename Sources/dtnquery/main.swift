@@ -69,7 +69,8 @@ extension DtnQuery {
                         for peer in peers {
                             if let eid = peer["eid"] as? String,
                                let type = peer["type"] as? String {
-                                print("- \(eid) [\(type)]")
+                                let queued = peer["queueDepth"] as? Int ?? 0
+                                print("- \(eid) [\(type)]\(queued > 0 ? " \(queued) queued" : "")")
                             }
                         }
                     } else {
@@ -115,81 +115,56 @@ struct DtnRecv: AsyncParsableCommand {
                 print("Connecting to daemon at \(baseURL)")
             }
             
-            // First register the endpoint
-            let registerUrl = URL(string: "\(baseURL)/register?endpoint=\(receiveEndpoint.addingPercentEncoding(withAllowedCharacters: .urlQueryAllowed) ?? receiveEndpoint)")!
+            // The daemon pushes bundles as they arrive; in hex and raw mode it sends them whole
+            let interface = WebSocketApplicationInterface(
+                host: ipv6 ? "::1" : "127.0.0.1",
+                port: Int(port),
+                mode: hex || raw ? .bundle : .data
+            )
             do {
-                let (_, response) = try await URLSession.shared.data(from: registerUrl)
-                if let httpResponse = response as? HTTPURLResponse, httpResponse.statusCode != 200 {
-                    print("Warning: Failed to register endpoint \(receiveEndpoint)")
-                }
+                try await interface.connect()
+                try await interface.registerEndpoint(receiveEndpoint)
             } catch {
-                print("Warning: Failed to register endpoint: \(error)")
+                print("Error: Failed to subscribe to \(receiveEndpoint): \(error)")
+                throw ExitCode.failure
             }
             
             print("Waiting to receive bundles...")
             
-            // Poll for bundles
-            let pollUrl = URL(string: "\(baseURL)/endpoint?endpoint=\(receiveEndpoint.addingPercentEncoding(withAllowedCharacters: .urlQueryAllowed) ?? receiveEndpoint)")!
+            for await bundle in interface.incomingBundles {
+                if verbose {
+                    print("\n--- Bundle received ---")
+                    print("Bundle ID: \(bundle.bundleId)")
+                    print("Source: \(bundle.source)")
+                    print("Destination: \(bundle.destination)")
+                    print("Creation time: \(bundle.creationTimestamp)")
+                }
             
-            while true {
+                // Handle output
                 do {
-                    let (data, _) = try await URLSession.shared.data(from: pollUrl)
-                    
-                    if let responseStr = String(data: data, encoding: .utf8) {
-                        if responseStr == "Nothing to receive" {
-                            // No bundle available, wait and retry
-                            try await Task.sleep(nanoseconds: 1_000_000_000) // 1 second
-                            continue
+                    if let bundleData = bundle.encoded, hex {
+                        // Hex output of whole bundle
+                        print(bundleData.map { String(format: "%02x", $0) }.joined())
+                    } else if let bundleData = bundle.encoded, raw {
+                        // Raw bundle output
+                        if let outfile = outfile {
+                            try bundleData.write(to: URL(fileURLWithPath: outfile))
+                            print("Bundle written to: \(outfile)")
+                        } else {
+                            FileHandle.standardOutput.write(bundleData)
                         }
-                        
-                        // Bundle received as base64 CBOR
-                        if let bundleData = Data(base64Encoded: responseStr) {
-                            // Decode the bundle
-                            if let bundle = try? BP7.Bundle.decode(from: Array(bundleData)) {
-                                let bundleId = BundlePack(from: bundle).id
-                                
-                                if verbose {
-                                    print("\n--- Bundle received ---")
-                                    print("Bundle ID: \(bundleId)")
-                                    print("Source: \(bundle.primary.source)")
-                                    print("Destination: \(bundle.primary.destination)")
-                                    print("Creation time: \(Date(timeIntervalSince1970: Double(bundle.primary.creationTimestamp.getDtnTime()) / 1000.0))")
-                                }
-                                
-                                // Handle output
-                                if let payload = bundle.payload() {
-                                    let payloadData = Data(payload)
-                                    
-                                    if hex {
-                                        // Hex output of whole bundle
-                                        print(bundleData.map { String(format: "%02x", $0) }.joined())
-                                    } else if raw {
-                                        // Raw bundle output
-                                        if let outfile = outfile {
-                                            try bundleData.write(to: URL(fileURLWithPath: outfile))
-                                            print("Bundle written to: \(outfile)")
-                                        } else {
-                                            FileHandle.standardOutput.write(bundleData)
-                                        }
-                                    } else {
-                                        // Payload output
-                                        if let outfile = outfile {
-                                            try payloadData.write(to: URL(fileURLWithPath: outfile))
-                                            print("Payload written to: \(outfile)")
-                                        } else {
-                                            FileHandle.standardOutput.write(payloadData)
-                                            print() // Add newline after payload
-                                        }
-                                    }
-                                }
-                            } else {
-                                print("Error: Failed to decode bundle")
-                            }
+                    } else {
+                        // Payload output
+                        if let outfile = outfile {
+                            try bundle.payload.write(to: URL(fileURLWithPath: outfile))
+                            print("Payload written to: \(outfile)")
+                        } else {
+                            FileHandle.standardOutput.write(bundle.payload)
+                            print() // Add newline after payload
                         }
                     }
                 } catch {
-                    print("Error receiving bundle: \(error)")
-                    try await Task.sleep(nanoseconds: 5_000_000_000) // 5 seconds on error
+                    print("Error writing bundle: \(error)")
                 }
             }
         }
@@ -34,6 +34,18 @@ struct DtnSend: AsyncParsableCommand {
     
     @Option(name: .shortAndLong, help: "Bundle lifetime in seconds")
     var lifetime: Int = 3600
+    
+    @Option(name: .shortAndLong, help: "Send the payload as this many bundles")
+    var count: Int = 1
+    
+    @Option(name: .long, help: "Bundles per /send/batch request when sending more than one")
+    var batchSize: Int = 100
+    
+    func validate() throws {
+        guard count > 0, batchSize > 0 else {
+            throw ValidationError("count and batch size must be positive")
+        }
+    }
 
     mutating func run() async throws {
         // Check for DTN_WEB_PORT environment variable
@@ -44,13 +56,18 @@ struct DtnSend: AsyncParsableCommand {
         
         let baseURL = "http://\(ipv6 ? "[::1]" : "127.0.0.1"):\(port)"
         
-        // Read payload
-        var payload: Data
-        if let infile = infile {
-            payload = try Data(contentsOf: URL(fileURLWithPath: infile))
+        // Files are uploaded straight from disk; stdin has to be read first
+        let payloadFile = infile.map { URL(fileURLWithPath: $0) }
+        var payload = Data()
+        let payloadSize: Int
+        if let payloadFile = payloadFile {
+            let handle = try FileHandle(forReadingFrom: payloadFile)
+            payloadSize = Int(try handle.seekToEnd())
+            try handle.close()
         } else {
             // Read from stdin
             payload = FileHandle.standardInput.readDataToEndOfFile()
+            payloadSize = payload.count
         }
         
         // Get sender from parameter or query daemon for node ID
@@ -74,16 +91,24 @@ struct DtnSend: AsyncParsableCommand {
             print("Sender: \(actualSender ?? "unknown")")
             print("Receiver: \(receiver)")
             print("Lifetime: \(lifetime) seconds")
-            print("Payload size: \(payload.count) bytes")
+            print("Payload size: \(payloadSize) bytes")
         }
         
         if dryrun {
+            if let payloadFile = payloadFile {
+                payload = try Data(contentsOf: payloadFile, options: .mappedIfSafe)
+            }
             print("Dry run - would send bundle with payload:")
             if let text = String(data: payload, encoding: .utf8) {
                 print(text)
             } else {
                 print("Binary data (\(payload.count) bytes)")
             }
+        } else if count > 1 {
+            if let payloadFile = payloadFile {
+                payload = try Data(contentsOf: payloadFile, options: .mappedIfSafe)
+            }
+            try await sendBatches(to: baseURL, from: actualSender ?? "dtn://node1/app", payload: payload)
         } else {
             // Send the bundle via HTTP API
             var urlComponents = URLComponents(string: "\(baseURL)/send")!
@@ -95,11 +120,15 @@ struct DtnSend: AsyncParsableCommand {
             
             var request = URLRequest(url: urlComponents.url!)
             request.httpMethod = "POST"
-            request.httpBody = payload
             request.setValue("application/octet-stream", forHTTPHeaderField: "Content-Type")
             
             do {
-                let (data, response) = try await URLSession.shared.data(for: request)
+                let (data, response): (Data, URLResponse)
+                if let payloadFile = payloadFile {
+                    (data, response) = try await URLSession.shared.upload(for: request, fromFile: payloadFile)
+                } else {
+                    (data, response) = try await URLSession.shared.upload(for: request, from: payload)
+                }
                 
                 if let httpResponse = response as? HTTPURLResponse {
                     if httpResponse.statusCode == 200 {
@@ -120,4 +149,53 @@ struct DtnSend: AsyncParsableCommand {
             }
         }
     }
-} 
\ No newline at end of file
+    
+    /// Submit `count` copies of the payload, `batchSize` bundles per request
+    private func sendBatches(to baseURL: String, from source: String, payload: Data) async throws {
+        var request = URLRequest(url: URL(string: "\(baseURL)/send/batch")!)
+        request.httpMethod = "POST"
+        request.setValue(BundleSendRequest.batchContentType, forHTTPHeaderField: "Content-Type")
+        
+        let clock = ContinuousClock()
+        let start = clock.now
+        var sent = 0
+        var failed = 0
+        for offset in stride(from: 0, to: count, by: batchSize) {
+            let bundles = (offset..<min(count, offset + batchSize)).map { _ in
+                BundleSendRequest(
+                    source: source,
+                    destination: receiver,
+                    deliveryNotification: false,
+                    lifetime: TimeInterval(lifetime),
+                    data: payload
+                )
+            }
+            
+            let (data, response) = try await URLSession.shared.upload(for: request, from: Data(try BundleSendRequest.encodeBatch(bundles)))
+            guard (response as? HTTPURLResponse)?.statusCode == 200,
+                  let result = try? JSONDecoder().decode(SendBatchResult.self, from: data) else {
+                print("Failed to send bundles: \(String(decoding: data, as: UTF8.self))")
+                throw ExitCode.failure
+            }
+            sent += result.sent.count
+            failed += result.errors.count
+            if verbose {
+                result.sent.forEach { print("Sent \($0)") }
+            }
+            result.errors.forEach { print("Error: \($0)") }
+        }
+        
+        let elapsed = clock.now - start
+        let seconds = Double(elapsed.components.seconds) + Double(elapsed.components.attoseconds) / 1e18
+        print("Sent \(sent) of \(count) bundles in \(String(format: "%.3f", seconds))s (\(String(format: "%.0f", Double(sent) / max(seconds, 1e-9))) bundles/s)")
+        if failed > 0 {
+            throw ExitCode.failure
+        }
+    }
+} 
+
+/// The reply to `/send/batch`
+private struct SendBatchResult: Decodable {
+    let sent: [String]
+    let errors: [String]
+}
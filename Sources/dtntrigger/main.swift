@@ -79,7 +79,7 @@ struct DtnTrigger: AsyncParsableCommand {
                     if let bundleData = Data(base64Encoded: responseStr) {
                         // Decode the bundle
                         if let bundle = try? BP7.Bundle.decode(from: Array(bundleData)) {
-                            let bundleId = BundlePack(from: bundle).id
+                            let bundleId = BundlePack.id(of: bundle)
                             let source = bundle.primary.source.description
                             
                             if verbose {
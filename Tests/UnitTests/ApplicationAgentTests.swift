@@ -0,0 +1,84 @@
+import Testing
+@testable import DTN7
+@testable import BP7
+import Foundation
+
+@Suite("Application Agent Tests")
+struct ApplicationAgentTests {
+    
+    @Test("Queued bundles wait in the store and are polled one at a time")
+    func testPolling() async throws {
+        let store = InMemoryBundleStore()
+        let agent = ApplicationAgent(store: store)
+        let endpoint = try EndpointID.from("dtn://node1/incoming")
+        await agent.register(endpoint)
+        
+        let bundles = (0..<3).map { createTestBundle(sequenceNumber: UInt64($0)) }
+        for bundle in bundles {
+            #expect(await !agent.deliverBundle(bundle))
+        }
+        #expect(await agent.pendingCount(for: endpoint) == 3)
+        #expect(await store.count() == 3)
+        
+        let first = try #require(await agent.takePendingBundle(for: endpoint))
+        #expect(BundlePack.id(of: first) == BundlePack.id(of: bundles[0]))
+        #expect(await agent.pendingCount(for: endpoint) == 2)
+        #expect(await agent.getPendingBundles(for: endpoint).count == 2)
+    }
+    
+    @Test("A subscriber is rung for new bundles and unacknowledged ones are requeued")
+    func testSubscription() async throws {
+        let agent = ApplicationAgent()
+        let endpoint = try EndpointID.from("dtn://node1/incoming")
+        let (doorbell, ring) = AsyncStream.makeStream(of: Void.self, bufferingPolicy: .bufferingNewest(1))
+        var rings = doorbell.makeAsyncIterator()
+        
+        let subscription = await agent.subscribe(endpoint, doorbell: ring)
+        let bundles = (0..<4).map { createTestBundle(sequenceNumber: UInt64($0)) }
+        let ids = bundles.map { BundlePack.id(of: $0) }
+        for bundle in bundles {
+            #expect(await agent.deliverBundle(bundle))
+        }
+        #expect(await rings.next() != nil)
+        
+        // The window allows two at a time
+        let pushed = await agent.takeBundles(for: endpoint, limit: 2)
+        #expect(pushed.map { BundlePack.id(of: $0) } == Array(ids[0..<2]))
+        #expect(await agent.pendingCount(for: endpoint) == 2)
+        #expect(await agent.acknowledge(BundlePack.id(of: pushed[0]), for: endpoint))
+        #expect(await !agent.acknowledge(BundlePack.id(of: pushed[0]), for: endpoint))
+        
+        // Dropping the connection puts the unacknowledged bundle back in front
+        await agent.unsubscribe(endpoint, subscription: subscription + 1)
+        #expect(await agent.pendingCount(for: endpoint) == 2)
+        await agent.unsubscribe(endpoint, subscription: subscription)
+        #expect(await agent.pendingCount(for: endpoint) == 3)
+        
+        _ = await agent.subscribe(endpoint, doorbell: ring)
+        let redelivered = await agent.takeBundles(for: endpoint, limit: 10)
+        #expect(redelivered.map { BundlePack.id(of: $0) } == Array(ids[1...]))
+    }
+    
+    // MARK: - Helper Functions
+    
+    private func createTestBundle(sequenceNumber: UInt64) -> BP7.Bundle {
+        let primary = PrimaryBlock(
+            bundleControlFlags: BundleControlFlags(),
+            destination: try! EndpointID.from("dtn://node1/incoming"),
+            source: try! EndpointID.from("dtn://source/test"),
+            reportTo: try! EndpointID.from("dtn://source/test"),
+            creationTimestamp: CreationTimestamp(time: 1000, sequenceNumber: sequenceNumber),
+            lifetime: 3600
+        )
+        
+        let payload = CanonicalBlock(
+            blockType: BlockType.payload.rawValue,
+            blockNumber: 1,
+            blockControlFlags: 0,
+            crc: .crc32(0),
+            data: .data(Array("bundle \(sequenceNumber)".utf8))
+        )
+        
+        return BP7.Bundle(primary: primary, canonicals: [payload])
+    }
+}
@@ -0,0 +1,63 @@
+import Testing
+@testable import DTN7
+@testable import BP7
+import Foundation
+
+@Suite("Bundle Pipeline Tests")
+struct BundlePipelineTests {
+    
+    @Test("A bundle maps to one shard by key and by ID")
+    func testShardSelection() {
+        let pipeline = BundlePipeline(config: DtnConfig(), shardCount: 8)
+        #expect(pipeline.shards.count == 8)
+        
+        var used = Set<ObjectIdentifier>()
+        for i in 0..<64 {
+            let bundle = createTestBundle(sequenceNumber: UInt64(i))
+            let shard = pipeline.shard(for: BundleKey(bundle: bundle))
+            #expect(shard === pipeline.shard(forBundleId: BundlePack.id(of: bundle)))
+            used.insert(ObjectIdentifier(shard))
+        }
+        #expect(used.count > 1)
+    }
+    
+    @Test("Sequential processing uses a single shard")
+    func testSingleShard() {
+        var config = DtnConfig()
+        config.parallelBundleProcessing = false
+        #expect(BundlePipeline(config: config).shards.count == 1)
+    }
+    
+    @Test("Submitted batches are stored once and bundles from foreign sources are refused")
+    func testSubmitBatch() async throws {
+        let store = InMemoryBundleStore()
+        let core = DtnCore(nodeId: try EndpointID.from("dtn://source"), store: store, config: DtnConfig())
+        await core.pipeline.setCore(core)
+        await core.registerEndpoint(try EndpointID.from("dtn://source/test"))
+        
+        // Created now, so none has expired
+        let now = CreationTimestamp().getDtnTime()
+        let bundles = (0..<10).map { createTestBundle(sequenceNumber: UInt64($0), time: now) }
+        let foreign = createTestBundle(sequenceNumber: 0, source: "dtn://elsewhere/test", time: now)
+        let failures = await core.submitBundles(bundles + [foreign])
+        
+        #expect(failures.map(\.id) == [BundlePack.id(of: foreign)])
+        #expect(await store.count() == 10)
+        #expect(core.metrics.incoming.value == 11)
+    }
+    
+    // MARK: - Helper Functions
+    
+    private func createTestBundle(sequenceNumber: UInt64, source: String = "dtn://source/test", time: UInt64 = 1000) -> BP7.Bundle {
+        let primary = PrimaryBlock(
+            bundleControlFlags: BundleControlFlags(),
+            destination: try! EndpointID.from("dtn://dest/test"),
+            source: try! EndpointID.from(source),
+            reportTo: try! EndpointID.from(source),
+            creationTimestamp: CreationTimestamp(time: time, sequenceNumber: sequenceNumber),
+            lifetime: 3600
+        )
+        
+        return BP7.Bundle(primary: primary, canonicals: [])
+    }
+}
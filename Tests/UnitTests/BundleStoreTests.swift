@@ -103,19 +103,498 @@ struct BundleStoreTests {
         #expect(node1Bundles.count == 2)
     }
     
+    @Test("CSQLite store basic operations")
+    func testCSQLiteStore() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let store = try CSQLiteStore(path: path)
+        
+        let bundle = createTestBundle(id: "sqlite-1")
+        let bundleId = BundlePack(from: bundle).id
+        
+        try await store.push(bundle: bundle)
+        #expect(await store.hasItem(bundleId: bundleId) == true)
+        #expect(await store.getBundle(bundleId: bundleId) != nil)
+        #expect(await store.count() == 1)
+        
+        // Duplicates are rejected
+        await #expect(throws: CSQLiteStore.CSQLiteStoreError.self) {
+            try await store.push(bundle: bundle)
+        }
+        
+        // Metadata round trip
+        var pack = try #require(await store.getMetadata(bundleId: bundleId))
+        pack.constraints.insert(.forwardPending)
+        try await store.updateMetadata(bundlePack: pack)
+        #expect(await store.getMetadata(bundleId: bundleId)?.constraints.contains(.forwardPending) == true)
+        
+        try await store.remove(bundleId: bundleId)
+        #expect(await store.hasItem(bundleId: bundleId) == false)
+        #expect(await store.allBundles().isEmpty)
+    }
+    
+    @Test("CSQLite store options from settings")
+    func testCSQLiteStoreOptions() async throws {
+        let defaults = try CSQLiteStore.Options(settings: [:])
+        #expect(defaults == .default)
+        #expect(defaults.journalMode == "WAL")
+        #expect(defaults.synchronous == .normal)
+        
+        let options = try CSQLiteStore.Options(settings: [
+            "journal_mode": "delete",
+            "synchronous": "full",
+            "mmap_size": "1048576",
+            "cache_size": "-4096",
+            "page_size": "8192"
+        ])
+        #expect(options.journalMode == "DELETE")
+        #expect(options.synchronous == .full)
+        #expect(options.mmapSize == 1048576)
+        #expect(options.cacheSize == -4096)
+        #expect(options.pageSize == 8192)
+        
+        // The tuned connection behaves like any other store
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let store = try CSQLiteStore(path: path, options: options)
+        try await store.push(bundle: createTestBundle(id: "sqlite-options"))
+        #expect(await store.count() == 1)
+        
+        // Journal modes off the list are refused, in the settings and by the C layer
+        #expect(throws: CSQLiteStore.CSQLiteStoreError.self) {
+            try CSQLiteStore.Options(settings: ["journal_mode": "WAL; DROP TABLE bundles"])
+        }
+        #expect(throws: CSQLiteStore.CSQLiteStoreError.self) {
+            try CSQLiteStore.Options(settings: ["journal_mode": "fast"])
+        }
+        let rejectedPath = temporaryDatabasePath()
+        defer { removeDatabase(at: rejectedPath) }
+        #expect(throws: (any Error).self) {
+            try CSQLiteStore(path: rejectedPath, options: CSQLiteStore.Options(journalMode: "WAL; DROP TABLE bundles"))
+        }
+    }
+    
+    @Test("CSQLite batch and group commit ingest")
+    func testCSQLiteBatchIngest() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let store = try CSQLiteStore(path: path, options: CSQLiteStore.Options(groupCommitWindow: 0.005, groupCommitMaxBatch: 8))
+        
+        // One transaction for the whole batch; duplicates are skipped
+        let batch = (1...20).map { createTestBundle(id: "batch-\($0)") }
+        try await store.pushBatch(bundles: batch)
+        try await store.pushBatch(bundles: Array(batch.prefix(5)))
+        #expect(await store.count() == 20)
+        
+        // Concurrent pushes coalesce into shared commits
+        let concurrent = (1...50).map { createTestBundle(id: "group-\($0)") }
+        try await withThrowingTaskGroup(of: Void.self) { group in
+            for bundle in concurrent {
+                group.addTask { try await store.push(bundle: bundle) }
+            }
+            try await group.waitForAll()
+        }
+        #expect(await store.count() == 70)
+        
+        // A duplicate only fails its own push
+        await #expect(throws: CSQLiteStore.CSQLiteStoreError.self) {
+            try await store.push(bundle: concurrent[0])
+        }
+    }
+    
+    @Test("Stream store contents in pages")
+    func testStoreStreams() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let stores: [any BundleStore] = [InMemoryBundleStore(), try CSQLiteStore(path: path)]
+        
+        for store in stores {
+            let bundles = (1...25).map { createTestBundle(id: "stream-\($0)") }
+            try await store.pushBatch(bundles: bundles)
+            let expected = Set(bundles.map { BundlePack(from: $0).id })
+            
+            var ids: [String] = []
+            for await id in store.idStream(pageSize: 7) {
+                ids.append(id)
+            }
+            #expect(ids.count == 25)
+            #expect(Set(ids) == expected)
+            
+            var packs: [BundlePack] = []
+            for await pack in store.bundleStream(pageSize: 10) {
+                packs.append(pack)
+            }
+            #expect(Set(packs.map(\.id)) == expected)
+            
+            // Removing while streaming neither skips nor repeats the remaining bundles
+            var streamed = 0
+            for await id in store.idStream(pageSize: 4) {
+                try await store.remove(bundleId: id)
+                streamed += 1
+            }
+            #expect(streamed == 25)
+            #expect(await store.count() == 0)
+        }
+    }
+    
+    @Test("Remove expired bundles by expiry index")
+    func testRemoveExpired() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let stores: [any BundleStore] = [InMemoryBundleStore(), try CSQLiteStore(path: path)]
+        
+        for store in stores {
+            let shortLived = createTestBundle(id: "short", creationTime: 1_000, lifetime: 10)
+            let longLived = createTestBundle(id: "long", creationTime: 1_000, lifetime: 100)
+            let immortal = createTestBundle(id: "immortal", creationTime: 1_000, lifetime: 0)
+            try await store.pushBatch(bundles: [shortLived, longLived, immortal])
+            
+            let shortId = BundlePack(from: shortLived).id
+            #expect(await store.getMetadata(bundleId: shortId)?.expiresAt == 11_000)
+            #expect(await store.getMetadata(bundleId: BundlePack(from: immortal).id)?.expiresAt == 0)
+            
+            #expect(try await store.removeExpired(before: 10_999).isEmpty)
+            #expect(try await store.removeExpired(before: 11_000) == [shortId])
+            #expect(await store.hasItem(bundleId: shortId) == false)
+            
+            let removed = try await store.removeExpired(before: UInt64.max)
+            #expect(removed == [BundlePack(from: longLived).id])
+            #expect(await store.count() == 1)
+            #expect(await store.allBundles().map(\.id) == [BundlePack(from: immortal).id])
+            
+            // Removal leaves no metadata behind
+            try await store.remove(bundleId: BundlePack(from: immortal).id)
+            #expect(await store.count() == 0)
+            #expect(await store.allBundles().isEmpty)
+        }
+    }
+    
+    @Test("Forwarding queue follows the forwardPending constraint")
+    func testForwardPendingQueue() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let stores: [any BundleStore] = [InMemoryBundleStore(), try CSQLiteStore(path: path)]
+        
+        for store in stores {
+            let bundles = (1...6).map { createTestBundle(id: "queue-\($0)") }
+            try await store.pushBatch(bundles: bundles)
+            
+            var expected: Set<String> = []
+            for bundle in bundles.prefix(3) {
+                var pack = try #require(await store.getMetadata(bundleId: BundlePack(from: bundle).id))
+                pack.constraints.insert(.forwardPending)
+                try await store.updateMetadata(bundlePack: pack)
+                expected.insert(pack.id)
+            }
+            
+            var queued: Set<String> = []
+            for await pack in store.forwardPendingStream(pageSize: 2) {
+                #expect(pack.constraints.contains(.forwardPending))
+                queued.insert(pack.id)
+            }
+            #expect(queued == expected)
+        }
+    }
+    
+    @Test("CSQLite bulk metadata read resolves interned EIDs")
+    func testCSQLiteMetadataColumns() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        
+        // Destinations repeat across rows and share one dictionary entry
+        let bundles = (1...12).map { createTestBundle(id: "columns-\($0)", destination: "dtn://node\($0 % 3)/inbox") }
+        let destinations = Dictionary(uniqueKeysWithValues: bundles.map { (BundlePack(from: $0).id, $0.primary.destination) })
+        
+        do {
+            let store = try CSQLiteStore(path: path)
+            try await store.pushBatch(bundles: bundles)
+            
+            var pack = try #require(await store.getMetadata(bundleId: BundlePack(from: bundles[0]).id))
+            pack.constraints.insert(.forwardPending)
+            try await store.updateMetadata(bundlePack: pack)
+            try await store.remove(bundleId: BundlePack(from: bundles[1]).id)
+        }
+        
+        // The same rows come back after reopening
+        let store = try CSQLiteStore(path: path)
+        let source = try EndpointID.from("dtn://source/test")
+        let packs = await store.allBundles()
+        #expect(packs.count == 11)
+        for pack in packs {
+            #expect(pack.destination == destinations[pack.id])
+            #expect(pack.source == source)
+        }
+        #expect(packs.first { $0.id == BundlePack(from: bundles[0]).id }?.constraints.contains(.forwardPending) == true)
+        #expect(await store.getBundle(bundleId: BundlePack(from: bundles[2]).id) != nil)
+    }
+    
+    @Test("Stored bundle bytes match the wire encoding")
+    func testGetBundleBytes() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let stores: [any BundleStore] = [InMemoryBundleStore(), try CSQLiteStore(path: path)]
+        
+        for store in stores {
+            let bundle = createTestBundle(id: "bytes-1")
+            let bundleId = BundlePack(from: bundle).id
+            try await store.push(bundle: bundle)
+            
+            let bytes = try #require(await store.getBundleBytes(bundleId: bundleId))
+            #expect(bytes == bundle.encode())
+            #expect(try BundlePack(from: BP7.Bundle.decode(from: bytes)).id == bundleId)
+            #expect(await store.getBundleBytes(bundleId: "missing") == nil)
+        }
+    }
+    
+    @Test("Chunked reads reassemble the stored encoding")
+    func testBundleChunks() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let stores: [any BundleStore] = [InMemoryBundleStore(), try CSQLiteStore(path: path)]
+        
+        for store in stores {
+            let bundle = createTestBundle(id: "chunks-1")
+            let bundleId = BundlePack(from: bundle).id
+            try await store.push(bundle: bundle)
+            
+            var chunks: [[UInt8]] = []
+            for await chunk in store.bundleChunks(bundleId: bundleId, chunkSize: 7) {
+                chunks.append(chunk)
+            }
+            #expect(chunks.joined().elementsEqual(bundle.encode()))
+            #expect(chunks.allSatisfy { !$0.isEmpty })
+            
+            var missing = 0
+            for await _ in store.bundleChunks(bundleId: "missing", chunkSize: 7) {
+                missing += 1
+            }
+            #expect(missing == 0)
+        }
+    }
+    
+    @Test("CSQLite store keeps one copy of identical payloads")
+    func testPayloadDedup() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let store = try CSQLiteStore(path: path, options: CSQLiteStore.Options(dedupMinSize: 1024, compressMinSize: 1024))
+        
+        let payload = (0..<8192).map { UInt8($0 % 7) }
+        let bundles = ["dedup-1", "dedup-2"].map { createTestBundle(id: $0, payload: payload) }
+        for bundle in bundles {
+            try await store.push(bundle: bundle)
+        }
+        
+        let stats = try #require(await store.payloadStats())
+        #expect(stats.payloads == 1)
+        #expect(stats.references == 2)
+        #expect(stats.storedBytes < UInt64(payload.count))
+        #expect(stats.referencedBytes == UInt64(2 * payload.count))
+        
+        for bundle in bundles {
+            let bundleId = BundlePack(from: bundle).id
+            #expect(await store.getBundleBytes(bundleId: bundleId) == bundle.encode())
+            
+            var chunks: [[UInt8]] = []
+            for await chunk in store.bundleChunks(bundleId: bundleId, chunkSize: 1000) {
+                chunks.append(chunk)
+            }
+            #expect(chunks.joined().elementsEqual(bundle.encode()))
+        }
+        
+        // The payload goes with its last reference
+        try await store.remove(bundleId: BundlePack(from: bundles[0]).id)
+        #expect(await store.payloadStats()?.payloads == 1)
+        try await store.remove(bundleId: BundlePack(from: bundles[1]).id)
+        #expect(await store.payloadStats() == CSQLiteStore.PayloadStats(payloads: 0, references: 0, storedBytes: 0, referencedBytes: 0))
+    }
+    
+    @Test("Segment log store keeps large bundles in the log and reopens from it")
+    func testSegmentLogStore() async throws {
+        let directory = temporaryDatabasePath()
+        defer { try? FileManager.default.removeItem(atPath: directory) }
+        let options = SegmentLogStore.Options(segmentSize: 4096, inlineMaxSize: 256)
+        
+        let payload = (0..<1000).map { UInt8($0 % 251) }
+        let large = (0..<12).map { createTestBundle(id: "segment-\($0)", payload: payload) }
+        let small = createTestBundle(id: "segment-small", payload: [1, 2, 3])
+        
+        let store = try await SegmentLogStore(directory: directory, options: options)
+        try await store.pushBatch(bundles: Array(large[0..<6]))
+        for bundle in large[6...] + [small] {
+            try await store.push(bundle: bundle)
+        }
+        await #expect(throws: CSQLiteStore.CSQLiteStoreError.self) {
+            try await store.push(bundle: large[0])
+        }
+        
+        let stats = await store.segmentStats()
+        #expect(stats.bundles == 12)
+        #expect(stats.segments >= 3)
+        #expect(stats.liveBytes == stats.bytes)
+        #expect(await store.count() == 13)
+        
+        var chunks: [[UInt8]] = []
+        for await chunk in store.bundleChunks(bundleId: BundlePack(from: large[3]).id, chunkSize: 300) {
+            chunks.append(chunk)
+        }
+        #expect(chunks.count == 4)
+        #expect(chunks.joined().elementsEqual(large[3].encode()))
+        
+        // The segments alone tell where every bundle is
+        let reopened = try await SegmentLogStore(directory: directory, options: options)
+        #expect(await reopened.segmentStats().bundles == 12)
+        for bundle in large + [small] {
+            #expect(await reopened.getBundleBytes(bundleId: BundlePack(from: bundle).id) == bundle.encode())
+        }
+    }
+    
+    @Test("Segment log compaction reclaims segments emptied by removals")
+    func testSegmentLogCompaction() async throws {
+        let directory = temporaryDatabasePath()
+        defer { try? FileManager.default.removeItem(atPath: directory) }
+        let store = try await SegmentLogStore(directory: directory, options: SegmentLogStore.Options(segmentSize: 4096, inlineMaxSize: 0))
+        
+        let payload = [UInt8](repeating: 7, count: 1000)
+        let bundles = (0..<16).map { createTestBundle(id: "compact-\($0)", creationTime: UInt64($0), lifetime: $0 % 4 == 0 ? 3600 : 1, payload: payload) }
+        try await store.pushBatch(bundles: bundles)
+        let full = await store.segmentStats()
+        
+        // Three in four expire, leaving every segment mostly dead
+        let removed = try await store.removeExpired(before: 2_000)
+        #expect(removed.count == 12)
+        await store.compact()
+        
+        let compacted = await store.segmentStats()
+        #expect(compacted.bundles == 4)
+        #expect(compacted.segments < full.segments)
+        #expect(compacted.bytes < full.bytes)
+        #expect(compacted.bytes - compacted.liveBytes < full.bytes / 4)
+        
+        for (index, bundle) in bundles.enumerated() {
+            let bytes = await store.getBundleBytes(bundleId: BundlePack(from: bundle).id)
+            #expect(bytes == (index % 4 == 0 ? bundle.encode() : nil))
+        }
+        
+        let reopened = try await SegmentLogStore(directory: directory, options: SegmentLogStore.Options(segmentSize: 4096, inlineMaxSize: 0))
+        #expect(await reopened.segmentStats().bundles == 4)
+    }
+    
+    @Test("A segment record failing its checksum ends the log")
+    func testSegmentLogChecksum() async throws {
+        let directory = temporaryDatabasePath()
+        defer { try? FileManager.default.removeItem(atPath: directory) }
+        let options = SegmentLogStore.Options(inlineMaxSize: 0)
+        let bundles = ["torn-1", "torn-2"].map { createTestBundle(id: $0, payload: [UInt8](repeating: 1, count: 500)) }
+        
+        let store = try await SegmentLogStore(directory: directory, options: options)
+        try await store.pushBatch(bundles: bundles)
+        
+        // Zero part of the second body, as a write torn by a power cut would leave it
+        let name = try #require(try FileManager.default.contentsOfDirectory(atPath: directory).first { $0.hasSuffix(".seg") })
+        let first = 16 + BundlePack(from: bundles[0]).id.utf8.count + bundles[0].encode().count
+        let handle = try #require(FileHandle(forUpdatingAtPath: "\(directory)/\(name)"))
+        try handle.seek(toOffset: UInt64(first + 16 + BundlePack(from: bundles[1]).id.utf8.count + 100))
+        try handle.write(contentsOf: Data(repeating: 0, count: 100))
+        try handle.close()
+        
+        let reopened = try await SegmentLogStore(directory: directory, options: options)
+        #expect(await reopened.getBundleBytes(bundleId: BundlePack(from: bundles[0]).id) == bundles[0].encode())
+        #expect(await !reopened.hasItem(bundleId: BundlePack(from: bundles[1]).id))
+        #expect(await reopened.count() == 1)
+    }
+    
+    @Test("In-memory store spills the least recently used bundles over its budget")
+    func testMemoryBudgetSpill() async throws {
+        let path = temporaryDatabasePath()
+        defer { removeDatabase(at: path) }
+        let bundles = (0..<20).map { createTestBundle(id: "spill-\($0)", creationTime: UInt64($0)) }
+        let size = bundles[0].encode().count
+        let store = InMemoryBundleStore(
+            options: InMemoryBundleStore.Options(byteBudget: size * 5),
+            overflow: try CSQLiteStore(path: path)
+        )
+        
+        for bundle in bundles {
+            try await store.push(bundle: bundle)
+        }
+        
+        #expect(await store.count() == 20)
+        #expect(await store.residentBytes <= size * 5)
+        #expect(await store.spilledCount >= 15)
+        
+        // The first bundles went to disk, the latest stayed in memory; all read back the same
+        for bundle in bundles {
+            let bundleId = BundlePack(from: bundle).id
+            #expect(await store.getBundleBytes(bundleId: bundleId) == bundle.encode())
+        }
+        
+        let first = BundlePack(from: bundles[0]).id
+        try await store.remove(bundleId: first)
+        #expect(await !store.hasItem(bundleId: first))
+        #expect(await store.count() == 19)
+        #expect(await store.getMetadata(bundleId: first) == nil)
+        #expect(await store.allBundles().count == 19)
+        
+        // Spilled bundles that expire leave nothing behind either
+        #expect(try await store.removeExpired(before: UInt64.max).count == 19)
+        #expect(await store.count() == 0)
+        #expect(await store.allBundles().isEmpty)
+    }
+    
+    @Test("In-memory store without overflow refuses bundles over its budget")
+    func testMemoryBudgetFull() async throws {
+        let bundle = createTestBundle(id: "full-1")
+        let store = InMemoryBundleStore(options: InMemoryBundleStore.Options(byteBudget: bundle.encode().count))
+        
+        try await store.push(bundle: bundle)
+        await #expect(throws: BundleStoreError.self) {
+            try await store.push(bundle: createTestBundle(id: "full-2"))
+        }
+        #expect(await store.count() == 1)
+    }
+    
+    @Test("Bundle context computes identity and size once")
+    func testBundleContext() async throws {
+        let bundle = createTestBundle(id: "context-1")
+        let context = BundleContext(bundle: bundle)
+        
+        #expect(context.id == BundlePack.id(of: bundle))
+        #expect(context.encoded == bundle.encode())
+        #expect(context.pack == BundlePack(from: bundle))
+        
+        // Pushing a context stores the same metadata as pushing the bundle
+        let store = InMemoryBundleStore()
+        try await store.push(context)
+        #expect(await store.getMetadata(bundleId: context.id) == context.pack)
+    }
+    
     // Helper function
-    private func createTestBundle(id: String, destination: String = "dtn://dest/test") -> BP7.Bundle {
+    private func createTestBundle(id: String, destination: String = "dtn://dest/test", creationTime: UInt64 = 0, lifetime: TimeInterval = 3600000, payload: [UInt8]? = nil) -> BP7.Bundle {
         // Create a simple bundle for testing
         let primary = PrimaryBlock(
             bundleControlFlags: BundleControlFlags(),
             destination: try! EndpointID.from(destination),
             source: try! EndpointID.from("dtn://source/test"),
             reportTo: try! EndpointID.from("dtn://source/test"),
-            creationTimestamp: CreationTimestamp(time: 0, sequenceNumber: UInt64(abs(id.hashValue))),
-            lifetime: 3600000
+            creationTimestamp: CreationTimestamp(time: creationTime, sequenceNumber: UInt64(abs(id.hashValue))),
+            lifetime: lifetime
         )
         
-        let bundle = BP7.Bundle(primary: primary, canonicals: [])
+        let canonicals = payload.map {
+            [CanonicalBlock(blockType: BlockType.payload.rawValue, blockNumber: 1, blockControlFlags: 0, crc: .crc32(0), data: .data($0))]
+        } ?? []
+        let bundle = BP7.Bundle(primary: primary, canonicals: canonicals)
         return bundle
     }
+    
+    private func temporaryDatabasePath() -> String {
+        FileManager.default.temporaryDirectory
+            .appendingPathComponent("dtn7-test-\(UUID().uuidString).db").path
+    }
+    
+    private func removeDatabase(at path: String) {
+        for suffix in ["", "-wal", "-shm"] {
+            try? FileManager.default.removeItem(atPath: path + suffix)
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+import Testing
+@testable import DTN7
+@testable import BP7
+import Foundation
+
+@Suite("Duplicate Filter Tests")
+struct DuplicateFilterTests {
+    
+    @Test("Bundle and ID keys agree")
+    func testKeyFromId() {
+        let bundle = createTestBundle(source: "dtn://node-a/app", time: 12345, sequenceNumber: 7)
+        let key = BundleKey(bundle: bundle)
+        
+        #expect(BundleKey(id: BundlePack.id(of: bundle)) == key)
+        #expect(BundleKey(bundle: createTestBundle(source: "dtn://node-a/app", time: 12345, sequenceNumber: 8)) != key)
+        #expect(BundleKey(id: "not-a-bundle-id") == BundleKey(id: "not-a-bundle-id"))
+    }
+    
+    @Test("Keys evicted from the LRU are still recognized")
+    func testLRUEviction() {
+        var filter = DuplicateFilter(configuration: DuplicateFilter.Configuration(exactCapacity: 16, filterCapacity: 1_000))
+        let keys = (0..<200).map { BundleKey(source: "dtn://node1/", timestamp: UInt64($0), sequenceNumber: 0) }
+        
+        for key in keys {
+            #expect(filter.insert(key) == false)
+        }
+        for key in keys {
+            #expect(filter.insert(key) == true)
+        }
+    }
+    
+    @Test("False positives stay near the configured rate")
+    func testFalsePositiveRate() {
+        var filter = DuplicateFilter(configuration: DuplicateFilter.Configuration(exactCapacity: 10, filterCapacity: 5_000, falsePositiveRate: 0.01))
+        for i in 0..<5_000 {
+            filter.insert(BundleKey(source: "dtn://node1/", timestamp: UInt64(i), sequenceNumber: 0))
+        }
+        
+        let falsePositives = (0..<10_000).filter {
+            filter.contains(BundleKey(source: "dtn://node2/", timestamp: UInt64($0), sequenceNumber: 0))
+        }.count
+        #expect(falsePositives < 200)
+    }
+    
+    @Test("Keys are forgotten after two windows")
+    func testWindowRotation() {
+        let start = Date(timeIntervalSince1970: 1_000_000)
+        var filter = DuplicateFilter(configuration: DuplicateFilter.Configuration(exactCapacity: 1, filterCapacity: 100, window: 60), now: start)
+        let old = BundleKey(source: "dtn://node1/", timestamp: 1, sequenceNumber: 0)
+        
+        filter.insert(old, now: start)
+        filter.insert(BundleKey(source: "dtn://node1/", timestamp: 2, sequenceNumber: 0), now: start)
+        #expect(filter.contains(old))
+        
+        // Survives one rotation in the previous generation
+        filter.insert(BundleKey(source: "dtn://node1/", timestamp: 3, sequenceNumber: 0), now: start.addingTimeInterval(61))
+        #expect(filter.contains(old))
+        
+        filter.insert(BundleKey(source: "dtn://node1/", timestamp: 4, sequenceNumber: 0), now: start.addingTimeInterval(122))
+        #expect(!filter.contains(old))
+    }
+    
+    @Test("Serialized filter restores exact and filtered keys")
+    func testSerialization() throws {
+        let configuration = DuplicateFilter.Configuration(exactCapacity: 8, filterCapacity: 1_000)
+        var filter = DuplicateFilter(configuration: configuration)
+        let keys = (0..<50).map { BundleKey(source: "dtn://node1/", timestamp: UInt64($0), sequenceNumber: 0) }
+        for key in keys {
+            filter.insert(key)
+        }
+        
+        let restored = try #require(DuplicateFilter(serialized: filter.serialized(), configuration: configuration))
+        for key in keys {
+            #expect(restored.contains(key))
+        }
+        #expect(restored.count == filter.count)
+        
+        // Differently sized filters keep only the exact keys
+        let resized = try #require(DuplicateFilter(serialized: filter.serialized(), configuration: DuplicateFilter.Configuration(exactCapacity: 8, filterCapacity: 50)))
+        #expect(resized.contains(keys[49]))
+        
+        #expect(DuplicateFilter(serialized: Data([1, 2, 3])) == nil)
+    }
+    
+    // MARK: - Helper Functions
+    
+    private func createTestBundle(source: String, time: UInt64, sequenceNumber: UInt64) -> BP7.Bundle {
+        let primary = PrimaryBlock(
+            bundleControlFlags: BundleControlFlags(),
+            destination: try! EndpointID.from("dtn://dest/test"),
+            source: try! EndpointID.from(source),
+            reportTo: try! EndpointID.from(source),
+            creationTimestamp: CreationTimestamp(time: time, sequenceNumber: sequenceNumber),
+            lifetime: 3600
+        )
+        
+        return BP7.Bundle(primary: primary, canonicals: [])
+    }
+}
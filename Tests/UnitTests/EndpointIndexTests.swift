@@ -0,0 +1,35 @@
+import Testing
+@testable import DTN7
+@testable import BP7
+import Foundation
+
+@Suite("Endpoint Index Tests")
+struct EndpointIndexTests {
+    
+    @Test("Local endpoints cover the EIDs they are a prefix of")
+    func testLocalEndpoints() throws {
+        let local = LocalEndpoints([try EndpointID.from("dtn://node1/"), try EndpointID.from("dtn://global/~news")])
+        
+        #expect(local.contains(try EndpointID.from("dtn://node1/")))
+        #expect(local.contains(try EndpointID.from("dtn://node1/incoming")))
+        #expect(local.contains(try EndpointID.from("dtn://global/~news/sport")))
+        #expect(!local.contains(try EndpointID.from("dtn://node2/incoming")))
+        #expect(!local.contains(try EndpointID.from("dtn://global/~weather")))
+    }
+    
+    @Test("Registrations match exactly, by wildcard or by group")
+    func testRegistrations() throws {
+        let incoming = try EndpointID.from("dtn://node1/incoming")
+        let files = try EndpointID.from("dtn://node1/files/*")
+        let news = try EndpointID.from("dtn://global/~news")
+        let index = EndpointIndex(registrations: [incoming, files, news])
+        #expect(index.count == 3)
+        
+        #expect(index.match(incoming) == incoming)
+        #expect(index.match(try EndpointID.from("dtn://node1/incoming/more")) == nil)
+        #expect(index.match(try EndpointID.from("dtn://node1/files/report")) == files)
+        #expect(index.match(try EndpointID.from("dtn://global/~chat")) == news)
+        #expect(index.match(try EndpointID.from("dtn://node2/~chat")) == nil)
+        #expect(index.match(try EndpointID.from("dtn://node1/other")) == nil)
+    }
+}
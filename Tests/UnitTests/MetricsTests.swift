@@ -0,0 +1,68 @@
+import Testing
+@testable import DTN7
+import Foundation
+
+@Suite("Metrics Tests")
+struct MetricsTests {
+    
+    @Test("Striped counters sum concurrent increments")
+    func testStripedCounter() async {
+        let counter = StripedCounter(stripes: 8)
+        
+        await withTaskGroup(of: Void.self) { group in
+            for _ in 0..<16 {
+                group.addTask {
+                    for _ in 0..<1_000 {
+                        counter.add()
+                    }
+                }
+            }
+        }
+        counter.add(5)
+        
+        #expect(counter.value == 16_005)
+    }
+    
+    @Test("Latencies land in power-of-two microsecond buckets")
+    func testHistogramBuckets() {
+        #expect(LatencyHistogram.bucketIndex(microseconds: 0) == 0)
+        #expect(LatencyHistogram.bucketIndex(microseconds: 1) == 0)
+        #expect(LatencyHistogram.bucketIndex(microseconds: 2) == 1)
+        #expect(LatencyHistogram.bucketIndex(microseconds: 3) == 2)
+        #expect(LatencyHistogram.bucketIndex(microseconds: 1024) == 10)
+        #expect(LatencyHistogram.bucketIndex(microseconds: .max) == LatencyHistogram.bucketCount)
+        
+        let histogram = LatencyHistogram()
+        histogram.record(.microseconds(3))
+        histogram.record(.milliseconds(1))
+        histogram.record(.seconds(1000))
+        
+        let snapshot = histogram.snapshot()
+        #expect(snapshot.count == 3)
+        #expect(snapshot.buckets[2] == 1)
+        #expect(snapshot.buckets[10] == 1)
+        #expect(snapshot.buckets[LatencyHistogram.bucketCount] == 1)
+        #expect(abs(snapshot.sumSeconds - 1000.001003) < 1e-9)
+    }
+    
+    @Test("Prometheus output has counters and cumulative histograms")
+    func testPrometheusText() {
+        let metrics = DtnMetrics()
+        metrics.incoming.add(3)
+        metrics.ingestToStore.record(.microseconds(3))
+        metrics.claSendTime("tcp").record(.milliseconds(2))
+        
+        let text = metrics.prometheusText(stored: 7)
+        let lines = Set(text.split(separator: "\n").map(String.init))
+        
+        #expect(lines.contains("dtn7_bundles_incoming_total 3"))
+        #expect(lines.contains("dtn7_bundles_stored 7"))
+        #expect(lines.contains("dtn7_ingest_to_store_seconds_bucket{le=\"+Inf\"} 1"))
+        #expect(lines.contains("dtn7_ingest_to_store_seconds_count 1"))
+        #expect(lines.contains("dtn7_cla_send_seconds_count{cla=\"tcp\"} 1"))
+        #expect(lines.contains("# TYPE dtn7_cla_send_seconds histogram"))
+        
+        #expect(metrics.statistics().incoming == 3)
+        #expect(metrics.latencies()["cla_send.tcp"]?.count == 1)
+    }
+}
@@ -0,0 +1,180 @@
+import Testing
+@testable import DTN7
+import BP7
+import AsyncAlgorithms
+import Foundation
+
+@Suite("Outbound Queue Tests")
+struct OutboundQueuesTests {
+    
+    /// Bundle IDs handed to the transmitter, per peer
+    actor SendLog {
+        private(set) var sent: [EndpointID: [String]] = [:]
+        
+        func record(_ bundles: [EncodedBundle], to peer: DtnPeer) {
+            sent[peer.eid, default: []].append(contentsOf: bundles.map(\.id))
+        }
+    }
+    
+    @Test("A stalled peer does not hold up other peers")
+    func testStalledPeer() async throws {
+        let slow = makePeer("dtn://slow/")
+        let fast = makePeer("dtn://fast/")
+        let log = SendLog()
+        
+        let queues = OutboundQueues { bundles, peer in
+            if peer.eid == slow.eid {
+                try? await Task.sleep(for: .seconds(30))
+                return false
+            }
+            await log.record(bundles, to: peer)
+            return true
+        }
+        
+        await queues.enqueue([makeBundle("a")], to: slow)
+        await queues.enqueue([makeBundle("b")], to: fast)
+        
+        try await waitUntil { await log.sent[fast.eid] == ["b"] }
+        #expect(await log.sent[slow.eid] == nil)
+        
+        await queues.removeAll()
+    }
+    
+    @Test("Queue depth counts bundles not yet handed to the CLA")
+    func testQueueDepth() async throws {
+        let peer = makePeer("dtn://peer1/")
+        let configuration = OutboundQueues.Configuration(maxConcurrentSends: 1, batchSize: 1, queueLimit: 4)
+        let queues = OutboundQueues(configuration: configuration) { _, _ in
+            try? await Task.sleep(for: .seconds(30))
+            return true
+        }
+        
+        let accepted = await queues.enqueue((0..<6).map { makeBundle("\($0)") }, to: peer)
+        #expect(!accepted)
+        
+        // One bundle is in flight, the rest wait
+        try await waitUntil { await queues.depths()[peer.eid] == 3 }
+        
+        await queues.removeAll()
+        #expect(await queues.depths().isEmpty)
+    }
+    
+    @Test("Failed sends back off before the next attempt")
+    func testBackoff() async throws {
+        let peer = makePeer("dtn://peer1/")
+        let log = SendLog()
+        let configuration = OutboundQueues.Configuration(maxConcurrentSends: 1, batchSize: 1, initialBackoff: 0.2)
+        let queues = OutboundQueues(configuration: configuration) { bundles, peer in
+            await log.record(bundles, to: peer)
+            return bundles.first?.id != "fail"
+        }
+        
+        let start = ContinuousClock.now
+        await queues.enqueue([makeBundle("fail"), makeBundle("next")], to: peer)
+        
+        try await waitUntil { await log.sent[peer.eid] == ["fail", "next"] }
+        #expect(ContinuousClock.now - start >= .milliseconds(200))
+        
+        await queues.removeAll()
+    }
+    
+    @Test("A bundle already queued or in flight is not queued again")
+    func testRequeueSkipped() async throws {
+        let peer = makePeer("dtn://peer1/")
+        let log = SendLog()
+        let configuration = OutboundQueues.Configuration(maxConcurrentSends: 1, batchSize: 1)
+        let queues = OutboundQueues(configuration: configuration) { bundles, peer in
+            await log.record(bundles, to: peer)
+            try? await Task.sleep(for: .milliseconds(100))
+            return true
+        }
+        
+        await queues.enqueue([makeBundle("a"), makeBundle("b")], to: peer)
+        await queues.enqueue([makeBundle("a"), makeBundle("b"), makeBundle("c")], to: peer)
+        try await waitUntil { await log.sent[peer.eid]?.count == 3 }
+        #expect(await log.sent[peer.eid] == ["a", "b", "c"])
+        
+        // Once sent, the bundle can be queued again
+        try await Task.sleep(for: .milliseconds(150))
+        await queues.enqueue([makeBundle("a")], to: peer)
+        try await waitUntil { await log.sent[peer.eid]?.count == 4 }
+        
+        await queues.removeAll()
+    }
+    
+    @Test("A bundle a CLA took leaves the forwarding queue unless the agent keeps copies")
+    func testForwardedLeavesQueue() async throws {
+        let store = InMemoryBundleStore()
+        let core = DtnCore(nodeId: try EndpointID.from("dtn://node/"), store: store, config: DtnConfig())
+        try await core.registerCLA(AcceptingCLA())
+        try await core.setRoutingAgent(StaticRouting())
+        
+        let primary = PrimaryBlock(
+            bundleControlFlags: BundleControlFlags(),
+            destination: try EndpointID.from("dtn://dest/"),
+            source: try EndpointID.from("dtn://node/"),
+            reportTo: try EndpointID.from("dtn://node/"),
+            creationTimestamp: CreationTimestamp(time: 1000, sequenceNumber: 1),
+            lifetime: 3600
+        )
+        let bundle = BP7.Bundle(primary: primary, canonicals: [])
+        try await store.push(bundle: bundle)
+        var pack = try #require(await store.getMetadata(bundleId: BundlePack.id(of: bundle)))
+        pack.constraints.insert(.forwardPending)
+        try await store.updateMetadata(bundlePack: pack)
+        
+        let sent = await core.transmit([EncodedBundle(id: pack.id, data: bundle.encode())], to: makePeer("dtn://peer/"))
+        #expect(sent)
+        var queued: [String] = []
+        for await pending in store.forwardPendingStream() {
+            queued.append(pending.id)
+        }
+        #expect(queued.isEmpty)
+        
+        // Epidemic routing offers the bundle to later peers too
+        try await core.setRoutingAgent(EpidemicRouting())
+        try await store.updateMetadata(bundlePack: pack)
+        #expect(await core.transmit([EncodedBundle(id: pack.id, data: bundle.encode())], to: makePeer("dtn://peer/")))
+        #expect(await store.getMetadata(bundleId: pack.id)?.constraints.contains(.forwardPending) == true)
+    }
+    
+    // MARK: - Helper Functions
+    
+    /// A CLA that reaches every peer and accepts whatever it is handed
+    private struct AcceptingCLA: ConvergenceLayerAgent {
+        let id = "accepting"
+        let name = "accepting"
+        let incomingBundles = AsyncChannel<(BP7.Bundle, CLAConnection)>()
+        
+        func start() async throws {}
+        func stop() async throws {}
+        func sendBundle(_ bundle: BP7.Bundle, to peer: DtnPeer) async throws {}
+        func canReach(_ peer: DtnPeer) -> Bool { true }
+        func getConnections() async -> [CLAConnection] { [] }
+    }
+    
+    private func waitUntil(timeout: Duration = .seconds(5), _ condition: @Sendable () async -> Bool) async throws {
+        let deadline = ContinuousClock.now + timeout
+        while await !condition() {
+            try #require(ContinuousClock.now < deadline, "Condition not met in time")
+            try await Task.sleep(for: .milliseconds(10))
+        }
+    }
+    
+    private func makeBundle(_ id: String) -> OutboundBundle {
+        OutboundBundle(encoded: EncodedBundle(id: id, data: [0x9f, 0xff]), destination: try! EndpointID.from("dtn://dest/"), expiresAt: 0)
+    }
+    
+    private func makePeer(_ eid: String) -> DtnPeer {
+        DtnPeer(
+            eid: try! EndpointID.from(eid),
+            addr: .generic("127.0.0.1"),
+            conType: .dynamic,
+            period: nil,
+            claList: [("tcp", 4556)],
+            services: [:],
+            lastContact: 0,
+            fails: 0
+        )
+    }
+}
@@ -0,0 +1,134 @@
+import Testing
+@testable import DTN7
+@testable import BP7
+import Foundation
+
+@Suite("Routing Table Tests")
+struct RoutingTableTests {
+    
+    @Test("Glob patterns match like the regex translation they replace")
+    func testGlobPatterns() {
+        #expect(GlobPattern("*").matches("dtn://anything/"))
+        #expect(GlobPattern("dtn://node1/").matches("dtn://node1/"))
+        #expect(!GlobPattern("dtn://node1/").matches("dtn://node1/app"))
+        #expect(GlobPattern("dtn://node1/*").matches("dtn://node1/app"))
+        #expect(GlobPattern("dtn://node1/*").matches("dtn://node1/"))
+        #expect(!GlobPattern("dtn://node1/*").matches("dtn://node2/app"))
+        #expect(GlobPattern("dtn://node?/*").matches("dtn://node7/app"))
+        #expect(!GlobPattern("dtn://node?/*").matches("dtn://node17/app"))
+        #expect(GlobPattern("*/incoming").matches("dtn://node1/incoming"))
+        #expect(GlobPattern("dtn://*/a*b").matches("dtn://x/aab"))
+        #expect(!GlobPattern("dtn://*/a*b").matches("dtn://x/aba"))
+    }
+    
+    @Test("Route lookup returns matches in index order")
+    func testRouteOrder() throws {
+        let table = StaticRouteTable(routes: [
+            try StaticRoute(index: 30, source: "*", destination: "*", via: "dtn://default/"),
+            try StaticRoute(index: 10, source: "*", destination: "dtn://node1/*", via: "dtn://hop1/"),
+            try StaticRoute(index: 20, source: "*", destination: "dtn://node1/app", via: "dtn://hop2/"),
+            try StaticRoute(index: 5, source: "dtn://other/*", destination: "dtn://node1/app", via: "dtn://hop3/"),
+            try StaticRoute(index: 15, source: "*", destination: "dtn://node?/app", via: "dtn://hop4/")
+        ])
+        
+        let matches = table.matches(source: "dtn://me/", destination: "dtn://node1/app")
+        #expect(matches.map(\.index) == [10, 15, 20, 30])
+        
+        let fromOther = table.matches(source: "dtn://other/x", destination: "dtn://node1/app")
+        #expect(fromOther.first?.index == 5)
+        
+        let unrelated = table.matches(source: "dtn://me/", destination: "dtn://node22/app")
+        #expect(unrelated.map(\.index) == [30])
+    }
+    
+    @Test("Peer table indexes peers and lists the reachable ones")
+    func testPeerTable() throws {
+        let withCLA = makePeer("dtn://peer1/", claList: [("tcp", 4556)])
+        let withoutCLA = makePeer("dtn://peer2/", claList: [])
+        
+        let table = PeerTable(peers: [withCLA.eid: withCLA, withoutCLA.eid: withoutCLA])
+        #expect(table.count == 2)
+        #expect(table[try EndpointID.from("dtn://peer2/")] != nil)
+        #expect(table.reachable.map(\.eid) == [withCLA.eid])
+        
+        #expect(PeerManager().peerTable.count == 0)
+    }
+    
+    @Test("Local endpoint snapshot matches exact and prefixed endpoints")
+    func testLocalEndpoints() throws {
+        let local = LocalEndpoints([try EndpointID.from("dtn://node1/")])
+        
+        #expect(local.contains(try EndpointID.from("dtn://node1/")))
+        #expect(local.contains(try EndpointID.from("dtn://node1/incoming")))
+        #expect(!local.contains(try EndpointID.from("dtn://node2/incoming")))
+    }
+    
+    @Test("Batch routing answers every bundle in order")
+    func testBatchDecisionOrder() async throws {
+        let packs = try ["dtn://node1/", "dtn://node2/", "dtn://node3/"].enumerated().map { index, source in
+            BundlePack(from: makeBundle(source: source, destination: "dtn://dest/"), id: "\(source)-\(index)-0", size: 0)
+        }
+        
+        // Without a core to consult, agents still answer with an empty decision per bundle
+        let agents: [any RoutingAgent] = [FloodingRouting(), EpidemicRouting(), SprayAndWaitRouting(), StaticRouting(), SinkRouting()]
+        for agent in agents {
+            let decisions = await agent.getNextHops(for: packs)
+            #expect(decisions.map(\.bundleId) == packs.map(\.id))
+            #expect(decisions.allSatisfy { $0.nextHops.isEmpty && !$0.isLocalDelivery })
+        }
+    }
+    
+    @Test("Forwarding history survives a restart through the state snapshot")
+    func testRoutingStateSnapshot() async throws {
+        let core = DtnCore(nodeId: try EndpointID.from("dtn://node1"), store: InMemoryBundleStore(), config: DtnConfig())
+        let peerManager = PeerManager()
+        await peerManager.addOrUpdatePeer(makePeer("dtn://node2", claList: [("tcp", 4556)]))
+        let packs = try (0..<3).map { index in
+            BundlePack(from: try makeBundle(source: "dtn://node1/", destination: "dtn://dest/"), id: "dtn://node1/-\(index)-0", size: 0)
+        }
+        
+        let agents: [() -> any RoutingAgent] = [{ EpidemicRouting() }, { SprayAndWaitRouting() }]
+        for makeAgent in agents {
+            let before = makeAgent()
+            await before.configure(peerManager: peerManager, core: core)
+            #expect(await before.getNextHops(for: packs).allSatisfy { $0.nextHops.count == 1 })
+            let snapshot = try #require(await before.stateSnapshot())
+            
+            // A fresh agent offers the bundles again unless it gets the snapshot
+            let after = makeAgent()
+            await after.configure(peerManager: peerManager, core: core)
+            #expect(await after.restoreState(from: snapshot))
+            #expect(await after.getNextHops(for: packs).allSatisfy { $0.nextHops.isEmpty })
+            #expect(await !after.restoreState(from: Data("garbage".utf8)))
+        }
+        
+        #expect(await FloodingRouting().stateSnapshot() == nil)
+    }
+    
+    // MARK: - Helper Functions
+    
+    private func makeBundle(source: String, destination: String) throws -> BP7.Bundle {
+        let primary = PrimaryBlock(
+            bundleControlFlags: BundleControlFlags(),
+            destination: try EndpointID.from(destination),
+            source: try EndpointID.from(source),
+            reportTo: try EndpointID.from(source),
+            creationTimestamp: CreationTimestamp(time: 1, sequenceNumber: 0),
+            lifetime: 3600
+        )
+        return BP7.Bundle(primary: primary, canonicals: [])
+    }
+    
+    private func makePeer(_ eid: String, claList: [(String, UInt16?)]) -> DtnPeer {
+        DtnPeer(
+            eid: try! EndpointID.from(eid),
+            addr: .generic("127.0.0.1"),
+            conType: .dynamic,
+            period: nil,
+            claList: claList,
+            services: [:],
+            lastContact: 0,
+            fails: 0
+        )
+    }
+}
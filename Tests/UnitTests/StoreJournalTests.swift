@@ -0,0 +1,72 @@
+import Testing
+@testable import DTN7
+import Foundation
+
+@Suite("Store Journal Tests")
+struct StoreJournalTests {
+    
+    @Test("A first poll resets to the current position, later polls page through new entries")
+    func testPaging() {
+        let journal = StoreJournal()
+        journal.append("a")
+        
+        let first = journal.page(after: nil, limit: 10)
+        #expect(first.reset)
+        #expect(first.bundles.isEmpty)
+        
+        for id in ["b", "c", "d"] {
+            journal.append(id)
+        }
+        
+        let second = journal.page(after: first.cursor, limit: 2)
+        #expect(!second.reset)
+        #expect(second.bundles == ["b", "c"])
+        #expect(second.more)
+        
+        let third = journal.page(after: second.cursor, limit: 2)
+        #expect(third.bundles == ["d"])
+        #expect(!third.more)
+        
+        let empty = journal.page(after: third.cursor, limit: 2)
+        #expect(empty.bundles.isEmpty)
+        #expect(empty.cursor == third.cursor)
+    }
+    
+    @Test("Cursors from another run or behind the retained entries are reset")
+    func testStaleCursor() {
+        let journal = StoreJournal(capacity: 2)
+        let start = journal.page(after: nil, limit: 10)
+        
+        for id in ["a", "b", "c"] {
+            journal.append(id)
+        }
+        
+        // "a" was overwritten
+        let behind = journal.page(after: start.cursor, limit: 10)
+        #expect(behind.reset)
+        
+        let other = StoreJournal().page(after: nil, limit: 10)
+        #expect(journal.page(after: other.cursor, limit: 10).reset)
+        #expect(journal.page(after: "garbage", limit: 10).reset)
+        
+        let current = journal.page(after: behind.cursor, limit: 10)
+        #expect(!current.reset)
+        #expect(current.bundles.isEmpty)
+    }
+    
+    @Test("Bundle batches round-trip and reject truncated bodies")
+    func testBundleBatch() throws {
+        let bundles: [[UInt8]] = [[0x9f, 0xff], [], Array(repeating: 0x42, count: 300)]
+        let body = BundleBatch.encode(bundles)
+        #expect(body.count == 3 * 4 + 302)
+        #expect(try BundleBatch.decode(body) == bundles)
+        #expect(try BundleBatch.decode([]).isEmpty)
+        
+        #expect(throws: CLAError.self) {
+            try BundleBatch.decode(Array(body.dropLast()))
+        }
+        #expect(throws: CLAError.self) {
+            try BundleBatch.decode([0x00, 0x00])
+        }
+    }
+}
@@ -0,0 +1,46 @@
+import Testing
+@testable import DTN7
+import Foundation
+
+@Suite("Summary Vector Tests")
+struct SummaryVectorTests {
+    
+    @Test("Encoded vectors decode to the same set")
+    func testRoundTrip() throws {
+        var vector = SummaryVector(capacity: 100)
+        let held = (0..<100).map { BundleKey(id: "dtn://node1/-\($0)-0") }
+        for key in held {
+            vector.insert(key)
+        }
+        
+        let decoded = try #require(SummaryVector(encoded: vector.encode()))
+        #expect(decoded == vector)
+        #expect(decoded.count == 100)
+        #expect(held.allSatisfy { decoded.contains($0) })
+        
+        // Bundles the node lacks are only reported at the false positive rate
+        let lacking = (0..<1_000).filter { decoded.contains(BundleKey(id: "dtn://node2/-\($0)-0")) }
+        #expect(lacking.count < 10)
+    }
+    
+    @Test("An empty vector encodes without its bit array")
+    func testEmpty() throws {
+        let vector = SummaryVector(capacity: 10)
+        #expect(vector.encode().count == 10)
+        
+        let decoded = try #require(SummaryVector(encoded: vector.encode()))
+        #expect(decoded.count == 0)
+        #expect(!decoded.contains(BundleKey(id: "dtn://node1/-1-0")))
+    }
+    
+    @Test("Malformed vectors are rejected")
+    func testMalformed() {
+        var vector = SummaryVector(capacity: 10)
+        vector.insert(BundleKey(id: "dtn://node1/-1-0"))
+        let encoded = vector.encode()
+        
+        #expect(SummaryVector(encoded: []) == nil)
+        #expect(SummaryVector(encoded: Array(encoded.dropLast())) == nil)
+        #expect(SummaryVector(encoded: [2] + encoded.dropFirst()) == nil)
+    }
+}
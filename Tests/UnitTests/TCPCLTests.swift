@@ -0,0 +1,121 @@
+import Testing
+@testable import DTN7
+import BP7
+import Foundation
+import NIOCore
+
+@Suite("TCPCL Tests")
+struct TCPCLTests {
+
+    @Test("Transfers are split at the segment MRU")
+    func testSegmentation() {
+        let segments = TCPCLMessage.segments(length: 10_000, segmentMRU: 4096)
+
+        #expect(segments.map(\.range) == [0..<4096, 4096..<8192, 8192..<10_000])
+        #expect(segments.first?.flags == TCPCLMessage.segmentStart)
+        #expect(segments[1].flags == 0)
+        #expect(segments.last?.flags == TCPCLMessage.segmentEnd)
+    }
+
+    @Test("Small and empty transfers fit in one segment")
+    func testSingleSegment() {
+        let flags = TCPCLMessage.segmentStart | TCPCLMessage.segmentEnd
+
+        let small = TCPCLMessage.segments(length: 100, segmentMRU: 64000)
+        #expect(small.count == 1)
+        #expect(small[0].range == 0..<100)
+        #expect(small[0].flags == flags)
+
+        let empty = TCPCLMessage.segments(length: 0, segmentMRU: 64000)
+        #expect(empty.count == 1)
+        #expect(empty[0].range == 0..<0)
+        #expect(empty[0].flags == flags)
+    }
+
+    @Test("Segment header plus payload matches the full message encoding")
+    func testSegmentHeader() {
+        let payload = Data((0..<32).map { UInt8($0) })
+        let extensions: [TCPCLExtension] = [.transferLength(UInt64(payload.count))]
+
+        var scattered = TCPCLMessage.xferSegmentHeader(
+            flags: TCPCLMessage.segmentStart,
+            transferId: 7,
+            extensionItems: extensions,
+            dataLength: UInt64(payload.count)
+        )
+        scattered.append(payload)
+
+        let message = TCPCLMessage.xferSegment(
+            flags: TCPCLMessage.segmentStart,
+            transferId: 7,
+            extensionItems: extensions,
+            data: payload
+        )
+        #expect(scattered == message.encode())
+    }
+    
+    @Test("Frame decoder reassembles messages split across reads")
+    func testFrameDecoderSplitReads() throws {
+        let payload = Data((0..<300).map { UInt8($0 % 251) })
+        var stream = Data([0x64, 0x74, 0x6E, 0x21, 0x04, 0x00])
+        stream.append(TCPCLMessage.xferSegment(
+            flags: TCPCLMessage.segmentStart | TCPCLMessage.segmentEnd,
+            transferId: 3,
+            extensionItems: [.transferLength(UInt64(payload.count))],
+            data: payload
+        ).encode())
+        stream.append(TCPCLMessage.xferAck(flags: 0, transferId: 3, length: 300).encode())
+        stream.append(TCPCLMessage.keepalive.encode())
+        
+        var processor = NIOSingleStepByteToMessageProcessor(TCPCLFrameDecoder(maxSegmentLength: 64000))
+        var frames: [TCPCLFrame] = []
+        
+        // Feed the stream in uneven chunks that cut through every field
+        var offset = 0
+        var chunkSize = 1
+        while offset < stream.count {
+            let end = min(offset + chunkSize, stream.count)
+            try processor.process(buffer: ByteBuffer(bytes: stream[offset..<end])) { frames.append($0) }
+            offset = end
+            chunkSize = chunkSize % 7 + 1
+        }
+        
+        try #require(frames.count == 4)
+        guard case .contactHeader(let version, _) = frames[0] else {
+            Issue.record("Expected contact header")
+            return
+        }
+        #expect(version == 4)
+        guard case .message(.xferSegment(_, let transferId, _, let data)) = frames[1] else {
+            Issue.record("Expected XFER_SEGMENT")
+            return
+        }
+        #expect(transferId == 3)
+        #expect(data == payload)
+        guard case .message(.xferAck(_, _, let length)) = frames[2] else {
+            Issue.record("Expected XFER_ACK")
+            return
+        }
+        #expect(length == 300)
+        guard case .message(.keepalive) = frames[3] else {
+            Issue.record("Expected KEEPALIVE")
+            return
+        }
+    }
+    
+    @Test("Frame decoder rejects segments above the MRU")
+    func testFrameDecoderSegmentLimit() throws {
+        var stream = Data([0x64, 0x74, 0x6E, 0x21, 0x04, 0x00])
+        stream.append(TCPCLMessage.xferSegment(
+            flags: TCPCLMessage.segmentStart,
+            transferId: 1,
+            extensionItems: [],
+            data: Data(count: 128)
+        ).encode())
+        
+        var processor = NIOSingleStepByteToMessageProcessor(TCPCLFrameDecoder(maxSegmentLength: 64))
+        #expect(throws: CLAError.self) {
+            try processor.process(buffer: ByteBuffer(bytes: stream)) { _ in }
+        }
+    }
+}
@@ -0,0 +1,97 @@
+import Testing
+@testable import DTN7
+import Foundation
+
+@Suite("Tracing Tests")
+struct TracingTests {
+    
+    @Test("Tracing is off by default and samples one bundle in N when on")
+    func testSampling() {
+        let disabled = Tracer()
+        #expect(!disabled.isEnabled)
+        #expect(disabled.sample("bundle") == nil)
+        
+        let tracer = Tracer(configuration: Tracer.Configuration(settings: ["sample": "0.25"]))
+        #expect(tracer.configuration.sampleEvery == 4)
+        let sampled = (0..<100).compactMap { tracer.sample("bundle-\($0)") }
+        #expect(sampled.count == 25)
+        #expect(Set(sampled.map(\.traceId)).count == 25)
+        
+        // Out of range values leave tracing off
+        #expect(Tracer.Configuration(settings: ["sample": "2"]).sampleEvery == 0)
+        #expect(Tracer.Configuration(settings: ["sample": "0"]).sampleEvery == 0)
+    }
+    
+    @Test("Stage spans are children of the bundle span, sends link to it")
+    func testSpans() throws {
+        let tracer = Tracer(configuration: Tracer.Configuration(sampleEvery: 1))
+        let trace = try #require(tracer.sample("dtn://a-1-0"))
+        
+        let store = trace.begin(.store)
+        store.end()
+        trace.record(.send, from: trace.start, attributes: ["cla": "tcp"])
+        trace.finish()
+        
+        let spans = tracer.recentSpans()
+        #expect(spans.map(\.name) == ["store", "cla.send", "bundle"])
+        #expect(spans.allSatisfy { $0.traceId == trace.traceId && $0.bundleId == "dtn://a-1-0" })
+        #expect(spans[0].parentSpanId == trace.rootSpanId)
+        #expect(spans[0].linkedSpanId == nil)
+        #expect(spans[1].parentSpanId == nil)
+        #expect(spans[1].linkedSpanId == trace.rootSpanId)
+        #expect(spans[1].attributes == ["cla": "tcp"])
+        #expect(spans[2].spanId == trace.rootSpanId)
+        #expect(spans[2].parentSpanId == nil)
+        #expect(spans.allSatisfy { $0.end >= $0.start })
+    }
+    
+    @Test("The ring keeps the most recent spans and hands the exporter only new ones")
+    func testRing() throws {
+        let tracer = Tracer(configuration: Tracer.Configuration(sampleEvery: 1, capacity: 4))
+        let trace = try #require(tracer.sample("bundle"))
+        for _ in 0..<3 {
+            trace.record(.queue, from: trace.start)
+        }
+        
+        let (first, position) = tracer.spans(after: 0)
+        #expect(first.count == 3)
+        #expect(position == 3)
+        
+        for _ in 0..<3 {
+            trace.record(.route, from: trace.start)
+        }
+        #expect(tracer.recentSpans().map(\.name) == ["queue", "route", "route", "route"])
+        #expect(tracer.recentSpans(limit: 2).count == 2)
+        
+        let (next, nextPosition) = tracer.spans(after: position)
+        #expect(next.map(\.name) == ["route", "route", "route"])
+        #expect(nextPosition == 6)
+        #expect(tracer.spans(after: nextPosition).spans.isEmpty)
+    }
+    
+    @Test("OTLP/JSON export carries hex IDs, string timestamps and attributes")
+    func testOTLPEncoding() throws {
+        let tracer = Tracer(configuration: Tracer.Configuration(sampleEvery: 1))
+        let trace = try #require(tracer.sample("dtn://a-1-0"))
+        trace.record(.dedup, from: trace.start, attributes: ["duplicate": "false"])
+        
+        let json = try JSONSerialization.jsonObject(with: Data(tracer.otlpJSON(tracer.recentSpans(), nodeId: "dtn://a"))) as? [String: Any]
+        let resourceSpans = try #require((json?["resourceSpans"] as? [[String: Any]])?.first)
+        let scopeSpans = try #require((resourceSpans["scopeSpans"] as? [[String: Any]])?.first)
+        let span = try #require((scopeSpans["spans"] as? [[String: Any]])?.first)
+        
+        #expect((span["traceId"] as? String)?.count == 32)
+        #expect(span["spanId"] as? String != nil)
+        #expect(span["parentSpanId"] as? String == Tracer.hex(trace.rootSpanId))
+        #expect(span["name"] as? String == "dedup")
+        #expect((span["links"] as? [Any])?.isEmpty == true)
+        let start = try #require((span["startTimeUnixNano"] as? String).flatMap { UInt64($0) })
+        #expect(start > 1_600_000_000 * 1_000_000_000)
+        
+        let attributes = (span["attributes"] as? [[String: Any]]) ?? []
+        let keys = attributes.compactMap { $0["key"] as? String }
+        #expect(keys == ["bundle.id", "duplicate"])
+        
+        #expect(Tracer.hex(0xAB) == "00000000000000ab")
+    }
+}
@@ -0,0 +1,78 @@
+import Testing
+@testable import DTN7
+import BP7
+import Foundation
+
+@Suite("Transmission Scheduler Tests")
+struct TransmissionSchedulerTests {
+    
+    @Test("Lower priority classes go first")
+    func testPriorityClasses() {
+        var scheduler = TransmissionScheduler(configuration: .init(settings: ["priority.dtn://*/telemetry": "0"]))
+        scheduler.push(makeBundle("bulk", destination: "dtn://ground/files"))
+        scheduler.push(makeBundle("telemetry", destination: "dtn://ground/telemetry"))
+        
+        #expect(scheduler.pop(now: 0)?.encoded.id == "telemetry")
+        #expect(scheduler.pop(now: 0)?.encoded.id == "bulk")
+        #expect(scheduler.pop(now: 0) == nil)
+    }
+    
+    @Test("A destination's bundles go soonest-expiring first, then smallest first")
+    func testBundleOrder() {
+        var scheduler = TransmissionScheduler()
+        scheduler.push(makeBundle("forever", destination: "dtn://ground/", expiresAt: 0))
+        scheduler.push(makeBundle("late", destination: "dtn://ground/", expiresAt: 2_000))
+        scheduler.push(makeBundle("large", destination: "dtn://ground/", expiresAt: 1_000, size: 100))
+        scheduler.push(makeBundle("small", destination: "dtn://ground/", expiresAt: 1_000, size: 10))
+        
+        let order = (0..<4).compactMap { _ in scheduler.pop(now: 0)?.encoded.id }
+        #expect(order == ["small", "large", "late", "forever"])
+    }
+    
+    @Test("Destinations share a class in proportion to their weights")
+    func testWeightedFairQueuing() {
+        var scheduler = TransmissionScheduler(configuration: .init(settings: ["weight.dtn://a/*": "3"]))
+        for i in 0..<20 {
+            scheduler.push(makeBundle("a\(i)", destination: "dtn://a/app"))
+            scheduler.push(makeBundle("b\(i)", destination: "dtn://b/app"))
+        }
+        
+        let first = (0..<8).compactMap { _ in scheduler.pop(now: 0)?.encoded.id }
+        #expect(first.filter { $0.hasPrefix("a") }.count == 6)
+        #expect(scheduler.count == 32)
+    }
+    
+    @Test("Bundles that expired while queued are dropped")
+    func testExpiredDropped() {
+        var scheduler = TransmissionScheduler()
+        scheduler.push(makeBundle("expired", destination: "dtn://ground/", expiresAt: 500))
+        scheduler.push(makeBundle("valid", destination: "dtn://ground/", expiresAt: 5_000))
+        
+        #expect(scheduler.pop(now: 1_000)?.encoded.id == "valid")
+        #expect(scheduler.isEmpty)
+    }
+    
+    @Test("Bandwidth budget paces sends beyond its burst")
+    func testBandwidthBudget() async {
+        let budget = BandwidthBudget(bytesPerSecond: 10_000)
+        let start = ContinuousClock.now
+        
+        await budget.reserve(10_000)
+        #expect(ContinuousClock.now - start < .milliseconds(100))
+        
+        await budget.reserve(2_000)
+        #expect(ContinuousClock.now - start >= .milliseconds(150))
+        
+        #expect(BandwidthBudget.budgets(settings: ["bandwidth.tcp": "1000", "priority.dtn://*": "0"]).keys.sorted() == ["tcp"])
+    }
+    
+    // MARK: - Helper Functions
+    
+    private func makeBundle(_ id: String, destination: String, expiresAt: UInt64 = 0, size: Int = 10) -> OutboundBundle {
+        OutboundBundle(
+            encoded: EncodedBundle(id: id, data: [UInt8](repeating: 0, count: size)),
+            destination: try! EndpointID.from(destination),
+            expiresAt: expiresAt
+        )
+    }
+}
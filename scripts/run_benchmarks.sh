@@ -0,0 +1,50 @@
+#!/bin/bash
+# Script to run the DTN7 benchmark suites and keep their results per revision
+#
+# Usage: scripts/run_benchmarks.sh [baseline-revision]
+# Results go to bench_results/<suite>-<revision>.json; with a baseline revision
+# whose results are there, the run fails on regressions against it.
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+RESULTS_DIR="${PROJECT_ROOT}/bench_results"
+
+# Colors for output
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+print_info() {
+    echo -e "${GREEN}[INFO]${NC} $1"
+}
+
+print_warning() {
+    echo -e "${YELLOW}[WARNING]${NC} $1"
+}
+
+cd "${PROJECT_ROOT}"
+REVISION="$(git rev-parse --short HEAD)"
+BASELINE="$1"
+mkdir -p "${RESULTS_DIR}"
+
+print_info "Building release binaries..."
+swift build -c release
+BIN_DIR="$(swift build -c release --show-bin-path)"
+
+for SUITE in micro macro; do
+    ARGS=(-o "${RESULTS_DIR}/${SUITE}-${REVISION}.json")
+    if [ -n "${BASELINE}" ]; then
+        if [ -f "${RESULTS_DIR}/${SUITE}-${BASELINE}.json" ]; then
+            ARGS+=(-b "${RESULTS_DIR}/${SUITE}-${BASELINE}.json")
+        else
+            print_warning "No ${SUITE} results for ${BASELINE}, running without a baseline"
+        fi
+    fi
+
+    print_info "Running ${SUITE} benchmarks at ${REVISION}..."
+    "${BIN_DIR}/dtnbench" "${SUITE}" "${ARGS[@]}"
+done
+
+print_info "Benchmarks completed"